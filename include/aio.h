@@ -0,0 +1,105 @@
+#ifndef AIO_H
+#define AIO_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include "heap.h"
+
+#define AIO_QUEUE_DEPTH 32
+#define AIO_POOL_THREADS 4
+
+typedef enum {
+    AIO_DEFAULT     = 0,
+    AIO_THREAD_POOL = 1 << 0
+} AioFlags;
+
+typedef enum {
+    AIO_BACKEND_URING,
+    AIO_BACKEND_THREADS
+} AioBackend;
+
+/* one read or write; the tag is the caller's and comes back with the result */
+typedef struct {
+    int fd;
+    bool write;
+    void *buf;
+    size_t len;
+    off_t offset;
+    uint64_t tag;
+    int64_t res;
+} AioRequest;
+
+/* res is the number of bytes moved, or -errno; anything short of len is a failure */
+typedef struct {
+    uint64_t tag;
+    int64_t res;
+} AioCompletion;
+
+/* the kernel's submission and completion rings, mapped into this process */
+typedef struct {
+    int fd;
+    void *sq_ring;
+    size_t sq_ring_len;
+    void *cq_ring;
+    size_t cq_ring_len;
+    void *sqes;
+    size_t sqes_len;
+    uint32_t *sq_head;
+    uint32_t *sq_tail;
+    uint32_t *sq_mask;
+    uint32_t *sq_array;
+    uint32_t *cq_head;
+    uint32_t *cq_tail;
+    uint32_t *cq_mask;
+    void *cqes;
+    int32_t unsubmitted;
+} AioRing;
+
+/* the portable fallback: a few threads taking requests off a fifo */
+typedef struct {
+    pthread_t threads[AIO_POOL_THREADS];
+    int32_t num_threads;
+    int32_t *todo;
+    int32_t todo_head;
+    int32_t todo_count;
+    int32_t *done;
+    int32_t done_count;
+    bool stopping;
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t finished;
+} AioPool;
+
+/*
+ * requests are prepared, then handed over together by aio_submit, and come
+ * back from aio_wait in whatever order they finish. a queue belongs to one
+ * thread at a time; buffers must stay put until their request comes back.
+ */
+typedef struct {
+    AioBackend backend;
+    int32_t depth;
+    AioRequest *requests;
+    int32_t *free_slots;
+    int32_t num_free;
+    int32_t *prepared;
+    int32_t num_prepared;
+    int32_t outstanding;
+    AioRing ring;
+    AioPool pool;
+} AioQueue;
+
+AioQueue *aio_create(int32_t depth, uint32_t flags);
+void aio_destroy(AioQueue *q);
+
+GrainResult aio_prep_read(AioQueue *q, int fd, void *buf, size_t len, off_t offset, uint64_t tag);
+GrainResult aio_prep_write(AioQueue *q, int fd, const void *buf, size_t len, off_t offset,
+                           uint64_t tag);
+GrainResult aio_submit(AioQueue *q);
+GrainResult aio_wait(AioQueue *q, AioCompletion *out, int32_t max, int32_t *count);
+
+int32_t aio_outstanding(const AioQueue *q);
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "heap.h"
+
+#define BLOOM_MAGIC 0x4d4f4c42u
+#define BLOOM_BLOCK_WORDS 8
+#define BLOOM_BITS_PER_KEY 10
+#define BLOOM_MIN_BLOCKS 64
+
+/* one cache line; a key sets one bit in each of its block's words */
+typedef struct {
+    uint64_t words[BLOOM_BLOCK_WORDS];
+} BloomBlock;
+
+typedef struct {
+    uint32_t magic;
+    int32_t num_blocks;
+    int32_t clean;
+    int32_t reserved;
+    int64_t num_keys;
+} BloomHeader;
+
+/* keys can't be taken out again; num_keys counts the adds since the last reset that set a new bit */
+typedef struct {
+    BloomHeader header;
+    int fd;
+    BloomBlock *blocks;
+    int32_t dirty_lo;
+    int32_t dirty_hi;
+} BloomFilter;
+
+BloomFilter *bloom_create(const char *path, int64_t expected_keys);
+BloomFilter *bloom_open(const char *path);
+GrainResult bloom_close(BloomFilter *bf);
+GrainResult bloom_flush(BloomFilter *bf);
+
+GrainResult bloom_reset(BloomFilter *bf, int64_t expected_keys);
+GrainResult bloom_add(BloomFilter *bf, int32_t key);
+bool bloom_may_contain(BloomFilter *bf, int32_t key);
+bool bloom_overloaded(BloomFilter *bf);
+
+#endif
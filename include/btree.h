@@ -0,0 +1,78 @@
+#ifndef BTREE_H
+#define BTREE_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "heap.h"
+#include "buffer.h"
+
+#define BTREE_MAGIC 0x45455254u
+#define BTREE_POOL_FRAMES 64
+
+/* entries are ordered by (key, rid), so equal keys are fine */
+typedef struct {
+    int32_t key;
+    RecordId rid;
+} BTreeEntry;
+
+typedef struct {
+    int32_t page_id;
+    int32_t is_leaf;
+    int32_t num_keys;
+    int32_t next_leaf;
+} BTreeNodeHeader;
+
+#define BTREE_LEAF_CAPACITY \
+    ((int32_t)((PAGE_SIZE - sizeof(BTreeNodeHeader)) / sizeof(BTreeEntry)))
+#define BTREE_INNER_CAPACITY \
+    ((int32_t)((PAGE_SIZE - sizeof(BTreeNodeHeader) - sizeof(int32_t)) / (sizeof(BTreeEntry) + sizeof(int32_t))))
+
+typedef struct {
+    BTreeNodeHeader header;
+    union {
+        BTreeEntry entries[BTREE_LEAF_CAPACITY];
+        struct {
+            BTreeEntry keys[BTREE_INNER_CAPACITY];
+            int32_t children[BTREE_INNER_CAPACITY + 1];
+        } inner;
+    };
+} BTreeNode;
+
+typedef struct {
+    uint32_t magic;
+    int32_t root_page;
+    int32_t num_pages;
+    int32_t height;
+    int32_t clean;
+    int32_t reserved;
+    int64_t num_entries;
+} BTreeHeader;
+
+typedef struct {
+    BTreeHeader header;
+    int fd;
+    BufferPool pool;
+} BTree;
+
+typedef struct {
+    BTree *tree;
+    int32_t leaf;
+    int32_t idx;
+    int32_t lo;
+    int32_t hi;
+} BTreeCursor;
+
+BTree *btree_create(const char *path);
+BTree *btree_open(const char *path);
+GrainResult btree_close(BTree *bt);
+GrainResult btree_flush(BTree *bt);
+
+GrainResult btree_insert(BTree *bt, int32_t key, RecordId rid);
+GrainResult btree_delete(BTree *bt, int32_t key, RecordId rid);
+GrainResult btree_find(BTree *bt, int32_t key, RecordId *rid);
+
+GrainResult btree_scan_init(BTree *bt, BTreeCursor *cur, int32_t lo, int32_t hi);
+GrainResult btree_scan_next(BTreeCursor *cur, int32_t *key, RecordId *rid);
+
+#endif
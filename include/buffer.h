@@ -0,0 +1,95 @@
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "heap.h"
+
+#define BUFFER_POOL_FRAMES 128
+#define NO_FRAME -1
+#define BP_EVICT_BATCH 16
+#define BP_READ_AHEAD_PAGES 32
+#define BP_SCAN_RING_FRAMES 64
+
+typedef GrainResult (*PageReadFn)(void *ctx, int32_t page_id, void *buf);
+typedef GrainResult (*PageWriteFn)(void *ctx, int32_t page_id, const void *buf);
+typedef GrainResult (*PageWriteBatchFn)(void *ctx, const int32_t *page_ids, const void *const *bufs,
+                                        int32_t count);
+/* reads a run of consecutive pages into frames that need not be contiguous; num_read is how many came back good */
+typedef GrainResult (*PageReadRunFn)(void *ctx, int32_t first_page_id, void *const *bufs, int32_t count,
+                                     int32_t *num_read);
+/* starts a run in the background; the finish call waits for it and says how many came back good */
+typedef GrainResult (*PageReadStartFn)(void *ctx, int32_t first_page_id, void *const *bufs, int32_t count);
+typedef GrainResult (*PageReadFinishFn)(void *ctx, void *const *bufs, int32_t count, int32_t *num_read);
+
+typedef struct {
+    int32_t page_id;
+    int32_t pin_count;
+    bool dirty;
+    bool referenced;
+    bool scan;
+    bool loading;
+} Frame;
+
+/*
+ * one mutex guards the frame table; page contents are latched by the caller.
+ * pages are read with the mutex dropped: the frame is marked loading and
+ * pinned by the pool meanwhile, and anyone else after that page waits on
+ * loaded.
+ */
+typedef struct {
+    char *data;
+    Frame *frames;
+    int32_t num_frames;
+    int32_t *table;
+    int32_t table_mask;
+    int32_t clock_hand;
+    PageReadFn read_fn;
+    PageWriteFn write_fn;
+    PageWriteBatchFn write_batch_fn;
+    int32_t *batch_ids;
+    const void **batch_bufs;
+    /*
+     * read-ahead: [ra_start, ra_next) is the window a sequential reader is in.
+     * a miss on ra_next reads an extent, a pin of ra_trigger starts the next
+     * one in the background. read-ahead pages go into a ring of frames that is
+     * recycled, so a big scan doesn't push out everything else.
+     */
+    PageReadRunFn read_run_fn;
+    PageReadStartFn read_start_fn;
+    PageReadFinishFn read_finish_fn;
+    int32_t ra_pages;
+    int32_t ra_start;
+    int32_t ra_next;
+    int32_t ra_trigger;
+    int32_t ra_count;
+    int32_t ra_frames[BP_READ_AHEAD_PAGES];
+    void *ra_bufs[BP_READ_AHEAD_PAGES];
+    int32_t ring[BP_SCAN_RING_FRAMES];
+    int32_t ring_cap;
+    int32_t ring_size;
+    int32_t ring_pos;
+    void *io_ctx;
+    pthread_mutex_t lock;
+    pthread_cond_t loaded;
+} BufferPool;
+
+GrainResult bp_init(BufferPool *bp, int32_t num_frames,
+                    PageReadFn read_fn, PageWriteFn write_fn, void *io_ctx);
+void bp_destroy(BufferPool *bp);
+void bp_set_batch_writer(BufferPool *bp, PageWriteBatchFn write_batch_fn);
+void bp_set_run_reader(BufferPool *bp, PageReadRunFn read_run_fn);
+void bp_set_prefetcher(BufferPool *bp, PageReadStartFn read_start_fn, PageReadFinishFn read_finish_fn);
+
+GrainResult bp_pin_page(BufferPool *bp, int32_t page_id, void **page);
+GrainResult bp_pin_new_page(BufferPool *bp, int32_t page_id, void **page);
+GrainResult bp_unpin_page(BufferPool *bp, int32_t page_id, bool dirty);
+GrainResult bp_flush_page(BufferPool *bp, int32_t page_id);
+GrainResult bp_discard_page(BufferPool *bp, int32_t page_id);
+GrainResult bp_flush_all(BufferPool *bp);
+
+bool bp_is_resident(BufferPool *bp, int32_t page_id);
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define CODEC_MIN_MATCH 4
+#define CODEC_MAX_OFFSET 65535
+
+/*
+ * an lz4-style block codec: a run of literals then a back reference, over and
+ * over. fixed-width records pad their strings with zeros, which turn into a
+ * few bytes of back reference each.
+ */
+size_t codec_bound(size_t len);
+size_t codec_compress(const void *src, size_t len, void *dst, size_t cap);
+bool codec_decompress(const void *src, size_t len, void *dst, size_t out_len);
+
+#endif
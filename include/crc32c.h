@@ -0,0 +1,16 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+/*
+ * crc32c (castagnoli). crc is the result of the previous chunk, 0 to start.
+ * uses the sse4.2 crc32 instruction when the cpu has it.
+ */
+uint32_t crc32c(uint32_t crc, const void *data, size_t len);
+
+/* the table driven version crc32c falls back to, exposed so the two can be compared */
+uint32_t crc32c_sw(uint32_t crc, const void *data, size_t len);
+
+#endif
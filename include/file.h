@@ -5,36 +5,171 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <pthread.h>
 #include "heap.h"
+#include "buffer.h"
+#include "wal.h"
+#include "btree.h"
+#include "hash.h"
+#include "bloom.h"
+#include "zonemap.h"
+#include "fsm.h"
+#include "pagedir.h"
+#include "aio.h"
+
+#define GRAIN_FORMAT_LEGACY 1
+#define GRAIN_FORMAT_VERSION 6
+
+/* the header is padded out to one block, so every page sits on a 4KB boundary */
+#define FILE_DATA_OFFSET 4096
+#define DIRECT_IO_ALIGN 4096
+
+#define MMAP_GROW_PAGES 256
+#define FILE_GROW_PAGES 128
+#define SCAN_MORSEL_PAGES 16
+#define VACUUM_STEP_PAGES 64
+#define PAGE_LATCH_STRIPES 256
+
+typedef enum {
+    HF_OPEN_DEFAULT = 0,
+    HF_OPEN_MMAP    = 1 << 0,
+    HF_OPEN_WAL     = 1 << 1,
+    HF_OPEN_ID_INDEX= 1 << 2,
+    HF_OPEN_ZONE_MAP= 1 << 3,
+    HF_OPEN_HASH_INDEX = 1 << 4,
+    HF_OPEN_AGE_INDEX = 1 << 5,
+    HF_OPEN_ID_FILTER = 1 << 6,
+    HF_OPEN_PAX     = 1 << 7,
+    HF_OPEN_COMPRESS= 1 << 8,
+    HF_OPEN_ASYNC_IO= 1 << 9,
+    HF_OPEN_DIRECT  = 1 << 10
+} HeapFileFlags;
 
 typedef struct {
     int32_t num_pages;
     int32_t next_page_idx;
     int32_t first_free_page;
+    int32_t version;
+    uint64_t checkpoint_lsn;
+    int32_t layout;
+    int32_t compressed;
 } FileHeader;
 
 typedef struct {
     FileHeader header;
-    FILE *file_ptr;
+    int fd;
+    int page_fd;
+    int32_t alloc_pages;
+    BufferPool pool;
+    bool header_dirty;
+    uint32_t flags;
+    char *map;
+    size_t map_len;
+    size_t map_reserved;
+    int32_t map_pins;
+    Wal *wal;
+    BTree *id_index;
+    BTree *age_index;
+    HashIndex *hash_index;
+    BloomFilter *id_filter;
+    ZoneMap *zone_map;
+    FreeSpaceMap *fsm;
+    PageDirectory *page_dir;
+    AioQueue *aio;
+    HeapPage *aio_pages;
+    AioQueue *prefetch;
+    /*
+     * latch order: flush_latch, then a page latch, then header_latch, then
+     * index_latch. page latches are striped by page id and only held while
+     * the page is pinned.
+     */
+    pthread_rwlock_t flush_latch;
+    pthread_rwlock_t page_latches[PAGE_LATCH_STRIPES];
+    pthread_mutex_t header_latch;
+    pthread_mutex_t index_latch;
 } HeapFile;
 
+/* the key a b+ tree index on the heap is built over */
+typedef int32_t (*RecordKeyFn)(const Record *rec);
+
+/* a batch scan keeps its current page pinned between calls */
+typedef struct {
+    int32_t page_id;
+    int32_t next_slot;
+    HeapPage *page;
+    bool filtered;
+    Predicate pred;
+} HfScanCursor;
+
+/* called once per page with that page's live records, from worker 0..n-1 */
+typedef GrainResult (*HfScanFn)(void *ctx, int32_t worker, const RecordId *rids,
+                                const Record *recs, int32_t count);
+
+/* called for every record a vacuum moves, once it is live at its new rid */
+typedef GrainResult (*HfForwardFn)(void *ctx, RecordId from, RecordId to, const Record *rec);
+
+/* a vacuum walks from the last page towards page 0, a bounded number of pages per step */
+typedef struct {
+    int32_t next_page;
+    int32_t sparse_slots;
+    HfForwardFn forward;
+    void *ctx;
+    int32_t records_moved;
+    int32_t pages_released;
+} HfVacuum;
+
+/* an insert session fills a page of its own, so concurrent sessions don't meet on one page */
 typedef struct {
     int32_t page_id;
-    int32_t slot_idx;
-} RecordId;
+} HfSession;
 
 HeapFile *create_file(const char *filename);
 HeapFile *open_file(const char *filename);
+HeapFile *create_file_ex(const char *filename, uint32_t flags);
+HeapFile *open_file_ex(const char *filename, uint32_t flags);
 GrainResult close_file(HeapFile *file);
 GrainResult write_file_header(HeapFile *hf);
+GrainResult hf_flush(HeapFile *hf);
+GrainResult hf_commit(HeapFile *hf);
 
 GrainResult hf_alloc_page(HeapFile *hf, int32_t *page_id);
 GrainResult write_page(HeapFile *hf, HeapPage *hp);
 GrainResult read_page(HeapFile *hf, HeapPage *hp, int32_t page_id);
+GrainResult hf_pin_page(HeapFile *hf, int32_t page_id, HeapPage **page);
+GrainResult hf_unpin_page(HeapFile *hf, int32_t page_id, bool dirty);
+GrainResult hf_latch_page(HeapFile *hf, int32_t page_id, bool exclusive);
+GrainResult hf_unlatch_page(HeapFile *hf, int32_t page_id);
 
 GrainResult hf_insert_record(HeapFile *hf, Record *rec);
+GrainResult hf_insert_records(HeapFile *hf, Record *recs, size_t n, RecordId *rids);
+GrainResult hf_session_init(HeapFile *hf, HfSession *session);
+GrainResult hf_session_insert(HeapFile *hf, HfSession *session, Record *rec, RecordId *rid);
+GrainResult hf_session_close(HeapFile *hf, HfSession *session);
 GrainResult hf_scan_next(HeapFile *hf, RecordId *rid, Record *rec);
+GrainResult hf_batch_scan_init(HeapFile *hf, HfScanCursor *cur);
+GrainResult hf_batch_scan_init_filtered(HeapFile *hf, HfScanCursor *cur, const Predicate *pred);
+GrainResult hf_batch_scan_next(HeapFile *hf, HfScanCursor *cur, RecordId *rids, Record *recs,
+                               int32_t max, int32_t *count);
+GrainResult hf_column_scan_next(HeapFile *hf, HfScanCursor *cur, RecordColumn col, RecordId *rids,
+                                int32_t *values, int32_t max, int32_t *count);
+GrainResult hf_batch_scan_close(HeapFile *hf, HfScanCursor *cur);
+GrainResult hf_parallel_scan(HeapFile *hf, int32_t num_workers, HfScanFn fn, void *ctx);
 GrainResult hf_update_record(HeapFile *hf, RecordId rid, Record *rec);
 GrainResult hf_delete_record(HeapFile *hf, RecordId rid);
+GrainResult hf_get_record(HeapFile *hf, RecordId rid, Record *rec);
+
+bool hf_id_may_exist(HeapFile *hf, int32_t id);
+GrainResult hf_find_by_id(HeapFile *hf, int32_t id, RecordId *rid, Record *rec);
+GrainResult hf_id_range_init(HeapFile *hf, BTreeCursor *cur, int32_t lo, int32_t hi);
+GrainResult hf_id_range_next(HeapFile *hf, BTreeCursor *cur, RecordId *rid, Record *rec);
+GrainResult hf_age_range_init(HeapFile *hf, BTreeCursor *cur, int32_t lo, int32_t hi);
+GrainResult hf_age_range_next(HeapFile *hf, BTreeCursor *cur, RecordId *rid);
+GrainResult hf_age_range_fetch(HeapFile *hf, BTreeCursor *cur, RecordId *rids, Record *recs,
+                               int32_t max, int32_t *count);
+
+GrainResult hf_vacuum_init(HeapFile *hf, HfVacuum *vac, int32_t sparse_slots,
+                           HfForwardFn forward, void *ctx);
+GrainResult hf_vacuum_step(HeapFile *hf, HfVacuum *vac, int32_t max_pages);
+GrainResult hf_vacuum(HeapFile *hf, int32_t sparse_slots, HfForwardFn forward, void *ctx);
 
 #endif
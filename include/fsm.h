@@ -0,0 +1,49 @@
+#ifndef FSM_H
+#define FSM_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "heap.h"
+
+#define FSM_MAGIC 0x204d5346u
+
+typedef struct {
+    uint32_t magic;
+    int32_t num_pages;
+    int32_t clean;
+    int32_t reserved;
+} FsmHeader;
+
+/*
+ * one byte of free slots per page on disk; a bit per page with room in memory.
+ * claimed pages belong to one inserter for now and are never written out.
+ */
+typedef struct {
+    FsmHeader header;
+    int fd;
+    uint8_t *free_slots;
+    uint64_t *has_room;
+    uint64_t *claimed;
+    int32_t capacity;
+    int32_t first_word;
+    int32_t dirty_lo;
+    int32_t dirty_hi;
+} FreeSpaceMap;
+
+FreeSpaceMap *fsm_create(const char *path);
+FreeSpaceMap *fsm_open(const char *path);
+GrainResult fsm_close(FreeSpaceMap *fsm);
+GrainResult fsm_flush(FreeSpaceMap *fsm);
+
+GrainResult fsm_set(FreeSpaceMap *fsm, int32_t page_id, int32_t free_slots);
+GrainResult fsm_truncate(FreeSpaceMap *fsm, int32_t num_pages);
+int32_t fsm_free_slots(FreeSpaceMap *fsm, int32_t page_id);
+int32_t fsm_find(FreeSpaceMap *fsm);
+int32_t fsm_find_empty_run(FreeSpaceMap *fsm, int32_t max_len, int32_t *first_page_id);
+int32_t fsm_find_unclaimed(FreeSpaceMap *fsm);
+GrainResult fsm_claim(FreeSpaceMap *fsm, int32_t page_id);
+GrainResult fsm_unclaim(FreeSpaceMap *fsm, int32_t page_id);
+bool fsm_is_claimed(FreeSpaceMap *fsm, int32_t page_id);
+
+#endif
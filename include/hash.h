@@ -0,0 +1,62 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "heap.h"
+#include "buffer.h"
+
+#define HASH_MAGIC 0x48534148u
+#define HASH_POOL_FRAMES 64
+#define HASH_MAX_DEPTH 20
+
+typedef struct {
+    int32_t key;
+    RecordId rid;
+} HashEntry;
+
+/* a bucket is a chain of pages; only buckets that can't be split grow a chain */
+typedef struct {
+    int32_t page_id;
+    int32_t local_depth;
+    int32_t num_entries;
+    int32_t next_page;
+} HashBucketHeader;
+
+#define HASH_BUCKET_CAPACITY \
+    ((int32_t)((PAGE_SIZE - sizeof(HashBucketHeader)) / sizeof(HashEntry)))
+
+typedef struct {
+    HashBucketHeader header;
+    HashEntry entries[HASH_BUCKET_CAPACITY];
+} HashBucket;
+
+typedef struct {
+    uint32_t magic;
+    int32_t global_depth;
+    int32_t num_pages;
+    int32_t free_page;
+    int32_t clean;
+    int32_t reserved;
+    int64_t num_entries;
+} HashHeader;
+
+/* the directory lives in memory and is written behind the last bucket page on flush */
+typedef struct {
+    HashHeader header;
+    int fd;
+    BufferPool pool;
+    int32_t *dir;
+} HashIndex;
+
+HashIndex *hash_create(const char *path);
+HashIndex *hash_open(const char *path);
+GrainResult hash_close(HashIndex *hi);
+GrainResult hash_flush(HashIndex *hi);
+
+GrainResult hash_insert(HashIndex *hi, int32_t key, RecordId rid);
+GrainResult hash_delete(HashIndex *hi, int32_t key, RecordId rid);
+GrainResult hash_find(HashIndex *hi, int32_t key, RecordId *rid);
+
+#endif
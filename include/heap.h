@@ -7,8 +7,9 @@
 
 #define PAGE_SIZE 8192
 #define RECORD_SIZE 64
-#define MAX_SLOTS ((PAGE_SIZE - sizeof(PageHeader)) / RECORD_SIZE)
+#define MAX_SLOTS ((PAGE_SIZE - sizeof(PageHeader) - sizeof(uint32_t)) / RECORD_SIZE)
 #define FREE_SLOT_END -1
+#define SLOT_BITMAP_WORDS 4
 
 #define CHECK_RET_NULL(ptr) if ((ptr) == NULL) return NULL;
 #define CHECK_RET_BOOL(ptr) if ((ptr) == NULL) return false;
@@ -28,7 +29,10 @@ typedef enum {
     GRAIN_FILE_READ_FAILED= -7,
     GRAIN_FILE_WRITE_FAILED=-8,
     GRAIN_FILE_SEEK_FAILED= -9,
-    GRAIN_CORRUPT_HEADER  = -10
+    GRAIN_CORRUPT_HEADER  = -10,
+    GRAIN_NO_FREE_FRAME   = -11,
+    GRAIN_NO_INDEX        = -12,
+    GRAIN_CORRUPT_PAGE    = -13
 } GrainResult;
 
 typedef struct {
@@ -38,6 +42,32 @@ typedef struct {
     char email[24];
 } Record;
 
+typedef struct {
+    int32_t page_id;
+    int32_t slot_idx;
+} RecordId;
+
+/* inclusive bounds on the fixed-offset int32 fields */
+typedef struct {
+    int32_t id_min;
+    int32_t id_max;
+    int32_t age_min;
+    int32_t age_max;
+} Predicate;
+
+#define PREDICATE_ALL {INT32_MIN, INT32_MAX, INT32_MIN, INT32_MAX}
+
+/* row pages store whole records; pax pages store each field as a column across the page */
+typedef enum {
+    PAGE_LAYOUT_ROW = 0,
+    PAGE_LAYOUT_PAX = 1
+} PageLayout;
+
+typedef enum {
+    COLUMN_ID,
+    COLUMN_AGE
+} RecordColumn;
+
 typedef struct {
     int32_t next_free_slot;
 } FreeSlot;
@@ -48,21 +78,42 @@ typedef struct {
     int32_t next_slot_idx;
     int32_t first_free_slot;
     int32_t next_free_page;
+    uint32_t slot_bitmap[SLOT_BITMAP_WORDS];
+    int32_t layout;
+    uint64_t lsn;
 } PageHeader;
 
+/* the checksum covers everything before it and lives in what used to be unused slack */
 typedef struct {
     PageHeader header;
-    char storage[PAGE_SIZE - sizeof(PageHeader)];
+    char storage[PAGE_SIZE - sizeof(PageHeader) - sizeof(uint32_t)];
+    uint32_t checksum;
 } HeapPage;
 
 void *get_slot(HeapPage *page, int32_t slot_idx);
 bool has_free_space(HeapPage *page);
 bool is_in_free_list(HeapPage *page, int32_t slot_idx);
+bool is_slot_live(HeapPage *page, int32_t slot_idx);
+int32_t next_live_slot(HeapPage *page, int32_t slot_idx);
+int32_t next_set_slot(const uint32_t *bitmap, int32_t slot_idx, int32_t end);
+void rebuild_slot_bitmap(HeapPage *page);
 
 HeapPage *init_page(HeapPage *page, int32_t page_id);
+HeapPage *init_page_layout(HeapPage *page, int32_t page_id, PageLayout layout);
 int32_t insert_record(HeapPage *page, Record *record);
+int32_t insert_records(HeapPage *page, Record *records, int32_t count, int32_t *slots);
 GrainResult delete_record(HeapPage *page, int32_t slot_idx);
 GrainResult update_record(HeapPage *page, int32_t slot_idx, Record *new_record);
 Record *get_record(HeapPage *page, int32_t slot_idx);
+bool read_record(HeapPage *page, int32_t slot_idx, Record *rec);
+void read_slot(const HeapPage *page, int32_t slot_idx, Record *rec);
+void write_slot(HeapPage *page, int32_t slot_idx, const Record *rec);
+const int32_t *page_column(HeapPage *page, RecordColumn col);
+int32_t column_value(HeapPage *page, RecordColumn col, int32_t slot_idx);
+void match_records(HeapPage *page, const Predicate *pred, uint32_t *matches);
+
+uint32_t page_checksum(const HeapPage *page);
+void stamp_page(HeapPage *page);
+bool verify_page(const HeapPage *page);
 
 #endif
@@ -0,0 +1,14 @@
+#ifndef IO_H
+#define IO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include "heap.h"
+
+bool pread_full(int fd, void *buf, size_t len, off_t offset);
+bool pwrite_full(int fd, const void *buf, size_t len, off_t offset);
+
+GrainResult sidecar_mark_in_use(int fd, void *header, size_t size, int32_t *clean);
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef PAGEDIR_H
+#define PAGEDIR_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "heap.h"
+
+#define PAGEDIR_MAGIC 0x52494450u
+#define PAGE_FRAME_MAGIC 0x4d415246u
+#define PAGE_FRAME_ALIGN 256
+
+/*
+ * a compressed heap file stores every page as a frame: this header, then
+ * length bytes of compressed page, then slack up to capacity. a length of
+ * PAGE_SIZE means the page didn't compress and is stored as is.
+ */
+typedef struct {
+    uint32_t magic;
+    int32_t page_id;
+    int32_t length;
+    int32_t capacity;
+    uint64_t seq;
+    uint32_t checksum;
+    int32_t reserved;
+} PageFrameHeader;
+
+/* offset 0 means the page has no frame yet */
+typedef struct {
+    int64_t offset;
+    int32_t capacity;
+    int32_t length;
+} PageExtent;
+
+typedef struct {
+    uint32_t magic;
+    int32_t num_pages;
+    int32_t clean;
+    int32_t reserved;
+    int64_t data_start;
+    int64_t data_end;
+    uint64_t next_seq;
+} PageDirHeader;
+
+/*
+ * where each page's frame lives, kept in a sidecar so read_page can find page N
+ * directly. the frames carry enough to rebuild it. data_fd is the heap file and
+ * isn't owned by the directory.
+ */
+typedef struct {
+    PageDirHeader header;
+    int fd;
+    int data_fd;
+    PageExtent *extents;
+    int32_t capacity;
+    int32_t dirty_lo;
+    int32_t dirty_hi;
+    pthread_mutex_t lock;
+} PageDirectory;
+
+PageDirectory *pagedir_create(const char *path, int data_fd, int64_t data_start);
+PageDirectory *pagedir_open(const char *path, int data_fd);
+GrainResult pagedir_close(PageDirectory *pd);
+GrainResult pagedir_flush(PageDirectory *pd);
+GrainResult pagedir_rebuild(PageDirectory *pd, int32_t num_pages);
+
+GrainResult pagedir_read(PageDirectory *pd, int32_t page_id, void *page);
+GrainResult pagedir_write(PageDirectory *pd, int32_t page_id, const void *page);
+GrainResult pagedir_truncate(PageDirectory *pd, int32_t num_pages);
+bool pagedir_extent(PageDirectory *pd, int32_t page_id, PageExtent *extent);
+
+#endif
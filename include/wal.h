@@ -0,0 +1,60 @@
+#ifndef WAL_H
+#define WAL_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "heap.h"
+
+#define WAL_MAGIC 0x4c415747u
+#define WAL_BUFFER_SIZE (1 << 20)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t reserved;
+    uint64_t base_lsn;
+} WalFileHeader;
+
+typedef struct {
+    uint32_t len;
+    uint32_t crc;
+    uint64_t lsn;
+} WalRecordHeader;
+
+typedef GrainResult (*WalReplayFn)(void *ctx, uint64_t lsn, const void *data, uint32_t len);
+
+/*
+ * an append-only redo log. lsns are byte positions in the log stream, a
+ * record's lsn is the position just past its end. appends go to an in-memory
+ * buffer; wal_commit makes everything up to an lsn durable, and concurrent
+ * committers share whichever fsync covers their records.
+ */
+typedef struct {
+    int fd;
+    char *buf;
+    char *spare;
+    size_t buf_len;
+    uint64_t buf_lsn;
+    uint64_t base_lsn;
+    uint64_t next_lsn;
+    uint64_t synced_lsn;
+    uint64_t syncs;
+    bool flushing;
+    bool failed;
+    pthread_mutex_t lock;
+    pthread_cond_t flushed;
+} Wal;
+
+GrainResult wal_open(Wal *wal, const char *path, uint64_t min_lsn);
+GrainResult wal_close(Wal *wal);
+
+GrainResult wal_append(Wal *wal, const void *data, uint32_t len, uint64_t *lsn);
+GrainResult wal_commit(Wal *wal, uint64_t lsn);
+GrainResult wal_replay(Wal *wal, WalReplayFn fn, void *ctx);
+GrainResult wal_truncate(Wal *wal);
+
+uint64_t wal_next_lsn(Wal *wal);
+bool wal_is_empty(Wal *wal);
+
+#endif
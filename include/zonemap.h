@@ -0,0 +1,44 @@
+#ifndef ZONEMAP_H
+#define ZONEMAP_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "heap.h"
+
+#define ZONEMAP_MAGIC 0x454e4f5au
+
+/* min/max of the int32 columns over a page's live records; an empty page has min > max */
+typedef struct {
+    int32_t id_min;
+    int32_t id_max;
+    int32_t age_min;
+    int32_t age_max;
+} Zone;
+
+typedef struct {
+    uint32_t magic;
+    int32_t num_pages;
+    int32_t clean;
+    int32_t reserved;
+} ZoneMapHeader;
+
+typedef struct {
+    ZoneMapHeader header;
+    int fd;
+    Zone *zones;
+    int32_t capacity;
+    int32_t dirty_lo;
+    int32_t dirty_hi;
+} ZoneMap;
+
+ZoneMap *zonemap_create(const char *path);
+ZoneMap *zonemap_open(const char *path);
+GrainResult zonemap_close(ZoneMap *zm);
+GrainResult zonemap_flush(ZoneMap *zm);
+
+GrainResult zonemap_widen(ZoneMap *zm, int32_t page_id, const Record *rec);
+GrainResult zonemap_track_page(ZoneMap *zm, HeapPage *page);
+bool zonemap_may_match(ZoneMap *zm, int32_t page_id, const Predicate *pred);
+
+#endif
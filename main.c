@@ -3,21 +3,20 @@
 #include "include/file.h"
 #include "include/heap.h"
 
-void print_free_page_list(HeapFile *hf) {
-    printf("  Free Page List: ");
+void print_free_space_map(HeapFile *hf) {
+    printf("  Free Space Map: ");
     if (hf->header.first_free_page == -1) {
-        printf("(empty)\n");
+        printf("(no room)\n");
         return;
     }
-    HeapPage page;
-    int32_t page_id = hf->header.first_free_page;
-    while (page_id != -1) {
-        printf("[Page %d]", page_id);
-        if (read_page(hf, &page, page_id) != GRAIN_OK) break;
-        page_id = page.header.next_free_page;
-        if (page_id != -1) printf(" -> ");
+    bool first = true;
+    for (int32_t page_id = 0; page_id < hf->header.num_pages; page_id++) {
+        int32_t free_slots = fsm_free_slots(hf->fsm, page_id);
+        if (free_slots == 0) continue;
+        printf("%s[Page %d: %d free]", first ? "" : ", ", page_id, free_slots);
+        first = false;
     }
-    printf(" -> NULL\n");
+    printf("\n");
 }
 
 void print_free_slot_list(HeapPage *page) {
@@ -39,7 +38,7 @@ void print_free_slot_list(HeapPage *page) {
 void print_state(HeapFile *hf) {
     printf("\n--- State ---\n");
     printf("  Pages: %d\n", hf->header.num_pages);
-    print_free_page_list(hf);
+    print_free_space_map(hf);
     for (int32_t i = 0; i < hf->header.num_pages; i++) {
         HeapPage page;
         if (read_page(hf, &page, i) == GRAIN_OK) {
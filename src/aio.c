@@ -0,0 +1,428 @@
+#include "../include/aio.h"
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#define PROBE_OPS 256
+
+/* moves a request's bytes from done onwards; a read stops early at end of file */
+static int64_t transfer(const AioRequest *req, size_t done) {
+    while (done < req->len) {
+        ssize_t n;
+        if (req->write) {
+            n = pwrite(req->fd, (const char *)req->buf + done, req->len - done, req->offset + (off_t)done);
+        } else {
+            n = pread(req->fd, (char *)req->buf + done, req->len - done, req->offset + (off_t)done);
+        }
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -errno;
+        }
+        if (n == 0) break;
+        done += (size_t)n;
+    }
+    return (int64_t)done;
+}
+
+/* the kernel may move fewer bytes than asked; the rest is done here before the caller sees it */
+static void finish(AioQueue *q, int32_t slot, int64_t res, AioCompletion *out) {
+    AioRequest *req = &q->requests[slot];
+    if (res > 0 && (size_t)res < req->len) {
+        res = transfer(req, (size_t)res);
+    }
+    out->tag = req->tag;
+    out->res = res;
+    q->free_slots[q->num_free++] = slot;
+    q->outstanding--;
+}
+
+/* no liburing here, just the three system calls */
+static int uring_setup(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/* plain reads and writes arrived in 5.6; an older ring is no use to us */
+static bool ring_supports_rw(int fd) {
+    struct io_uring_probe *probe = calloc(1, sizeof(struct io_uring_probe) +
+                                             PROBE_OPS * sizeof(struct io_uring_probe_op));
+    if (probe == NULL) {
+        return false;
+    }
+    bool ok = uring_register(fd, IORING_REGISTER_PROBE, probe, PROBE_OPS) == 0 &&
+              probe->last_op >= IORING_OP_WRITE &&
+              (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED) &&
+              (probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED);
+    free(probe);
+    return ok;
+}
+
+static void ring_close(AioRing *r) {
+    if (r->sqes != NULL) {
+        munmap(r->sqes, r->sqes_len);
+    }
+    if (r->cq_ring != NULL && r->cq_ring != r->sq_ring) {
+        munmap(r->cq_ring, r->cq_ring_len);
+    }
+    if (r->sq_ring != NULL) {
+        munmap(r->sq_ring, r->sq_ring_len);
+    }
+    if (r->fd >= 0) {
+        close(r->fd);
+    }
+    memset(r, 0, sizeof(AioRing));
+    r->fd = -1;
+}
+
+static void *map_ring(int fd, size_t len, off_t offset) {
+    void *p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+    return (p == MAP_FAILED) ? NULL : p;
+}
+
+static bool ring_open(AioRing *r, int32_t depth) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    r->fd = uring_setup((unsigned)depth, &p);
+    if (r->fd < 0 || !ring_supports_rw(r->fd)) {
+        ring_close(r);
+        return false;
+    }
+
+    r->sq_ring_len = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+    r->cq_ring_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    /* newer kernels hand out both rings in one mapping */
+    bool single_mmap = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap && r->cq_ring_len > r->sq_ring_len) {
+        r->sq_ring_len = r->cq_ring_len;
+    }
+    r->sq_ring = map_ring(r->fd, r->sq_ring_len, IORING_OFF_SQ_RING);
+    r->cq_ring = single_mmap ? r->sq_ring : map_ring(r->fd, r->cq_ring_len, IORING_OFF_CQ_RING);
+    r->sqes = map_ring(r->fd, r->sqes_len, IORING_OFF_SQES);
+    if (r->sq_ring == NULL || r->cq_ring == NULL || r->sqes == NULL) {
+        ring_close(r);
+        return false;
+    }
+
+    char *sq = r->sq_ring;
+    char *cq = r->cq_ring;
+    r->sq_head = (uint32_t *)(sq + p.sq_off.head);
+    r->sq_tail = (uint32_t *)(sq + p.sq_off.tail);
+    r->sq_mask = (uint32_t *)(sq + p.sq_off.ring_mask);
+    r->sq_array = (uint32_t *)(sq + p.sq_off.array);
+    r->cq_head = (uint32_t *)(cq + p.cq_off.head);
+    r->cq_tail = (uint32_t *)(cq + p.cq_off.tail);
+    r->cq_mask = (uint32_t *)(cq + p.cq_off.ring_mask);
+    r->cqes = cq + p.cq_off.cqes;
+    r->unsubmitted = 0;
+    return true;
+}
+
+/* entries the kernel didn't take stay in the ring and go with the next call */
+static GrainResult ring_enter(AioRing *r, unsigned min_complete) {
+    for (;;) {
+        unsigned flags = (min_complete > 0) ? IORING_ENTER_GETEVENTS : 0;
+        int n = uring_enter(r->fd, (unsigned)r->unsubmitted, min_complete, flags);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return (min_complete > 0) ? GRAIN_FILE_READ_FAILED : GRAIN_FILE_WRITE_FAILED;
+        }
+        r->unsubmitted -= n;
+        return GRAIN_OK;
+    }
+}
+
+/* the queue never holds more than depth requests, so the rings can't overflow */
+static GrainResult ring_submit(AioQueue *q) {
+    AioRing *r = &q->ring;
+    struct io_uring_sqe *sqes = r->sqes;
+    uint32_t tail = *r->sq_tail;
+    for (int32_t i = 0; i < q->num_prepared; i++) {
+        int32_t slot = q->prepared[i];
+        AioRequest *req = &q->requests[slot];
+        uint32_t idx = tail & *r->sq_mask;
+        struct io_uring_sqe *sqe = &sqes[idx];
+        memset(sqe, 0, sizeof(struct io_uring_sqe));
+        sqe->opcode = req->write ? IORING_OP_WRITE : IORING_OP_READ;
+        sqe->fd = req->fd;
+        sqe->addr = (uint64_t)(uintptr_t)req->buf;
+        sqe->len = (uint32_t)req->len;
+        sqe->off = (uint64_t)req->offset;
+        sqe->user_data = (uint64_t)slot;
+        r->sq_array[idx] = idx;
+        tail++;
+    }
+    __atomic_store_n(r->sq_tail, tail, __ATOMIC_RELEASE);
+    r->unsubmitted += q->num_prepared;
+    q->num_prepared = 0;
+    return ring_enter(r, 0);
+}
+
+static int32_t ring_reap(AioQueue *q, AioCompletion *out, int32_t max) {
+    AioRing *r = &q->ring;
+    struct io_uring_cqe *cqes = r->cqes;
+    uint32_t head = *r->cq_head;
+    uint32_t tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+    int32_t n = 0;
+    while (head != tail && n < max) {
+        struct io_uring_cqe *cqe = &cqes[head & *r->cq_mask];
+        finish(q, (int32_t)cqe->user_data, cqe->res, &out[n]);
+        n++;
+        head++;
+    }
+    __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+    return n;
+}
+
+static void *pool_worker(void *arg) {
+    AioQueue *q = (AioQueue *)arg;
+    AioPool *p = &q->pool;
+    pthread_mutex_lock(&p->lock);
+    for (;;) {
+        while (!p->stopping && p->todo_count == 0) {
+            pthread_cond_wait(&p->work, &p->lock);
+        }
+        if (p->todo_count == 0) {
+            break;
+        }
+        int32_t slot = p->todo[p->todo_head];
+        p->todo_head = (p->todo_head + 1) % q->depth;
+        p->todo_count--;
+        pthread_mutex_unlock(&p->lock);
+
+        AioRequest *req = &q->requests[slot];
+        req->res = transfer(req, 0);
+
+        pthread_mutex_lock(&p->lock);
+        p->done[p->done_count++] = slot;
+        pthread_cond_signal(&p->finished);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+static void pool_stop(AioQueue *q) {
+    AioPool *p = &q->pool;
+    pthread_mutex_lock(&p->lock);
+    p->stopping = true;
+    pthread_cond_broadcast(&p->work);
+    pthread_mutex_unlock(&p->lock);
+    for (int32_t i = 0; i < p->num_threads; i++) {
+        pthread_join(p->threads[i], NULL);
+    }
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->work);
+    pthread_cond_destroy(&p->finished);
+    free(p->todo);
+    free(p->done);
+}
+
+static bool pool_start(AioQueue *q) {
+    AioPool *p = &q->pool;
+    p->todo = malloc(sizeof(int32_t) * q->depth);
+    p->done = malloc(sizeof(int32_t) * q->depth);
+    if (p->todo == NULL || p->done == NULL) {
+        free(p->todo);
+        free(p->done);
+        return false;
+    }
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->work, NULL);
+    pthread_cond_init(&p->finished, NULL);
+
+    int32_t wanted = (q->depth < AIO_POOL_THREADS) ? q->depth : AIO_POOL_THREADS;
+    for (int32_t i = 0; i < wanted; i++) {
+        if (pthread_create(&p->threads[p->num_threads], NULL, pool_worker, q) != 0) {
+            break;
+        }
+        p->num_threads++;
+    }
+    if (p->num_threads == 0) {
+        pool_stop(q);
+        return false;
+    }
+    return true;
+}
+
+static GrainResult pool_submit(AioQueue *q) {
+    AioPool *p = &q->pool;
+    pthread_mutex_lock(&p->lock);
+    for (int32_t i = 0; i < q->num_prepared; i++) {
+        p->todo[(p->todo_head + p->todo_count) % q->depth] = q->prepared[i];
+        p->todo_count++;
+    }
+    pthread_cond_broadcast(&p->work);
+    pthread_mutex_unlock(&p->lock);
+    q->num_prepared = 0;
+    return GRAIN_OK;
+}
+
+static int32_t pool_reap(AioQueue *q, AioCompletion *out, int32_t max) {
+    AioPool *p = &q->pool;
+    int32_t slots[AIO_QUEUE_DEPTH];
+    if (max > AIO_QUEUE_DEPTH) {
+        max = AIO_QUEUE_DEPTH;
+    }
+    pthread_mutex_lock(&p->lock);
+    while (p->done_count == 0) {
+        pthread_cond_wait(&p->finished, &p->lock);
+    }
+    int32_t n = (p->done_count < max) ? p->done_count : max;
+    p->done_count -= n;
+    memcpy(slots, &p->done[p->done_count], sizeof(int32_t) * n);
+    pthread_mutex_unlock(&p->lock);
+
+    for (int32_t i = 0; i < n; i++) {
+        finish(q, slots[i], q->requests[slots[i]].res, &out[i]);
+    }
+    return n;
+}
+
+static void free_queue(AioQueue *q) {
+    free(q->requests);
+    free(q->free_slots);
+    free(q->prepared);
+    free(q);
+}
+
+/* io_uring when the kernel has it, the thread pool when it doesn't or when asked to */
+AioQueue *aio_create(int32_t depth, uint32_t flags) {
+    if (depth <= 0) {
+        depth = AIO_QUEUE_DEPTH;
+    }
+    AioQueue *q = (AioQueue *)calloc(1, sizeof(AioQueue));
+    CHECK_RET_NULL(q);
+    q->depth = depth;
+    q->ring.fd = -1;
+    q->requests = calloc((size_t)depth, sizeof(AioRequest));
+    q->free_slots = malloc(sizeof(int32_t) * depth);
+    q->prepared = malloc(sizeof(int32_t) * depth);
+    if (q->requests == NULL || q->free_slots == NULL || q->prepared == NULL) {
+        free_queue(q);
+        return NULL;
+    }
+    for (int32_t i = 0; i < depth; i++) {
+        q->free_slots[i] = depth - 1 - i;
+    }
+    q->num_free = depth;
+
+    if (!(flags & AIO_THREAD_POOL) && ring_open(&q->ring, depth)) {
+        q->backend = AIO_BACKEND_URING;
+    } else if (pool_start(q)) {
+        q->backend = AIO_BACKEND_THREADS;
+    } else {
+        free_queue(q);
+        return NULL;
+    }
+    return q;
+}
+
+/* waits out anything still in flight, since it may be writing into the caller's buffers */
+void aio_destroy(AioQueue *q) {
+    if (q == NULL) return;
+    for (int32_t i = 0; i < q->num_prepared; i++) {
+        q->free_slots[q->num_free++] = q->prepared[i];
+    }
+    q->outstanding -= q->num_prepared;
+    q->num_prepared = 0;
+
+    AioCompletion done[AIO_QUEUE_DEPTH];
+    while (q->outstanding > 0) {
+        int32_t count;
+        if (aio_wait(q, done, AIO_QUEUE_DEPTH, &count) != GRAIN_OK) {
+            break;
+        }
+    }
+
+    if (q->backend == AIO_BACKEND_URING) {
+        ring_close(&q->ring);
+    } else {
+        pool_stop(q);
+    }
+    free_queue(q);
+}
+
+static GrainResult prep(AioQueue *q, int fd, bool write, void *buf, size_t len, off_t offset,
+                        uint64_t tag) {
+    CHECK_RET_GRAIN_NULL(q);
+    CHECK_RET_GRAIN_NULL(buf);
+    if (q->num_free == 0) {
+        return GRAIN_NO_FREE_FRAME;
+    }
+    int32_t slot = q->free_slots[--q->num_free];
+    AioRequest *req = &q->requests[slot];
+    req->fd = fd;
+    req->write = write;
+    req->buf = buf;
+    req->len = len;
+    req->offset = offset;
+    req->tag = tag;
+    req->res = 0;
+    q->prepared[q->num_prepared++] = slot;
+    q->outstanding++;
+    return GRAIN_OK;
+}
+
+GrainResult aio_prep_read(AioQueue *q, int fd, void *buf, size_t len, off_t offset, uint64_t tag) {
+    return prep(q, fd, false, buf, len, offset, tag);
+}
+
+GrainResult aio_prep_write(AioQueue *q, int fd, const void *buf, size_t len, off_t offset,
+                           uint64_t tag) {
+    return prep(q, fd, true, (void *)buf, len, offset, tag);
+}
+
+/* hands every prepared request over in one go */
+GrainResult aio_submit(AioQueue *q) {
+    CHECK_RET_GRAIN_NULL(q);
+    if (q->num_prepared == 0) {
+        return GRAIN_OK;
+    }
+    return (q->backend == AIO_BACKEND_URING) ? ring_submit(q) : pool_submit(q);
+}
+
+/* blocks until at least one request is back, unless none are out */
+GrainResult aio_wait(AioQueue *q, AioCompletion *out, int32_t max, int32_t *count) {
+    CHECK_RET_GRAIN_NULL(q);
+    CHECK_RET_GRAIN_NULL(out);
+    CHECK_RET_GRAIN_NULL(count);
+    *count = 0;
+    GrainResult res = aio_submit(q);
+    if (res != GRAIN_OK) {
+        return res;
+    }
+    if (q->outstanding == 0 || max <= 0) {
+        return GRAIN_OK;
+    }
+
+    if (q->backend == AIO_BACKEND_THREADS) {
+        *count = pool_reap(q, out, max);
+        return GRAIN_OK;
+    }
+    for (;;) {
+        int32_t n = ring_reap(q, out, max);
+        if (n > 0) {
+            *count = n;
+            return GRAIN_OK;
+        }
+        res = ring_enter(&q->ring, 1);
+        if (res != GRAIN_OK) {
+            return res;
+        }
+    }
+}
+
+int32_t aio_outstanding(const AioQueue *q) {
+    return (q == NULL) ? 0 : q->outstanding;
+}
@@ -0,0 +1,237 @@
+#include "../include/bloom.h"
+#include "../include/io.h"
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define BLOOM_BLOCK_BITS (BLOOM_BLOCK_WORDS * 64)
+
+/* odd multipliers that pick one bit per word out of the same 32 hash bits */
+static const uint32_t SALTS[BLOOM_BLOCK_WORDS] = {
+    0x47b6137bu, 0x44974d91u, 0x8824ad5bu, 0xa2b7289du,
+    0x705495c7u, 0x2df1424bu, 0x9efc4947u, 0x5c6bfb31u,
+};
+
+static inline off_t block_offset(int32_t block) {
+    return sizeof(BloomHeader) + ((off_t)block * sizeof(BloomBlock));
+}
+
+/* murmur3's 64-bit finalizer; the high half picks the block, the low half the bits */
+static inline uint64_t hash_key(int32_t key) {
+    uint64_t h = (uint32_t)key;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+static inline int32_t block_for(const BloomFilter *bf, uint64_t h) {
+    return (int32_t)(((h >> 32) * (uint64_t)bf->header.num_blocks) >> 32);
+}
+
+static inline uint64_t bit_for(uint64_t h, int32_t word) {
+    return 1ull << (((uint32_t)h * SALTS[word]) >> 26);
+}
+
+static int32_t blocks_for(int64_t expected_keys) {
+    if (expected_keys < 0) {
+        expected_keys = 0;
+    }
+    int64_t blocks = (expected_keys * BLOOM_BITS_PER_KEY + BLOOM_BLOCK_BITS - 1) / BLOOM_BLOCK_BITS;
+    if (blocks < BLOOM_MIN_BLOCKS) {
+        blocks = BLOOM_MIN_BLOCKS;
+    }
+    return (blocks > INT32_MAX / 2) ? INT32_MAX / 2 : (int32_t)blocks;
+}
+
+static GrainResult write_header(BloomFilter *bf) {
+    if (!pwrite_full(bf->fd, &bf->header, sizeof(BloomHeader), 0)) {
+        return GRAIN_FILE_WRITE_FAILED;
+    }
+    return GRAIN_OK;
+}
+
+/* blocks are cache line aligned, so a lookup touches exactly one line */
+static GrainResult alloc_blocks(BloomFilter *bf, int32_t num_blocks) {
+    void *blocks;
+    if (posix_memalign(&blocks, sizeof(BloomBlock), sizeof(BloomBlock) * (size_t)num_blocks) != 0) {
+        return GRAIN_NULL_PTR;
+    }
+    free(bf->blocks);
+    bf->blocks = blocks;
+    bf->header.num_blocks = num_blocks;
+    return GRAIN_OK;
+}
+
+/* empties the filter and resizes it for expected_keys */
+GrainResult bloom_reset(BloomFilter *bf, int64_t expected_keys) {
+    CHECK_RET_GRAIN_NULL(bf);
+    GrainResult res = sidecar_mark_in_use(bf->fd, &bf->header, sizeof(BloomHeader), &bf->header.clean);
+    if (res != GRAIN_OK) {
+        return res;
+    }
+    int32_t num_blocks = blocks_for(expected_keys);
+    if (num_blocks != bf->header.num_blocks) {
+        res = alloc_blocks(bf, num_blocks);
+        if (res != GRAIN_OK) {
+            return res;
+        }
+        if (ftruncate(bf->fd, block_offset(num_blocks)) != 0) {
+            return GRAIN_FILE_WRITE_FAILED;
+        }
+    }
+    memset(bf->blocks, 0, sizeof(BloomBlock) * (size_t)num_blocks);
+    bf->header.num_keys = 0;
+    bf->dirty_lo = 0;
+    bf->dirty_hi = num_blocks - 1;
+    return GRAIN_OK;
+}
+
+GrainResult bloom_add(BloomFilter *bf, int32_t key) {
+    CHECK_RET_GRAIN_NULL(bf);
+    uint64_t h = hash_key(key);
+    int32_t block = block_for(bf, h);
+    uint64_t *words = bf->blocks[block].words;
+
+    uint64_t missing = 0;
+    for (int32_t i = 0; i < BLOOM_BLOCK_WORDS; i++) {
+        missing |= bit_for(h, i) & ~words[i];
+    }
+    if (missing == 0) {
+        return GRAIN_OK;
+    }
+
+    GrainResult res = sidecar_mark_in_use(bf->fd, &bf->header, sizeof(BloomHeader), &bf->header.clean);
+    if (res != GRAIN_OK) {
+        return res;
+    }
+    for (int32_t i = 0; i < BLOOM_BLOCK_WORDS; i++) {
+        words[i] |= bit_for(h, i);
+    }
+    bf->header.num_keys++;
+    if (block < bf->dirty_lo) bf->dirty_lo = block;
+    if (block > bf->dirty_hi) bf->dirty_hi = block;
+    return GRAIN_OK;
+}
+
+/* false means the key was never added; true can be wrong */
+bool bloom_may_contain(BloomFilter *bf, int32_t key) {
+    if (bf == NULL) {
+        return true;
+    }
+    uint64_t h = hash_key(key);
+    const uint64_t *words = bf->blocks[block_for(bf, h)].words;
+    for (int32_t i = 0; i < BLOOM_BLOCK_WORDS; i++) {
+        if (!(words[i] & bit_for(h, i))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* more keys than the filter was sized for; false positives climb from here */
+bool bloom_overloaded(BloomFilter *bf) {
+    if (bf == NULL) {
+        return false;
+    }
+    int64_t capacity = (int64_t)bf->header.num_blocks * BLOOM_BLOCK_BITS / BLOOM_BITS_PER_KEY;
+    return bf->header.num_keys > capacity;
+}
+
+static BloomFilter *new_bloom(int fd) {
+    BloomFilter *bf = (BloomFilter *)calloc(1, sizeof(BloomFilter));
+    CHECK_RET_NULL(bf);
+    bf->fd = fd;
+    bf->dirty_lo = INT32_MAX;
+    bf->dirty_hi = -1;
+    return bf;
+}
+
+static void free_bloom(BloomFilter *bf) {
+    close(bf->fd);
+    free(bf->blocks);
+    free(bf);
+}
+
+BloomFilter *bloom_create(const char *path, int64_t expected_keys) {
+    CHECK_RET_NULL(path);
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return NULL;
+    }
+    BloomFilter *bf = new_bloom(fd);
+    if (bf == NULL) {
+        close(fd);
+        return NULL;
+    }
+
+    /* unlike the other sidecars it has a fixed size, so the empty blocks are written right away */
+    int32_t num_blocks = blocks_for(expected_keys);
+    bf->header.magic = BLOOM_MAGIC;
+    bf->header.clean = 0;
+    if (alloc_blocks(bf, num_blocks) != GRAIN_OK) {
+        free_bloom(bf);
+        return NULL;
+    }
+    memset(bf->blocks, 0, sizeof(BloomBlock) * (size_t)num_blocks);
+    bf->dirty_lo = 0;
+    bf->dirty_hi = num_blocks - 1;
+    if (bloom_flush(bf) != GRAIN_OK) {
+        free_bloom(bf);
+        return NULL;
+    }
+    return bf;
+}
+
+BloomFilter *bloom_open(const char *path) {
+    CHECK_RET_NULL(path);
+    int fd = open(path, O_RDWR);
+    if (fd < 0) {
+        return NULL;
+    }
+    BloomFilter *bf = new_bloom(fd);
+    if (bf == NULL) {
+        close(fd);
+        return NULL;
+    }
+
+    BloomHeader h;
+    if (!pread_full(fd, &h, sizeof(BloomHeader), 0) || h.magic != BLOOM_MAGIC ||
+        h.num_blocks <= 0 || h.num_keys < 0 || alloc_blocks(bf, h.num_blocks) != GRAIN_OK ||
+        !pread_full(fd, bf->blocks, sizeof(BloomBlock) * (size_t)h.num_blocks, block_offset(0))) {
+        free_bloom(bf);
+        return NULL;
+    }
+    bf->header = h;
+    return bf;
+}
+
+GrainResult bloom_flush(BloomFilter *bf) {
+    CHECK_RET_GRAIN_NULL(bf);
+    if (bf->header.clean) {
+        return GRAIN_OK;
+    }
+    if (bf->dirty_hi >= bf->dirty_lo) {
+        size_t len = sizeof(BloomBlock) * (size_t)(bf->dirty_hi - bf->dirty_lo + 1);
+        if (!pwrite_full(bf->fd, &bf->blocks[bf->dirty_lo], len, block_offset(bf->dirty_lo))) {
+            return GRAIN_FILE_WRITE_FAILED;
+        }
+        bf->dirty_lo = INT32_MAX;
+        bf->dirty_hi = -1;
+    }
+    bf->header.clean = 1;
+    GrainResult res = write_header(bf);
+    if (res == GRAIN_OK && fsync(bf->fd) != 0) {
+        res = GRAIN_FILE_WRITE_FAILED;
+    }
+    return res;
+}
+
+GrainResult bloom_close(BloomFilter *bf) {
+    CHECK_RET_GRAIN_NULL(bf);
+    GrainResult res = bloom_flush(bf);
+    free_bloom(bf);
+    return res;
+}
@@ -0,0 +1,461 @@
+#include "../include/btree.h"
+#include "../include/io.h"
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+_Static_assert(sizeof(BTreeNode) <= PAGE_SIZE, "btree node must fit in a page");
+
+typedef struct {
+    bool inserted;
+    bool split;
+    BTreeEntry separator;
+    int32_t right;
+} InsertResult;
+
+static inline off_t node_offset(int32_t page_id) {
+    return sizeof(BTreeHeader) + ((off_t)page_id * PAGE_SIZE);
+}
+
+static GrainResult disk_read_node(void *ctx, int32_t page_id, void *buf) {
+    BTree *bt = (BTree *)ctx;
+    if (!pread_full(bt->fd, buf, PAGE_SIZE, node_offset(page_id))) {
+        return GRAIN_FILE_READ_FAILED;
+    }
+    return GRAIN_OK;
+}
+
+static GrainResult disk_write_node(void *ctx, int32_t page_id, const void *buf) {
+    BTree *bt = (BTree *)ctx;
+    if (!pwrite_full(bt->fd, buf, PAGE_SIZE, node_offset(page_id))) {
+        return GRAIN_FILE_WRITE_FAILED;
+    }
+    return GRAIN_OK;
+}
+
+static GrainResult write_header(BTree *bt) {
+    if (!pwrite_full(bt->fd, &bt->header, sizeof(BTreeHeader), 0)) {
+        return GRAIN_FILE_WRITE_FAILED;
+    }
+    return GRAIN_OK;
+}
+
+static int compare_entries(const BTreeEntry *a, const BTreeEntry *b) {
+    if (a->key != b->key) return a->key < b->key ? -1 : 1;
+    if (a->rid.page_id != b->rid.page_id) return a->rid.page_id < b->rid.page_id ? -1 : 1;
+    if (a->rid.slot_idx != b->rid.slot_idx) return a->rid.slot_idx < b->rid.slot_idx ? -1 : 1;
+    return 0;
+}
+
+/* first position whose entry is >= target */
+static int32_t lower_bound(const BTreeEntry *entries, int32_t n, const BTreeEntry *target) {
+    int32_t lo = 0, hi = n;
+    while (lo < hi) {
+        int32_t mid = lo + (hi - lo) / 2;
+        if (compare_entries(&entries[mid], target) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/* first position whose entry is > target */
+static int32_t upper_bound(const BTreeEntry *entries, int32_t n, const BTreeEntry *target) {
+    int32_t lo = 0, hi = n;
+    while (lo < hi) {
+        int32_t mid = lo + (hi - lo) / 2;
+        if (compare_entries(&entries[mid], target) <= 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static GrainResult alloc_node(BTree *bt, bool leaf, int32_t *page_id, BTreeNode **node) {
+    int32_t new_page_id = bt->header.num_pages;
+    GrainResult res = bp_pin_new_page(&bt->pool, new_page_id, (void **)node);
+    if (res != GRAIN_OK) {
+        return res;
+    }
+    bt->header.num_pages++;
+
+    (*node)->header.page_id = new_page_id;
+    (*node)->header.is_leaf = leaf;
+    (*node)->header.num_keys = 0;
+    (*node)->header.next_leaf = -1;
+    *page_id = new_page_id;
+    return GRAIN_OK;
+}
+
+static void leaf_insert_at(BTreeNode *node, int32_t pos, const BTreeEntry *entry) {
+    int32_t n = node->header.num_keys;
+    memmove(&node->entries[pos + 1], &node->entries[pos], (size_t)(n - pos) * sizeof(BTreeEntry));
+    node->entries[pos] = *entry;
+    node->header.num_keys++;
+}
+
+static GrainResult insert_leaf(BTree *bt, BTreeNode *node, const BTreeEntry *entry, InsertResult *out) {
+    int32_t n = node->header.num_keys;
+    int32_t pos = lower_bound(node->entries, n, entry);
+    if (pos < n && compare_entries(&node->entries[pos], entry) == 0) {
+        return GRAIN_OK;
+    }
+    out->inserted = true;
+
+    if (n < BTREE_LEAF_CAPACITY) {
+        leaf_insert_at(node, pos, entry);
+        return GRAIN_OK;
+    }
+
+    int32_t right_id;
+    BTreeNode *right;
+    GrainResult res = alloc_node(bt, true, &right_id, &right);
+    if (res != GRAIN_OK) {
+        return res;
+    }
+
+    int32_t mid = n / 2;
+    memcpy(right->entries, &node->entries[mid], (size_t)(n - mid) * sizeof(BTreeEntry));
+    right->header.num_keys = n - mid;
+    node->header.num_keys = mid;
+    right->header.next_leaf = node->header.next_leaf;
+    node->header.next_leaf = right_id;
+
+    if (pos <= mid) {
+        leaf_insert_at(node, pos, entry);
+    } else {
+        leaf_insert_at(right, pos - mid, entry);
+    }
+
+    out->split = true;
+    out->separator = right->entries[0];
+    out->right = right_id;
+    return bp_unpin_page(&bt->pool, right_id, true);
+}
+
+static GrainResult insert_inner(BTree *bt, BTreeNode *node, int32_t pos,
+                                const InsertResult *child, InsertResult *out) {
+    int32_t n = node->header.num_keys;
+    if (n < BTREE_INNER_CAPACITY) {
+        memmove(&node->inner.keys[pos + 1], &node->inner.keys[pos], (size_t)(n - pos) * sizeof(BTreeEntry));
+        memmove(&node->inner.children[pos + 2], &node->inner.children[pos + 1], (size_t)(n - pos) * sizeof(int32_t));
+        node->inner.keys[pos] = child->separator;
+        node->inner.children[pos + 1] = child->right;
+        node->header.num_keys++;
+        return GRAIN_OK;
+    }
+
+    /* lay out all n + 1 keys in order, then push the middle one up */
+    BTreeEntry keys[BTREE_INNER_CAPACITY + 1];
+    int32_t children[BTREE_INNER_CAPACITY + 2];
+    memcpy(keys, node->inner.keys, (size_t)pos * sizeof(BTreeEntry));
+    keys[pos] = child->separator;
+    memcpy(&keys[pos + 1], &node->inner.keys[pos], (size_t)(n - pos) * sizeof(BTreeEntry));
+    memcpy(children, node->inner.children, (size_t)(pos + 1) * sizeof(int32_t));
+    children[pos + 1] = child->right;
+    memcpy(&children[pos + 2], &node->inner.children[pos + 1], (size_t)(n - pos) * sizeof(int32_t));
+
+    int32_t right_id;
+    BTreeNode *right;
+    GrainResult res = alloc_node(bt, false, &right_id, &right);
+    if (res != GRAIN_OK) {
+        return res;
+    }
+
+    int32_t total = n + 1;
+    int32_t mid = total / 2;
+    memcpy(node->inner.keys, keys, (size_t)mid * sizeof(BTreeEntry));
+    memcpy(node->inner.children, children, (size_t)(mid + 1) * sizeof(int32_t));
+    node->header.num_keys = mid;
+
+    memcpy(right->inner.keys, &keys[mid + 1], (size_t)(total - mid - 1) * sizeof(BTreeEntry));
+    memcpy(right->inner.children, &children[mid + 1], (size_t)(total - mid) * sizeof(int32_t));
+    right->header.num_keys = total - mid - 1;
+
+    out->split = true;
+    out->separator = keys[mid];
+    out->right = right_id;
+    return bp_unpin_page(&bt->pool, right_id, true);
+}
+
+static GrainResult insert_into(BTree *bt, int32_t page_id, const BTreeEntry *entry, InsertResult *out) {
+    out->inserted = false;
+    out->split = false;
+
+    BTreeNode *node;
+    GrainResult res = bp_pin_page(&bt->pool, page_id, (void **)&node);
+    if (res != GRAIN_OK) {
+        return res;
+    }
+
+    if (node->header.is_leaf) {
+        res = insert_leaf(bt, node, entry, out);
+        GrainResult unpin_res = bp_unpin_page(&bt->pool, page_id, out->inserted);
+        return (res != GRAIN_OK) ? res : unpin_res;
+    }
+
+    int32_t pos = upper_bound(node->inner.keys, node->header.num_keys, entry);
+    InsertResult child;
+    res = insert_into(bt, node->inner.children[pos], entry, &child);
+    out->inserted = child.inserted;
+    if (res != GRAIN_OK || !child.split) {
+        bp_unpin_page(&bt->pool, page_id, false);
+        return res;
+    }
+
+    res = insert_inner(bt, node, pos, &child, out);
+    GrainResult unpin_res = bp_unpin_page(&bt->pool, page_id, true);
+    return (res != GRAIN_OK) ? res : unpin_res;
+}
+
+GrainResult btree_insert(BTree *bt, int32_t key, RecordId rid) {
+    CHECK_RET_GRAIN_NULL(bt);
+    GrainResult res = sidecar_mark_in_use(bt->fd, &bt->header, sizeof(BTreeHeader), &bt->header.clean);
+    if (res != GRAIN_OK) {
+        return res;
+    }
+
+    BTreeEntry entry = {.key = key, .rid = rid};
+    InsertResult result;
+    res = insert_into(bt, bt->header.root_page, &entry, &result);
+    if (res != GRAIN_OK) {
+        return res;
+    }
+    if (result.inserted) {
+        bt->header.num_entries++;
+    }
+    if (!result.split) {
+        return GRAIN_OK;
+    }
+
+    int32_t root_id;
+    BTreeNode *root;
+    res = alloc_node(bt, false, &root_id, &root);
+    if (res != GRAIN_OK) {
+        return res;
+    }
+    root->inner.keys[0] = result.separator;
+    root->inner.children[0] = bt->header.root_page;
+    root->inner.children[1] = result.right;
+    root->header.num_keys = 1;
+    bt->header.root_page = root_id;
+    bt->header.height++;
+    return bp_unpin_page(&bt->pool, root_id, true);
+}
+
+/* descends to the leaf where target is, or would be inserted */
+static GrainResult find_leaf(BTree *bt, const BTreeEntry *target, int32_t *leaf_id) {
+    int32_t page_id = bt->header.root_page;
+    for (;;) {
+        BTreeNode *node;
+        GrainResult res = bp_pin_page(&bt->pool, page_id, (void **)&node);
+        if (res != GRAIN_OK) {
+            return res;
+        }
+        if (node->header.is_leaf) {
+            *leaf_id = page_id;
+            return bp_unpin_page(&bt->pool, page_id, false);
+        }
+        int32_t pos = upper_bound(node->inner.keys, node->header.num_keys, target);
+        int32_t child = node->inner.children[pos];
+        bp_unpin_page(&bt->pool, page_id, false);
+        page_id = child;
+    }
+}
+
+/* leaves may underflow or empty out; nodes are never merged */
+GrainResult btree_delete(BTree *bt, int32_t key, RecordId rid) {
+    CHECK_RET_GRAIN_NULL(bt);
+
+    BTreeEntry entry = {.key = key, .rid = rid};
+    int32_t leaf_id;
+    GrainResult res = find_leaf(bt, &entry, &leaf_id);
+    if (res != GRAIN_OK) {
+        return res;
+    }
+
+    BTreeNode *leaf;
+    res = bp_pin_page(&bt->pool, leaf_id, (void **)&leaf);
+    if (res != GRAIN_OK) {
+        return res;
+    }
+    int32_t n = leaf->header.num_keys;
+    int32_t pos = lower_bound(leaf->entries, n, &entry);
+    if (pos == n || compare_entries(&leaf->entries[pos], &entry) != 0) {
+        bp_unpin_page(&bt->pool, leaf_id, false);
+        return GRAIN_RECORD_NOT_FOUND;
+    }
+
+    res = sidecar_mark_in_use(bt->fd, &bt->header, sizeof(BTreeHeader), &bt->header.clean);
+    if (res != GRAIN_OK) {
+        bp_unpin_page(&bt->pool, leaf_id, false);
+        return res;
+    }
+    memmove(&leaf->entries[pos], &leaf->entries[pos + 1], (size_t)(n - pos - 1) * sizeof(BTreeEntry));
+    leaf->header.num_keys--;
+    bt->header.num_entries--;
+    return bp_unpin_page(&bt->pool, leaf_id, true);
+}
+
+GrainResult btree_scan_init(BTree *bt, BTreeCursor *cur, int32_t lo, int32_t hi) {
+    CHECK_RET_GRAIN_NULL(bt);
+    CHECK_RET_GRAIN_NULL(cur);
+
+    BTreeEntry target = {.key = lo, .rid = {.page_id = INT32_MIN, .slot_idx = INT32_MIN}};
+    int32_t leaf_id;
+    GrainResult res = find_leaf(bt, &target, &leaf_id);
+    if (res != GRAIN_OK) {
+        return res;
+    }
+
+    BTreeNode *leaf;
+    res = bp_pin_page(&bt->pool, leaf_id, (void **)&leaf);
+    if (res != GRAIN_OK) {
+        return res;
+    }
+    cur->tree = bt;
+    cur->leaf = leaf_id;
+    cur->idx = lower_bound(leaf->entries, leaf->header.num_keys, &target);
+    cur->lo = lo;
+    cur->hi = hi;
+    return bp_unpin_page(&bt->pool, leaf_id, false);
+}
+
+GrainResult btree_scan_next(BTreeCursor *cur, int32_t *key, RecordId *rid) {
+    CHECK_RET_GRAIN_NULL(cur);
+    CHECK_RET_GRAIN_NULL(rid);
+
+    BufferPool *pool = &cur->tree->pool;
+    while (cur->leaf != -1) {
+        BTreeNode *leaf;
+        GrainResult res = bp_pin_page(pool, cur->leaf, (void **)&leaf);
+        if (res != GRAIN_OK) {
+            return res;
+        }
+
+        if (cur->idx < leaf->header.num_keys) {
+            BTreeEntry entry = leaf->entries[cur->idx];
+            bp_unpin_page(pool, cur->leaf, false);
+            if (entry.key > cur->hi) {
+                cur->leaf = -1;
+                return GRAIN_END;
+            }
+            cur->idx++;
+            if (key != NULL) *key = entry.key;
+            *rid = entry.rid;
+            return GRAIN_OK;
+        }
+
+        int32_t next = leaf->header.next_leaf;
+        bp_unpin_page(pool, cur->leaf, false);
+        cur->leaf = next;
+        cur->idx = 0;
+    }
+    return GRAIN_END;
+}
+
+GrainResult btree_find(BTree *bt, int32_t key, RecordId *rid) {
+    CHECK_RET_GRAIN_NULL(bt);
+    CHECK_RET_GRAIN_NULL(rid);
+
+    BTreeCursor cur;
+    GrainResult res = btree_scan_init(bt, &cur, key, key);
+    if (res != GRAIN_OK) {
+        return res;
+    }
+    res = btree_scan_next(&cur, NULL, rid);
+    return (res == GRAIN_END) ? GRAIN_RECORD_NOT_FOUND : res;
+}
+
+static BTree *new_btree(int fd) {
+    BTree *bt = (BTree *)calloc(1, sizeof(BTree));
+    CHECK_RET_NULL(bt);
+    bt->fd = fd;
+    if (bp_init(&bt->pool, BTREE_POOL_FRAMES, disk_read_node, disk_write_node, bt) != GRAIN_OK) {
+        free(bt);
+        return NULL;
+    }
+    return bt;
+}
+
+static void free_btree(BTree *bt) {
+    close(bt->fd);
+    bp_destroy(&bt->pool);
+    free(bt);
+}
+
+BTree *btree_create(const char *path) {
+    CHECK_RET_NULL(path);
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return NULL;
+    }
+    BTree *bt = new_btree(fd);
+    if (bt == NULL) {
+        close(fd);
+        return NULL;
+    }
+
+    bt->header.magic = BTREE_MAGIC;
+    bt->header.height = 1;
+    bt->header.num_pages = 0;
+    bt->header.num_entries = 0;
+
+    int32_t root_id;
+    BTreeNode *root;
+    if (alloc_node(bt, true, &root_id, &root) != GRAIN_OK) {
+        free_btree(bt);
+        return NULL;
+    }
+    bt->header.root_page = root_id;
+    bp_unpin_page(&bt->pool, root_id, true);
+
+    if (btree_flush(bt) != GRAIN_OK) {
+        free_btree(bt);
+        return NULL;
+    }
+    return bt;
+}
+
+BTree *btree_open(const char *path) {
+    CHECK_RET_NULL(path);
+    int fd = open(path, O_RDWR);
+    if (fd < 0) {
+        return NULL;
+    }
+    BTree *bt = new_btree(fd);
+    if (bt == NULL) {
+        close(fd);
+        return NULL;
+    }
+
+    BTreeHeader *h = &bt->header;
+    if (!pread_full(fd, h, sizeof(BTreeHeader), 0) || h->magic != BTREE_MAGIC ||
+        h->num_pages <= 0 || h->root_page < 0 || h->root_page >= h->num_pages) {
+        free_btree(bt);
+        return NULL;
+    }
+    return bt;
+}
+
+GrainResult btree_flush(BTree *bt) {
+    CHECK_RET_GRAIN_NULL(bt);
+    if (bt->header.clean) {
+        return GRAIN_OK;
+    }
+    GrainResult res = bp_flush_all(&bt->pool);
+    if (res != GRAIN_OK) {
+        return res;
+    }
+    bt->header.clean = 1;
+    res = write_header(bt);
+    if (res == GRAIN_OK && fsync(bt->fd) != 0) {
+        res = GRAIN_FILE_WRITE_FAILED;
+    }
+    return res;
+}
+
+GrainResult btree_close(BTree *bt) {
+    CHECK_RET_GRAIN_NULL(bt);
+    GrainResult res = btree_flush(bt);
+    free_btree(bt);
+    return res;
+}
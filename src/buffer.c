@@ -0,0 +1,562 @@
+#include "../include/buffer.h"
+#include <string.h>
+
+static inline uint32_t hash_page_id(int32_t page_id) {
+    return (uint32_t)page_id * 2654435761u;
+}
+
+static inline void *frame_data(BufferPool *bp, int32_t frame_idx) {
+    return bp->data + ((size_t)frame_idx * PAGE_SIZE);
+}
+
+static int32_t table_find(BufferPool *bp, int32_t page_id, uint32_t *pos) {
+    uint32_t i = hash_page_id(page_id) & bp->table_mask;
+    while (bp->table[i] != NO_FRAME) {
+        if (bp->frames[bp->table[i]].page_id == page_id) {
+            if (pos != NULL) *pos = i;
+            return bp->table[i];
+        }
+        i = (i + 1) & bp->table_mask;
+    }
+    return NO_FRAME;
+}
+
+static void table_insert(BufferPool *bp, int32_t page_id, int32_t frame_idx) {
+    uint32_t i = hash_page_id(page_id) & bp->table_mask;
+    while (bp->table[i] != NO_FRAME) {
+        i = (i + 1) & bp->table_mask;
+    }
+    bp->table[i] = frame_idx;
+}
+
+static void table_remove(BufferPool *bp, int32_t page_id) {
+    uint32_t i;
+    if (table_find(bp, page_id, &i) == NO_FRAME) return;
+
+    /* backward-shift deletion keeps probe chains intact without tombstones */
+    bp->table[i] = NO_FRAME;
+    uint32_t j = i;
+    for (;;) {
+        j = (j + 1) & bp->table_mask;
+        if (bp->table[j] == NO_FRAME) break;
+        uint32_t k = hash_page_id(bp->frames[bp->table[j]].page_id) & bp->table_mask;
+        bool stays = (i <= j) ? (i < k && k <= j) : (i < k || k <= j);
+        if (!stays) {
+            bp->table[i] = bp->table[j];
+            bp->table[j] = NO_FRAME;
+            i = j;
+        }
+    }
+}
+
+GrainResult bp_init(BufferPool *bp, int32_t num_frames,
+                    PageReadFn read_fn, PageWriteFn write_fn, void *io_ctx) {
+    CHECK_RET_GRAIN_NULL(bp);
+    CHECK_RET_GRAIN_NULL(read_fn);
+    CHECK_RET_GRAIN_NULL(write_fn);
+    if (num_frames <= 0) {
+        return GRAIN_NO_FREE_FRAME;
+    }
+
+    int32_t table_size = 1;
+    while (table_size < num_frames * 2) {
+        table_size <<= 1;
+    }
+
+    bp->data = aligned_alloc(PAGE_SIZE, (size_t)num_frames * PAGE_SIZE);
+    bp->frames = malloc(sizeof(Frame) * num_frames);
+    bp->table = malloc(sizeof(int32_t) * table_size);
+    bp->batch_ids = malloc(sizeof(int32_t) * num_frames);
+    bp->batch_bufs = malloc(sizeof(void *) * num_frames);
+    if (bp->data == NULL || bp->frames == NULL || bp->table == NULL ||
+        bp->batch_ids == NULL || bp->batch_bufs == NULL) {
+        free(bp->data);
+        free(bp->frames);
+        free(bp->table);
+        free(bp->batch_ids);
+        free(bp->batch_bufs);
+        return GRAIN_NULL_PTR;
+    }
+
+    for (int32_t i = 0; i < num_frames; i++) {
+        bp->frames[i].page_id = -1;
+        bp->frames[i].pin_count = 0;
+        bp->frames[i].dirty = false;
+        bp->frames[i].referenced = false;
+        bp->frames[i].scan = false;
+        bp->frames[i].loading = false;
+    }
+    for (int32_t i = 0; i < table_size; i++) {
+        bp->table[i] = NO_FRAME;
+    }
+
+    bp->num_frames = num_frames;
+    bp->table_mask = table_size - 1;
+    bp->clock_hand = 0;
+    bp->read_fn = read_fn;
+    bp->write_fn = write_fn;
+    bp->write_batch_fn = NULL;
+    bp->read_run_fn = NULL;
+    bp->read_start_fn = NULL;
+    bp->read_finish_fn = NULL;
+    bp->ra_pages = 0;
+    bp->ra_start = 0;
+    bp->ra_next = 0;
+    bp->ra_trigger = -1;
+    bp->ra_count = 0;
+    bp->ring_cap = (num_frames / 2 < BP_SCAN_RING_FRAMES) ? num_frames / 2 : BP_SCAN_RING_FRAMES;
+    bp->ring_size = 0;
+    bp->ring_pos = 0;
+    bp->io_ctx = io_ctx;
+    pthread_mutex_init(&bp->lock, NULL);
+    pthread_cond_init(&bp->loaded, NULL);
+    return GRAIN_OK;
+}
+
+/* a run still loading in the background has to be waited out by its reader first */
+void bp_destroy(BufferPool *bp) {
+    if (bp == NULL || bp->frames == NULL) return;
+    pthread_mutex_destroy(&bp->lock);
+    pthread_cond_destroy(&bp->loaded);
+    free(bp->data);
+    free(bp->frames);
+    free(bp->table);
+    free(bp->batch_ids);
+    free(bp->batch_bufs);
+    bp->data = NULL;
+    bp->frames = NULL;
+    bp->table = NULL;
+    bp->batch_ids = NULL;
+    bp->batch_bufs = NULL;
+    bp->num_frames = 0;
+}
+
+/* optional: lets flushes and evictions hand many dirty pages to the writer at once */
+void bp_set_batch_writer(BufferPool *bp, PageWriteBatchFn write_batch_fn) {
+    if (bp == NULL) return;
+    pthread_mutex_lock(&bp->lock);
+    bp->write_batch_fn = write_batch_fn;
+    pthread_mutex_unlock(&bp->lock);
+}
+
+/* optional: sequential misses read a whole extent; needs a pool of at least 8 frames */
+void bp_set_run_reader(BufferPool *bp, PageReadRunFn read_run_fn) {
+    if (bp == NULL) return;
+    pthread_mutex_lock(&bp->lock);
+    int32_t pages = (bp->ring_cap / 2 < BP_READ_AHEAD_PAGES) ? bp->ring_cap / 2 : BP_READ_AHEAD_PAGES;
+    bp->read_run_fn = read_run_fn;
+    bp->ra_pages = (read_run_fn != NULL && pages >= 2) ? pages : 0;
+    pthread_mutex_unlock(&bp->lock);
+}
+
+/* optional: with a run reader, the extent after the one being read is fetched in the background */
+void bp_set_prefetcher(BufferPool *bp, PageReadStartFn read_start_fn, PageReadFinishFn read_finish_fn) {
+    if (bp == NULL) return;
+    pthread_mutex_lock(&bp->lock);
+    bool both = read_start_fn != NULL && read_finish_fn != NULL;
+    bp->read_start_fn = both ? read_start_fn : NULL;
+    bp->read_finish_fn = both ? read_finish_fn : NULL;
+    pthread_mutex_unlock(&bp->lock);
+}
+
+static GrainResult write_back(BufferPool *bp, int32_t frame_idx) {
+    Frame *frame = &bp->frames[frame_idx];
+    if (!frame->dirty) return GRAIN_OK;
+    GrainResult res = bp->write_fn(bp->io_ctx, frame->page_id, frame_data(bp, frame_idx));
+    if (res != GRAIN_OK) {
+        return res;
+    }
+    frame->dirty = false;
+    return GRAIN_OK;
+}
+
+typedef struct {
+    int32_t page_id;
+    int32_t frame_idx;
+} DirtyFrame;
+
+static int compare_dirty_frames(const void *a, const void *b) {
+    int32_t pa = ((const DirtyFrame *)a)->page_id;
+    int32_t pb = ((const DirtyFrame *)b)->page_id;
+    return (pa > pb) - (pa < pb);
+}
+
+/* dirty frames sorted by page id; with a batch writer they go out in one call */
+static GrainResult write_frames(BufferPool *bp, const DirtyFrame *dirty, int32_t count) {
+    if (bp->write_batch_fn == NULL || count == 1) {
+        for (int32_t i = 0; i < count; i++) {
+            GrainResult res = write_back(bp, dirty[i].frame_idx);
+            if (res != GRAIN_OK) {
+                return res;
+            }
+        }
+        return GRAIN_OK;
+    }
+
+    for (int32_t i = 0; i < count; i++) {
+        bp->batch_ids[i] = dirty[i].page_id;
+        bp->batch_bufs[i] = frame_data(bp, dirty[i].frame_idx);
+    }
+    GrainResult res = bp->write_batch_fn(bp->io_ctx, bp->batch_ids, bp->batch_bufs, count);
+    if (res != GRAIN_OK) {
+        return res;
+    }
+    for (int32_t i = 0; i < count; i++) {
+        bp->frames[dirty[i].frame_idx].dirty = false;
+    }
+    return GRAIN_OK;
+}
+
+/* a dirty victim takes the next few dirty, unpinned frames with it, so eviction writes in batches */
+static GrainResult write_back_victim(BufferPool *bp, int32_t victim) {
+    if (bp->write_batch_fn == NULL) {
+        return write_back(bp, victim);
+    }
+    DirtyFrame batch[BP_EVICT_BATCH];
+    int32_t count = 0;
+    for (int32_t step = 0; step < bp->num_frames && count < BP_EVICT_BATCH; step++) {
+        int32_t i = (victim + step) % bp->num_frames;
+        Frame *frame = &bp->frames[i];
+        if (frame->page_id != -1 && frame->dirty && frame->pin_count == 0) {
+            batch[count].page_id = frame->page_id;
+            batch[count].frame_idx = i;
+            count++;
+        }
+    }
+    qsort(batch, count, sizeof(DirtyFrame), compare_dirty_frames);
+    return write_frames(bp, batch, count);
+}
+
+/* CLOCK: sweep the frames, giving every recently referenced page a second chance */
+static GrainResult find_victim(BufferPool *bp, int32_t *frame_idx) {
+    for (int32_t step = 0; step < bp->num_frames * 2; step++) {
+        int32_t i = bp->clock_hand;
+        bp->clock_hand = (bp->clock_hand + 1) % bp->num_frames;
+
+        Frame *frame = &bp->frames[i];
+        if (frame->page_id == -1) {
+            *frame_idx = i;
+            return GRAIN_OK;
+        }
+        if (frame->pin_count > 0) continue;
+        if (frame->referenced) {
+            frame->referenced = false;
+            continue;
+        }
+
+        GrainResult res = write_back_victim(bp, i);
+        if (res != GRAIN_OK) {
+            return res;
+        }
+        table_remove(bp, frame->page_id);
+        frame->page_id = -1;
+        *frame_idx = i;
+        return GRAIN_OK;
+    }
+    return GRAIN_NO_FREE_FRAME;
+}
+
+/* read-ahead pages only replace each other once the ring is full */
+static GrainResult ring_frame(BufferPool *bp, int32_t *frame_idx) {
+    if (bp->ring_size < bp->ring_cap) {
+        GrainResult res = find_victim(bp, frame_idx);
+        if (res == GRAIN_OK) {
+            bp->ring[bp->ring_size++] = *frame_idx;
+        }
+        return res;
+    }
+
+    int32_t slot = bp->ring_pos;
+    bp->ring_pos = (slot + 1) % bp->ring_cap;
+    Frame *frame = &bp->frames[bp->ring[slot]];
+    if (!frame->scan || frame->pin_count > 0) {
+        /* still pinned, or the frame went to an ordinary page since: the ring takes another one */
+        GrainResult res = find_victim(bp, frame_idx);
+        if (res == GRAIN_OK) {
+            bp->ring[slot] = *frame_idx;
+        }
+        return res;
+    }
+    if (frame->dirty) {
+        GrainResult res = write_back_victim(bp, bp->ring[slot]);
+        if (res != GRAIN_OK) {
+            return res;
+        }
+    }
+    table_remove(bp, frame->page_id);
+    frame->page_id = -1;
+    *frame_idx = bp->ring[slot];
+    return GRAIN_OK;
+}
+
+/* claims ring frames for up to count pages from first_page_id on, stopping at one that is already here */
+static int32_t claim_run(BufferPool *bp, int32_t first_page_id, int32_t count,
+                         int32_t *frames, void **bufs) {
+    int32_t n = 0;
+    while (n < count && table_find(bp, first_page_id + n, NULL) == NO_FRAME) {
+        int32_t frame_idx;
+        if (ring_frame(bp, &frame_idx) != GRAIN_OK) {
+            break;
+        }
+        /* the pool holds a pin on the frame until the read is settled */
+        Frame *frame = &bp->frames[frame_idx];
+        frame->page_id = first_page_id + n;
+        frame->pin_count = 1;
+        frame->dirty = false;
+        frame->referenced = false;
+        frame->scan = true;
+        frame->loading = true;
+        table_insert(bp, frame->page_id, frame_idx);
+        frames[n] = frame_idx;
+        bufs[n] = frame_data(bp, frame_idx);
+        n++;
+    }
+    return n;
+}
+
+/* the first num_read pages of a claimed run came in; the rest give their frames back */
+static void settle_run(BufferPool *bp, const int32_t *frames, int32_t count, int32_t num_read) {
+    for (int32_t n = 0; n < count; n++) {
+        Frame *frame = &bp->frames[frames[n]];
+        frame->pin_count = 0;
+        frame->loading = false;
+        if (n >= num_read) {
+            table_remove(bp, frame->page_id);
+            frame->page_id = -1;
+            frame->scan = false;
+        }
+    }
+    pthread_cond_broadcast(&bp->loaded);
+}
+
+/* the prefetch queue belongs to the pool, so unlike the other reads this one waits with the lock held */
+static void finish_prefetch(BufferPool *bp) {
+    if (bp->ra_count == 0) return;
+    int32_t num_read;
+    if (bp->read_finish_fn(bp->io_ctx, bp->ra_bufs, bp->ra_count, &num_read) != GRAIN_OK) {
+        num_read = 0;
+    }
+    settle_run(bp, bp->ra_frames, bp->ra_count, num_read);
+    bp->ra_count = 0;
+}
+
+/* the reader got to the trigger page, so the extent after what is already here starts loading */
+static void prefetch(BufferPool *bp) {
+    bp->ra_start = bp->ra_trigger;
+    bp->ra_trigger = -1;
+    finish_prefetch(bp);
+    int32_t first = bp->ra_next;
+    int32_t count = claim_run(bp, first, bp->ra_pages, bp->ra_frames, bp->ra_bufs);
+    if (count > 0 && bp->read_start_fn(bp->io_ctx, first, bp->ra_bufs, count) != GRAIN_OK) {
+        settle_run(bp, bp->ra_frames, count, 0);
+        count = 0;
+    }
+    if (count > 0) {
+        bp->ra_count = count;
+        bp->ra_trigger = first;
+        bp->ra_next = first + count;
+    }
+}
+
+/*
+ * a miss right where the last read stopped reads a whole extent. anything
+ * that goes wrong only shortens it; the page itself is then read on its own,
+ * which is what reports the error.
+ */
+static void read_ahead(BufferPool *bp, int32_t page_id) {
+    finish_prefetch(bp);
+    int32_t frames[BP_READ_AHEAD_PAGES];
+    void *bufs[BP_READ_AHEAD_PAGES];
+    int32_t count = claim_run(bp, page_id, bp->ra_pages, frames, bufs);
+    int32_t num_read = 0;
+    if (count > 0) {
+        PageReadRunFn read_run_fn = bp->read_run_fn;
+        pthread_mutex_unlock(&bp->lock);
+        if (read_run_fn(bp->io_ctx, page_id, bufs, count, &num_read) != GRAIN_OK) {
+            num_read = 0;
+        }
+        pthread_mutex_lock(&bp->lock);
+    }
+    settle_run(bp, frames, count, num_read);
+    if (num_read > 0) {
+        bp->ra_start = page_id;
+        bp->ra_next = page_id + num_read;
+        bp->ra_trigger = (bp->read_start_fn != NULL) ? page_id : -1;
+    }
+}
+
+/* the page's frame once nobody is reading into it any more; NO_FRAME if the read failed */
+static int32_t find_loaded(BufferPool *bp, int32_t page_id) {
+    int32_t frame_idx = table_find(bp, page_id, NULL);
+    while (frame_idx != NO_FRAME && bp->frames[frame_idx].loading) {
+        if (bp->ra_count > 0) {
+            /* it may be in the background run, which nobody else is going to finish */
+            finish_prefetch(bp);
+        } else {
+            pthread_cond_wait(&bp->loaded, &bp->lock);
+        }
+        frame_idx = table_find(bp, page_id, NULL);
+    }
+    return frame_idx;
+}
+
+/*
+ * a miss claims its frame before the read, so a second pinner of the same
+ * page waits for it instead of reading it again, and the lock is free for
+ * every other page meanwhile.
+ */
+static GrainResult pin_locked(BufferPool *bp, int32_t page_id, void **page, bool load) {
+    int32_t frame_idx = find_loaded(bp, page_id);
+    if (frame_idx == NO_FRAME && load && bp->ra_pages > 0 && page_id == bp->ra_next) {
+        read_ahead(bp, page_id);
+        frame_idx = table_find(bp, page_id, NULL);
+    }
+    if (frame_idx == NO_FRAME) {
+        GrainResult res = find_victim(bp, &frame_idx);
+        if (res != GRAIN_OK) {
+            return res;
+        }
+        Frame *frame = &bp->frames[frame_idx];
+        frame->page_id = page_id;
+        frame->dirty = false;
+        frame->scan = false;
+        table_insert(bp, page_id, frame_idx);
+        if (load) {
+            frame->pin_count = 1;
+            frame->loading = true;
+            PageReadFn read_fn = bp->read_fn;
+            pthread_mutex_unlock(&bp->lock);
+            res = read_fn(bp->io_ctx, page_id, frame_data(bp, frame_idx));
+            pthread_mutex_lock(&bp->lock);
+            frame->pin_count = 0;
+            frame->loading = false;
+            pthread_cond_broadcast(&bp->loaded);
+            if (res != GRAIN_OK) {
+                table_remove(bp, page_id);
+                frame->page_id = -1;
+                return res;
+            }
+        } else {
+            memset(frame_data(bp, frame_idx), 0, PAGE_SIZE);
+        }
+        if (load && (page_id < bp->ra_start || page_id >= bp->ra_next)) {
+            /* a miss outside the window starts a new stream; one inside it is just a hole */
+            bp->ra_start = page_id;
+            bp->ra_next = page_id + 1;
+            bp->ra_trigger = -1;
+        }
+    }
+
+    Frame *frame = &bp->frames[frame_idx];
+    frame->pin_count++;
+    frame->referenced = true;
+    *page = frame_data(bp, frame_idx);
+    if (load && page_id == bp->ra_trigger) {
+        prefetch(bp);
+    }
+    return GRAIN_OK;
+}
+
+static GrainResult pin(BufferPool *bp, int32_t page_id, void **page, bool load) {
+    CHECK_RET_GRAIN_NULL(bp);
+    CHECK_RET_GRAIN_NULL(page);
+    if (page_id < 0) {
+        return GRAIN_INVALID_PAGE_ID;
+    }
+    pthread_mutex_lock(&bp->lock);
+    GrainResult res = pin_locked(bp, page_id, page, load);
+    pthread_mutex_unlock(&bp->lock);
+    return res;
+}
+
+GrainResult bp_pin_page(BufferPool *bp, int32_t page_id, void **page) {
+    return pin(bp, page_id, page, true);
+}
+
+GrainResult bp_pin_new_page(BufferPool *bp, int32_t page_id, void **page) {
+    return pin(bp, page_id, page, false);
+}
+
+GrainResult bp_unpin_page(BufferPool *bp, int32_t page_id, bool dirty) {
+    CHECK_RET_GRAIN_NULL(bp);
+    pthread_mutex_lock(&bp->lock);
+    GrainResult res = GRAIN_OK;
+    int32_t frame_idx = table_find(bp, page_id, NULL);
+    if (frame_idx == NO_FRAME || bp->frames[frame_idx].pin_count == 0) {
+        res = GRAIN_INVALID_PAGE_ID;
+    } else {
+        Frame *frame = &bp->frames[frame_idx];
+        frame->pin_count--;
+        if (dirty) {
+            frame->dirty = true;
+        }
+    }
+    pthread_mutex_unlock(&bp->lock);
+    return res;
+}
+
+GrainResult bp_flush_page(BufferPool *bp, int32_t page_id) {
+    CHECK_RET_GRAIN_NULL(bp);
+    pthread_mutex_lock(&bp->lock);
+    GrainResult res = GRAIN_OK;
+    int32_t frame_idx = table_find(bp, page_id, NULL);
+    if (frame_idx != NO_FRAME) {
+        res = write_back(bp, frame_idx);
+    }
+    pthread_mutex_unlock(&bp->lock);
+    return res;
+}
+
+/* drops a page without writing it back, for pages that no longer exist */
+GrainResult bp_discard_page(BufferPool *bp, int32_t page_id) {
+    CHECK_RET_GRAIN_NULL(bp);
+    pthread_mutex_lock(&bp->lock);
+    GrainResult res = GRAIN_OK;
+    int32_t frame_idx = find_loaded(bp, page_id);
+    if (frame_idx != NO_FRAME) {
+        Frame *frame = &bp->frames[frame_idx];
+        if (frame->pin_count > 0) {
+            res = GRAIN_NO_FREE_FRAME;
+        } else {
+            table_remove(bp, page_id);
+            frame->page_id = -1;
+            frame->dirty = false;
+            frame->referenced = false;
+            frame->scan = false;
+        }
+    }
+    pthread_mutex_unlock(&bp->lock);
+    return res;
+}
+
+GrainResult bp_flush_all(BufferPool *bp) {
+    CHECK_RET_GRAIN_NULL(bp);
+
+    DirtyFrame *dirty = malloc(sizeof(DirtyFrame) * bp->num_frames);
+    CHECK_RET_GRAIN_NULL(dirty);
+    pthread_mutex_lock(&bp->lock);
+    int32_t num_dirty = 0;
+    for (int32_t i = 0; i < bp->num_frames; i++) {
+        if (bp->frames[i].page_id != -1 && bp->frames[i].dirty) {
+            dirty[num_dirty].page_id = bp->frames[i].page_id;
+            dirty[num_dirty].frame_idx = i;
+            num_dirty++;
+        }
+    }
+
+    /* write back in page order so the flush is one forward sweep over the file */
+    qsort(dirty, num_dirty, sizeof(DirtyFrame), compare_dirty_frames);
+
+    GrainResult res = write_frames(bp, dirty, num_dirty);
+    pthread_mutex_unlock(&bp->lock);
+    free(dirty);
+    return res;
+}
+
+bool bp_is_resident(BufferPool *bp, int32_t page_id) {
+    if (bp == NULL) return false;
+    pthread_mutex_lock(&bp->lock);
+    bool resident = table_find(bp, page_id, NULL) != NO_FRAME;
+    pthread_mutex_unlock(&bp->lock);
+    return resident;
+}
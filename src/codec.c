@@ -0,0 +1,156 @@
+#include "../include/codec.h"
+#include <string.h>
+
+#define HASH_BITS 12
+#define LAST_LITERALS 5
+#define MATCH_LIMIT 12
+
+static inline uint32_t read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t hash4(uint32_t v) {
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/* worst case: everything is one literal run */
+size_t codec_bound(size_t len) {
+    return len + (len / 255) + 16;
+}
+
+static uint8_t *put_length(uint8_t *op, size_t len) {
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+/* literals [lit, lit + lit_len) then a match of match_len at offset, or no match when match_len is 0 */
+static uint8_t *put_sequence(uint8_t *op, const uint8_t *oend, const uint8_t *lit, size_t lit_len,
+                             size_t offset, size_t match_len) {
+    size_t need = 1 + (lit_len / 255) + 1 + lit_len + 2 + (match_len / 255) + 1;
+    if ((size_t)(oend - op) < need) {
+        return NULL;
+    }
+
+    uint8_t *token = op++;
+    *token = (uint8_t)((lit_len < 15 ? lit_len : 15) << 4);
+    if (lit_len >= 15) {
+        op = put_length(op, lit_len - 15);
+    }
+    memcpy(op, lit, lit_len);
+    op += lit_len;
+    if (match_len == 0) {
+        return op;
+    }
+
+    *op++ = (uint8_t)offset;
+    *op++ = (uint8_t)(offset >> 8);
+    size_t extra = match_len - CODEC_MIN_MATCH;
+    *token |= (uint8_t)(extra < 15 ? extra : 15);
+    if (extra >= 15) {
+        op = put_length(op, extra - 15);
+    }
+    return op;
+}
+
+/* returns the compressed size, or 0 if it doesn't fit in cap */
+size_t codec_compress(const void *src, size_t len, void *dst, size_t cap) {
+    if (src == NULL || dst == NULL) return 0;
+    const uint8_t *in = (const uint8_t *)src;
+    const uint8_t *ip = in;
+    const uint8_t *anchor = in;
+    const uint8_t *end = in + len;
+    uint8_t *op = (uint8_t *)dst;
+    const uint8_t *oend = op + cap;
+
+    int32_t table[1 << HASH_BITS];
+    memset(table, 0xff, sizeof(table));
+
+    if (len >= MATCH_LIMIT) {
+        const uint8_t *match_limit = end - MATCH_LIMIT;
+        const uint8_t *match_end = end - LAST_LITERALS;
+        while (ip < match_limit) {
+            uint32_t h = hash4(read32(ip));
+            int32_t ref = table[h];
+            table[h] = (int32_t)(ip - in);
+            if (ref < 0 || (ip - in) - ref > CODEC_MAX_OFFSET || read32(in + ref) != read32(ip)) {
+                ip++;
+                continue;
+            }
+
+            const uint8_t *match = in + ref;
+            size_t match_len = CODEC_MIN_MATCH;
+            while (ip + match_len < match_end && match[match_len] == ip[match_len]) {
+                match_len++;
+            }
+            op = put_sequence(op, oend, anchor, (size_t)(ip - anchor), (size_t)(ip - match), match_len);
+            if (op == NULL) {
+                return 0;
+            }
+            ip += match_len;
+            anchor = ip;
+        }
+    }
+
+    op = put_sequence(op, oend, anchor, (size_t)(end - anchor), 0, 0);
+    return (op == NULL) ? 0 : (size_t)(op - (uint8_t *)dst);
+}
+
+static bool get_length(const uint8_t **ip, const uint8_t *iend, size_t *len) {
+    uint8_t b;
+    do {
+        if (*ip >= iend) return false;
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return true;
+}
+
+/* true only if src decodes to exactly out_len bytes; never reads or writes out of bounds */
+bool codec_decompress(const void *src, size_t len, void *dst, size_t out_len) {
+    if (src == NULL || dst == NULL) return false;
+    const uint8_t *ip = (const uint8_t *)src;
+    const uint8_t *iend = ip + len;
+    uint8_t *out = (uint8_t *)dst;
+    uint8_t *op = out;
+    uint8_t *oend = out + out_len;
+
+    while (ip < iend) {
+        uint8_t token = *ip++;
+        size_t lit_len = token >> 4;
+        if (lit_len == 15 && !get_length(&ip, iend, &lit_len)) return false;
+        if (lit_len > (size_t)(iend - ip) || lit_len > (size_t)(oend - op)) return false;
+        memcpy(op, ip, lit_len);
+        ip += lit_len;
+        op += lit_len;
+        if (ip == iend) {
+            break;
+        }
+
+        if (iend - ip < 2) return false;
+        size_t offset = ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - out)) return false;
+        size_t match_len = token & 15;
+        if (match_len == 15 && !get_length(&ip, iend, &match_len)) return false;
+        match_len += CODEC_MIN_MATCH;
+        if (match_len > (size_t)(oend - op)) return false;
+
+        const uint8_t *match = op - offset;
+        if (offset >= match_len) {
+            memcpy(op, match, match_len);
+            op += match_len;
+        } else {
+            /* overlapping copy: a short pattern repeated, most often a run of zeros */
+            for (size_t i = 0; i < match_len; i++) {
+                *op++ = match[i];
+            }
+        }
+    }
+    return op == oend;
+}
@@ -0,0 +1,81 @@
+#include "../include/crc32c.h"
+#include <string.h>
+#include <pthread.h>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define HAVE_SSE42_CRC 1
+#endif
+
+#define CRC32C_POLY 0x82f63b78u
+
+/* slicing by 8: table[k][b] is the crc of byte b followed by k zero bytes */
+static uint32_t crc_tables[8][256];
+static pthread_once_t crc_tables_once = PTHREAD_ONCE_INIT;
+
+static void build_crc_tables(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (CRC32C_POLY & (0u - (crc & 1)));
+        }
+        crc_tables[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int k = 1; k < 8; k++) {
+            uint32_t prev = crc_tables[k - 1][i];
+            crc_tables[k][i] = crc_tables[0][prev & 0xff] ^ (prev >> 8);
+        }
+    }
+}
+
+uint32_t crc32c_sw(uint32_t crc, const void *data, size_t len) {
+    pthread_once(&crc_tables_once, build_crc_tables);
+    const unsigned char *p = data;
+    crc = ~crc;
+    while (len >= 8) {
+        uint32_t lo, hi;
+        memcpy(&lo, p, 4);
+        memcpy(&hi, p + 4, 4);
+        lo ^= crc;
+        crc = crc_tables[7][lo & 0xff] ^ crc_tables[6][(lo >> 8) & 0xff] ^
+              crc_tables[5][(lo >> 16) & 0xff] ^ crc_tables[4][lo >> 24] ^
+              crc_tables[3][hi & 0xff] ^ crc_tables[2][(hi >> 8) & 0xff] ^
+              crc_tables[1][(hi >> 16) & 0xff] ^ crc_tables[0][hi >> 24];
+        p += 8;
+        len -= 8;
+    }
+    while (len-- > 0) {
+        crc = crc_tables[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+#ifdef HAVE_SSE42_CRC
+/* one crc32 instruction per 8 bytes; a page takes about a thousand of them */
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t crc, const void *data, size_t len) {
+    const unsigned char *p = data;
+    uint64_t c = ~crc;
+    while (len >= 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        c = _mm_crc32_u64(c, v);
+        p += 8;
+        len -= 8;
+    }
+    uint32_t c32 = (uint32_t)c;
+    while (len-- > 0) {
+        c32 = _mm_crc32_u8(c32, *p++);
+    }
+    return ~c32;
+}
+#endif
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t len) {
+#ifdef HAVE_SSE42_CRC
+    if (__builtin_cpu_supports("sse4.2")) {
+        return crc32c_hw(crc, data, len);
+    }
+#endif
+    return crc32c_sw(crc, data, len);
+}
@@ -1,15 +1,53 @@
+#define _GNU_SOURCE
 #include "../include/file.h"
 #include "../include/heap.h"
+#include "../include/io.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#define LEGACY_FILE_HEADER_SIZE 12
+#define LEGACY_PAGE_HEADER_SIZE 20
+#define V2_FILE_HEADER_SIZE 16
+#define V2_PAGE_HEADER_SIZE 36
+#define V3_FILE_HEADER_SIZE 24
+#define MMAP_RESERVE_BYTES ((size_t)1 << 34)
+
+static inline off_t page_offset(int32_t page_id) {
+    return FILE_DATA_OFFSET + ((off_t)page_id * PAGE_SIZE);
+}
+
+/* pins and scans read num_pages without the header latch */
+static inline int32_t page_count(HeapFile *hf) {
+    return __atomic_load_n(&hf->header.num_pages, __ATOMIC_ACQUIRE);
+}
+
+static inline void set_page_count(HeapFile *hf, int32_t num_pages) {
+    __atomic_store_n(&hf->header.num_pages, num_pages, __ATOMIC_RELEASE);
+}
 
 static FileHeader *read_file_header(HeapFile *hf) {
     CHECK_RET_NULL(hf);
-    if (fseek(hf->file_ptr, 0, SEEK_SET) != 0) {
+    memset(&hf->header, 0, sizeof(FileHeader));
+    if (!pread_full(hf->fd, &hf->header, LEGACY_FILE_HEADER_SIZE, 0)) {
         return NULL;
     }
-    if (fread(&hf->header, sizeof(FileHeader), 1, hf->file_ptr) != 1) {
+    /* legacy files have page 0's page_id (always 0) or EOF where the version lives */
+    if (!pread_full(hf->fd, &hf->header.version, sizeof(int32_t), LEGACY_FILE_HEADER_SIZE) ||
+        hf->header.version == 0) {
+        hf->header.version = GRAIN_FORMAT_LEGACY;
+    } else if (hf->header.version == 3 &&
+               !pread_full(hf->fd, &hf->header, V3_FILE_HEADER_SIZE, 0)) {
+        return NULL;
+    } else if (hf->header.version > 3 &&
+               !pread_full(hf->fd, &hf->header, sizeof(FileHeader), 0)) {
         return NULL;
     }
     return &hf->header;
@@ -17,276 +55,3036 @@ static FileHeader *read_file_header(HeapFile *hf) {
 
 GrainResult write_file_header(HeapFile *hf) {
     CHECK_RET_GRAIN_NULL(hf);
-    if (fseek(hf->file_ptr, 0, SEEK_SET) != 0) {
-        return GRAIN_FILE_SEEK_FAILED;
-    }
-    if (fwrite(&hf->header, sizeof(FileHeader), 1, hf->file_ptr) != 1) {
+    if (!pwrite_full(hf->fd, &hf->header, sizeof(FileHeader), 0)) {
         return GRAIN_FILE_WRITE_FAILED;
     }
-    fflush(hf->file_ptr);
+    hf->header_dirty = false;
     return GRAIN_OK;
 }
 
-GrainResult read_page(HeapFile *hf, HeapPage *hp, int32_t page_id) {
-    CHECK_RET_GRAIN_NULL(hf);
-    CHECK_RET_GRAIN_NULL(hp);
-    if (page_id < 0 || page_id >= hf->header.num_pages) {
-        return GRAIN_INVALID_PAGE_ID;
-    }
-    long offset = sizeof(FileHeader) + ((long)page_id * PAGE_SIZE);
-    if (fseek(hf->file_ptr, offset, SEEK_SET) != 0) {
-        return GRAIN_FILE_SEEK_FAILED;
+/* a compressed file finds its pages through the directory, every other file at a fixed offset */
+static GrainResult load_page(HeapFile *hf, int32_t page_id, void *buf) {
+    if (hf->page_dir != NULL) {
+        return pagedir_read(hf->page_dir, page_id, buf);
     }
-    if (fread(hp, PAGE_SIZE, 1, hf->file_ptr) != 1) {
+    if (!pread_full(hf->page_fd, buf, PAGE_SIZE, page_offset(page_id))) {
         return GRAIN_FILE_READ_FAILED;
     }
     return GRAIN_OK;
 }
 
-GrainResult write_page(HeapFile *hf, HeapPage *hp) {
-    CHECK_RET_GRAIN_NULL(hf);
-    CHECK_RET_GRAIN_NULL(hp);
-    long offset = sizeof(FileHeader) + ((long)hp->header.page_id * PAGE_SIZE);
-    if (fseek(hf->file_ptr, offset, SEEK_SET) != 0) {
-        return GRAIN_FILE_SEEK_FAILED;
+/* other threads may still be reading the frame, so the checksum goes on a copy */
+static GrainResult store_page(HeapFile *hf, int32_t page_id, const void *buf) {
+    HeapPage page __attribute__((aligned(DIRECT_IO_ALIGN)));
+    memcpy(&page, buf, PAGE_SIZE);
+    stamp_page(&page);
+    if (hf->page_dir != NULL) {
+        return pagedir_write(hf->page_dir, page_id, &page);
     }
-    if (fwrite(hp, PAGE_SIZE, 1, hf->file_ptr) != 1) {
+    if (!pwrite_full(hf->page_fd, &page, PAGE_SIZE, page_offset(page_id))) {
         return GRAIN_FILE_WRITE_FAILED;
     }
-    fflush(hf->file_ptr);
     return GRAIN_OK;
 }
 
-HeapFile *create_file(const char *filename) {
-    CHECK_RET_NULL(filename);
-    FILE *file_ptr = fopen(filename, "wb+");
-    CHECK_RET_NULL(file_ptr);
+static GrainResult load_checked_page(HeapFile *hf, int32_t page_id, HeapPage *page) {
+    GrainResult res = load_page(hf, page_id, page);
+    if (res == GRAIN_OK && !verify_page(page)) {
+        res = GRAIN_CORRUPT_PAGE;
+    }
+    return res;
+}
 
-    HeapFile *heap_file = (HeapFile *)malloc(sizeof(HeapFile));
-    if (heap_file == NULL) {
-        fclose(file_ptr);
-        return NULL;
+/* a page the vacuum just released may still be asked for by a pin that checked the count before it dropped */
+static GrainResult disk_read_page(void *ctx, int32_t page_id, void *buf) {
+    HeapFile *hf = (HeapFile *)ctx;
+    if (page_id >= page_count(hf)) {
+        return GRAIN_INVALID_PAGE_ID;
     }
+    return load_checked_page(hf, page_id, (HeapPage *)buf);
+}
 
-    heap_file->file_ptr = file_ptr;
-    heap_file->header.num_pages = 0;
-    heap_file->header.next_page_idx = 0;
-    heap_file->header.first_free_page = -1;
+static GrainResult disk_write_page(void *ctx, int32_t page_id, const void *buf) {
+    HeapFile *hf = (HeapFile *)ctx;
+    if (hf->wal != NULL) {
+        /* write-ahead rule: the log must be durable up to the page's last change first */
+        GrainResult res = wal_commit(hf->wal, ((const HeapPage *)buf)->header.lsn);
+        if (res != GRAIN_OK) {
+            return res;
+        }
+    }
+    return store_page(hf, page_id, buf);
+}
 
-    if (write_file_header(heap_file) != GRAIN_OK) {
-        fclose(file_ptr);
-        free(heap_file);
-        return NULL;
+/* the pool's run reader: one preadv for the whole extent, then the pages are checked in order */
+static GrainResult disk_read_pages(void *ctx, int32_t first_page_id, void *const *bufs, int32_t count,
+                                   int32_t *num_read) {
+    HeapFile *hf = (HeapFile *)ctx;
+    int32_t avail = page_count(hf) - first_page_id;
+    count = (count < avail) ? count : avail;
+    *num_read = 0;
+    if (hf->page_dir != NULL) {
+        /* compressed pages are wherever their frame is, so they still come one at a time */
+        while (*num_read < count &&
+               load_checked_page(hf, first_page_id + *num_read, (HeapPage *)bufs[*num_read]) == GRAIN_OK) {
+            (*num_read)++;
+        }
+        return GRAIN_OK;
+    }
+    if (count <= 0) {
+        return GRAIN_OK;
     }
 
-    return heap_file;
+    struct iovec iov[BP_READ_AHEAD_PAGES];
+    for (int32_t i = 0; i < count; i++) {
+        iov[i].iov_base = bufs[i];
+        iov[i].iov_len = PAGE_SIZE;
+    }
+    /* a signal is retried, as in pread_full; a short read is fine here */
+    ssize_t n;
+    do {
+        n = preadv(hf->page_fd, iov, count, page_offset(first_page_id));
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        return GRAIN_FILE_READ_FAILED;
+    }
+    /* a short read just makes the run shorter; the pages behind it are read when they're needed */
+    int32_t full = (int32_t)(n / PAGE_SIZE);
+    while (*num_read < full && verify_page((HeapPage *)bufs[*num_read])) {
+        (*num_read)++;
+    }
+    return GRAIN_OK;
 }
 
-static bool validate_header(FileHeader *header) {
-    if (header->num_pages < 0) return false;
-    if (header->next_page_idx < 0) return false;
-    if (header->first_free_page < -1) return false;
-    if (header->next_page_idx < header->num_pages) return false;
-    return true;
+/* waits for everything on the queue; a request that came back short fails the lot */
+static GrainResult drain_queue(AioQueue *q, GrainResult short_res) {
+    AioCompletion done[AIO_QUEUE_DEPTH];
+    GrainResult res = GRAIN_OK;
+    while (aio_outstanding(q) > 0) {
+        int32_t count;
+        GrainResult wait_res = aio_wait(q, done, AIO_QUEUE_DEPTH, &count);
+        if (wait_res != GRAIN_OK) {
+            return wait_res;
+        }
+        for (int32_t i = 0; i < count; i++) {
+            if (done[i].res != PAGE_SIZE) {
+                res = short_res;
+            }
+        }
+    }
+    return res;
 }
 
-HeapFile *open_file(const char *filename) {
-    CHECK_RET_NULL(filename);
-    FILE *file_ptr = fopen(filename, "rb+");
-    CHECK_RET_NULL(file_ptr);
+/* background read-ahead has a queue of its own, so a batch of writes never waits on it */
+static GrainResult disk_start_pages(void *ctx, int32_t first_page_id, void *const *bufs, int32_t count) {
+    HeapFile *hf = (HeapFile *)ctx;
+    int32_t avail = page_count(hf) - first_page_id;
+    count = (count < avail) ? count : avail;
+    GrainResult res = GRAIN_OK;
+    for (int32_t i = 0; i < count && res == GRAIN_OK; i++) {
+        res = aio_prep_read(hf->prefetch, hf->page_fd, bufs[i], PAGE_SIZE,
+                            page_offset(first_page_id + i), (uint64_t)i);
+    }
+    if (res == GRAIN_OK) {
+        res = aio_submit(hf->prefetch);
+    }
+    if (res != GRAIN_OK) {
+        /* the pool takes the frames back on an error, so nothing may still be reading into them */
+        drain_queue(hf->prefetch, GRAIN_FILE_READ_FAILED);
+    }
+    return res;
+}
 
-    HeapFile *heap_file = (HeapFile *)malloc(sizeof(HeapFile));
-    if (heap_file == NULL) {
-        fclose(file_ptr);
-        return NULL;
+static GrainResult disk_finish_pages(void *ctx, void *const *bufs, int32_t count, int32_t *num_read) {
+    HeapFile *hf = (HeapFile *)ctx;
+    bool ok[BP_READ_AHEAD_PAGES] = {false};
+    AioCompletion done[AIO_QUEUE_DEPTH];
+    while (aio_outstanding(hf->prefetch) > 0) {
+        int32_t n;
+        GrainResult res = aio_wait(hf->prefetch, done, AIO_QUEUE_DEPTH, &n);
+        if (res != GRAIN_OK) {
+            return res;
+        }
+        for (int32_t i = 0; i < n; i++) {
+            ok[done[i].tag] = done[i].res == PAGE_SIZE;
+        }
+    }
+    *num_read = 0;
+    while (*num_read < count && ok[*num_read] && verify_page((HeapPage *)bufs[*num_read])) {
+        (*num_read)++;
     }
+    return GRAIN_OK;
+}
 
-    heap_file->file_ptr = file_ptr;
-    if (fread(&heap_file->header, sizeof(FileHeader), 1, file_ptr) != 1) {
-        fclose(file_ptr);
-        free(heap_file);
-        return NULL;
+/*
+ * the pool's batch writer, called with bp->lock held, which is also what keeps
+ * hf->aio to one thread. one log sync covers the whole batch, then the pages
+ * go out a queue's depth at a time.
+ */
+static GrainResult disk_write_pages(void *ctx, const int32_t *page_ids, const void *const *bufs,
+                                    int32_t count) {
+    HeapFile *hf = (HeapFile *)ctx;
+    if (hf->page_dir != NULL) {
+        /* compressed frames move about as they change size, so they stay one at a time */
+        for (int32_t i = 0; i < count; i++) {
+            GrainResult res = disk_write_page(hf, page_ids[i], bufs[i]);
+            if (res != GRAIN_OK) {
+                return res;
+            }
+        }
+        return GRAIN_OK;
     }
 
-    if (!validate_header(&heap_file->header)) {
-        fclose(file_ptr);
-        free(heap_file);
-        return NULL;
+    if (hf->wal != NULL) {
+        uint64_t lsn = 0;
+        for (int32_t i = 0; i < count; i++) {
+            uint64_t page_lsn = ((const HeapPage *)bufs[i])->header.lsn;
+            lsn = (page_lsn > lsn) ? page_lsn : lsn;
+        }
+        GrainResult res = wal_commit(hf->wal, lsn);
+        if (res != GRAIN_OK) {
+            return res;
+        }
     }
 
-    return heap_file;
+    GrainResult res = GRAIN_OK;
+    for (int32_t first = 0; first < count && res == GRAIN_OK; first += AIO_QUEUE_DEPTH) {
+        int32_t n = (count - first < AIO_QUEUE_DEPTH) ? count - first : AIO_QUEUE_DEPTH;
+        for (int32_t i = 0; i < n && res == GRAIN_OK; i++) {
+            HeapPage *page = &hf->aio_pages[i];
+            memcpy(page, bufs[first + i], PAGE_SIZE);
+            stamp_page(page);
+            res = aio_prep_write(hf->aio, hf->page_fd, page, PAGE_SIZE, page_offset(page_ids[first + i]), i);
+        }
+        /* a page that couldn't be queued is a lost write, so it fails the batch even if the rest went out */
+        GrainResult drain_res = drain_queue(hf->aio, GRAIN_FILE_WRITE_FAILED);
+        res = (res != GRAIN_OK) ? res : drain_res;
+    }
+    return res;
 }
 
-GrainResult close_file(HeapFile *hf) {
-    CHECK_RET_GRAIN_NULL(hf);
-    if (hf->file_ptr != NULL) {
-        fclose(hf->file_ptr);
-        hf->file_ptr = NULL;
+static inline size_t round_up_to_chunk(size_t len) {
+    size_t chunk = (size_t)MMAP_GROW_PAGES * PAGE_SIZE;
+    return ((len + chunk - 1) / chunk) * chunk;
+}
+
+/*
+ * mmap mode reserves a large PROT_NONE range up front and maps the file over
+ * its prefix, so growing the file never moves pages callers have pinned.
+ */
+static GrainResult reserve_mapping(HeapFile *hf, size_t reserve) {
+    void *base = mmap(NULL, reserve, PROT_NONE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) {
+        return GRAIN_FILE_OPEN_FAILED;
     }
-    free(hf);
+    hf->map = base;
+    hf->map_reserved = reserve;
+    hf->map_len = 0;
     return GRAIN_OK;
 }
 
-GrainResult hf_alloc_page(HeapFile *hf, int32_t *page_id) {
-    CHECK_RET_GRAIN_NULL(hf);
-    CHECK_RET_GRAIN_NULL(page_id);
-
-    int32_t new_page_id = hf->header.next_page_idx;
-    hf->header.next_page_idx++;
+static GrainResult grow_mapping(HeapFile *hf, size_t needed) {
+    if (needed <= hf->map_len) {
+        return GRAIN_OK;
+    }
 
-    HeapPage heap_page;
-    init_page(&heap_page, new_page_id);
+    size_t new_len = round_up_to_chunk(needed);
+    if (new_len > hf->map_reserved) {
+        if (__atomic_load_n(&hf->map_pins, __ATOMIC_ACQUIRE) > 0) {
+            return GRAIN_NO_FREE_FRAME;
+        }
+        char *old_map = hf->map;
+        size_t old_reserved = hf->map_reserved;
+        GrainResult res = reserve_mapping(hf, new_len * 2);
+        if (res != GRAIN_OK) {
+            return res;
+        }
+        munmap(old_map, old_reserved);
+    }
 
-    heap_page.header.next_free_page = hf->header.first_free_page;
-    hf->header.first_free_page = new_page_id;
+    struct stat st;
+    if (fstat(hf->fd, &st) != 0) {
+        return GRAIN_FILE_READ_FAILED;
+    }
+    /* real blocks for the whole chunk, so a full disk fails here and not as a SIGBUS on some later store */
+    if ((size_t)st.st_size < new_len &&
+        posix_fallocate(hf->fd, st.st_size, (off_t)new_len - st.st_size) != 0) {
+        return GRAIN_FILE_WRITE_FAILED;
+    }
 
-    GrainResult res = write_page(hf, &heap_page);
-    if (res != GRAIN_OK) {
-        return res;
+    void *tail = mmap(hf->map + hf->map_len, new_len - hf->map_len,
+                      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+                      hf->fd, (off_t)hf->map_len);
+    if (tail == MAP_FAILED) {
+        return GRAIN_FILE_READ_FAILED;
     }
+    hf->map_len = new_len;
+    return GRAIN_OK;
+}
 
-    hf->header.num_pages++;
+static GrainResult map_file(HeapFile *hf) {
+    size_t needed = (size_t)page_offset(hf->header.num_pages);
+    size_t reserve = MMAP_RESERVE_BYTES;
+    if (reserve < needed * 2) {
+        reserve = round_up_to_chunk(needed * 2);
+    }
 
-    res = write_file_header(hf);
+    GrainResult res = reserve_mapping(hf, reserve);
     if (res != GRAIN_OK) {
         return res;
     }
+    return grow_mapping(hf, needed > 0 ? needed : 1);
+}
 
-    *page_id = new_page_id;
+static GrainResult unmap_file(HeapFile *hf) {
+    if (hf->map == NULL) {
+        return GRAIN_OK;
+    }
+    munmap(hf->map, hf->map_reserved);
+    hf->map = NULL;
+    hf->map_len = 0;
+
+    /* drop the unused tail of the last chunk so the file matches buffered mode */
+    if (ftruncate(hf->fd, page_offset(hf->header.num_pages)) != 0) {
+        return GRAIN_FILE_WRITE_FAILED;
+    }
     return GRAIN_OK;
 }
 
-GrainResult hf_insert_record(HeapFile *hf, Record *rec) {
-    CHECK_RET_GRAIN_NULL(hf);
-    CHECK_RET_GRAIN_NULL(rec);
+static bool file_covers_pages(int fd, int32_t num_pages) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) return false;
+    return st.st_size >= page_offset(num_pages);
+}
 
+typedef enum {
+    LOG_PAGE_IMAGE = 1,
+    LOG_SLOT       = 2
+} LogRecordType;
+
+/*
+ * the file header as version 3 laid it out, so a log left behind by a
+ * version 3 file still replays after the upgrade. the layout never changes
+ * after create and isn't logged.
+ */
+typedef struct {
+    int32_t num_pages;
+    int32_t next_page_idx;
+    int32_t first_free_page;
+    int32_t version;
+    uint64_t checkpoint_lsn;
+} LoggedFileHeader;
+
+/* followed by the whole page (LOG_PAGE_IMAGE) or the page header and one slot (LOG_SLOT) */
+typedef struct {
+    int32_t type;
     int32_t page_id;
-    HeapPage page;
+    int32_t slot_idx;
+    int32_t has_file_header;
+    LoggedFileHeader file_header;
+} LogRecord;
 
-    if (hf->header.first_free_page != -1) {
-        page_id = hf->header.first_free_page;
-        GrainResult res = read_page(hf, &page, page_id);
-        if (res != GRAIN_OK) {
-            return res;
-        }
+#define LOG_SLOT_BODY_SIZE (sizeof(PageHeader) + RECORD_SIZE)
+
+/*
+ * the first change to a page after a checkpoint logs the whole page, so redo
+ * never has to trust a page that may have been torn mid-write. later changes
+ * only log the page header and the slot they touched.
+ */
+static GrainResult log_page(HeapFile *hf, HeapPage *page, int32_t slot_idx, bool with_header) {
+    if (hf->wal == NULL) {
+        return GRAIN_OK;
+    }
+
+    char entry[sizeof(LogRecord) + PAGE_SIZE];
+    LogRecord rec;
+    memset(&rec, 0, sizeof(rec));
+    bool image = slot_idx < 0 || page->header.lsn <= hf->wal->base_lsn;
+    rec.type = image ? LOG_PAGE_IMAGE : LOG_SLOT;
+    rec.page_id = page->header.page_id;
+    rec.slot_idx = slot_idx;
+    rec.has_file_header = with_header;
+    if (with_header) {
+        rec.file_header.num_pages = hf->header.num_pages;
+        rec.file_header.next_page_idx = hf->header.next_page_idx;
+        rec.file_header.first_free_page = hf->header.first_free_page;
+        rec.file_header.version = hf->header.version;
+        rec.file_header.checkpoint_lsn = hf->header.checkpoint_lsn;
+    }
+    memcpy(entry, &rec, sizeof(rec));
+
+    char *body = entry + sizeof(LogRecord);
+    size_t body_len;
+    if (image) {
+        memcpy(body, page, PAGE_SIZE);
+        body_len = PAGE_SIZE;
     } else {
-        GrainResult res = hf_alloc_page(hf, &page_id);
-        if (res != GRAIN_OK) {
-            return res;
-        }
-        res = read_page(hf, &page, page_id);
-        if (res != GRAIN_OK) {
-            return res;
-        }
+        memcpy(body, &page->header, sizeof(PageHeader));
+        Record slot;
+        read_slot(page, slot_idx, &slot);
+        memcpy(body + sizeof(PageHeader), &slot, RECORD_SIZE);
+        body_len = LOG_SLOT_BODY_SIZE;
+    }
+
+    uint64_t lsn;
+    GrainResult res = wal_append(hf->wal, entry, (uint32_t)(sizeof(LogRecord) + body_len), &lsn);
+    if (res != GRAIN_OK) {
+        return res;
+    }
+    page->header.lsn = lsn;
+    return GRAIN_OK;
+}
+
+/* logs a change to a pinned page, then releases it dirty */
+static GrainResult unpin_logged(HeapFile *hf, HeapPage *page, int32_t slot_idx, bool with_header) {
+    int32_t page_id = page->header.page_id;
+    GrainResult res = log_page(hf, page, slot_idx, with_header);
+    GrainResult unpin_res = hf_unpin_page(hf, page_id, true);
+    return (res != GRAIN_OK) ? res : unpin_res;
+}
+
+/* redo applies after-images straight to the file, before any pool or mapping exists */
+static GrainResult redo_record(void *ctx, uint64_t lsn, const void *data, uint32_t len) {
+    HeapFile *hf = (HeapFile *)ctx;
+    if (len < sizeof(LogRecord)) {
+        return GRAIN_CORRUPT_HEADER;
     }
 
-    int32_t slot = insert_record(&page, rec);
-    if (slot == -1) {
-        return GRAIN_PAGE_FULL;
+    LogRecord rec;
+    memcpy(&rec, data, sizeof(rec));
+    const char *body = (const char *)data + sizeof(LogRecord);
+    if (rec.page_id < 0) {
+        return GRAIN_CORRUPT_HEADER;
+    }
+    if (rec.has_file_header) {
+        hf->header.num_pages = rec.file_header.num_pages;
+        hf->header.next_page_idx = rec.file_header.next_page_idx;
+        hf->header.first_free_page = rec.file_header.first_free_page;
     }
 
-    if (!has_free_space(&page)) {
-        hf->header.first_free_page = page.header.next_free_page;
-        page.header.next_free_page = -1;
-        GrainResult res = write_file_header(hf);
+    HeapPage page __attribute__((aligned(DIRECT_IO_ALIGN)));
+    if (rec.type == LOG_PAGE_IMAGE && len == sizeof(LogRecord) + PAGE_SIZE) {
+        memcpy(&page, body, PAGE_SIZE);
+    } else if (rec.type == LOG_SLOT && len == sizeof(LogRecord) + LOG_SLOT_BODY_SIZE &&
+               rec.slot_idx >= 0 && rec.slot_idx < (int32_t)MAX_SLOTS) {
+        GrainResult res = load_checked_page(hf, rec.page_id, &page);
         if (res != GRAIN_OK) {
             return res;
         }
+        if (page.header.lsn >= lsn) {
+            return GRAIN_OK;
+        }
+        Record slot;
+        memcpy(&page.header, body, sizeof(PageHeader));
+        memcpy(&slot, body + sizeof(PageHeader), RECORD_SIZE);
+        write_slot(&page, rec.slot_idx, &slot);
+    } else {
+        return GRAIN_CORRUPT_HEADER;
     }
 
-    GrainResult res = write_page(hf, &page);
+    page.header.lsn = lsn;
+    return store_page(hf, rec.page_id, &page);
+}
+
+/* once every logged change is in the heap file and synced, the log can start over */
+static GrainResult checkpoint(HeapFile *hf, Wal *wal) {
+    hf->header.checkpoint_lsn = wal_next_lsn(wal);
+    GrainResult res = write_file_header(hf);
     if (res != GRAIN_OK) {
         return res;
     }
+    if (fsync(hf->fd) != 0) {
+        return GRAIN_FILE_WRITE_FAILED;
+    }
+    return wal_truncate(wal);
+}
 
-    return GRAIN_OK;
+static inline pthread_rwlock_t *page_latch(HeapFile *hf, int32_t page_id) {
+    return &hf->page_latches[(uint32_t)page_id % PAGE_LATCH_STRIPES];
 }
 
-GrainResult hf_scan_next(HeapFile *hf, RecordId *rid, Record *rec) {
-    CHECK_RET_GRAIN_NULL(hf);
-    CHECK_RET_GRAIN_NULL(rid);
-    CHECK_RET_GRAIN_NULL(rec);
+/* every change holds the flush latch shared, so hf_flush never sees one half done */
+static inline void begin_change(HeapFile *hf) {
+    pthread_rwlock_rdlock(&hf->flush_latch);
+}
 
-    HeapPage page;
-    int32_t currPage = rid->page_id;
-    int32_t nextSlot = rid->slot_idx + 1;
+static inline void end_change(HeapFile *hf) {
+    pthread_rwlock_unlock(&hf->flush_latch);
+}
+
+/* the fsm is the source of truth for room; first_free_page just mirrors its lowest page */
+static void sync_first_free_page(HeapFile *hf) {
+    int32_t first = fsm_find(hf->fsm);
+    if (first != hf->header.first_free_page) {
+        hf->header.first_free_page = first;
+        hf->header_dirty = true;
+    }
+}
+
+static GrainResult note_free_space_locked(HeapFile *hf, HeapPage *page) {
+    if (hf->fsm == NULL) {
+        return GRAIN_OK;
+    }
+    GrainResult res = fsm_set(hf->fsm, page->header.page_id, (int32_t)MAX_SLOTS - page->header.num_slots);
+    if (res != GRAIN_OK) {
+        return res;
+    }
+    sync_first_free_page(hf);
+    return GRAIN_OK;
+}
+
+static GrainResult note_free_space(HeapFile *hf, HeapPage *page) {
+    pthread_mutex_lock(&hf->header_latch);
+    GrainResult res = note_free_space_locked(hf, page);
+    pthread_mutex_unlock(&hf->header_latch);
+    return res;
+}
 
-    while (currPage < hf->header.num_pages) {
-        GrainResult res = read_page(hf, &page, currPage);
+/*
+ * zones only ever widen before a page changes, so a zone on disk is never
+ * narrower than the page it describes. tightening after a delete can be lost.
+ */
+static GrainResult zone_widen_locked(HeapFile *hf, int32_t page_id, const Record *recs, int32_t count) {
+    if (hf->zone_map == NULL) {
+        return GRAIN_OK;
+    }
+    for (int32_t i = 0; i < count; i++) {
+        GrainResult res = zonemap_widen(hf->zone_map, page_id, &recs[i]);
         if (res != GRAIN_OK) {
             return res;
         }
+    }
+    return GRAIN_OK;
+}
 
-        while (nextSlot < page.header.next_slot_idx) {
-            Record *found = get_record(&page, nextSlot);
-            if (found != NULL) {
-                *rec = *found;
-                rid->page_id = currPage;
-                rid->slot_idx = nextSlot;
-                return GRAIN_OK;
-            }
-            nextSlot++;
-        }
+static GrainResult zone_widen(HeapFile *hf, int32_t page_id, const Record *recs, int32_t count) {
+    if (hf->zone_map == NULL) {
+        return GRAIN_OK;
+    }
+    pthread_mutex_lock(&hf->header_latch);
+    GrainResult res = zone_widen_locked(hf, page_id, recs, count);
+    pthread_mutex_unlock(&hf->header_latch);
+    return res;
+}
 
-        currPage++;
-        nextSlot = 0;
+static GrainResult zone_track(HeapFile *hf, HeapPage *page) {
+    if (hf->zone_map == NULL) {
+        return GRAIN_OK;
     }
+    pthread_mutex_lock(&hf->header_latch);
+    GrainResult res = zonemap_track_page(hf->zone_map, page);
+    pthread_mutex_unlock(&hf->header_latch);
+    return res;
+}
 
-    return GRAIN_END;
+static bool zone_may_match(HeapFile *hf, int32_t page_id, const Predicate *pred) {
+    pthread_mutex_lock(&hf->header_latch);
+    bool match = zonemap_may_match(hf->zone_map, page_id, pred);
+    pthread_mutex_unlock(&hf->header_latch);
+    return match;
 }
 
-GrainResult hf_update_record(HeapFile *hf, RecordId rid, Record *rec) {
+GrainResult hf_pin_page(HeapFile *hf, int32_t page_id, HeapPage **page) {
     CHECK_RET_GRAIN_NULL(hf);
-    CHECK_RET_GRAIN_NULL(rec);
+    CHECK_RET_GRAIN_NULL(page);
+    if (page_id < 0 || page_id >= page_count(hf)) {
+        return GRAIN_INVALID_PAGE_ID;
+    }
+    if (hf->map != NULL) {
+        *page = (HeapPage *)(hf->map + page_offset(page_id));
+        __atomic_add_fetch(&hf->map_pins, 1, __ATOMIC_ACQ_REL);
+        return GRAIN_OK;
+    }
+    return bp_pin_page(&hf->pool, page_id, (void **)page);
+}
 
-    HeapPage page;
-    GrainResult res = read_page(hf, &page, rid.page_id);
-    if (res != GRAIN_OK) {
-        return res;
+GrainResult hf_unpin_page(HeapFile *hf, int32_t page_id, bool dirty) {
+    CHECK_RET_GRAIN_NULL(hf);
+    if (hf->map != NULL) {
+        if (page_id < 0 || page_id >= page_count(hf) ||
+            __atomic_load_n(&hf->map_pins, __ATOMIC_ACQUIRE) == 0) {
+            return GRAIN_INVALID_PAGE_ID;
+        }
+        __atomic_sub_fetch(&hf->map_pins, 1, __ATOMIC_ACQ_REL);
+        return GRAIN_OK;
     }
+    return bp_unpin_page(&hf->pool, page_id, dirty);
+}
 
-    res = update_record(&page, rid.slot_idx, rec);
-    if (res != GRAIN_OK) {
-        return res;
+/* a pin keeps the page in memory, a latch keeps other threads out of its contents */
+GrainResult hf_latch_page(HeapFile *hf, int32_t page_id, bool exclusive) {
+    CHECK_RET_GRAIN_NULL(hf);
+    if (page_id < 0) {
+        return GRAIN_INVALID_PAGE_ID;
+    }
+    pthread_rwlock_t *latch = page_latch(hf, page_id);
+    int rc = exclusive ? pthread_rwlock_wrlock(latch) : pthread_rwlock_rdlock(latch);
+    return (rc == 0) ? GRAIN_OK : GRAIN_INVALID_PAGE_ID;
+}
+
+GrainResult hf_unlatch_page(HeapFile *hf, int32_t page_id) {
+    CHECK_RET_GRAIN_NULL(hf);
+    if (page_id < 0) {
+        return GRAIN_INVALID_PAGE_ID;
     }
+    return (pthread_rwlock_unlock(page_latch(hf, page_id)) == 0) ? GRAIN_OK : GRAIN_INVALID_PAGE_ID;
+}
 
-    res = write_page(hf, &page);
+/* pins a page, then latches it */
+static GrainResult pin_latched(HeapFile *hf, int32_t page_id, bool exclusive, HeapPage **page) {
+    GrainResult res = hf_pin_page(hf, page_id, page);
     if (res != GRAIN_OK) {
         return res;
     }
-
+    hf_latch_page(hf, page_id, exclusive);
     return GRAIN_OK;
 }
 
-GrainResult hf_delete_record(HeapFile *hf, RecordId rid) {
+static GrainResult unpin_latched(HeapFile *hf, int32_t page_id, bool dirty) {
+    hf_unlatch_page(hf, page_id);
+    return hf_unpin_page(hf, page_id, dirty);
+}
+
+/* logs a change to an exclusively latched page, then releases the latch and the pin */
+static GrainResult release_logged(HeapFile *hf, HeapPage *page, int32_t slot_idx, bool with_header) {
+    int32_t page_id = page->header.page_id;
+    GrainResult res = log_page(hf, page, slot_idx, with_header);
+    GrainResult unpin_res = unpin_latched(hf, page_id, true);
+    return (res != GRAIN_OK) ? res : unpin_res;
+}
+
+GrainResult read_page(HeapFile *hf, HeapPage *hp, int32_t page_id) {
     CHECK_RET_GRAIN_NULL(hf);
+    CHECK_RET_GRAIN_NULL(hp);
 
-    HeapPage page;
-    GrainResult res = read_page(hf, &page, rid.page_id);
+    HeapPage *frame;
+    GrainResult res = pin_latched(hf, page_id, false, &frame);
     if (res != GRAIN_OK) {
         return res;
     }
+    memcpy(hp, frame, PAGE_SIZE);
+    return unpin_latched(hf, page_id, false);
+}
+
+GrainResult write_page(HeapFile *hf, HeapPage *hp) {
+    CHECK_RET_GRAIN_NULL(hf);
+    CHECK_RET_GRAIN_NULL(hp);
 
-    bool was_full = !has_free_space(&page);
+    int32_t page_id = hp->header.page_id;
+    begin_change(hf);
+    GrainResult res = zone_track(hf, hp);
+    if (res != GRAIN_OK) {
+        end_change(hf);
+        return res;
+    }
 
-    res = delete_record(&page, rid.slot_idx);
+    HeapPage *frame;
+    res = (hf->map != NULL)
+        ? hf_pin_page(hf, page_id, &frame)
+        : bp_pin_new_page(&hf->pool, page_id, (void **)&frame);
     if (res != GRAIN_OK) {
+        end_change(hf);
         return res;
     }
+    hf_latch_page(hf, page_id, true);
+    memcpy(frame, hp, PAGE_SIZE);
+    res = note_free_space(hf, frame);
+    GrainResult unpin_res = release_logged(hf, frame, -1, false);
+    end_change(hf);
+    return (res != GRAIN_OK) ? res : unpin_res;
+}
 
-    if (was_full) {
-        page.header.next_free_page = hf->header.first_free_page;
-        hf->header.first_free_page = rid.page_id;
-        res = write_file_header(hf);
+/*
+ * gives back the blocks reserved past the last page. filesystems disagree on
+ * which call frees blocks kept past the end: xfs wants them punched out, ext4
+ * ignores a punch there and drops them on a truncate to the same size. so both.
+ */
+static GrainResult release_space(HeapFile *hf, int32_t num_pages) {
+    if (hf->alloc_pages <= num_pages) {
+        return GRAIN_OK;
+    }
+    struct stat st;
+    if (fallocate(hf->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, page_offset(num_pages),
+                  (off_t)(hf->alloc_pages - num_pages) * PAGE_SIZE) != 0 &&
+        errno != EOPNOTSUPP && errno != ENOSYS) {
+        return GRAIN_FILE_WRITE_FAILED;
+    }
+    if (fstat(hf->fd, &st) != 0 || ftruncate(hf->fd, st.st_size) != 0) {
+        return GRAIN_FILE_WRITE_FAILED;
+    }
+    hf->alloc_pages = num_pages;
+    return GRAIN_OK;
+}
+
+/* drops pages a vacuum released, once the header that no longer counts them is on disk */
+static GrainResult trim_file(HeapFile *hf) {
+    struct stat st;
+    off_t end = page_offset(hf->header.num_pages);
+    if (hf->page_dir != NULL) {
+        /* only frames behind the last one still in use can go; holes further in stay */
+        GrainResult res = pagedir_truncate(hf->page_dir, hf->header.num_pages);
         if (res != GRAIN_OK) {
             return res;
         }
+        end = hf->page_dir->header.data_end;
+    }
+    if (fstat(hf->fd, &st) != 0) {
+        return GRAIN_FILE_READ_FAILED;
     }
+    if (st.st_size <= end) {
+        return GRAIN_OK;
+    }
+    if (fsync(hf->fd) != 0 || ftruncate(hf->fd, end) != 0) {
+        return GRAIN_FILE_WRITE_FAILED;
+    }
+    return release_space(hf, hf->header.num_pages);
+}
+
+static GrainResult flush_indexes(HeapFile *hf) {
+    GrainResult res = GRAIN_OK;
+    pthread_mutex_lock(&hf->index_latch);
+    if (hf->id_index != NULL) {
+        res = btree_flush(hf->id_index);
+    }
+    if (res == GRAIN_OK && hf->age_index != NULL) {
+        res = btree_flush(hf->age_index);
+    }
+    if (res == GRAIN_OK && hf->hash_index != NULL) {
+        res = hash_flush(hf->hash_index);
+    }
+    if (res == GRAIN_OK && hf->id_filter != NULL) {
+        res = bloom_flush(hf->id_filter);
+    }
+    pthread_mutex_unlock(&hf->index_latch);
+    return res;
+}
 
-    res = write_page(hf, &page);
+static GrainResult flush_sidecars(HeapFile *hf) {
+    if (hf->page_dir != NULL) {
+        GrainResult res = pagedir_flush(hf->page_dir);
+        if (res != GRAIN_OK) {
+            return res;
+        }
+    }
+    GrainResult res = flush_indexes(hf);
     if (res != GRAIN_OK) {
         return res;
     }
-
-    return GRAIN_OK;
+    if (hf->zone_map != NULL) {
+        GrainResult res = zonemap_flush(hf->zone_map);
+        if (res != GRAIN_OK) {
+            return res;
+        }
+    }
+    if (hf->fsm != NULL) {
+        GrainResult res = fsm_flush(hf->fsm);
+        if (res != GRAIN_OK) {
+            return res;
+        }
+    }
+    return GRAIN_OK;
+}
+
+/*
+ * nothing sees a mapped page go to disk, so its checksum can only be brought up
+ * to date here, with changes held off. mapped pages aren't verified either.
+ */
+static void stamp_mapped_pages(HeapFile *hf) {
+    for (int32_t page_id = 0; page_id < hf->header.num_pages; page_id++) {
+        stamp_page((HeapPage *)(hf->map + page_offset(page_id)));
+    }
+}
+
+/* waits for changes in flight to finish and holds new ones off until everything is on disk */
+GrainResult hf_flush(HeapFile *hf) {
+    CHECK_RET_GRAIN_NULL(hf);
+    pthread_rwlock_wrlock(&hf->flush_latch);
+
+    GrainResult res = GRAIN_OK;
+    if (hf->map != NULL) {
+        stamp_mapped_pages(hf);
+        if (msync(hf->map, hf->map_len, MS_SYNC) != 0) {
+            res = GRAIN_FILE_WRITE_FAILED;
+        }
+    } else {
+        res = bp_flush_all(&hf->pool);
+    }
+
+    pthread_mutex_lock(&hf->header_latch);
+    if (res == GRAIN_OK) {
+        res = flush_sidecars(hf);
+    }
+    if (res == GRAIN_OK && hf->wal != NULL) {
+        res = checkpoint(hf, hf->wal);
+    } else if (res == GRAIN_OK && hf->header_dirty) {
+        res = write_file_header(hf);
+    }
+    /* in mmap mode the tail goes when the file is unmapped */
+    if (res == GRAIN_OK && hf->map == NULL) {
+        res = trim_file(hf);
+    }
+    pthread_mutex_unlock(&hf->header_latch);
+
+    pthread_rwlock_unlock(&hf->flush_latch);
+    return res;
+}
+
+GrainResult hf_commit(HeapFile *hf) {
+    CHECK_RET_GRAIN_NULL(hf);
+    if (hf->wal == NULL) {
+        return hf_flush(hf);
+    }
+    return wal_commit(hf->wal, wal_next_lsn(hf->wal));
+}
+
+static HeapFile *new_heap_file(int fd, uint32_t flags) {
+    HeapFile *heap_file = (HeapFile *)calloc(1, sizeof(HeapFile));
+    CHECK_RET_NULL(heap_file);
+
+    heap_file->fd = fd;
+    heap_file->page_fd = fd;
+    heap_file->header_dirty = false;
+    heap_file->flags = flags;
+    if (!(flags & HF_OPEN_MMAP) &&
+        bp_init(&heap_file->pool, BUFFER_POOL_FRAMES,
+                disk_read_page, disk_write_page, heap_file) != GRAIN_OK) {
+        free(heap_file);
+        return NULL;
+    }
+    if (!(flags & HF_OPEN_MMAP)) {
+        bp_set_run_reader(&heap_file->pool, disk_read_pages);
+    }
+    if ((flags & HF_OPEN_ASYNC_IO) && !(flags & HF_OPEN_MMAP)) {
+        heap_file->aio = aio_create(AIO_QUEUE_DEPTH, AIO_DEFAULT);
+        heap_file->aio_pages = aligned_alloc(PAGE_SIZE, (size_t)AIO_QUEUE_DEPTH * PAGE_SIZE);
+        if (heap_file->aio == NULL || heap_file->aio_pages == NULL) {
+            aio_destroy(heap_file->aio);
+            free(heap_file->aio_pages);
+            bp_destroy(&heap_file->pool);
+            free(heap_file);
+            return NULL;
+        }
+        bp_set_batch_writer(&heap_file->pool, disk_write_pages);
+    }
+
+    pthread_rwlock_init(&heap_file->flush_latch, NULL);
+    for (int32_t i = 0; i < PAGE_LATCH_STRIPES; i++) {
+        pthread_rwlock_init(&heap_file->page_latches[i], NULL);
+    }
+    pthread_mutex_init(&heap_file->header_latch, NULL);
+    pthread_mutex_init(&heap_file->index_latch, NULL);
+    return heap_file;
+}
+
+static void free_heap_file(HeapFile *hf) {
+    if (hf->map != NULL) {
+        munmap(hf->map, hf->map_reserved);
+    }
+    if (hf->page_dir != NULL) {
+        pagedir_close(hf->page_dir);
+    }
+    /* waits out any read-ahead still landing in the pool's frames */
+    aio_destroy(hf->prefetch);
+    aio_destroy(hf->aio);
+    free(hf->aio_pages);
+    if (hf->page_fd >= 0 && hf->page_fd != hf->fd) {
+        close(hf->page_fd);
+    }
+    if (hf->fd >= 0) {
+        close(hf->fd);
+    }
+    if (hf->wal != NULL) {
+        wal_close(hf->wal);
+        free(hf->wal);
+    }
+    if (hf->id_index != NULL) {
+        btree_close(hf->id_index);
+    }
+    if (hf->age_index != NULL) {
+        btree_close(hf->age_index);
+    }
+    if (hf->hash_index != NULL) {
+        hash_close(hf->hash_index);
+    }
+    if (hf->id_filter != NULL) {
+        bloom_close(hf->id_filter);
+    }
+    if (hf->zone_map != NULL) {
+        zonemap_close(hf->zone_map);
+    }
+    if (hf->fsm != NULL) {
+        fsm_close(hf->fsm);
+    }
+    bp_destroy(&hf->pool);
+    pthread_rwlock_destroy(&hf->flush_latch);
+    for (int32_t i = 0; i < PAGE_LATCH_STRIPES; i++) {
+        pthread_rwlock_destroy(&hf->page_latches[i]);
+    }
+    pthread_mutex_destroy(&hf->header_latch);
+    pthread_mutex_destroy(&hf->index_latch);
+    free(hf);
+}
+
+HeapFile *create_file(const char *filename) {
+    return create_file_ex(filename, HF_OPEN_DEFAULT);
+}
+
+static void wal_path(const char *filename, char *path, size_t len) {
+    snprintf(path, len, "%s.wal", filename);
+}
+
+static void id_index_path(const char *filename, char *path, size_t len) {
+    snprintf(path, len, "%s.id.idx", filename);
+}
+
+static void age_index_path(const char *filename, char *path, size_t len) {
+    snprintf(path, len, "%s.age.idx", filename);
+}
+
+static void hash_index_path(const char *filename, char *path, size_t len) {
+    snprintf(path, len, "%s.id.hash", filename);
+}
+
+static void id_filter_path(const char *filename, char *path, size_t len) {
+    snprintf(path, len, "%s.id.bloom", filename);
+}
+
+static void zone_map_path(const char *filename, char *path, size_t len) {
+    snprintf(path, len, "%s.zm", filename);
+}
+
+static void fsm_path(const char *filename, char *path, size_t len) {
+    snprintf(path, len, "%s.fsm", filename);
+}
+
+static void page_dir_path(const char *filename, char *path, size_t len) {
+    snprintf(path, len, "%s.pdir", filename);
+}
+
+/*
+ * replays a log left behind by a session that never checkpointed. with
+ * HF_OPEN_WAL the log stays attached, otherwise it is removed once applied.
+ */
+static GrainResult attach_wal(HeapFile *hf, const char *filename) {
+    char path[FILENAME_MAX];
+    wal_path(filename, path, sizeof(path));
+    bool keep = (hf->flags & HF_OPEN_WAL) != 0;
+    if (!keep && access(path, F_OK) != 0) {
+        return GRAIN_OK;
+    }
+
+    Wal *wal = malloc(sizeof(Wal));
+    CHECK_RET_GRAIN_NULL(wal);
+    GrainResult res = wal_open(wal, path, hf->header.checkpoint_lsn);
+    if (res != GRAIN_OK) {
+        free(wal);
+        return res;
+    }
+
+    res = wal_replay(wal, redo_record, hf);
+    if (res == GRAIN_OK && !wal_is_empty(wal)) {
+        res = checkpoint(hf, wal);
+    }
+    if (res == GRAIN_OK && keep) {
+        hf->wal = wal;
+        return GRAIN_OK;
+    }
+
+    wal_close(wal);
+    free(wal);
+    if (res == GRAIN_OK) {
+        remove(path);
+    }
+    return res;
+}
+
+static GrainResult build_fsm(HeapFile *hf, FreeSpaceMap *fsm) {
+    for (int32_t page_id = 0; page_id < hf->header.num_pages; page_id++) {
+        HeapPage *page;
+        GrainResult res = hf_pin_page(hf, page_id, &page);
+        if (res != GRAIN_OK) {
+            return res;
+        }
+        res = fsm_set(fsm, page_id, (int32_t)MAX_SLOTS - page->header.num_slots);
+        hf_unpin_page(hf, page_id, false);
+        if (res != GRAIN_OK) {
+            return res;
+        }
+    }
+    return fsm_flush(fsm);
+}
+
+/*
+ * page reads and writes go through a second descriptor opened with O_DIRECT,
+ * which skips the kernel's page cache. the header stays on the buffered one;
+ * it has the first block to itself, so the two never share a cached page.
+ * a filesystem that refuses O_DIRECT (tmpfs, say) keeps buffered page i/o.
+ */
+static GrainResult attach_direct_io(HeapFile *hf, const char *filename) {
+    if (!(hf->flags & HF_OPEN_DIRECT)) {
+        return GRAIN_OK;
+    }
+    int fd = open(filename, O_RDWR | O_DIRECT);
+    if (fd < 0) {
+        return (errno == EINVAL) ? GRAIN_OK : GRAIN_FILE_OPEN_FAILED;
+    }
+    hf->page_fd = fd;
+    return GRAIN_OK;
+}
+
+/* background read-ahead needs pages at fixed offsets, so compressed files only read ahead synchronously */
+static GrainResult attach_prefetch(HeapFile *hf) {
+    if (!(hf->flags & HF_OPEN_ASYNC_IO) || hf->page_dir != NULL) {
+        return GRAIN_OK;
+    }
+    hf->prefetch = aio_create(AIO_QUEUE_DEPTH, AIO_DEFAULT);
+    CHECK_RET_GRAIN_NULL(hf->prefetch);
+    bp_set_prefetcher(&hf->pool, disk_start_pages, disk_finish_pages);
+    return GRAIN_OK;
+}
+
+/* a compressed file can't be read without its directory, so one that wasn't flushed is rebuilt from the frames */
+static GrainResult attach_page_dir(HeapFile *hf, const char *filename) {
+    if (!hf->header.compressed) {
+        return GRAIN_OK;
+    }
+    char path[FILENAME_MAX];
+    page_dir_path(filename, path, sizeof(path));
+
+    PageDirectory *pd = pagedir_open(path, hf->fd);
+    if (pd != NULL && (!pd->header.clean || pd->header.data_start != (int64_t)sizeof(FileHeader))) {
+        pagedir_close(pd);
+        pd = NULL;
+    }
+    if (pd == NULL) {
+        pd = pagedir_create(path, hf->fd, sizeof(FileHeader));
+        if (pd == NULL) {
+            return GRAIN_FILE_OPEN_FAILED;
+        }
+        GrainResult res = pagedir_rebuild(pd, hf->header.num_pages);
+        if (res != GRAIN_OK) {
+            pagedir_close(pd);
+            return res;
+        }
+    }
+    hf->page_dir = pd;
+    return GRAIN_OK;
+}
+
+/*
+ * every file has a free space map. one that is missing, was not flushed
+ * cleanly or is shorter than the heap is rebuilt from the page headers.
+ */
+static GrainResult attach_fsm(HeapFile *hf, const char *filename) {
+    char path[FILENAME_MAX];
+    fsm_path(filename, path, sizeof(path));
+
+    FreeSpaceMap *fsm = fsm_open(path);
+    if (fsm != NULL && (!fsm->header.clean || fsm->header.num_pages < hf->header.num_pages)) {
+        fsm_close(fsm);
+        fsm = NULL;
+    }
+    if (fsm == NULL) {
+        fsm = fsm_create(path);
+        if (fsm == NULL) {
+            return GRAIN_FILE_OPEN_FAILED;
+        }
+        GrainResult res = build_fsm(hf, fsm);
+        if (res != GRAIN_OK) {
+            fsm_close(fsm);
+            return res;
+        }
+    }
+
+    hf->fsm = fsm;
+    sync_first_free_page(hf);
+    return GRAIN_OK;
+}
+
+static int32_t record_id(const Record *rec) {
+    return rec->id;
+}
+
+static int32_t record_age(const Record *rec) {
+    return rec->age;
+}
+
+static GrainResult build_tree(HeapFile *hf, BTree *bt, RecordKeyFn key) {
+    RecordId rid = {.page_id = 0, .slot_idx = -1};
+    Record rec;
+    GrainResult res;
+    while ((res = hf_scan_next(hf, &rid, &rec)) == GRAIN_OK) {
+        res = btree_insert(bt, key(&rec), rid);
+        if (res != GRAIN_OK) {
+            return res;
+        }
+    }
+    return (res == GRAIN_END) ? btree_flush(bt) : res;
+}
+
+/*
+ * an existing index is always attached so it never falls behind the heap. one
+ * that was not flushed cleanly is rebuilt from a scan, as is a missing one
+ * when its open flag asks for it.
+ */
+static GrainResult attach_tree(HeapFile *hf, const char *path, uint32_t flag, RecordKeyFn key,
+                               BTree **out) {
+    bool exists = access(path, F_OK) == 0;
+    if (!exists && !(hf->flags & flag)) {
+        return GRAIN_OK;
+    }
+
+    BTree *bt = exists ? btree_open(path) : NULL;
+    if (bt != NULL && bt->header.clean) {
+        *out = bt;
+        return GRAIN_OK;
+    }
+    if (bt != NULL) {
+        btree_close(bt);
+    }
+
+    bt = btree_create(path);
+    if (bt == NULL) {
+        return GRAIN_FILE_OPEN_FAILED;
+    }
+    GrainResult res = build_tree(hf, bt, key);
+    if (res != GRAIN_OK) {
+        btree_close(bt);
+        return res;
+    }
+    *out = bt;
+    return GRAIN_OK;
+}
+
+static GrainResult attach_id_index(HeapFile *hf, const char *filename) {
+    char path[FILENAME_MAX];
+    id_index_path(filename, path, sizeof(path));
+    return attach_tree(hf, path, HF_OPEN_ID_INDEX, record_id, &hf->id_index);
+}
+
+static GrainResult attach_age_index(HeapFile *hf, const char *filename) {
+    char path[FILENAME_MAX];
+    age_index_path(filename, path, sizeof(path));
+    return attach_tree(hf, path, HF_OPEN_AGE_INDEX, record_age, &hf->age_index);
+}
+
+static GrainResult build_hash_index(HeapFile *hf, HashIndex *hi) {
+    RecordId rid = {.page_id = 0, .slot_idx = -1};
+    Record rec;
+    GrainResult res;
+    while ((res = hf_scan_next(hf, &rid, &rec)) == GRAIN_OK) {
+        res = hash_insert(hi, rec.id, rid);
+        if (res != GRAIN_OK) {
+            return res;
+        }
+    }
+    return (res == GRAIN_END) ? hash_flush(hi) : res;
+}
+
+/* same rules as the b+ tree: always attached if present, rebuilt when not clean */
+static GrainResult attach_hash_index(HeapFile *hf, const char *filename) {
+    char path[FILENAME_MAX];
+    hash_index_path(filename, path, sizeof(path));
+    bool exists = access(path, F_OK) == 0;
+    if (!exists && !(hf->flags & HF_OPEN_HASH_INDEX)) {
+        return GRAIN_OK;
+    }
+
+    HashIndex *hi = exists ? hash_open(path) : NULL;
+    if (hi != NULL && hi->header.clean) {
+        hf->hash_index = hi;
+        return GRAIN_OK;
+    }
+    if (hi != NULL) {
+        hash_close(hi);
+    }
+
+    hi = hash_create(path);
+    if (hi == NULL) {
+        return GRAIN_FILE_OPEN_FAILED;
+    }
+    GrainResult res = build_hash_index(hf, hi);
+    if (res != GRAIN_OK) {
+        hash_close(hi);
+        return res;
+    }
+    hf->hash_index = hi;
+    return GRAIN_OK;
+}
+
+/* sized for a full file, so inserts into the free slots it has now don't overload it */
+static GrainResult fill_id_filter(HeapFile *hf, BloomFilter *bf) {
+    GrainResult res = bloom_reset(bf, (int64_t)page_count(hf) * MAX_SLOTS);
+    if (res != GRAIN_OK) {
+        return res;
+    }
+    RecordId rid = {.page_id = 0, .slot_idx = -1};
+    Record rec;
+    while ((res = hf_scan_next(hf, &rid, &rec)) == GRAIN_OK) {
+        res = bloom_add(bf, rec.id);
+        if (res != GRAIN_OK) {
+            return res;
+        }
+    }
+    return (res == GRAIN_END) ? bloom_flush(bf) : res;
+}
+
+/* same rules as the indexes, and it is also rebuilt once it holds more ids than it was sized for */
+static GrainResult attach_id_filter(HeapFile *hf, const char *filename) {
+    char path[FILENAME_MAX];
+    id_filter_path(filename, path, sizeof(path));
+    bool exists = access(path, F_OK) == 0;
+    if (!exists && !(hf->flags & HF_OPEN_ID_FILTER)) {
+        return GRAIN_OK;
+    }
+
+    BloomFilter *bf = exists ? bloom_open(path) : NULL;
+    if (bf != NULL && bf->header.clean && !bloom_overloaded(bf)) {
+        hf->id_filter = bf;
+        return GRAIN_OK;
+    }
+    if (bf == NULL) {
+        bf = bloom_create(path, 0);
+        if (bf == NULL) {
+            return GRAIN_FILE_OPEN_FAILED;
+        }
+    }
+    GrainResult res = fill_id_filter(hf, bf);
+    if (res != GRAIN_OK) {
+        bloom_close(bf);
+        return res;
+    }
+    hf->id_filter = bf;
+    return GRAIN_OK;
+}
+
+static GrainResult build_zone_map(HeapFile *hf, ZoneMap *zm) {
+    for (int32_t page_id = 0; page_id < hf->header.num_pages; page_id++) {
+        HeapPage *page;
+        GrainResult res = hf_pin_page(hf, page_id, &page);
+        if (res != GRAIN_OK) {
+            return res;
+        }
+        res = zonemap_track_page(zm, page);
+        hf_unpin_page(hf, page_id, false);
+        if (res != GRAIN_OK) {
+            return res;
+        }
+    }
+    return zonemap_flush(zm);
+}
+
+static GrainResult attach_zone_map(HeapFile *hf, const char *filename) {
+    char path[FILENAME_MAX];
+    zone_map_path(filename, path, sizeof(path));
+    bool exists = access(path, F_OK) == 0;
+    if (!exists && !(hf->flags & HF_OPEN_ZONE_MAP)) {
+        return GRAIN_OK;
+    }
+
+    ZoneMap *zm = exists ? zonemap_open(path) : NULL;
+    if (zm != NULL && zm->header.clean) {
+        hf->zone_map = zm;
+        return GRAIN_OK;
+    }
+    if (zm != NULL) {
+        zonemap_close(zm);
+    }
+
+    zm = zonemap_create(path);
+    if (zm == NULL) {
+        return GRAIN_FILE_OPEN_FAILED;
+    }
+    GrainResult res = build_zone_map(hf, zm);
+    if (res != GRAIN_OK) {
+        zonemap_close(zm);
+        return res;
+    }
+    hf->zone_map = zm;
+    return GRAIN_OK;
+}
+
+HeapFile *create_file_ex(const char *filename, uint32_t flags) {
+    CHECK_RET_NULL(filename);
+    if ((flags & HF_OPEN_MMAP) && (flags & (HF_OPEN_WAL | HF_OPEN_COMPRESS | HF_OPEN_ASYNC_IO))) {
+        return NULL;
+    }
+    if ((flags & HF_OPEN_DIRECT) && (flags & (HF_OPEN_MMAP | HF_OPEN_COMPRESS))) {
+        return NULL;
+    }
+    int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    HeapFile *heap_file = new_heap_file(fd, flags);
+    if (heap_file == NULL) {
+        close(fd);
+        return NULL;
+    }
+
+    heap_file->header.num_pages = 0;
+    heap_file->header.next_page_idx = 0;
+    heap_file->header.first_free_page = -1;
+    heap_file->header.version = GRAIN_FORMAT_VERSION;
+    heap_file->header.checkpoint_lsn = 0;
+    heap_file->header.layout = (flags & HF_OPEN_PAX) ? PAGE_LAYOUT_PAX : PAGE_LAYOUT_ROW;
+    heap_file->header.compressed = (flags & HF_OPEN_COMPRESS) ? 1 : 0;
+
+    if (write_file_header(heap_file) != GRAIN_OK) {
+        free_heap_file(heap_file);
+        return NULL;
+    }
+
+    /* a log left over from an older file with the same name must not be replayed into this one */
+    char path[FILENAME_MAX];
+    wal_path(filename, path, sizeof(path));
+    remove(path);
+    id_index_path(filename, path, sizeof(path));
+    remove(path);
+    age_index_path(filename, path, sizeof(path));
+    remove(path);
+    hash_index_path(filename, path, sizeof(path));
+    remove(path);
+    id_filter_path(filename, path, sizeof(path));
+    remove(path);
+    zone_map_path(filename, path, sizeof(path));
+    remove(path);
+    fsm_path(filename, path, sizeof(path));
+    remove(path);
+    page_dir_path(filename, path, sizeof(path));
+    remove(path);
+    if (attach_direct_io(heap_file, filename) != GRAIN_OK ||
+        attach_page_dir(heap_file, filename) != GRAIN_OK ||
+        attach_prefetch(heap_file) != GRAIN_OK ||
+        attach_wal(heap_file, filename) != GRAIN_OK) {
+        free_heap_file(heap_file);
+        return NULL;
+    }
+
+    if ((flags & HF_OPEN_MMAP) && map_file(heap_file) != GRAIN_OK) {
+        free_heap_file(heap_file);
+        return NULL;
+    }
+
+    if (attach_fsm(heap_file, filename) != GRAIN_OK ||
+        attach_id_index(heap_file, filename) != GRAIN_OK ||
+        attach_age_index(heap_file, filename) != GRAIN_OK ||
+        attach_hash_index(heap_file, filename) != GRAIN_OK ||
+        attach_id_filter(heap_file, filename) != GRAIN_OK ||
+        attach_zone_map(heap_file, filename) != GRAIN_OK) {
+        free_heap_file(heap_file);
+        return NULL;
+    }
+
+    return heap_file;
+}
+
+static bool validate_header(FileHeader *header) {
+    if (header->num_pages < 0) return false;
+    if (header->next_page_idx < 0) return false;
+    if (header->first_free_page < -1) return false;
+    if (header->next_page_idx < header->num_pages) return false;
+    if (header->version < GRAIN_FORMAT_LEGACY) return false;
+    if (header->version > GRAIN_FORMAT_VERSION) return false;
+    if (header->layout != PAGE_LAYOUT_ROW && header->layout != PAGE_LAYOUT_PAX) return false;
+    if (header->compressed != 0 && header->compressed != 1) return false;
+    return true;
+}
+
+/*
+ * every format so far only appended fields to the page header, so old headers
+ * are a prefix. version 3 pages only lack the layout, which sits in what was
+ * padding; version 4 and 5 pages only moved.
+ */
+static void upgrade_page(int32_t version, const char *old_page, HeapPage *page) {
+    if (version >= 4) {
+        memcpy(page, old_page, PAGE_SIZE);
+    } else if (version == 3) {
+        memcpy(page, old_page, PAGE_SIZE);
+        page->header.layout = PAGE_LAYOUT_ROW;
+    } else {
+        size_t header_size = (version == GRAIN_FORMAT_LEGACY) ? LEGACY_PAGE_HEADER_SIZE : V2_PAGE_HEADER_SIZE;
+        memset(page, 0, PAGE_SIZE);
+        memcpy(&page->header, old_page, header_size);
+        memcpy(page->storage, old_page + header_size, MAX_SLOTS * RECORD_SIZE);
+        if (version == GRAIN_FORMAT_LEGACY) {
+            rebuild_slot_bitmap(page);
+        }
+    }
+    stamp_page(page);
+}
+
+/*
+ * compressed files find their frames through the directory, so nothing has to
+ * move for them. version 4 pages only lack the checksum, which sits in what was
+ * slack, so they are stamped where they are. a crash halfway leaves the old
+ * version, which never looks at the checksum, and the next open starts over.
+ */
+static GrainResult upgrade_in_place(HeapFile *hf) {
+    HeapPage page __attribute__((aligned(DIRECT_IO_ALIGN)));
+    for (int32_t i = 0; hf->header.version == 4 && i < hf->header.num_pages; i++) {
+        GrainResult res = load_page(hf, i, &page);
+        if (res == GRAIN_OK) {
+            res = store_page(hf, i, &page);
+        }
+        if (res != GRAIN_OK) {
+            return res;
+        }
+    }
+    if (fsync(hf->fd) != 0) {
+        return GRAIN_FILE_WRITE_FAILED;
+    }
+    hf->header.version = GRAIN_FORMAT_VERSION;
+    GrainResult res = write_file_header(hf);
+    if (res == GRAIN_OK && fsync(hf->fd) != 0) {
+        res = GRAIN_FILE_WRITE_FAILED;
+    }
+    return res;
+}
+
+/*
+ * rewrites an older file into a sibling file in the current format and renames
+ * it over the original, so a crash mid-upgrade leaves the old file untouched.
+ */
+static GrainResult upgrade_file(HeapFile *hf, const char *filename) {
+    char tmp_name[FILENAME_MAX];
+    snprintf(tmp_name, sizeof(tmp_name), "%s.upgrade", filename);
+    int out = open(tmp_name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (out < 0) {
+        return GRAIN_FILE_OPEN_FAILED;
+    }
+
+    /* up to version 5 page 0 came right after the header */
+    int32_t old_version = hf->header.version;
+    size_t old_header_size = (old_version == GRAIN_FORMAT_LEGACY) ? LEGACY_FILE_HEADER_SIZE :
+                             (old_version == 2) ? V2_FILE_HEADER_SIZE :
+                             (old_version == 3) ? V3_FILE_HEADER_SIZE : sizeof(FileHeader);
+    /* a version 3 file keeps its checkpoint, so a log it left behind still replays */
+    FileHeader header = hf->header;
+    header.version = GRAIN_FORMAT_VERSION;
+    if (old_version < 4) {
+        header.layout = PAGE_LAYOUT_ROW;
+    }
+
+    GrainResult res = GRAIN_OK;
+    if (!pwrite_full(out, &header, sizeof(FileHeader), 0)) {
+        res = GRAIN_FILE_WRITE_FAILED;
+    }
+
+    char old_page[PAGE_SIZE];
+    HeapPage page;
+    for (int32_t i = 0; res == GRAIN_OK && i < hf->header.num_pages; i++) {
+        off_t offset = old_header_size + ((off_t)i * PAGE_SIZE);
+        if (!pread_full(hf->fd, old_page, PAGE_SIZE, offset)) {
+            res = GRAIN_FILE_READ_FAILED;
+        } else {
+            upgrade_page(old_version, old_page, &page);
+            if (!pwrite_full(out, &page, PAGE_SIZE, page_offset(i))) {
+                res = GRAIN_FILE_WRITE_FAILED;
+            }
+        }
+    }
+
+    if (res == GRAIN_OK && fsync(out) != 0) {
+        res = GRAIN_FILE_WRITE_FAILED;
+    }
+    close(out);
+    if (res == GRAIN_OK && rename(tmp_name, filename) != 0) {
+        res = GRAIN_FILE_WRITE_FAILED;
+    }
+    if (res != GRAIN_OK) {
+        remove(tmp_name);
+        return res;
+    }
+
+    int fd = open(filename, O_RDWR);
+    if (fd < 0) {
+        return GRAIN_FILE_OPEN_FAILED;
+    }
+    close(hf->fd);
+    hf->fd = fd;
+    hf->page_fd = fd;
+    hf->header = header;
+    return GRAIN_OK;
+}
+
+HeapFile *open_file(const char *filename) {
+    return open_file_ex(filename, HF_OPEN_DEFAULT);
+}
+
+HeapFile *open_file_ex(const char *filename, uint32_t flags) {
+    CHECK_RET_NULL(filename);
+    if ((flags & HF_OPEN_MMAP) && (flags & (HF_OPEN_WAL | HF_OPEN_ASYNC_IO | HF_OPEN_DIRECT))) {
+        return NULL;
+    }
+    int fd = open(filename, O_RDWR);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    HeapFile *heap_file = new_heap_file(fd, flags);
+    if (heap_file == NULL) {
+        close(fd);
+        return NULL;
+    }
+
+    if (read_file_header(heap_file) == NULL) {
+        free_heap_file(heap_file);
+        return NULL;
+    }
+
+    if (!validate_header(&heap_file->header)) {
+        free_heap_file(heap_file);
+        return NULL;
+    }
+
+    if (heap_file->header.version < GRAIN_FORMAT_VERSION && !heap_file->header.compressed &&
+        upgrade_file(heap_file, filename) != GRAIN_OK) {
+        free_heap_file(heap_file);
+        return NULL;
+    }
+
+    /* compressed pages are not at fixed offsets, so they can't be mapped or read a block at a time */
+    if ((flags & (HF_OPEN_MMAP | HF_OPEN_DIRECT)) && heap_file->header.compressed) {
+        free_heap_file(heap_file);
+        return NULL;
+    }
+
+    /* an older compressed file needs its directory to find the pages to stamp */
+    if (attach_direct_io(heap_file, filename) != GRAIN_OK ||
+        attach_page_dir(heap_file, filename) != GRAIN_OK ||
+        (heap_file->header.version < GRAIN_FORMAT_VERSION && upgrade_in_place(heap_file) != GRAIN_OK) ||
+        attach_prefetch(heap_file) != GRAIN_OK ||
+        attach_wal(heap_file, filename) != GRAIN_OK) {
+        free_heap_file(heap_file);
+        return NULL;
+    }
+
+    /* pages already in the file have their space; growth starts behind them */
+    heap_file->alloc_pages = heap_file->header.num_pages;
+
+    if ((flags & HF_OPEN_MMAP) &&
+        (!file_covers_pages(heap_file->fd, heap_file->header.num_pages) ||
+         map_file(heap_file) != GRAIN_OK)) {
+        free_heap_file(heap_file);
+        return NULL;
+    }
+
+    if (attach_fsm(heap_file, filename) != GRAIN_OK ||
+        attach_id_index(heap_file, filename) != GRAIN_OK ||
+        attach_age_index(heap_file, filename) != GRAIN_OK ||
+        attach_hash_index(heap_file, filename) != GRAIN_OK ||
+        attach_id_filter(heap_file, filename) != GRAIN_OK ||
+        attach_zone_map(heap_file, filename) != GRAIN_OK) {
+        free_heap_file(heap_file);
+        return NULL;
+    }
+
+    return heap_file;
+}
+
+GrainResult close_file(HeapFile *hf) {
+    CHECK_RET_GRAIN_NULL(hf);
+    GrainResult res = GRAIN_OK;
+    if (hf->fd >= 0) {
+        res = hf_flush(hf);
+        GrainResult unmap_res = unmap_file(hf);
+        if (res == GRAIN_OK) {
+            res = unmap_res;
+        }
+        if (res == GRAIN_OK) {
+            res = release_space(hf, page_count(hf));
+        }
+    }
+    free_heap_file(hf);
+    return res;
+}
+
+/*
+ * disk space for new pages is taken FILE_GROW_PAGES at a time, before the
+ * pages are ever written, so the file isn't extended a page per write-back
+ * and stays in a few large extents. KEEP_SIZE leaves the end of the file at
+ * the last page, so nothing that goes by the file size has to change. a
+ * filesystem that can't reserve space just grows the file as pages are written.
+ */
+static GrainResult reserve_space(HeapFile *hf, int32_t num_pages) {
+    if (num_pages <= hf->alloc_pages) {
+        return GRAIN_OK;
+    }
+    int32_t end = ((num_pages + FILE_GROW_PAGES - 1) / FILE_GROW_PAGES) * FILE_GROW_PAGES;
+    if (fallocate(hf->fd, FALLOC_FL_KEEP_SIZE, page_offset(hf->alloc_pages),
+                  (off_t)(end - hf->alloc_pages) * PAGE_SIZE) != 0 &&
+        errno != EOPNOTSUPP && errno != ENOSYS) {
+        return GRAIN_FILE_WRITE_FAILED;
+    }
+    hf->alloc_pages = end;
+    return GRAIN_OK;
+}
+
+/* claims the ids of a run of new pages; the file grows once for the whole run */
+static GrainResult reserve_page_run(HeapFile *hf, int32_t count, int32_t *first_page_id) {
+    int32_t first = hf->header.next_page_idx;
+    if (hf->map != NULL) {
+        GrainResult res = grow_mapping(hf, (size_t)page_offset(first + count));
+        if (res != GRAIN_OK) {
+            return res;
+        }
+    } else if (hf->page_dir == NULL) {
+        /* compressed frames are appended wherever the directory says, so they aren't reserved */
+        GrainResult res = reserve_space(hf, first + count);
+        if (res != GRAIN_OK) {
+            return res;
+        }
+    }
+    *first_page_id = first;
+    return GRAIN_OK;
+}
+
+static GrainResult pin_new_page(HeapFile *hf, int32_t page_id, HeapPage **page) {
+    if (hf->map != NULL) {
+        *page = (HeapPage *)(hf->map + page_offset(page_id));
+        __atomic_add_fetch(&hf->map_pins, 1, __ATOMIC_ACQ_REL);
+        return GRAIN_OK;
+    }
+    return bp_pin_new_page(&hf->pool, page_id, (void **)page);
+}
+
+/* new pages are invisible to other threads until num_pages covers them, so they need no latch */
+static GrainResult alloc_page_locked(HeapFile *hf, int32_t *page_id) {
+    int32_t new_page_id;
+    GrainResult res = reserve_page_run(hf, 1, &new_page_id);
+    if (res != GRAIN_OK) {
+        return res;
+    }
+
+    HeapPage *page;
+    res = pin_new_page(hf, new_page_id, &page);
+    if (res != GRAIN_OK) {
+        return res;
+    }
+    hf->header.next_page_idx++;
+
+    init_page_layout(page, new_page_id, hf->header.layout);
+    set_page_count(hf, hf->header.num_pages + 1);
+    hf->header_dirty = true;
+
+    *page_id = new_page_id;
+    res = note_free_space_locked(hf, page);
+    GrainResult unpin_res = unpin_logged(hf, page, -1, true);
+    return (res != GRAIN_OK) ? res : unpin_res;
+}
+
+GrainResult hf_alloc_page(HeapFile *hf, int32_t *page_id) {
+    CHECK_RET_GRAIN_NULL(hf);
+    CHECK_RET_GRAIN_NULL(page_id);
+
+    begin_change(hf);
+    pthread_mutex_lock(&hf->header_latch);
+    GrainResult res = alloc_page_locked(hf, page_id);
+    pthread_mutex_unlock(&hf->header_latch);
+    end_change(hf);
+    return res;
+}
+
+static bool has_indexes(HeapFile *hf) {
+    return hf->id_index != NULL || hf->age_index != NULL || hf->hash_index != NULL ||
+           hf->id_filter != NULL;
+}
+
+/* callers hold index_latch */
+static GrainResult index_insert_locked(HeapFile *hf, const Record *rec, RecordId rid) {
+    GrainResult res = GRAIN_OK;
+    if (hf->id_index != NULL) {
+        res = btree_insert(hf->id_index, rec->id, rid);
+    }
+    if (res == GRAIN_OK && hf->age_index != NULL) {
+        res = btree_insert(hf->age_index, rec->age, rid);
+    }
+    if (res == GRAIN_OK && hf->hash_index != NULL) {
+        res = hash_insert(hf->hash_index, rec->id, rid);
+    }
+    if (res == GRAIN_OK && hf->id_filter != NULL) {
+        res = bloom_add(hf->id_filter, rec->id);
+    }
+    return res;
+}
+
+static GrainResult index_insert(HeapFile *hf, const Record *rec, int32_t page_id, int32_t slot_idx) {
+    if (!has_indexes(hf)) {
+        return GRAIN_OK;
+    }
+    RecordId rid = {.page_id = page_id, .slot_idx = slot_idx};
+    pthread_mutex_lock(&hf->index_latch);
+    GrainResult res = index_insert_locked(hf, rec, rid);
+    pthread_mutex_unlock(&hf->index_latch);
+    return res;
+}
+
+static GrainResult index_insert_batch(HeapFile *hf, const Record *recs, int32_t page_id,
+                                      const int32_t *slots, int32_t count) {
+    if (!has_indexes(hf)) {
+        return GRAIN_OK;
+    }
+    GrainResult res = GRAIN_OK;
+    pthread_mutex_lock(&hf->index_latch);
+    for (int32_t i = 0; i < count && res == GRAIN_OK; i++) {
+        RecordId rid = {.page_id = page_id, .slot_idx = slots[i]};
+        res = index_insert_locked(hf, &recs[i], rid);
+    }
+    pthread_mutex_unlock(&hf->index_latch);
+    return res;
+}
+
+/* ids stay in the filter until it is rebuilt */
+static GrainResult index_delete(HeapFile *hf, const Record *rec, RecordId rid) {
+    if (!has_indexes(hf)) {
+        return GRAIN_OK;
+    }
+    GrainResult res = GRAIN_OK;
+    pthread_mutex_lock(&hf->index_latch);
+    if (hf->id_index != NULL) {
+        res = btree_delete(hf->id_index, rec->id, rid);
+    }
+    if (res == GRAIN_OK && hf->age_index != NULL) {
+        res = btree_delete(hf->age_index, rec->age, rid);
+    }
+    if (res == GRAIN_OK && hf->hash_index != NULL) {
+        res = hash_delete(hf->hash_index, rec->id, rid);
+    }
+    pthread_mutex_unlock(&hf->index_latch);
+    return res;
+}
+
+/* only the age index is keyed on something an update can change */
+static GrainResult index_update(HeapFile *hf, int32_t old_age, int32_t new_age, RecordId rid) {
+    if (hf->age_index == NULL || old_age == new_age) {
+        return GRAIN_OK;
+    }
+    pthread_mutex_lock(&hf->index_latch);
+    GrainResult res = btree_delete(hf->age_index, old_age, rid);
+    if (res == GRAIN_OK) {
+        res = btree_insert(hf->age_index, new_age, rid);
+    }
+    pthread_mutex_unlock(&hf->index_latch);
+    return res;
+}
+
+/*
+ * pins the lowest page with room that no session has claimed, adding a page
+ * if there is none. the pin is taken under the header latch so a vacuum can't
+ * release the page in between.
+ */
+static GrainResult pin_insert_target(HeapFile *hf, HeapPage **page) {
+    pthread_mutex_lock(&hf->header_latch);
+    int32_t page_id = fsm_find_unclaimed(hf->fsm);
+    GrainResult res = GRAIN_OK;
+    if (page_id == -1) {
+        res = alloc_page_locked(hf, &page_id);
+    }
+    if (res == GRAIN_OK) {
+        res = hf_pin_page(hf, page_id, page);
+    }
+    pthread_mutex_unlock(&hf->header_latch);
+    return res;
+}
+
+/* same, for a page the caller picked; GRAIN_PAGE_FULL if the map says it has no room */
+static GrainResult pin_page_with_room(HeapFile *hf, int32_t page_id, HeapPage **page) {
+    pthread_mutex_lock(&hf->header_latch);
+    GrainResult res = (fsm_free_slots(hf->fsm, page_id) > 0)
+        ? hf_pin_page(hf, page_id, page)
+        : GRAIN_PAGE_FULL;
+    pthread_mutex_unlock(&hf->header_latch);
+    return res;
+}
+
+static GrainResult insert_one(HeapFile *hf, Record *rec) {
+    for (;;) {
+        HeapPage *page;
+        GrainResult res = pin_insert_target(hf, &page);
+        if (res != GRAIN_OK) {
+            return res;
+        }
+        int32_t page_id = page->header.page_id;
+        hf_latch_page(hf, page_id, true);
+
+        /* another thread may have filled the page since the map was read, or a crash left the map stale */
+        if (!has_free_space(page)) {
+            res = note_free_space(hf, page);
+            unpin_latched(hf, page_id, false);
+            if (res != GRAIN_OK) {
+                return res;
+            }
+            continue;
+        }
+
+        res = zone_widen(hf, page_id, rec, 1);
+        if (res != GRAIN_OK) {
+            unpin_latched(hf, page_id, false);
+            return res;
+        }
+
+        int32_t slot = insert_record(page, rec);
+        if (slot == -1) {
+            unpin_latched(hf, page_id, false);
+            return GRAIN_PAGE_FULL;
+        }
+
+        /* the index entries go in before the latch, so a delete that finds the record finds them too */
+        res = note_free_space(hf, page);
+        if (res == GRAIN_OK) {
+            res = index_insert(hf, rec, page_id, slot);
+        }
+        GrainResult unpin_res = release_logged(hf, page, slot, false);
+        return (res != GRAIN_OK) ? res : unpin_res;
+    }
+}
+
+GrainResult hf_insert_record(HeapFile *hf, Record *rec) {
+    CHECK_RET_GRAIN_NULL(hf);
+    CHECK_RET_GRAIN_NULL(rec);
+
+    begin_change(hf);
+    GrainResult res = insert_one(hf, rec);
+    end_change(hf);
+    return res;
+}
+
+GrainResult hf_session_init(HeapFile *hf, HfSession *session) {
+    CHECK_RET_GRAIN_NULL(hf);
+    CHECK_RET_GRAIN_NULL(session);
+    session->page_id = -1;
+    return GRAIN_OK;
+}
+
+/* claims the lowest unclaimed page with room, or a new one */
+static GrainResult claim_target(HeapFile *hf, HfSession *session) {
+    pthread_mutex_lock(&hf->header_latch);
+    int32_t page_id = fsm_find_unclaimed(hf->fsm);
+    GrainResult res = GRAIN_OK;
+    if (page_id == -1) {
+        res = alloc_page_locked(hf, &page_id);
+    }
+    if (res == GRAIN_OK) {
+        res = fsm_claim(hf->fsm, page_id);
+    }
+    if (res == GRAIN_OK) {
+        session->page_id = page_id;
+    }
+    pthread_mutex_unlock(&hf->header_latch);
+    return res;
+}
+
+static void release_target(HeapFile *hf, HfSession *session) {
+    pthread_mutex_lock(&hf->header_latch);
+    fsm_unclaim(hf->fsm, session->page_id);
+    pthread_mutex_unlock(&hf->header_latch);
+    session->page_id = -1;
+}
+
+static GrainResult session_insert(HeapFile *hf, HfSession *session, Record *rec, RecordId *rid) {
+    for (;;) {
+        if (session->page_id == -1) {
+            GrainResult res = claim_target(hf, session);
+            if (res != GRAIN_OK) {
+                return res;
+            }
+        }
+        int32_t page_id = session->page_id;
+
+        /* a claimed page is never released by vacuum, so it can be pinned without the header latch */
+        HeapPage *page;
+        GrainResult res = pin_latched(hf, page_id, true, &page);
+        if (res != GRAIN_OK) {
+            return res;
+        }
+
+        /* inserts leave a claimed page alone, but a vacuum move may still land on it */
+        if (!has_free_space(page)) {
+            res = note_free_space(hf, page);
+            unpin_latched(hf, page_id, false);
+            release_target(hf, session);
+            if (res != GRAIN_OK) {
+                return res;
+            }
+            continue;
+        }
+
+        res = zone_widen(hf, page_id, rec, 1);
+        if (res != GRAIN_OK) {
+            unpin_latched(hf, page_id, false);
+            return res;
+        }
+
+        int32_t slot = insert_record(page, rec);
+        if (slot == -1) {
+            unpin_latched(hf, page_id, false);
+            return GRAIN_PAGE_FULL;
+        }
+        bool full = !has_free_space(page);
+
+        res = note_free_space(hf, page);
+        if (res == GRAIN_OK) {
+            res = index_insert(hf, rec, page_id, slot);
+        }
+        GrainResult unpin_res = release_logged(hf, page, slot, false);
+        if (res == GRAIN_OK) {
+            res = unpin_res;
+        }
+        if (full) {
+            release_target(hf, session);
+        }
+        if (res != GRAIN_OK) {
+            return res;
+        }
+        if (rid != NULL) {
+            rid->page_id = page_id;
+            rid->slot_idx = slot;
+        }
+        return GRAIN_OK;
+    }
+}
+
+GrainResult hf_session_insert(HeapFile *hf, HfSession *session, Record *rec, RecordId *rid) {
+    CHECK_RET_GRAIN_NULL(hf);
+    CHECK_RET_GRAIN_NULL(session);
+    CHECK_RET_GRAIN_NULL(rec);
+
+    begin_change(hf);
+    GrainResult res = session_insert(hf, session, rec, rid);
+    end_change(hf);
+    return res;
+}
+
+/* gives the page back to everyone else; it keeps whatever room it has left */
+GrainResult hf_session_close(HeapFile *hf, HfSession *session) {
+    CHECK_RET_GRAIN_NULL(hf);
+    CHECK_RET_GRAIN_NULL(session);
+    if (session->page_id != -1) {
+        release_target(hf, session);
+    }
+    return GRAIN_OK;
+}
+
+static void fill_rids(RecordId *rids, size_t offset, int32_t page_id,
+                      const int32_t *slots, int32_t count) {
+    if (rids == NULL) return;
+    for (int32_t i = 0; i < count; i++) {
+        rids[offset + i].page_id = page_id;
+        rids[offset + i].slot_idx = slots[i];
+    }
+}
+
+static inline int32_t batch_size(size_t remaining) {
+    return remaining < MAX_SLOTS ? (int32_t)remaining : (int32_t)MAX_SLOTS;
+}
+
+/* fills an existing page with as many of the remaining records as fit; a page without room is skipped */
+static GrainResult fill_page(HeapFile *hf, int32_t page_id, Record *recs, size_t n,
+                             size_t *done, RecordId *rids) {
+    int32_t slots[MAX_SLOTS];
+    HeapPage *page;
+    GrainResult res = pin_page_with_room(hf, page_id, &page);
+    if (res != GRAIN_OK) {
+        return (res == GRAIN_PAGE_FULL) ? GRAIN_OK : res;
+    }
+    hf_latch_page(hf, page_id, true);
+
+    int32_t room = (int32_t)MAX_SLOTS - page->header.num_slots;
+    int32_t want = batch_size(n - *done);
+    res = zone_widen(hf, page_id, &recs[*done], want < room ? want : room);
+    if (res != GRAIN_OK) {
+        unpin_latched(hf, page_id, false);
+        return res;
+    }
+
+    int32_t count = insert_records(page, &recs[*done], want, slots);
+    fill_rids(rids, *done, page_id, slots, count);
+    *done += count;
+
+    res = note_free_space(hf, page);
+    if (res == GRAIN_OK) {
+        res = index_insert_batch(hf, &recs[*done - count], page_id, slots, count);
+    }
+    GrainResult unpin_res = release_logged(hf, page, -1, false);
+    return (res != GRAIN_OK) ? res : unpin_res;
+}
+
+/*
+ * packs the rest of a batch into a run of fresh pages. the header latch is
+ * held throughout, and each page is counted only once it is filled and
+ * indexed, so nobody sees a page of the run before that.
+ */
+static GrainResult fill_new_pages(HeapFile *hf, Record *recs, size_t n, size_t done, RecordId *rids) {
+    int32_t slots[MAX_SLOTS];
+    int32_t run = (int32_t)((n - done + MAX_SLOTS - 1) / MAX_SLOTS);
+    int32_t first_page_id;
+    GrainResult res = reserve_page_run(hf, run, &first_page_id);
+    if (res != GRAIN_OK) {
+        return res;
+    }
+
+    hf->header_dirty = true;
+    for (int32_t i = 0; i < run; i++) {
+        int32_t page_id = first_page_id + i;
+        HeapPage *page;
+        res = pin_new_page(hf, page_id, &page);
+        if (res != GRAIN_OK) {
+            return res;
+        }
+        init_page_layout(page, page_id, hf->header.layout);
+        hf->header.next_page_idx++;
+
+        res = zone_widen_locked(hf, page_id, &recs[done], batch_size(n - done));
+        if (res != GRAIN_OK) {
+            set_page_count(hf, hf->header.num_pages + 1);
+            hf_unpin_page(hf, page_id, true);
+            return res;
+        }
+
+        int32_t count = insert_records(page, &recs[done], batch_size(n - done), slots);
+        fill_rids(rids, done, page_id, slots, count);
+        done += count;
+
+        res = note_free_space_locked(hf, page);
+        if (res == GRAIN_OK) {
+            res = index_insert_batch(hf, &recs[done - count], page_id, slots, count);
+        }
+        set_page_count(hf, hf->header.num_pages + 1);
+        GrainResult unpin_res = unpin_logged(hf, page, -1, true);
+        if (res == GRAIN_OK) {
+            res = unpin_res;
+        }
+        if (res != GRAIN_OK) {
+            return res;
+        }
+    }
+    return GRAIN_OK;
+}
+
+static GrainResult insert_batch(HeapFile *hf, Record *recs, size_t n, RecordId *rids) {
+    size_t done = 0;
+
+    /* whole pages' worth go into runs of empty pages first, so they stay contiguous */
+    for (;;) {
+        int32_t first_page_id, len = 0;
+        if (n - done >= MAX_SLOTS) {
+            pthread_mutex_lock(&hf->header_latch);
+            len = fsm_find_empty_run(hf->fsm, (int32_t)((n - done) / MAX_SLOTS), &first_page_id);
+            pthread_mutex_unlock(&hf->header_latch);
+        }
+        if (len == 0) {
+            break;
+        }
+        size_t before = done;
+        for (int32_t i = 0; i < len; i++) {
+            GrainResult res = fill_page(hf, first_page_id + i, recs, n, &done, rids);
+            if (res != GRAIN_OK) {
+                return res;
+            }
+        }
+        if (done == before) {
+            break;
+        }
+    }
+
+    /* then top up pages that already have room before growing the file, leaving sessions' pages alone */
+    while (done < n) {
+        pthread_mutex_lock(&hf->header_latch);
+        int32_t page_id = fsm_find_unclaimed(hf->fsm);
+        pthread_mutex_unlock(&hf->header_latch);
+        if (page_id == -1) {
+            break;
+        }
+        GrainResult res = fill_page(hf, page_id, recs, n, &done, rids);
+        if (res != GRAIN_OK) {
+            return res;
+        }
+    }
+    if (done == n) {
+        return GRAIN_OK;
+    }
+
+    pthread_mutex_lock(&hf->header_latch);
+    GrainResult res = fill_new_pages(hf, recs, n, done, rids);
+    pthread_mutex_unlock(&hf->header_latch);
+    return res;
+}
+
+GrainResult hf_insert_records(HeapFile *hf, Record *recs, size_t n, RecordId *rids) {
+    CHECK_RET_GRAIN_NULL(hf);
+    CHECK_RET_GRAIN_NULL(recs);
+
+    begin_change(hf);
+    GrainResult res = insert_batch(hf, recs, n, rids);
+    end_change(hf);
+    return res;
+}
+
+GrainResult hf_scan_next(HeapFile *hf, RecordId *rid, Record *rec) {
+    CHECK_RET_GRAIN_NULL(hf);
+    CHECK_RET_GRAIN_NULL(rid);
+    CHECK_RET_GRAIN_NULL(rec);
+
+    int32_t currPage = rid->page_id;
+    int32_t nextSlot = rid->slot_idx + 1;
+
+    while (currPage < page_count(hf)) {
+        HeapPage *page;
+        GrainResult res = pin_latched(hf, currPage, false, &page);
+        if (res != GRAIN_OK) {
+            return res;
+        }
+
+        nextSlot = next_live_slot(page, nextSlot);
+        if (nextSlot != -1) {
+            read_slot(page, nextSlot, rec);
+            rid->page_id = currPage;
+            rid->slot_idx = nextSlot;
+            return unpin_latched(hf, currPage, false);
+        }
+
+        res = unpin_latched(hf, currPage, false);
+        if (res != GRAIN_OK) {
+            return res;
+        }
+        currPage++;
+        nextSlot = 0;
+    }
+
+    return GRAIN_END;
+}
+
+GrainResult hf_batch_scan_init(HeapFile *hf, HfScanCursor *cur) {
+    CHECK_RET_GRAIN_NULL(hf);
+    CHECK_RET_GRAIN_NULL(cur);
+    cur->page_id = 0;
+    cur->next_slot = 0;
+    cur->page = NULL;
+    cur->filtered = false;
+    return GRAIN_OK;
+}
+
+GrainResult hf_batch_scan_init_filtered(HeapFile *hf, HfScanCursor *cur, const Predicate *pred) {
+    CHECK_RET_GRAIN_NULL(pred);
+    GrainResult res = hf_batch_scan_init(hf, cur);
+    if (res != GRAIN_OK) {
+        return res;
+    }
+    cur->filtered = true;
+    cur->pred = *pred;
+    return GRAIN_OK;
+}
+
+/* fills recs with whole records, or values with one column when recs is NULL */
+static GrainResult scan_batch(HeapFile *hf, HfScanCursor *cur, RecordId *rids, Record *recs,
+                              RecordColumn col, int32_t *values, int32_t max, int32_t *count) {
+    if (max <= 0) {
+        return GRAIN_INVALID_SLOT;
+    }
+
+    int32_t n = 0;
+    while (n < max) {
+        if (cur->page == NULL) {
+            if (cur->page_id >= page_count(hf)) {
+                break;
+            }
+            if (cur->filtered && !zone_may_match(hf, cur->page_id, &cur->pred)) {
+                cur->page_id++;
+                continue;
+            }
+            GrainResult res = hf_pin_page(hf, cur->page_id, &cur->page);
+            if (res != GRAIN_OK) {
+                cur->page = NULL;
+                return res;
+            }
+            cur->next_slot = 0;
+        }
+
+        /* the predicate runs over the whole page again on every call, so edits between calls are seen */
+        HeapPage *page = cur->page;
+        hf_latch_page(hf, cur->page_id, false);
+        uint32_t matches[SLOT_BITMAP_WORDS];
+        const uint32_t *wanted = page->header.slot_bitmap;
+        if (cur->filtered) {
+            match_records(page, &cur->pred, matches);
+            wanted = matches;
+        }
+        int32_t end = page->header.next_slot_idx;
+        int32_t slot = next_set_slot(wanted, cur->next_slot, end);
+        while (slot != -1 && n < max) {
+            rids[n].page_id = cur->page_id;
+            rids[n].slot_idx = slot;
+            if (recs != NULL) {
+                read_slot(page, slot, &recs[n]);
+            } else {
+                values[n] = column_value(page, col, slot);
+            }
+            n++;
+            slot = next_set_slot(wanted, slot + 1, end);
+        }
+        hf_unlatch_page(hf, cur->page_id);
+        if (slot != -1) {
+            /* batch is full; the page stays pinned for the next call */
+            cur->next_slot = slot;
+            break;
+        }
+
+        cur->page = NULL;
+        GrainResult res = hf_unpin_page(hf, cur->page_id++, false);
+        if (res != GRAIN_OK) {
+            return res;
+        }
+    }
+
+    *count = n;
+    return (n > 0) ? GRAIN_OK : GRAIN_END;
+}
+
+GrainResult hf_batch_scan_next(HeapFile *hf, HfScanCursor *cur, RecordId *rids, Record *recs,
+                               int32_t max, int32_t *count) {
+    CHECK_RET_GRAIN_NULL(hf);
+    CHECK_RET_GRAIN_NULL(cur);
+    CHECK_RET_GRAIN_NULL(rids);
+    CHECK_RET_GRAIN_NULL(recs);
+    CHECK_RET_GRAIN_NULL(count);
+    return scan_batch(hf, cur, rids, recs, COLUMN_ID, NULL, max, count);
+}
+
+/* like hf_batch_scan_next but only decodes one int column; on a pax file that is one contiguous run per page */
+GrainResult hf_column_scan_next(HeapFile *hf, HfScanCursor *cur, RecordColumn col, RecordId *rids,
+                                int32_t *values, int32_t max, int32_t *count) {
+    CHECK_RET_GRAIN_NULL(hf);
+    CHECK_RET_GRAIN_NULL(cur);
+    CHECK_RET_GRAIN_NULL(rids);
+    CHECK_RET_GRAIN_NULL(values);
+    CHECK_RET_GRAIN_NULL(count);
+    return scan_batch(hf, cur, rids, NULL, col, values, max, count);
+}
+
+GrainResult hf_batch_scan_close(HeapFile *hf, HfScanCursor *cur) {
+    CHECK_RET_GRAIN_NULL(hf);
+    CHECK_RET_GRAIN_NULL(cur);
+    if (cur->page == NULL) {
+        return GRAIN_OK;
+    }
+    cur->page = NULL;
+    return hf_unpin_page(hf, cur->page_id, false);
+}
+
+typedef struct {
+    HeapFile *hf;
+    HfScanFn fn;
+    void *ctx;
+    int32_t next_page;
+    GrainResult result;
+    pthread_mutex_t lock;
+} ParallelScan;
+
+typedef struct {
+    ParallelScan *scan;
+    int32_t worker;
+} ScanWorker;
+
+/* hands out the next run of pages, or nothing once the file is done or a worker failed */
+static bool next_morsel(ParallelScan *scan, int32_t *first, int32_t *end) {
+    pthread_mutex_lock(&scan->lock);
+    int32_t num_pages = page_count(scan->hf);
+    bool ok = scan->result == GRAIN_OK && scan->next_page < num_pages;
+    if (ok) {
+        *first = scan->next_page;
+        *end = (num_pages - *first > SCAN_MORSEL_PAGES) ? *first + SCAN_MORSEL_PAGES : num_pages;
+        scan->next_page = *end;
+    }
+    pthread_mutex_unlock(&scan->lock);
+    return ok;
+}
+
+static void fail_scan(ParallelScan *scan, GrainResult res) {
+    pthread_mutex_lock(&scan->lock);
+    if (scan->result == GRAIN_OK) {
+        scan->result = res;
+    }
+    pthread_mutex_unlock(&scan->lock);
+}
+
+static GrainResult scan_page(ScanWorker *w, HeapPage *page, int32_t page_id,
+                             RecordId *rids, Record *recs) {
+    int32_t count = 0;
+    for (int32_t slot = next_live_slot(page, 0); slot != -1; slot = next_live_slot(page, slot + 1)) {
+        rids[count].page_id = page_id;
+        rids[count].slot_idx = slot;
+        read_slot(page, slot, &recs[count]);
+        count++;
+    }
+    if (count == 0) {
+        return GRAIN_OK;
+    }
+    return w->scan->fn(w->scan->ctx, w->worker, rids, recs, count);
+}
+
+static GrainResult scan_morsel(ScanWorker *w, HeapPage *buf, RecordId *rids, Record *recs,
+                               int32_t first, int32_t end) {
+    HeapFile *hf = w->scan->hf;
+    for (int32_t page_id = first; page_id < end; page_id++) {
+        HeapPage *page = buf;
+        if (hf->map != NULL) {
+            page = (HeapPage *)(hf->map + page_offset(page_id));
+        } else {
+            GrainResult res = load_checked_page(hf, page_id, buf);
+            if (res != GRAIN_OK) {
+                return res;
+            }
+        }
+        GrainResult res = scan_page(w, page, page_id, rids, recs);
+        if (res != GRAIN_OK) {
+            return res;
+        }
+    }
+    return GRAIN_OK;
+}
+
+/*
+ * keeps a queue's depth of page reads outstanding, claiming morsels as it
+ * goes, and hands pages on in whatever order they land. once something fails
+ * it stops reading ahead but still waits for what it already asked for.
+ */
+static GrainResult scan_queued(ScanWorker *w, AioQueue *q, HeapPage *bufs, RecordId *rids,
+                               Record *recs) {
+    HeapFile *hf = w->scan->hf;
+    int32_t page_ids[AIO_QUEUE_DEPTH];
+    int32_t free_bufs[AIO_QUEUE_DEPTH];
+    int32_t num_free = AIO_QUEUE_DEPTH;
+    for (int32_t i = 0; i < AIO_QUEUE_DEPTH; i++) {
+        free_bufs[i] = i;
+    }
+
+    AioCompletion done[AIO_QUEUE_DEPTH];
+    int32_t next = 0, end = 0;
+    bool more = true;
+    GrainResult res = GRAIN_OK;
+    for (;;) {
+        while (res == GRAIN_OK && num_free > 0) {
+            if (next == end && !(more && (more = next_morsel(w->scan, &next, &end)))) {
+                break;
+            }
+            int32_t b = free_bufs[--num_free];
+            page_ids[b] = next;
+            aio_prep_read(q, hf->page_fd, &bufs[b], PAGE_SIZE, page_offset(next), (uint64_t)b);
+            next++;
+        }
+        if (aio_outstanding(q) == 0) {
+            return res;
+        }
+
+        int32_t count;
+        GrainResult wait_res = aio_wait(q, done, AIO_QUEUE_DEPTH, &count);
+        if (wait_res != GRAIN_OK) {
+            return wait_res;
+        }
+        for (int32_t i = 0; i < count; i++) {
+            int32_t b = (int32_t)done[i].tag;
+            if (res == GRAIN_OK) {
+                if (done[i].res != PAGE_SIZE) {
+                    res = GRAIN_FILE_READ_FAILED;
+                } else if (!verify_page(&bufs[b])) {
+                    res = GRAIN_CORRUPT_PAGE;
+                } else {
+                    res = scan_page(w, &bufs[b], page_ids[b], rids, recs);
+                }
+            }
+            free_bufs[num_free++] = b;
+        }
+    }
+}
+
+/* with async i/o each worker gets a queue of its own; mapped and compressed files read as before */
+static void *scan_worker(void *arg) {
+    ScanWorker *w = (ScanWorker *)arg;
+    HeapFile *hf = w->scan->hf;
+    bool queued = hf->aio != NULL && hf->page_dir == NULL;
+    int32_t num_bufs = queued ? AIO_QUEUE_DEPTH : 1;
+    HeapPage *bufs = aligned_alloc(PAGE_SIZE, (size_t)num_bufs * PAGE_SIZE);
+    RecordId *rids = malloc(sizeof(RecordId) * MAX_SLOTS);
+    Record *recs = malloc(sizeof(Record) * MAX_SLOTS);
+    AioQueue *q = queued ? aio_create(AIO_QUEUE_DEPTH, AIO_DEFAULT) : NULL;
+
+    if (bufs == NULL || rids == NULL || recs == NULL || (queued && q == NULL)) {
+        fail_scan(w->scan, GRAIN_NULL_PTR);
+    } else if (queued) {
+        GrainResult res = scan_queued(w, q, bufs, rids, recs);
+        if (res != GRAIN_OK) {
+            fail_scan(w->scan, res);
+        }
+    } else {
+        int32_t first, end;
+        while (next_morsel(w->scan, &first, &end)) {
+            GrainResult res = scan_morsel(w, bufs, rids, recs, first, end);
+            if (res != GRAIN_OK) {
+                fail_scan(w->scan, res);
+                break;
+            }
+        }
+    }
+    aio_destroy(q);
+    free(bufs);
+    free(rids);
+    free(recs);
+    return NULL;
+}
+
+static GrainResult run_scan(HeapFile *hf, int32_t num_workers, HfScanFn fn, void *ctx) {
+    if (num_workers <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        num_workers = (cpus > 0) ? (int32_t)cpus : 1;
+    }
+    int32_t morsels = (page_count(hf) + SCAN_MORSEL_PAGES - 1) / SCAN_MORSEL_PAGES;
+    if (num_workers > morsels) {
+        num_workers = (morsels > 0) ? morsels : 1;
+    }
+
+    ParallelScan scan = {.hf = hf, .fn = fn, .ctx = ctx, .next_page = 0, .result = GRAIN_OK};
+    ScanWorker *workers = malloc(sizeof(ScanWorker) * num_workers);
+    pthread_t *threads = malloc(sizeof(pthread_t) * num_workers);
+    if (workers == NULL || threads == NULL) {
+        free(workers);
+        free(threads);
+        return GRAIN_NULL_PTR;
+    }
+    pthread_mutex_init(&scan.lock, NULL);
+
+    /* the calling thread is worker 0; a thread that fails to start just leaves its share to the others */
+    int32_t started = 1;
+    for (int32_t i = 0; i < num_workers; i++) {
+        workers[i].scan = &scan;
+        workers[i].worker = i;
+    }
+    for (int32_t i = 1; i < num_workers; i++) {
+        if (pthread_create(&threads[started], NULL, scan_worker, &workers[started]) != 0) {
+            break;
+        }
+        started++;
+    }
+    scan_worker(&workers[0]);
+    for (int32_t i = 1; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&scan.lock);
+    free(workers);
+    free(threads);
+    return scan.result;
+}
+
+/*
+ * the workers read the file directly, past the pool and the page latches, so
+ * the flush latch shuts changes out for the whole scan and cached changes are
+ * written back before it starts. lookups and other scans carry on.
+ */
+GrainResult hf_parallel_scan(HeapFile *hf, int32_t num_workers, HfScanFn fn, void *ctx) {
+    CHECK_RET_GRAIN_NULL(hf);
+    CHECK_RET_GRAIN_NULL(fn);
+
+    pthread_rwlock_wrlock(&hf->flush_latch);
+    GrainResult res = (hf->map == NULL) ? bp_flush_all(&hf->pool) : GRAIN_OK;
+    if (res == GRAIN_OK) {
+        res = run_scan(hf, num_workers, fn, ctx);
+    }
+    pthread_rwlock_unlock(&hf->flush_latch);
+    return res;
+}
+
+static GrainResult update_locked(HeapFile *hf, RecordId rid, Record *rec) {
+    HeapPage *page;
+    GrainResult res = pin_latched(hf, rid.page_id, true, &page);
+    if (res != GRAIN_OK) {
+        return res;
+    }
+
+    /* update keeps the id, so the zone has to widen by the stored id and the new age */
+    Record old;
+    bool live = read_record(page, rid.slot_idx, &old);
+    int32_t old_age = live ? old.age : rec->age;
+    if (live) {
+        Record updated = *rec;
+        updated.id = old.id;
+        res = zone_widen(hf, rid.page_id, &updated, 1);
+        if (res != GRAIN_OK) {
+            unpin_latched(hf, rid.page_id, false);
+            return res;
+        }
+    }
+
+    res = update_record(page, rid.slot_idx, rec);
+    if (res != GRAIN_OK) {
+        unpin_latched(hf, rid.page_id, false);
+        return res;
+    }
+
+    /* like a delete, the age entry moves before the latch is dropped */
+    res = index_update(hf, old_age, rec->age, rid);
+    GrainResult unpin_res = release_logged(hf, page, rid.slot_idx, false);
+    return (res != GRAIN_OK) ? res : unpin_res;
+}
+
+GrainResult hf_update_record(HeapFile *hf, RecordId rid, Record *rec) {
+    CHECK_RET_GRAIN_NULL(hf);
+    CHECK_RET_GRAIN_NULL(rec);
+
+    begin_change(hf);
+    GrainResult res = update_locked(hf, rid, rec);
+    end_change(hf);
+    return res;
+}
+
+static GrainResult delete_locked(HeapFile *hf, RecordId rid) {
+    HeapPage *page;
+    GrainResult res = pin_latched(hf, rid.page_id, true, &page);
+    if (res != GRAIN_OK) {
+        return res;
+    }
+
+    Record victim = {0};
+    read_record(page, rid.slot_idx, &victim);
+
+    res = delete_record(page, rid.slot_idx);
+    if (res != GRAIN_OK) {
+        unpin_latched(hf, rid.page_id, false);
+        return res;
+    }
+
+    /* only memory changes here; the fsm reaches disk with the next flush */
+    res = note_free_space(hf, page);
+    if (res == GRAIN_OK) {
+        res = zone_track(hf, page);
+    }
+    /* the index entry goes before the latch, so nobody finds the id in a slot that was reused */
+    if (res == GRAIN_OK) {
+        res = index_delete(hf, &victim, rid);
+    }
+    GrainResult unpin_res = release_logged(hf, page, rid.slot_idx, false);
+    return (res != GRAIN_OK) ? res : unpin_res;
+}
+
+GrainResult hf_delete_record(HeapFile *hf, RecordId rid) {
+    CHECK_RET_GRAIN_NULL(hf);
+
+    begin_change(hf);
+    GrainResult res = delete_locked(hf, rid);
+    end_change(hf);
+    return res;
+}
+
+GrainResult hf_get_record(HeapFile *hf, RecordId rid, Record *rec) {
+    CHECK_RET_GRAIN_NULL(hf);
+    CHECK_RET_GRAIN_NULL(rec);
+
+    HeapPage *page;
+    GrainResult res = pin_latched(hf, rid.page_id, false, &page);
+    if (res != GRAIN_OK) {
+        return res;
+    }
+    bool found = read_record(page, rid.slot_idx, rec);
+    unpin_latched(hf, rid.page_id, false);
+    return found ? GRAIN_OK : GRAIN_RECORD_NOT_FOUND;
+}
+
+/*
+ * reads the record an index entry points at. the index latch is gone before
+ * the page latch is taken, so by then the slot may hold another id, the
+ * record may have been moved by a vacuum, or the page released with the
+ * tail; all of those read as not found.
+ */
+static GrainResult read_indexed(HeapFile *hf, RecordId rid, int32_t lo, int32_t hi, Record *rec) {
+    GrainResult res = hf_get_record(hf, rid, rec);
+    if (res == GRAIN_INVALID_PAGE_ID || (res == GRAIN_OK && (rec->id < lo || rec->id > hi))) {
+        return GRAIN_RECORD_NOT_FOUND;
+    }
+    return res;
+}
+
+/* false only if no record has ever had this id since the filter was last built; true without a filter */
+bool hf_id_may_exist(HeapFile *hf, int32_t id) {
+    if (hf == NULL || hf->id_filter == NULL) {
+        return true;
+    }
+    pthread_mutex_lock(&hf->index_latch);
+    bool maybe = bloom_may_contain(hf->id_filter, id);
+    pthread_mutex_unlock(&hf->index_latch);
+    return maybe;
+}
+
+/*
+ * the filter turns most missing ids away without a page read. after that the
+ * hash index is one bucket read, the b+ tree one per level; without either
+ * this is a full scan.
+ */
+GrainResult hf_find_by_id(HeapFile *hf, int32_t id, RecordId *rid, Record *rec) {
+    CHECK_RET_GRAIN_NULL(hf);
+    CHECK_RET_GRAIN_NULL(rid);
+    CHECK_RET_GRAIN_NULL(rec);
+
+    if (!hf_id_may_exist(hf, id)) {
+        return GRAIN_RECORD_NOT_FOUND;
+    }
+
+    if (hf->hash_index != NULL || hf->id_index != NULL) {
+        RecordId seen = {.page_id = -1, .slot_idx = -1};
+        for (;;) {
+            pthread_mutex_lock(&hf->index_latch);
+            GrainResult res = (hf->hash_index != NULL) ? hash_find(hf->hash_index, id, rid)
+                                                       : btree_find(hf->id_index, id, rid);
+            pthread_mutex_unlock(&hf->index_latch);
+            if (res != GRAIN_OK) {
+                return res;
+            }
+            res = read_indexed(hf, *rid, id, id, rec);
+            /* the entry changes before the page latch goes, so the same stale rid twice means it is gone */
+            bool stale = rid->page_id == seen.page_id && rid->slot_idx == seen.slot_idx;
+            if (res != GRAIN_RECORD_NOT_FOUND || stale) {
+                return res;
+            }
+            seen = *rid;
+        }
+    }
+
+    RecordId cur = {.page_id = 0, .slot_idx = -1};
+    GrainResult res;
+    while ((res = hf_scan_next(hf, &cur, rec)) == GRAIN_OK) {
+        if (rec->id == id) {
+            *rid = cur;
+            return GRAIN_OK;
+        }
+    }
+    return (res == GRAIN_END) ? GRAIN_RECORD_NOT_FOUND : res;
+}
+
+GrainResult hf_id_range_init(HeapFile *hf, BTreeCursor *cur, int32_t lo, int32_t hi) {
+    CHECK_RET_GRAIN_NULL(hf);
+    CHECK_RET_GRAIN_NULL(cur);
+    if (hf->id_index == NULL) {
+        return GRAIN_NO_INDEX;
+    }
+    pthread_mutex_lock(&hf->index_latch);
+    GrainResult res = btree_scan_init(hf->id_index, cur, lo, hi);
+    pthread_mutex_unlock(&hf->index_latch);
+    return res;
+}
+
+GrainResult hf_id_range_next(HeapFile *hf, BTreeCursor *cur, RecordId *rid, Record *rec) {
+    CHECK_RET_GRAIN_NULL(hf);
+    CHECK_RET_GRAIN_NULL(rec);
+    for (;;) {
+        pthread_mutex_lock(&hf->index_latch);
+        GrainResult res = btree_scan_next(cur, NULL, rid);
+        pthread_mutex_unlock(&hf->index_latch);
+        if (res != GRAIN_OK) {
+            return res;
+        }
+        /* an entry whose record went away or moved since the cursor passed it is skipped */
+        res = read_indexed(hf, *rid, cur->lo, cur->hi, rec);
+        if (res != GRAIN_RECORD_NOT_FOUND) {
+            return res;
+        }
+    }
+}
+
+GrainResult hf_age_range_init(HeapFile *hf, BTreeCursor *cur, int32_t lo, int32_t hi) {
+    CHECK_RET_GRAIN_NULL(hf);
+    CHECK_RET_GRAIN_NULL(cur);
+    if (hf->age_index == NULL) {
+        return GRAIN_NO_INDEX;
+    }
+    pthread_mutex_lock(&hf->index_latch);
+    GrainResult res = btree_scan_init(hf->age_index, cur, lo, hi);
+    pthread_mutex_unlock(&hf->index_latch);
+    return res;
+}
+
+/* rids come back in age order, which is no order at all on the heap */
+GrainResult hf_age_range_next(HeapFile *hf, BTreeCursor *cur, RecordId *rid) {
+    CHECK_RET_GRAIN_NULL(hf);
+    CHECK_RET_GRAIN_NULL(cur);
+    pthread_mutex_lock(&hf->index_latch);
+    GrainResult res = btree_scan_next(cur, NULL, rid);
+    pthread_mutex_unlock(&hf->index_latch);
+    return res;
+}
+
+static int compare_rids(const void *a, const void *b) {
+    const RecordId *ra = a, *rb = b;
+    if (ra->page_id != rb->page_id) {
+        return (ra->page_id > rb->page_id) - (ra->page_id < rb->page_id);
+    }
+    return (ra->slot_idx > rb->slot_idx) - (ra->slot_idx < rb->slot_idx);
+}
+
+/*
+ * takes up to max rids off the cursor, sorts them by location and reads each
+ * heap page once for all of its records. a record deleted or moved out of the
+ * range since the index was read is dropped, so count can be less than max
+ * before the range is done.
+ */
+GrainResult hf_age_range_fetch(HeapFile *hf, BTreeCursor *cur, RecordId *rids, Record *recs,
+                               int32_t max, int32_t *count) {
+    CHECK_RET_GRAIN_NULL(hf);
+    CHECK_RET_GRAIN_NULL(cur);
+    CHECK_RET_GRAIN_NULL(rids);
+    CHECK_RET_GRAIN_NULL(recs);
+    CHECK_RET_GRAIN_NULL(count);
+    if (max <= 0) {
+        return GRAIN_INVALID_SLOT;
+    }
+
+    int32_t taken = 0;
+    GrainResult res = GRAIN_OK;
+    pthread_mutex_lock(&hf->index_latch);
+    while (taken < max && (res = btree_scan_next(cur, NULL, &rids[taken])) == GRAIN_OK) {
+        taken++;
+    }
+    pthread_mutex_unlock(&hf->index_latch);
+    *count = 0;
+    if (res != GRAIN_OK && res != GRAIN_END) {
+        return res;
+    }
+    if (taken == 0) {
+        return GRAIN_END;
+    }
+    qsort(rids, taken, sizeof(RecordId), compare_rids);
+
+    int32_t n = 0;
+    for (int32_t i = 0; i < taken;) {
+        int32_t page_id = rids[i].page_id;
+        if (page_id >= page_count(hf)) {
+            /* released by a vacuum, along with everything after it */
+            break;
+        }
+        HeapPage *page;
+        res = pin_latched(hf, page_id, false, &page);
+        if (res != GRAIN_OK) {
+            return res;
+        }
+        for (; i < taken && rids[i].page_id == page_id; i++) {
+            int32_t slot = rids[i].slot_idx;
+            if (!is_slot_live(page, slot)) {
+                continue;
+            }
+            int32_t age = column_value(page, COLUMN_AGE, slot);
+            if (age >= cur->lo && age <= cur->hi) {
+                rids[n] = rids[i];
+                read_slot(page, slot, &recs[n]);
+                n++;
+            }
+        }
+        unpin_latched(hf, page_id, false);
+    }
+    *count = n;
+    return GRAIN_OK;
+}
+
+/* latches two pages in stripe order, so two threads moving records between them can't deadlock */
+static void latch_pair(HeapFile *hf, int32_t a, int32_t b) {
+    uint32_t sa = (uint32_t)a % PAGE_LATCH_STRIPES, sb = (uint32_t)b % PAGE_LATCH_STRIPES;
+    if (sa == sb) {
+        hf_latch_page(hf, a, true);
+        return;
+    }
+    hf_latch_page(hf, sa < sb ? a : b, true);
+    hf_latch_page(hf, sa < sb ? b : a, true);
+}
+
+static void unlatch_pair(HeapFile *hf, int32_t a, int32_t b) {
+    hf_unlatch_page(hf, a);
+    if ((uint32_t)a % PAGE_LATCH_STRIPES != (uint32_t)b % PAGE_LATCH_STRIPES) {
+        hf_unlatch_page(hf, b);
+    }
+}
+
+/*
+ * moves one record into the lowest page with room, if that lies below it.
+ * *to is left at page -1 when there is no such page or the record is gone.
+ */
+static GrainResult move_record(HeapFile *hf, RecordId from, RecordId *to, Record *rec) {
+    to->page_id = -1;
+    for (;;) {
+        HeapPage *target, *source;
+        pthread_mutex_lock(&hf->header_latch);
+        int32_t target_id = fsm_find(hf->fsm);
+        GrainResult res = GRAIN_OK;
+        if (target_id == -1 || target_id >= from.page_id) {
+            target_id = -1;
+        } else {
+            res = hf_pin_page(hf, target_id, &target);
+        }
+        pthread_mutex_unlock(&hf->header_latch);
+        if (target_id == -1 || res != GRAIN_OK) {
+            return res;
+        }
+        res = hf_pin_page(hf, from.page_id, &source);
+        if (res != GRAIN_OK) {
+            hf_unpin_page(hf, target_id, false);
+            return res;
+        }
+        latch_pair(hf, target_id, from.page_id);
+
+        bool found = read_record(source, from.slot_idx, rec);
+        bool room = has_free_space(target);
+        if (!found || !room) {
+            res = room ? GRAIN_OK : note_free_space(hf, target);
+            unlatch_pair(hf, target_id, from.page_id);
+            hf_unpin_page(hf, from.page_id, false);
+            hf_unpin_page(hf, target_id, false);
+            if (!found || res != GRAIN_OK) {
+                return res;
+            }
+            continue;
+        }
+
+        /* insert before delete, so a crash in between leaves a copy rather than a hole */
+        int32_t slot = -1;
+        res = zone_widen(hf, target_id, rec, 1);
+        if (res == GRAIN_OK) {
+            slot = insert_record(target, rec);
+            res = (slot == -1) ? GRAIN_PAGE_FULL : note_free_space(hf, target);
+        }
+        if (res == GRAIN_OK) {
+            res = log_page(hf, target, slot, false);
+        }
+        if (res == GRAIN_OK) {
+            res = delete_record(source, from.slot_idx);
+        }
+        if (res == GRAIN_OK) {
+            res = note_free_space(hf, source);
+        }
+        if (res == GRAIN_OK) {
+            res = zone_track(hf, source);
+        }
+        if (res == GRAIN_OK) {
+            res = log_page(hf, source, from.slot_idx, false);
+        }
+        if (res == GRAIN_OK) {
+            res = index_insert(hf, rec, target_id, slot);
+        }
+        if (res == GRAIN_OK) {
+            res = index_delete(hf, rec, from);
+        }
+        if (res == GRAIN_OK) {
+            to->page_id = target_id;
+            to->slot_idx = slot;
+        }
+
+        unlatch_pair(hf, target_id, from.page_id);
+        GrainResult unpin_res = hf_unpin_page(hf, from.page_id, true);
+        GrainResult target_res = hf_unpin_page(hf, target_id, true);
+        if (res == GRAIN_OK) {
+            res = (unpin_res != GRAIN_OK) ? unpin_res : target_res;
+        }
+        return res;
+    }
+}
+
+/* moves the records of one sparse page into lower pages with room, as far as they fit */
+static GrainResult vacuum_page(HeapFile *hf, HfVacuum *vac, int32_t page_id) {
+    int32_t slots[MAX_SLOTS];
+    int32_t count = 0;
+
+    HeapPage *page;
+    GrainResult res = pin_latched(hf, page_id, false, &page);
+    if (res != GRAIN_OK) {
+        return res;
+    }
+    if (page->header.num_slots <= vac->sparse_slots) {
+        for (int32_t slot = next_live_slot(page, 0); slot != -1; slot = next_live_slot(page, slot + 1)) {
+            slots[count++] = slot;
+        }
+    }
+    unpin_latched(hf, page_id, false);
+
+    /* each move is its own change; the callback runs outside it, so it may call back into the file */
+    for (int32_t i = 0; i < count; i++) {
+        RecordId from = {.page_id = page_id, .slot_idx = slots[i]};
+        RecordId to;
+        Record rec;
+        begin_change(hf);
+        res = move_record(hf, from, &to, &rec);
+        end_change(hf);
+        if (res != GRAIN_OK) {
+            return res;
+        }
+        if (to.page_id == -1) {
+            continue;
+        }
+        vac->records_moved++;
+        if (vac->forward != NULL) {
+            res = vac->forward(vac->ctx, from, to, &rec);
+            if (res != GRAIN_OK) {
+                return res;
+            }
+        }
+    }
+    return GRAIN_OK;
+}
+
+/*
+ * gives back empty pages at the end of the file; they leave the disk at the
+ * next flush. inserters pin under the header latch and sessions claim their
+ * page, so no page they picked can go.
+ */
+static GrainResult release_empty_tail(HeapFile *hf, HfVacuum *vac) {
+    pthread_mutex_lock(&hf->header_latch);
+    int32_t old_pages = hf->header.num_pages, num_pages = old_pages;
+    while (num_pages > 0 && fsm_free_slots(hf->fsm, num_pages - 1) == MAX_SLOTS &&
+           !fsm_is_claimed(hf->fsm, num_pages - 1)) {
+        /*
+         * a page someone still has pinned stays, and so does one a session is
+         * filling. the count drops before the discard, so a pin that misses
+         * after it can't read the page back in.
+         */
+        set_page_count(hf, num_pages - 1);
+        bool pinned = (hf->map != NULL) ? __atomic_load_n(&hf->map_pins, __ATOMIC_ACQUIRE) > 0
+                                        : bp_discard_page(&hf->pool, num_pages - 1) != GRAIN_OK;
+        if (pinned) {
+            set_page_count(hf, num_pages);
+            break;
+        }
+        num_pages--;
+    }
+    GrainResult res = GRAIN_OK;
+    if (num_pages != old_pages) {
+        vac->pages_released += old_pages - num_pages;
+        hf->header.next_page_idx = num_pages;
+        hf->header_dirty = true;
+        res = fsm_truncate(hf->fsm, num_pages);
+        sync_first_free_page(hf);
+    }
+    pthread_mutex_unlock(&hf->header_latch);
+    return res;
+}
+
+/* every live id, in heap order */
+static GrainResult collect_ids(HeapFile *hf, int32_t **ids, int64_t *count) {
+    int64_t capacity = 1024, n = 0;
+    int32_t *out = malloc(sizeof(int32_t) * capacity);
+    CHECK_RET_GRAIN_NULL(out);
+
+    RecordId rid = {.page_id = 0, .slot_idx = -1};
+    Record rec;
+    GrainResult res;
+    while ((res = hf_scan_next(hf, &rid, &rec)) == GRAIN_OK) {
+        if (n == capacity) {
+            int32_t *grown = realloc(out, sizeof(int32_t) * capacity * 2);
+            if (grown == NULL) {
+                free(out);
+                return GRAIN_NULL_PTR;
+            }
+            out = grown;
+            capacity *= 2;
+        }
+        out[n++] = rec.id;
+    }
+    if (res != GRAIN_END) {
+        free(out);
+        return res;
+    }
+    *ids = out;
+    *count = n;
+    return GRAIN_OK;
+}
+
+/*
+ * deleted and moved-away ids can't be taken out of a bloom filter, so a
+ * finished vacuum builds it again. the flush latch shuts changes out while the
+ * ids are collected; lookups keep using the old bits until the new ones are
+ * swapped in under index_latch.
+ */
+static GrainResult rebuild_id_filter(HeapFile *hf) {
+    if (hf->id_filter == NULL) {
+        return GRAIN_OK;
+    }
+    pthread_rwlock_wrlock(&hf->flush_latch);
+    int32_t *ids;
+    int64_t count;
+    GrainResult res = collect_ids(hf, &ids, &count);
+    if (res == GRAIN_OK) {
+        pthread_mutex_lock(&hf->index_latch);
+        res = bloom_reset(hf->id_filter, (int64_t)page_count(hf) * MAX_SLOTS);
+        for (int64_t i = 0; i < count && res == GRAIN_OK; i++) {
+            res = bloom_add(hf->id_filter, ids[i]);
+        }
+        if (res == GRAIN_OK) {
+            res = bloom_flush(hf->id_filter);
+        }
+        pthread_mutex_unlock(&hf->index_latch);
+        free(ids);
+    }
+    pthread_rwlock_unlock(&hf->flush_latch);
+    return res;
+}
+
+GrainResult hf_vacuum_init(HeapFile *hf, HfVacuum *vac, int32_t sparse_slots,
+                           HfForwardFn forward, void *ctx) {
+    CHECK_RET_GRAIN_NULL(hf);
+    CHECK_RET_GRAIN_NULL(vac);
+    if (sparse_slots < 0 || sparse_slots > (int32_t)MAX_SLOTS) {
+        return GRAIN_INVALID_SLOT;
+    }
+    vac->next_page = page_count(hf) - 1;
+    vac->sparse_slots = sparse_slots;
+    vac->forward = forward;
+    vac->ctx = ctx;
+    vac->records_moved = 0;
+    vac->pages_released = 0;
+    return GRAIN_OK;
+}
+
+/*
+ * looks at up to max_pages pages, walking down from the end of the file, then
+ * releases whatever empty pages that left at the end. GRAIN_END once page 0
+ * has been visited or no page below the cursor has room left.
+ */
+GrainResult hf_vacuum_step(HeapFile *hf, HfVacuum *vac, int32_t max_pages) {
+    CHECK_RET_GRAIN_NULL(hf);
+    CHECK_RET_GRAIN_NULL(vac);
+
+    if (vac->next_page >= page_count(hf)) {
+        vac->next_page = page_count(hf) - 1;
+    }
+    GrainResult res = GRAIN_OK;
+    for (int32_t i = 0; i < max_pages && vac->next_page >= 0; i++) {
+        pthread_mutex_lock(&hf->header_latch);
+        int32_t target = fsm_find(hf->fsm);
+        pthread_mutex_unlock(&hf->header_latch);
+        if (target == -1 || target >= vac->next_page) {
+            vac->next_page = -1;
+            break;
+        }
+        res = vacuum_page(hf, vac, vac->next_page);
+        if (res != GRAIN_OK) {
+            return res;
+        }
+        vac->next_page--;
+    }
+
+    begin_change(hf);
+    res = release_empty_tail(hf, vac);
+    end_change(hf);
+    if (res != GRAIN_OK) {
+        return res;
+    }
+    if (vac->next_page >= 0) {
+        return GRAIN_OK;
+    }
+    res = rebuild_id_filter(hf);
+    return (res != GRAIN_OK) ? res : GRAIN_END;
+}
+
+GrainResult hf_vacuum(HeapFile *hf, int32_t sparse_slots, HfForwardFn forward, void *ctx) {
+    HfVacuum vac;
+    GrainResult res = hf_vacuum_init(hf, &vac, sparse_slots, forward, ctx);
+    while (res == GRAIN_OK) {
+        res = hf_vacuum_step(hf, &vac, VACUUM_STEP_PAGES);
+    }
+    return (res == GRAIN_END) ? GRAIN_OK : res;
 }
@@ -0,0 +1,310 @@
+#include "../include/fsm.h"
+#include "../include/io.h"
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define FSM_INITIAL_CAPACITY 256
+
+static inline off_t entry_offset(int32_t page_id) {
+    return sizeof(FsmHeader) + (off_t)page_id;
+}
+
+static inline int32_t num_words(int32_t pages) {
+    return (pages + 63) / 64;
+}
+
+static GrainResult write_header(FreeSpaceMap *fsm) {
+    if (!pwrite_full(fsm->fd, &fsm->header, sizeof(FsmHeader), 0)) {
+        return GRAIN_FILE_WRITE_FAILED;
+    }
+    return GRAIN_OK;
+}
+
+static GrainResult reserve_pages(FreeSpaceMap *fsm, int32_t count) {
+    if (count <= fsm->capacity) {
+        return GRAIN_OK;
+    }
+    int32_t capacity = (fsm->capacity > 0) ? fsm->capacity : FSM_INITIAL_CAPACITY;
+    while (capacity < count) {
+        capacity *= 2;
+    }
+
+    uint8_t *free_slots = realloc(fsm->free_slots, (size_t)capacity);
+    CHECK_RET_GRAIN_NULL(free_slots);
+    fsm->free_slots = free_slots;
+    uint64_t *has_room = realloc(fsm->has_room, sizeof(uint64_t) * num_words(capacity));
+    CHECK_RET_GRAIN_NULL(has_room);
+    fsm->has_room = has_room;
+    uint64_t *claimed = realloc(fsm->claimed, sizeof(uint64_t) * num_words(capacity));
+    CHECK_RET_GRAIN_NULL(claimed);
+    fsm->claimed = claimed;
+
+    int32_t old_words = num_words(fsm->capacity);
+    memset(fsm->has_room + old_words, 0, sizeof(uint64_t) * (num_words(capacity) - old_words));
+    memset(fsm->claimed + old_words, 0, sizeof(uint64_t) * (num_words(capacity) - old_words));
+    fsm->capacity = capacity;
+    return GRAIN_OK;
+}
+
+static void set_entry(FreeSpaceMap *fsm, int32_t page_id, uint8_t free_slots) {
+    fsm->free_slots[page_id] = free_slots;
+    int32_t word = page_id >> 6;
+    uint64_t bit = 1ull << (page_id & 63);
+    if (free_slots > 0) {
+        fsm->has_room[word] |= bit;
+        if (word < fsm->first_word) {
+            fsm->first_word = word;
+        }
+    } else {
+        fsm->has_room[word] &= ~bit;
+    }
+}
+
+GrainResult fsm_set(FreeSpaceMap *fsm, int32_t page_id, int32_t free_slots) {
+    CHECK_RET_GRAIN_NULL(fsm);
+    if (page_id < 0) {
+        return GRAIN_INVALID_PAGE_ID;
+    }
+    if (free_slots < 0 || free_slots > (int32_t)MAX_SLOTS) {
+        return GRAIN_INVALID_SLOT;
+    }
+    if (page_id < fsm->header.num_pages && fsm->free_slots[page_id] == free_slots) {
+        return GRAIN_OK;
+    }
+
+    GrainResult res = sidecar_mark_in_use(fsm->fd, &fsm->header, sizeof(FsmHeader), &fsm->header.clean);
+    if (res != GRAIN_OK) {
+        return res;
+    }
+    if (page_id >= fsm->header.num_pages) {
+        res = reserve_pages(fsm, page_id + 1);
+        if (res != GRAIN_OK) {
+            return res;
+        }
+        /* pages skipped over are unknown; treat them as full until someone says otherwise */
+        for (int32_t i = fsm->header.num_pages; i < page_id; i++) {
+            set_entry(fsm, i, 0);
+        }
+        if (fsm->header.num_pages < fsm->dirty_lo) fsm->dirty_lo = fsm->header.num_pages;
+        fsm->header.num_pages = page_id + 1;
+    }
+
+    set_entry(fsm, page_id, (uint8_t)free_slots);
+    if (page_id < fsm->dirty_lo) fsm->dirty_lo = page_id;
+    if (page_id > fsm->dirty_hi) fsm->dirty_hi = page_id;
+    return GRAIN_OK;
+}
+
+/* forgets every page from num_pages on, after the heap released them */
+GrainResult fsm_truncate(FreeSpaceMap *fsm, int32_t num_pages) {
+    CHECK_RET_GRAIN_NULL(fsm);
+    if (num_pages < 0) {
+        return GRAIN_INVALID_PAGE_ID;
+    }
+    if (num_pages >= fsm->header.num_pages) {
+        return GRAIN_OK;
+    }
+
+    GrainResult res = sidecar_mark_in_use(fsm->fd, &fsm->header, sizeof(FsmHeader), &fsm->header.clean);
+    if (res != GRAIN_OK) {
+        return res;
+    }
+    for (int32_t i = num_pages; i < fsm->header.num_pages; i++) {
+        set_entry(fsm, i, 0);
+        fsm->claimed[i >> 6] &= ~(1ull << (i & 63));
+    }
+    fsm->header.num_pages = num_pages;
+    if (fsm->dirty_hi >= num_pages) {
+        fsm->dirty_hi = num_pages - 1;
+    }
+    return GRAIN_OK;
+}
+
+int32_t fsm_free_slots(FreeSpaceMap *fsm, int32_t page_id) {
+    if (fsm == NULL || page_id < 0 || page_id >= fsm->header.num_pages) {
+        return 0;
+    }
+    return fsm->free_slots[page_id];
+}
+
+/* lowest page with a free slot, or -1; words below first_word are known to be empty */
+int32_t fsm_find(FreeSpaceMap *fsm) {
+    CHECK_RET_INT(fsm);
+    int32_t words = num_words(fsm->header.num_pages);
+    while (fsm->first_word < words) {
+        uint64_t bits = fsm->has_room[fsm->first_word];
+        if (bits != 0) {
+            return (fsm->first_word << 6) + __builtin_ctzll(bits);
+        }
+        fsm->first_word++;
+    }
+    return -1;
+}
+
+/* first run of completely empty, unclaimed pages, at most max_len long; returns its length or 0 */
+int32_t fsm_find_empty_run(FreeSpaceMap *fsm, int32_t max_len, int32_t *first_page_id) {
+    if (fsm == NULL || first_page_id == NULL || max_len <= 0) {
+        return 0;
+    }
+    int32_t page_id = fsm_find(fsm);
+    if (page_id < 0) {
+        return 0;
+    }
+    for (; page_id < fsm->header.num_pages; page_id++) {
+        uint64_t bits = fsm->has_room[page_id >> 6] & ~fsm->claimed[page_id >> 6];
+        if ((bits >> (page_id & 63)) == 0) {
+            page_id |= 63;
+            continue;
+        }
+        if (fsm->free_slots[page_id] != MAX_SLOTS || fsm_is_claimed(fsm, page_id)) {
+            continue;
+        }
+        int32_t len = 1;
+        while (len < max_len && page_id + len < fsm->header.num_pages &&
+               fsm->free_slots[page_id + len] == MAX_SLOTS && !fsm_is_claimed(fsm, page_id + len)) {
+            len++;
+        }
+        *first_page_id = page_id;
+        return len;
+    }
+    return 0;
+}
+
+/* lowest page with a free slot that no inserter has claimed, or -1 */
+int32_t fsm_find_unclaimed(FreeSpaceMap *fsm) {
+    CHECK_RET_INT(fsm);
+    if (fsm_find(fsm) == -1) {
+        return -1;
+    }
+    int32_t words = num_words(fsm->header.num_pages);
+    for (int32_t word = fsm->first_word; word < words; word++) {
+        uint64_t bits = fsm->has_room[word] & ~fsm->claimed[word];
+        if (bits != 0) {
+            return (word << 6) + __builtin_ctzll(bits);
+        }
+    }
+    return -1;
+}
+
+/* claims only live in memory; a crash or reopen forgets them */
+GrainResult fsm_claim(FreeSpaceMap *fsm, int32_t page_id) {
+    CHECK_RET_GRAIN_NULL(fsm);
+    if (page_id < 0 || page_id >= fsm->header.num_pages) {
+        return GRAIN_INVALID_PAGE_ID;
+    }
+    fsm->claimed[page_id >> 6] |= 1ull << (page_id & 63);
+    return GRAIN_OK;
+}
+
+GrainResult fsm_unclaim(FreeSpaceMap *fsm, int32_t page_id) {
+    CHECK_RET_GRAIN_NULL(fsm);
+    if (page_id < 0 || page_id >= fsm->header.num_pages) {
+        return GRAIN_INVALID_PAGE_ID;
+    }
+    fsm->claimed[page_id >> 6] &= ~(1ull << (page_id & 63));
+    return GRAIN_OK;
+}
+
+bool fsm_is_claimed(FreeSpaceMap *fsm, int32_t page_id) {
+    if (fsm == NULL || page_id < 0 || page_id >= fsm->header.num_pages) {
+        return false;
+    }
+    return (fsm->claimed[page_id >> 6] >> (page_id & 63)) & 1;
+}
+
+static FreeSpaceMap *new_fsm(int fd) {
+    FreeSpaceMap *fsm = (FreeSpaceMap *)calloc(1, sizeof(FreeSpaceMap));
+    CHECK_RET_NULL(fsm);
+    fsm->fd = fd;
+    fsm->dirty_lo = INT32_MAX;
+    fsm->dirty_hi = -1;
+    return fsm;
+}
+
+static void free_fsm(FreeSpaceMap *fsm) {
+    close(fsm->fd);
+    free(fsm->free_slots);
+    free(fsm->has_room);
+    free(fsm->claimed);
+    free(fsm);
+}
+
+FreeSpaceMap *fsm_create(const char *path) {
+    CHECK_RET_NULL(path);
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return NULL;
+    }
+    FreeSpaceMap *fsm = new_fsm(fd);
+    if (fsm == NULL) {
+        close(fd);
+        return NULL;
+    }
+
+    fsm->header.magic = FSM_MAGIC;
+    fsm->header.num_pages = 0;
+    fsm->header.clean = 1;
+    if (write_header(fsm) != GRAIN_OK) {
+        free_fsm(fsm);
+        return NULL;
+    }
+    return fsm;
+}
+
+FreeSpaceMap *fsm_open(const char *path) {
+    CHECK_RET_NULL(path);
+    int fd = open(path, O_RDWR);
+    if (fd < 0) {
+        return NULL;
+    }
+    FreeSpaceMap *fsm = new_fsm(fd);
+    if (fsm == NULL) {
+        close(fd);
+        return NULL;
+    }
+
+    FsmHeader *h = &fsm->header;
+    if (!pread_full(fd, h, sizeof(FsmHeader), 0) || h->magic != FSM_MAGIC || h->num_pages < 0 ||
+        reserve_pages(fsm, h->num_pages) != GRAIN_OK ||
+        !pread_full(fd, fsm->free_slots, (size_t)h->num_pages, entry_offset(0))) {
+        free_fsm(fsm);
+        return NULL;
+    }
+    for (int32_t i = 0; i < h->num_pages; i++) {
+        if (fsm->free_slots[i] > MAX_SLOTS) {
+            free_fsm(fsm);
+            return NULL;
+        }
+        set_entry(fsm, i, fsm->free_slots[i]);
+    }
+    return fsm;
+}
+
+GrainResult fsm_flush(FreeSpaceMap *fsm) {
+    CHECK_RET_GRAIN_NULL(fsm);
+    if (fsm->header.clean) {
+        return GRAIN_OK;
+    }
+    if (fsm->dirty_hi >= fsm->dirty_lo) {
+        size_t len = (size_t)(fsm->dirty_hi - fsm->dirty_lo + 1);
+        if (!pwrite_full(fsm->fd, &fsm->free_slots[fsm->dirty_lo], len, entry_offset(fsm->dirty_lo))) {
+            return GRAIN_FILE_WRITE_FAILED;
+        }
+        fsm->dirty_lo = INT32_MAX;
+        fsm->dirty_hi = -1;
+    }
+    fsm->header.clean = 1;
+    GrainResult res = write_header(fsm);
+    if (res == GRAIN_OK && fsync(fsm->fd) != 0) {
+        res = GRAIN_FILE_WRITE_FAILED;
+    }
+    return res;
+}
+
+GrainResult fsm_close(FreeSpaceMap *fsm) {
+    CHECK_RET_GRAIN_NULL(fsm);
+    GrainResult res = fsm_flush(fsm);
+    free_fsm(fsm);
+    return res;
+}
@@ -0,0 +1,502 @@
+#include "../include/hash.h"
+#include "../include/io.h"
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+_Static_assert(sizeof(HashBucket) <= PAGE_SIZE, "hash bucket must fit in a page");
+
+static inline off_t bucket_offset(int32_t page_id) {
+    return sizeof(HashHeader) + ((off_t)page_id * PAGE_SIZE);
+}
+
+static GrainResult disk_read_bucket(void *ctx, int32_t page_id, void *buf) {
+    HashIndex *hi = (HashIndex *)ctx;
+    if (!pread_full(hi->fd, buf, PAGE_SIZE, bucket_offset(page_id))) {
+        return GRAIN_FILE_READ_FAILED;
+    }
+    return GRAIN_OK;
+}
+
+static GrainResult disk_write_bucket(void *ctx, int32_t page_id, const void *buf) {
+    HashIndex *hi = (HashIndex *)ctx;
+    if (!pwrite_full(hi->fd, buf, PAGE_SIZE, bucket_offset(page_id))) {
+        return GRAIN_FILE_WRITE_FAILED;
+    }
+    return GRAIN_OK;
+}
+
+static GrainResult write_header(HashIndex *hi) {
+    if (!pwrite_full(hi->fd, &hi->header, sizeof(HashHeader), 0)) {
+        return GRAIN_FILE_WRITE_FAILED;
+    }
+    return GRAIN_OK;
+}
+
+/* murmur3's finalizer; ids are mostly sequential, so the low bits need mixing */
+static inline uint32_t hash_key(int32_t key) {
+    uint32_t h = (uint32_t)key;
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+static inline int32_t dir_size(int32_t depth) {
+    return 1 << depth;
+}
+
+static inline int32_t bucket_for(HashIndex *hi, int32_t key) {
+    return hi->dir[hash_key(key) & (uint32_t)(dir_size(hi->header.global_depth) - 1)];
+}
+
+/* reuses a page freed by an earlier split before growing the file */
+static GrainResult alloc_bucket(HashIndex *hi, int32_t local_depth, int32_t *page_id, HashBucket **bucket) {
+    int32_t new_page_id = hi->header.free_page;
+    GrainResult res;
+    if (new_page_id != -1) {
+        res = bp_pin_page(&hi->pool, new_page_id, (void **)bucket);
+        if (res != GRAIN_OK) {
+            return res;
+        }
+        hi->header.free_page = (*bucket)->header.next_page;
+    } else {
+        new_page_id = hi->header.num_pages;
+        res = bp_pin_new_page(&hi->pool, new_page_id, (void **)bucket);
+        if (res != GRAIN_OK) {
+            return res;
+        }
+        hi->header.num_pages++;
+    }
+
+    (*bucket)->header.page_id = new_page_id;
+    (*bucket)->header.local_depth = local_depth;
+    (*bucket)->header.num_entries = 0;
+    (*bucket)->header.next_page = -1;
+    *page_id = new_page_id;
+    return GRAIN_OK;
+}
+
+static inline bool same_entry(const HashEntry *a, const HashEntry *b) {
+    return a->key == b->key && a->rid.page_id == b->rid.page_id && a->rid.slot_idx == b->rid.slot_idx;
+}
+
+static GrainResult chain_contains(HashIndex *hi, int32_t page_id, const HashEntry *entry, bool *found) {
+    *found = false;
+    while (page_id != -1 && !*found) {
+        HashBucket *bucket;
+        GrainResult res = bp_pin_page(&hi->pool, page_id, (void **)&bucket);
+        if (res != GRAIN_OK) {
+            return res;
+        }
+        for (int32_t i = 0; i < bucket->header.num_entries && !*found; i++) {
+            *found = same_entry(&bucket->entries[i], entry);
+        }
+        int32_t next = bucket->header.next_page;
+        bp_unpin_page(&hi->pool, page_id, false);
+        page_id = next;
+    }
+    return GRAIN_OK;
+}
+
+/* adds the entry to the first page of the chain with room; *added is false if every page is full */
+static GrainResult chain_append(HashIndex *hi, int32_t page_id, const HashEntry *entry, bool *added) {
+    *added = false;
+    while (page_id != -1) {
+        HashBucket *bucket;
+        GrainResult res = bp_pin_page(&hi->pool, page_id, (void **)&bucket);
+        if (res != GRAIN_OK) {
+            return res;
+        }
+        if (bucket->header.num_entries < HASH_BUCKET_CAPACITY) {
+            bucket->entries[bucket->header.num_entries++] = *entry;
+            *added = true;
+            return bp_unpin_page(&hi->pool, page_id, true);
+        }
+        int32_t next = bucket->header.next_page;
+        bp_unpin_page(&hi->pool, page_id, false);
+        page_id = next;
+    }
+    return GRAIN_OK;
+}
+
+/* hangs a new page off the end of the chain and puts the entry there */
+static GrainResult chain_extend(HashIndex *hi, int32_t page_id, const HashEntry *entry) {
+    for (;;) {
+        HashBucket *bucket;
+        GrainResult res = bp_pin_page(&hi->pool, page_id, (void **)&bucket);
+        if (res != GRAIN_OK) {
+            return res;
+        }
+        if (bucket->header.next_page != -1) {
+            int32_t next = bucket->header.next_page;
+            bp_unpin_page(&hi->pool, page_id, false);
+            page_id = next;
+            continue;
+        }
+
+        int32_t overflow_id;
+        HashBucket *overflow;
+        res = alloc_bucket(hi, bucket->header.local_depth, &overflow_id, &overflow);
+        if (res != GRAIN_OK) {
+            bp_unpin_page(&hi->pool, page_id, false);
+            return res;
+        }
+        overflow->entries[overflow->header.num_entries++] = *entry;
+        bucket->header.next_page = overflow_id;
+        bp_unpin_page(&hi->pool, overflow_id, true);
+        return bp_unpin_page(&hi->pool, page_id, true);
+    }
+}
+
+/*
+ * a split only helps if the hashes in the bucket differ somewhere. many copies
+ * of one id never do, and those go into an overflow chain instead.
+ */
+static GrainResult can_split(HashIndex *hi, int32_t page_id, const HashEntry *incoming, bool *split) {
+    uint32_t h = hash_key(incoming->key);
+    *split = false;
+    while (page_id != -1) {
+        HashBucket *bucket;
+        GrainResult res = bp_pin_page(&hi->pool, page_id, (void **)&bucket);
+        if (res != GRAIN_OK) {
+            return res;
+        }
+        if (bucket->header.local_depth >= HASH_MAX_DEPTH) {
+            return bp_unpin_page(&hi->pool, page_id, false);
+        }
+        for (int32_t i = 0; i < bucket->header.num_entries && !*split; i++) {
+            *split = hash_key(bucket->entries[i].key) != h;
+        }
+        int32_t next = bucket->header.next_page;
+        bp_unpin_page(&hi->pool, page_id, false);
+        if (*split) {
+            return GRAIN_OK;
+        }
+        page_id = next;
+    }
+    return GRAIN_OK;
+}
+
+static GrainResult grow_directory(HashIndex *hi) {
+    int32_t old_size = dir_size(hi->header.global_depth);
+    int32_t *dir = realloc(hi->dir, sizeof(int32_t) * 2 * (size_t)old_size);
+    CHECK_RET_GRAIN_NULL(dir);
+    memcpy(dir + old_size, dir, sizeof(int32_t) * (size_t)old_size);
+    hi->dir = dir;
+    hi->header.global_depth++;
+    return GRAIN_OK;
+}
+
+/* takes every entry out of a chain; overflow pages go on the free list, the head stays */
+static GrainResult drain_chain(HashIndex *hi, int32_t head, HashEntry **entries, int32_t *count) {
+    int32_t capacity = HASH_BUCKET_CAPACITY;
+    HashEntry *out = malloc(sizeof(HashEntry) * (size_t)capacity);
+    CHECK_RET_GRAIN_NULL(out);
+    int32_t n = 0;
+
+    for (int32_t page_id = head; page_id != -1;) {
+        HashBucket *bucket;
+        GrainResult res = bp_pin_page(&hi->pool, page_id, (void **)&bucket);
+        if (res != GRAIN_OK) {
+            free(out);
+            return res;
+        }
+        if (n + bucket->header.num_entries > capacity) {
+            capacity *= 2;
+            HashEntry *grown = realloc(out, sizeof(HashEntry) * (size_t)capacity);
+            if (grown == NULL) {
+                bp_unpin_page(&hi->pool, page_id, false);
+                free(out);
+                return GRAIN_NULL_PTR;
+            }
+            out = grown;
+        }
+        memcpy(&out[n], bucket->entries, sizeof(HashEntry) * (size_t)bucket->header.num_entries);
+        n += bucket->header.num_entries;
+
+        int32_t next = bucket->header.next_page;
+        bucket->header.num_entries = 0;
+        if (page_id == head) {
+            bucket->header.next_page = -1;
+        } else {
+            bucket->header.next_page = hi->header.free_page;
+            hi->header.free_page = page_id;
+        }
+        bp_unpin_page(&hi->pool, page_id, true);
+        page_id = next;
+    }
+    *entries = out;
+    *count = n;
+    return GRAIN_OK;
+}
+
+/* splits a bucket in two by the next hash bit, doubling the directory if it has to */
+static GrainResult split_bucket(HashIndex *hi, int32_t head) {
+    HashBucket *bucket;
+    GrainResult res = bp_pin_page(&hi->pool, head, (void **)&bucket);
+    if (res != GRAIN_OK) {
+        return res;
+    }
+    int32_t depth = bucket->header.local_depth;
+    bucket->header.local_depth = depth + 1;
+    bp_unpin_page(&hi->pool, head, true);
+
+    if (depth == hi->header.global_depth) {
+        res = grow_directory(hi);
+        if (res != GRAIN_OK) {
+            return res;
+        }
+    }
+
+    int32_t sibling;
+    HashBucket *new_bucket;
+    res = alloc_bucket(hi, depth + 1, &sibling, &new_bucket);
+    if (res != GRAIN_OK) {
+        return res;
+    }
+    bp_unpin_page(&hi->pool, sibling, true);
+    for (int32_t i = 0; i < dir_size(hi->header.global_depth); i++) {
+        if (hi->dir[i] == head && ((i >> depth) & 1)) {
+            hi->dir[i] = sibling;
+        }
+    }
+
+    HashEntry *entries = NULL;
+    int32_t count = 0;
+    res = drain_chain(hi, head, &entries, &count);
+    if (res != GRAIN_OK) {
+        return res;
+    }
+    for (int32_t i = 0; i < count && res == GRAIN_OK; i++) {
+        int32_t target = ((hash_key(entries[i].key) >> depth) & 1) ? sibling : head;
+        bool added;
+        res = chain_append(hi, target, &entries[i], &added);
+        if (res == GRAIN_OK && !added) {
+            res = chain_extend(hi, target, &entries[i]);
+        }
+    }
+    free(entries);
+    return res;
+}
+
+/* like the b+ tree, inserting the same (key, rid) twice is a no-op */
+GrainResult hash_insert(HashIndex *hi, int32_t key, RecordId rid) {
+    CHECK_RET_GRAIN_NULL(hi);
+
+    HashEntry entry = {.key = key, .rid = rid};
+    bool found;
+    GrainResult res = chain_contains(hi, bucket_for(hi, key), &entry, &found);
+    if (res != GRAIN_OK || found) {
+        return res;
+    }
+    res = sidecar_mark_in_use(hi->fd, &hi->header, sizeof(HashHeader), &hi->header.clean);
+    if (res != GRAIN_OK) {
+        return res;
+    }
+
+    for (;;) {
+        int32_t head = bucket_for(hi, key);
+        bool added;
+        res = chain_append(hi, head, &entry, &added);
+        if (res != GRAIN_OK) {
+            return res;
+        }
+        if (!added) {
+            bool split;
+            res = can_split(hi, head, &entry, &split);
+            if (res != GRAIN_OK) {
+                return res;
+            }
+            if (split) {
+                res = split_bucket(hi, head);
+                if (res != GRAIN_OK) {
+                    return res;
+                }
+                continue;
+            }
+            res = chain_extend(hi, head, &entry);
+            if (res != GRAIN_OK) {
+                return res;
+            }
+        }
+        hi->header.num_entries++;
+        return GRAIN_OK;
+    }
+}
+
+/* buckets are never merged; an emptied overflow page just stays in its chain */
+GrainResult hash_delete(HashIndex *hi, int32_t key, RecordId rid) {
+    CHECK_RET_GRAIN_NULL(hi);
+
+    HashEntry target = {.key = key, .rid = rid};
+    for (int32_t page_id = bucket_for(hi, key); page_id != -1;) {
+        HashBucket *bucket;
+        GrainResult res = bp_pin_page(&hi->pool, page_id, (void **)&bucket);
+        if (res != GRAIN_OK) {
+            return res;
+        }
+        for (int32_t i = 0; i < bucket->header.num_entries; i++) {
+            if (!same_entry(&bucket->entries[i], &target)) {
+                continue;
+            }
+            res = sidecar_mark_in_use(hi->fd, &hi->header, sizeof(HashHeader), &hi->header.clean);
+            if (res != GRAIN_OK) {
+                bp_unpin_page(&hi->pool, page_id, false);
+                return res;
+            }
+            bucket->entries[i] = bucket->entries[--bucket->header.num_entries];
+            hi->header.num_entries--;
+            return bp_unpin_page(&hi->pool, page_id, true);
+        }
+        int32_t next = bucket->header.next_page;
+        bp_unpin_page(&hi->pool, page_id, false);
+        page_id = next;
+    }
+    return GRAIN_RECORD_NOT_FOUND;
+}
+
+/* one bucket page, plus its overflow pages for ids that repeat a lot */
+GrainResult hash_find(HashIndex *hi, int32_t key, RecordId *rid) {
+    CHECK_RET_GRAIN_NULL(hi);
+    CHECK_RET_GRAIN_NULL(rid);
+
+    for (int32_t page_id = bucket_for(hi, key); page_id != -1;) {
+        HashBucket *bucket;
+        GrainResult res = bp_pin_page(&hi->pool, page_id, (void **)&bucket);
+        if (res != GRAIN_OK) {
+            return res;
+        }
+        for (int32_t i = 0; i < bucket->header.num_entries; i++) {
+            if (bucket->entries[i].key == key) {
+                *rid = bucket->entries[i].rid;
+                return bp_unpin_page(&hi->pool, page_id, false);
+            }
+        }
+        int32_t next = bucket->header.next_page;
+        bp_unpin_page(&hi->pool, page_id, false);
+        page_id = next;
+    }
+    return GRAIN_RECORD_NOT_FOUND;
+}
+
+static HashIndex *new_hash_index(int fd) {
+    HashIndex *hi = (HashIndex *)calloc(1, sizeof(HashIndex));
+    CHECK_RET_NULL(hi);
+    hi->fd = fd;
+    if (bp_init(&hi->pool, HASH_POOL_FRAMES, disk_read_bucket, disk_write_bucket, hi) != GRAIN_OK) {
+        free(hi);
+        return NULL;
+    }
+    return hi;
+}
+
+static void free_hash_index(HashIndex *hi) {
+    close(hi->fd);
+    bp_destroy(&hi->pool);
+    free(hi->dir);
+    free(hi);
+}
+
+HashIndex *hash_create(const char *path) {
+    CHECK_RET_NULL(path);
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return NULL;
+    }
+    HashIndex *hi = new_hash_index(fd);
+    if (hi == NULL) {
+        close(fd);
+        return NULL;
+    }
+
+    hi->header.magic = HASH_MAGIC;
+    hi->header.global_depth = 0;
+    hi->header.num_pages = 0;
+    hi->header.free_page = -1;
+    hi->header.num_entries = 0;
+    hi->dir = malloc(sizeof(int32_t));
+    if (hi->dir == NULL) {
+        free_hash_index(hi);
+        return NULL;
+    }
+
+    HashBucket *bucket;
+    if (alloc_bucket(hi, 0, &hi->dir[0], &bucket) != GRAIN_OK) {
+        free_hash_index(hi);
+        return NULL;
+    }
+    bp_unpin_page(&hi->pool, hi->dir[0], true);
+
+    if (hash_flush(hi) != GRAIN_OK) {
+        free_hash_index(hi);
+        return NULL;
+    }
+    return hi;
+}
+
+HashIndex *hash_open(const char *path) {
+    CHECK_RET_NULL(path);
+    int fd = open(path, O_RDWR);
+    if (fd < 0) {
+        return NULL;
+    }
+    HashIndex *hi = new_hash_index(fd);
+    if (hi == NULL) {
+        close(fd);
+        return NULL;
+    }
+
+    HashHeader *h = &hi->header;
+    if (!pread_full(fd, h, sizeof(HashHeader), 0) || h->magic != HASH_MAGIC ||
+        h->global_depth < 0 || h->global_depth > HASH_MAX_DEPTH || h->num_pages <= 0 ||
+        h->free_page < -1 || h->free_page >= h->num_pages) {
+        free_hash_index(hi);
+        return NULL;
+    }
+
+    size_t len = sizeof(int32_t) * (size_t)dir_size(h->global_depth);
+    hi->dir = malloc(len);
+    if (hi->dir == NULL || !pread_full(fd, hi->dir, len, bucket_offset(h->num_pages))) {
+        free_hash_index(hi);
+        return NULL;
+    }
+    for (int32_t i = 0; i < dir_size(h->global_depth); i++) {
+        if (hi->dir[i] < 0 || hi->dir[i] >= h->num_pages) {
+            free_hash_index(hi);
+            return NULL;
+        }
+    }
+    return hi;
+}
+
+/* new buckets overwrite the old copy of the directory, which is why it is only trusted when clean */
+GrainResult hash_flush(HashIndex *hi) {
+    CHECK_RET_GRAIN_NULL(hi);
+    if (hi->header.clean) {
+        return GRAIN_OK;
+    }
+    GrainResult res = bp_flush_all(&hi->pool);
+    if (res != GRAIN_OK) {
+        return res;
+    }
+    size_t len = sizeof(int32_t) * (size_t)dir_size(hi->header.global_depth);
+    if (!pwrite_full(hi->fd, hi->dir, len, bucket_offset(hi->header.num_pages))) {
+        return GRAIN_FILE_WRITE_FAILED;
+    }
+    hi->header.clean = 1;
+    res = write_header(hi);
+    if (res == GRAIN_OK && fsync(hi->fd) != 0) {
+        res = GRAIN_FILE_WRITE_FAILED;
+    }
+    return res;
+}
+
+GrainResult hash_close(HashIndex *hi) {
+    CHECK_RET_GRAIN_NULL(hi);
+    GrainResult res = hash_flush(hi);
+    free_hash_index(hi);
+    return res;
+}
@@ -1,43 +1,177 @@
 #include "../include/heap.h"
+#include "../include/crc32c.h"
 #include <string.h>
+#include <stddef.h>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define HAVE_AVX2_MATCH 1
+#endif
+
+#define NAME_LEN sizeof(((Record *)0)->name)
+#define EMAIL_LEN sizeof(((Record *)0)->email)
+
+/* a pax page keeps MAX_SLOTS ids, then MAX_SLOTS ages, names and emails */
+#define PAX_ID_OFFSET 0
+#define PAX_AGE_OFFSET (PAX_ID_OFFSET + MAX_SLOTS * sizeof(int32_t))
+#define PAX_NAME_OFFSET (PAX_AGE_OFFSET + MAX_SLOTS * sizeof(int32_t))
+#define PAX_EMAIL_OFFSET (PAX_NAME_OFFSET + MAX_SLOTS * NAME_LEN)
+
+_Static_assert(MAX_SLOTS <= SLOT_BITMAP_WORDS * 32, "slot bitmap too small for MAX_SLOTS");
+_Static_assert(PAX_EMAIL_OFFSET + MAX_SLOTS * EMAIL_LEN <= sizeof(((HeapPage *)0)->storage),
+               "pax columns don't fit in a page");
+
+static inline void set_slot_bit(HeapPage *page, int32_t slot_idx) {
+    page->header.slot_bitmap[slot_idx >> 5] |= 1u << (slot_idx & 31);
+}
+
+static inline void clear_slot_bit(HeapPage *page, int32_t slot_idx) {
+    page->header.slot_bitmap[slot_idx >> 5] &= ~(1u << (slot_idx & 31));
+}
 
 static inline bool slot_in_range(const HeapPage *page, int32_t slot_idx) {
     if (page == NULL) return false;
     return slot_idx >= 0 && slot_idx < page->header.next_slot_idx;
 }
 
+static inline bool is_pax(const HeapPage *page) {
+    return page->header.layout == PAGE_LAYOUT_PAX;
+}
+
+static inline int32_t *pax_column(const HeapPage *page, size_t offset) {
+    return (int32_t *)(page->storage + offset);
+}
+
+static inline char *row_slot(const HeapPage *page, int32_t slot_idx) {
+    return (char *)page->storage + ((size_t)slot_idx * RECORD_SIZE);
+}
+
+/* a free slot's link sits where its id would: the first word of a row, or the id column */
+static inline int32_t *free_link(HeapPage *page, int32_t slot_idx) {
+    if (is_pax(page)) {
+        return pax_column(page, PAX_ID_OFFSET) + slot_idx;
+    }
+    return &((FreeSlot *)row_slot(page, slot_idx))->next_free_slot;
+}
+
 HeapPage *init_page(HeapPage *page, int32_t page_id) {
+    return init_page_layout(page, page_id, PAGE_LAYOUT_ROW);
+}
+
+HeapPage *init_page_layout(HeapPage *page, int32_t page_id, PageLayout layout) {
     page->header.page_id = page_id;
     page->header.num_slots = 0;
     page->header.next_slot_idx = 0;
     page->header.first_free_slot = FREE_SLOT_END;
     page->header.next_free_page = -1;
+    memset(page->header.slot_bitmap, 0, sizeof(page->header.slot_bitmap));
+    page->header.layout = layout;
+    page->header.lsn = 0;
     return page;
 }
 
+/* pax pages have no contiguous slot to point at; use read_slot/write_slot there */
 void *get_slot(HeapPage *page, int32_t slot_idx) {
     CHECK_RET_NULL(page);
-    if (!slot_in_range(page, slot_idx)) {
+    if (!slot_in_range(page, slot_idx) || is_pax(page)) {
         return NULL;
     }
-    return page->storage + (slot_idx * RECORD_SIZE);
+    return row_slot(page, slot_idx);
+}
+
+/* copies out whatever slot_idx holds, live or not, in row format */
+void read_slot(const HeapPage *page, int32_t slot_idx, Record *rec) {
+    if (page == NULL || rec == NULL || slot_idx < 0 || slot_idx >= (int32_t)MAX_SLOTS) return;
+    if (!is_pax(page)) {
+        memcpy(rec, row_slot(page, slot_idx), RECORD_SIZE);
+        return;
+    }
+    rec->id = pax_column(page, PAX_ID_OFFSET)[slot_idx];
+    rec->age = pax_column(page, PAX_AGE_OFFSET)[slot_idx];
+    memcpy(rec->name, page->storage + PAX_NAME_OFFSET + (slot_idx * NAME_LEN), NAME_LEN);
+    memcpy(rec->email, page->storage + PAX_EMAIL_OFFSET + (slot_idx * EMAIL_LEN), EMAIL_LEN);
+}
+
+void write_slot(HeapPage *page, int32_t slot_idx, const Record *rec) {
+    if (page == NULL || rec == NULL || slot_idx < 0 || slot_idx >= (int32_t)MAX_SLOTS) return;
+    if (!is_pax(page)) {
+        memcpy(row_slot(page, slot_idx), rec, RECORD_SIZE);
+        return;
+    }
+    pax_column(page, PAX_ID_OFFSET)[slot_idx] = rec->id;
+    pax_column(page, PAX_AGE_OFFSET)[slot_idx] = rec->age;
+    memcpy(page->storage + PAX_NAME_OFFSET + (slot_idx * NAME_LEN), rec->name, NAME_LEN);
+    memcpy(page->storage + PAX_EMAIL_OFFSET + (slot_idx * EMAIL_LEN), rec->email, EMAIL_LEN);
+}
+
+bool read_record(HeapPage *page, int32_t slot_idx, Record *rec) {
+    CHECK_RET_BOOL(rec);
+    if (!is_slot_live(page, slot_idx)) return false;
+    read_slot(page, slot_idx, rec);
+    return true;
+}
+
+/* the whole column on a pax page, NULL on a row page */
+const int32_t *page_column(HeapPage *page, RecordColumn col) {
+    if (page == NULL || !is_pax(page)) return NULL;
+    return pax_column(page, (col == COLUMN_ID) ? PAX_ID_OFFSET : PAX_AGE_OFFSET);
+}
+
+int32_t column_value(HeapPage *page, RecordColumn col, int32_t slot_idx) {
+    if (page == NULL || slot_idx < 0 || slot_idx >= (int32_t)MAX_SLOTS) return 0;
+    const int32_t *column = page_column(page, col);
+    if (column != NULL) {
+        return column[slot_idx];
+    }
+    const Record *rec = (const Record *)row_slot(page, slot_idx);
+    return (col == COLUMN_ID) ? rec->id : rec->age;
+}
+
+bool is_slot_live(HeapPage *page, int32_t slot_idx) {
+    if (!slot_in_range(page, slot_idx)) return false;
+    return (page->header.slot_bitmap[slot_idx >> 5] >> (slot_idx & 31)) & 1u;
 }
 
 bool is_in_free_list(HeapPage *page, int32_t slot_idx) {
     CHECK_RET_BOOL(page);
-    if (page->header.first_free_slot == FREE_SLOT_END) {
-        return false;
+    return slot_in_range(page, slot_idx) && !is_slot_live(page, slot_idx);
+}
+
+int32_t next_set_slot(const uint32_t *bitmap, int32_t slot_idx, int32_t end) {
+    CHECK_RET_INT(bitmap);
+    if (slot_idx < 0) slot_idx = 0;
+    if (slot_idx >= end) return -1;
+
+    int32_t word = slot_idx >> 5;
+    uint32_t bits = bitmap[word] & (~0u << (slot_idx & 31));
+    for (;;) {
+        if (bits != 0) {
+            int32_t found = (word << 5) + __builtin_ctz(bits);
+            return found < end ? found : -1;
+        }
+        if (++word >= SLOT_BITMAP_WORDS) return -1;
+        bits = bitmap[word];
     }
+}
 
-    int32_t curr = page->header.first_free_slot;
-    while (curr != FREE_SLOT_END) {
-        if (curr == slot_idx) return true;
-        FreeSlot *slot = (FreeSlot *)get_slot(page, curr);
-        CHECK_RET_BOOL(slot);
-        curr = slot->next_free_slot;
+int32_t next_live_slot(HeapPage *page, int32_t slot_idx) {
+    CHECK_RET_INT(page);
+    return next_set_slot(page->header.slot_bitmap, slot_idx, page->header.next_slot_idx);
+}
+
+void rebuild_slot_bitmap(HeapPage *page) {
+    if (page == NULL) return;
+    memset(page->header.slot_bitmap, 0, sizeof(page->header.slot_bitmap));
+    for (int32_t i = 0; i < page->header.next_slot_idx; i++) {
+        set_slot_bit(page, i);
     }
 
-    return false;
+    int32_t curr = page->header.first_free_slot;
+    int32_t steps = 0;
+    while (curr != FREE_SLOT_END && steps++ < page->header.next_slot_idx) {
+        if (!slot_in_range(page, curr)) break;
+        clear_slot_bit(page, curr);
+        curr = *free_link(page, curr);
+    }
 }
 
 int32_t insert_record(HeapPage *page, Record *record) {
@@ -52,35 +186,68 @@ int32_t insert_record(HeapPage *page, Record *record) {
     int32_t slot_idx;
     if (page->header.first_free_slot != FREE_SLOT_END) {
         slot_idx = page->header.first_free_slot;
-        FreeSlot *slot = (FreeSlot *)get_slot(page, slot_idx);
-        CHECK_RET_INT(slot);
-        page->header.first_free_slot = slot->next_free_slot;
+        if (!slot_in_range(page, slot_idx)) return -1;
+        page->header.first_free_slot = *free_link(page, slot_idx);
     } else {
         slot_idx = page->header.next_slot_idx;
         page->header.next_slot_idx++;
     }
 
-    void *dest = get_slot(page, slot_idx);
-    memcpy(dest, record, RECORD_SIZE);
+    write_slot(page, slot_idx, record);
+    set_slot_bit(page, slot_idx);
     page->header.num_slots++;
     return slot_idx;
 }
 
+int32_t insert_records(HeapPage *page, Record *records, int32_t count, int32_t *slots) {
+    CHECK_RET_INT(page);
+    CHECK_RET_INT(records);
+
+    int32_t done = 0;
+    while (done < count && page->header.first_free_slot != FREE_SLOT_END) {
+        int32_t slot_idx = insert_record(page, &records[done]);
+        if (slot_idx == -1) break;
+        if (slots != NULL) slots[done] = slot_idx;
+        done++;
+    }
+
+    /* whatever is left goes past the high water mark in a single copy */
+    int32_t tail = page->header.next_slot_idx;
+    int32_t room = (int32_t)MAX_SLOTS - tail;
+    int32_t take = (count - done < room) ? count - done : room;
+    if (take <= 0) {
+        return done;
+    }
+
+    if (is_pax(page)) {
+        for (int32_t i = 0; i < take; i++) {
+            write_slot(page, tail + i, &records[done + i]);
+        }
+    } else {
+        memcpy(row_slot(page, tail), &records[done], (size_t)take * RECORD_SIZE);
+    }
+    for (int32_t i = 0; i < take; i++) {
+        set_slot_bit(page, tail + i);
+        if (slots != NULL) slots[done + i] = tail + i;
+    }
+    page->header.next_slot_idx += take;
+    page->header.num_slots += take;
+    return done + take;
+}
+
 GrainResult delete_record(HeapPage *page, int32_t slot_idx) {
     CHECK_RET_GRAIN_NULL(page);
     if (!slot_in_range(page, slot_idx)) {
         return GRAIN_INVALID_SLOT;
     }
 
-    if (is_in_free_list(page, slot_idx)) {
+    if (!is_slot_live(page, slot_idx)) {
         return GRAIN_INVALID_SLOT;
     }
 
-    FreeSlot *slot = (FreeSlot *)get_slot(page, slot_idx);
-    CHECK_RET_GRAIN_INVALID(slot);
-
-    slot->next_free_slot = page->header.first_free_slot;
+    *free_link(page, slot_idx) = page->header.first_free_slot;
     page->header.first_free_slot = slot_idx;
+    clear_slot_bit(page, slot_idx);
     page->header.num_slots--;
     return GRAIN_OK;
 }
@@ -92,19 +259,21 @@ GrainResult update_record(HeapPage *page, int32_t slot_idx, Record *new_record)
         return GRAIN_INVALID_SLOT;
     }
 
-    Record *record = get_record(page, slot_idx);
-    CHECK_RET_GRAIN_NULL(record);
+    Record record;
+    if (!read_record(page, slot_idx, &record)) {
+        return GRAIN_NULL_PTR;
+    }
 
-    strcpy(record->name, new_record->name);
-    strcpy(record->email, new_record->email);
-    record->age = new_record->age;
+    strcpy(record.name, new_record->name);
+    strcpy(record.email, new_record->email);
+    record.age = new_record->age;
+    write_slot(page, slot_idx, &record);
     return GRAIN_OK;
 }
 
 Record *get_record(HeapPage *page, int32_t slot_idx) {
     CHECK_RET_NULL(page);
-    if (!slot_in_range(page, slot_idx)) return NULL;
-    if (is_in_free_list(page, slot_idx)) return NULL;
+    if (!is_slot_live(page, slot_idx)) return NULL;
     Record *record = (Record *)get_slot(page, slot_idx);
     CHECK_RET_NULL(record);
     return record;
@@ -117,3 +286,106 @@ bool has_free_space(HeapPage *page) {
     }
     return page->header.next_slot_idx < (int32_t)MAX_SLOTS;
 }
+
+static inline bool values_match(int32_t id, int32_t age, const Predicate *pred) {
+    return id >= pred->id_min && id <= pred->id_max &&
+           age >= pred->age_min && age <= pred->age_max;
+}
+
+#ifdef HAVE_AVX2_MATCH
+/* one bit per lane whose id and age are both inside the predicate's bounds */
+__attribute__((target("avx2")))
+static inline uint32_t match_lanes(__m256i ids, __m256i ages, const Predicate *pred) {
+    __m256i out = _mm256_or_si256(_mm256_cmpgt_epi32(_mm256_set1_epi32(pred->id_min), ids),
+                                  _mm256_cmpgt_epi32(ids, _mm256_set1_epi32(pred->id_max)));
+    out = _mm256_or_si256(out, _mm256_cmpgt_epi32(_mm256_set1_epi32(pred->age_min), ages));
+    out = _mm256_or_si256(out, _mm256_cmpgt_epi32(ages, _mm256_set1_epi32(pred->age_max)));
+    return ~(uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(out)) & 0xffu;
+}
+
+/* 8 records per step: gather id and age at the 64-byte record stride, range-check both */
+__attribute__((target("avx2")))
+static int32_t match_rows_avx2(HeapPage *page, const Predicate *pred, int32_t end,
+                               uint32_t *matches) {
+    const __m256i stride = _mm256_setr_epi32(0, 16, 32, 48, 64, 80, 96, 112);
+
+    int32_t slot = 0;
+    for (; slot + 8 <= end; slot += 8) {
+        const int *base = (const int *)row_slot(page, slot);
+        __m256i ids = _mm256_i32gather_epi32(base, stride, 4);
+        __m256i ages = _mm256_i32gather_epi32(base + offsetof(Record, age) / 4, stride, 4);
+        matches[slot >> 5] |= match_lanes(ids, ages, pred) << (slot & 31);
+    }
+    return slot;
+}
+
+/* on a pax page the same check is two plain loads per 8 records */
+__attribute__((target("avx2")))
+static int32_t match_columns_avx2(const int32_t *ids, const int32_t *ages, const Predicate *pred,
+                                  int32_t end, uint32_t *matches) {
+    int32_t slot = 0;
+    for (; slot + 8 <= end; slot += 8) {
+        __m256i id = _mm256_loadu_si256((const __m256i *)(ids + slot));
+        __m256i age = _mm256_loadu_si256((const __m256i *)(ages + slot));
+        matches[slot >> 5] |= match_lanes(id, age, pred) << (slot & 31);
+    }
+    return slot;
+}
+#endif
+
+void match_records(HeapPage *page, const Predicate *pred, uint32_t *matches) {
+    if (matches == NULL) return;
+    memset(matches, 0, sizeof(uint32_t) * SLOT_BITMAP_WORDS);
+    if (page == NULL || pred == NULL) return;
+
+    int32_t end = page->header.next_slot_idx;
+    int32_t slot = 0;
+    if (is_pax(page)) {
+        const int32_t *ids = pax_column(page, PAX_ID_OFFSET);
+        const int32_t *ages = pax_column(page, PAX_AGE_OFFSET);
+#ifdef HAVE_AVX2_MATCH
+        if (__builtin_cpu_supports("avx2")) {
+            slot = match_columns_avx2(ids, ages, pred, end, matches);
+        }
+#endif
+        for (; slot < end; slot++) {
+            if (values_match(ids[slot], ages[slot], pred)) {
+                matches[slot >> 5] |= 1u << (slot & 31);
+            }
+        }
+    } else {
+#ifdef HAVE_AVX2_MATCH
+        if (__builtin_cpu_supports("avx2")) {
+            slot = match_rows_avx2(page, pred, end, matches);
+        }
+#endif
+        for (; slot < end; slot++) {
+            const Record *rec = (const Record *)row_slot(page, slot);
+            if (values_match(rec->id, rec->age, pred)) {
+                matches[slot >> 5] |= 1u << (slot & 31);
+            }
+        }
+    }
+
+    /* free slots hold list links, not records, so whatever they "matched" is dropped here */
+    for (int32_t w = 0; w < SLOT_BITMAP_WORDS; w++) {
+        matches[w] &= page->header.slot_bitmap[w];
+    }
+}
+
+uint32_t page_checksum(const HeapPage *page) {
+    if (page == NULL) return 0;
+    return crc32c(0, page, offsetof(HeapPage, checksum));
+}
+
+/* done on the copy that goes to disk, right before it's written */
+void stamp_page(HeapPage *page) {
+    if (page == NULL) return;
+    page->checksum = page_checksum(page);
+}
+
+/* false for a page that was torn or rotted since it was stamped */
+bool verify_page(const HeapPage *page) {
+    if (page == NULL) return false;
+    return page->checksum == page_checksum(page);
+}
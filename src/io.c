@@ -0,0 +1,46 @@
+#include "../include/io.h"
+#include <errno.h>
+#include <unistd.h>
+
+/* pread/pwrite may transfer less than asked or be interrupted; both loop until done or EOF */
+bool pread_full(int fd, void *buf, size_t len, off_t offset) {
+    char *dst = buf;
+    while (len > 0) {
+        ssize_t n = pread(fd, dst, len, offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        dst += n;
+        len -= (size_t)n;
+        offset += n;
+    }
+    return true;
+}
+
+bool pwrite_full(int fd, const void *buf, size_t len, off_t offset) {
+    const char *src = buf;
+    while (len > 0) {
+        ssize_t n = pwrite(fd, src, len, offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        src += n;
+        len -= (size_t)n;
+        offset += n;
+    }
+    return true;
+}
+
+/*
+ * every sidecar keeps a clean flag in its header at offset 0. it is cleared
+ * on disk before the first change after a flush, so a sidecar that was not
+ * flushed before a crash is known to be stale. clean points into header.
+ */
+GrainResult sidecar_mark_in_use(int fd, void *header, size_t size, int32_t *clean) {
+    if (!*clean) {
+        return GRAIN_OK;
+    }
+    *clean = 0;
+    if (!pwrite_full(fd, header, size, 0) || fdatasync(fd) != 0) {
+        return GRAIN_FILE_WRITE_FAILED;
+    }
+    return GRAIN_OK;
+}
@@ -0,0 +1,359 @@
+#include "../include/pagedir.h"
+#include "../include/codec.h"
+#include "../include/crc32c.h"
+#include "../include/io.h"
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define PAGEDIR_INITIAL_CAPACITY 256
+#define FRAME_HEADER_SIZE ((int64_t)sizeof(PageFrameHeader))
+
+static inline off_t entry_offset(int32_t page_id) {
+    return sizeof(PageDirHeader) + ((off_t)page_id * sizeof(PageExtent));
+}
+
+static inline int32_t frame_capacity(int32_t length) {
+    int64_t size = FRAME_HEADER_SIZE + length;
+    size = ((size + PAGE_FRAME_ALIGN - 1) / PAGE_FRAME_ALIGN) * PAGE_FRAME_ALIGN;
+    return (int32_t)(size - FRAME_HEADER_SIZE);
+}
+
+/* over the stored bytes, so a frame that was only half written is caught before it's decompressed */
+static uint32_t frame_checksum(const uint8_t *body, int32_t length) {
+    return crc32c(0, body, (size_t)length);
+}
+
+static GrainResult write_header(PageDirectory *pd) {
+    if (!pwrite_full(pd->fd, &pd->header, sizeof(PageDirHeader), 0)) {
+        return GRAIN_FILE_WRITE_FAILED;
+    }
+    return GRAIN_OK;
+}
+
+static GrainResult reserve_pages(PageDirectory *pd, int32_t count) {
+    if (count <= pd->capacity) {
+        return GRAIN_OK;
+    }
+    int32_t capacity = (pd->capacity > 0) ? pd->capacity : PAGEDIR_INITIAL_CAPACITY;
+    while (capacity < count) {
+        capacity *= 2;
+    }
+    PageExtent *extents = realloc(pd->extents, sizeof(PageExtent) * (size_t)capacity);
+    CHECK_RET_GRAIN_NULL(extents);
+    memset(extents + pd->capacity, 0, sizeof(PageExtent) * (size_t)(capacity - pd->capacity));
+    pd->extents = extents;
+    pd->capacity = capacity;
+    return GRAIN_OK;
+}
+
+static void touch(PageDirectory *pd, int32_t page_id) {
+    if (page_id < pd->dirty_lo) pd->dirty_lo = page_id;
+    if (page_id > pd->dirty_hi) pd->dirty_hi = page_id;
+}
+
+/* compresses the page and writes it over its frame, or behind the last frame if it has outgrown it */
+GrainResult pagedir_write(PageDirectory *pd, int32_t page_id, const void *page) {
+    CHECK_RET_GRAIN_NULL(pd);
+    CHECK_RET_GRAIN_NULL(page);
+    if (page_id < 0) {
+        return GRAIN_INVALID_PAGE_ID;
+    }
+
+    uint8_t frame[sizeof(PageFrameHeader) + PAGE_SIZE];
+    uint8_t *body = frame + sizeof(PageFrameHeader);
+    int32_t length = (int32_t)codec_compress(page, PAGE_SIZE, body, PAGE_SIZE - 1);
+    if (length == 0) {
+        memcpy(body, page, PAGE_SIZE);
+        length = PAGE_SIZE;
+    }
+
+    pthread_mutex_lock(&pd->lock);
+    GrainResult res = sidecar_mark_in_use(pd->fd, &pd->header, sizeof(PageDirHeader), &pd->header.clean);
+    if (res == GRAIN_OK) {
+        res = reserve_pages(pd, page_id + 1);
+    }
+    if (res != GRAIN_OK) {
+        pthread_mutex_unlock(&pd->lock);
+        return res;
+    }
+
+    PageExtent *ext = &pd->extents[page_id];
+    if (ext->offset == 0 || ext->capacity < length) {
+        ext->offset = pd->header.data_end;
+        ext->capacity = frame_capacity(length);
+        pd->header.data_end += FRAME_HEADER_SIZE + ext->capacity;
+    }
+    ext->length = length;
+    if (page_id >= pd->header.num_pages) {
+        pd->header.num_pages = page_id + 1;
+    }
+    touch(pd, page_id);
+
+    PageFrameHeader header = {
+        .magic = PAGE_FRAME_MAGIC,
+        .page_id = page_id,
+        .length = length,
+        .capacity = ext->capacity,
+        .seq = pd->header.next_seq++,
+        .checksum = frame_checksum(body, length),
+        .reserved = 0,
+    };
+    memcpy(frame, &header, sizeof(header));
+    /* written under the lock, so a reader never sees a frame half rewritten in place */
+    if (!pwrite_full(pd->data_fd, frame, sizeof(PageFrameHeader) + (size_t)length, ext->offset)) {
+        res = GRAIN_FILE_WRITE_FAILED;
+    }
+    pthread_mutex_unlock(&pd->lock);
+    return res;
+}
+
+static bool frame_valid(const PageFrameHeader *h) {
+    return h->magic == PAGE_FRAME_MAGIC && h->page_id >= 0 && h->length > 0 &&
+           h->length <= PAGE_SIZE && h->capacity >= h->length && h->capacity <= PAGE_SIZE + PAGE_FRAME_ALIGN;
+}
+
+GrainResult pagedir_read(PageDirectory *pd, int32_t page_id, void *page) {
+    CHECK_RET_GRAIN_NULL(pd);
+    CHECK_RET_GRAIN_NULL(page);
+    if (page_id < 0) {
+        return GRAIN_INVALID_PAGE_ID;
+    }
+
+    uint8_t frame[sizeof(PageFrameHeader) + PAGE_SIZE];
+    pthread_mutex_lock(&pd->lock);
+    PageExtent ext = {0, 0, 0};
+    if (page_id < pd->header.num_pages) {
+        ext = pd->extents[page_id];
+    }
+    bool read = ext.offset != 0 &&
+                pread_full(pd->data_fd, frame, sizeof(PageFrameHeader) + (size_t)ext.length, ext.offset);
+    pthread_mutex_unlock(&pd->lock);
+    if (!read) {
+        return GRAIN_FILE_READ_FAILED;
+    }
+
+    /* decompression happens outside the lock, so parallel readers only queue for the pread */
+    PageFrameHeader header;
+    memcpy(&header, frame, sizeof(header));
+    const uint8_t *body = frame + sizeof(PageFrameHeader);
+    if (!frame_valid(&header) || header.page_id != page_id || header.length != ext.length ||
+        header.checksum != frame_checksum(body, header.length)) {
+        return GRAIN_CORRUPT_PAGE;
+    }
+    if (header.length == PAGE_SIZE) {
+        memcpy(page, body, PAGE_SIZE);
+        return GRAIN_OK;
+    }
+    return codec_decompress(body, (size_t)header.length, page, PAGE_SIZE) ? GRAIN_OK : GRAIN_CORRUPT_PAGE;
+}
+
+bool pagedir_extent(PageDirectory *pd, int32_t page_id, PageExtent *extent) {
+    if (pd == NULL || extent == NULL || page_id < 0) return false;
+    pthread_mutex_lock(&pd->lock);
+    bool found = page_id < pd->header.num_pages && pd->extents[page_id].offset != 0;
+    if (found) {
+        *extent = pd->extents[page_id];
+    }
+    pthread_mutex_unlock(&pd->lock);
+    return found;
+}
+
+/* forgets pages from num_pages on and pulls data_end back to the end of the last frame still in use */
+GrainResult pagedir_truncate(PageDirectory *pd, int32_t num_pages) {
+    CHECK_RET_GRAIN_NULL(pd);
+    if (num_pages < 0) {
+        return GRAIN_INVALID_PAGE_ID;
+    }
+
+    pthread_mutex_lock(&pd->lock);
+    GrainResult res = GRAIN_OK;
+    if (num_pages < pd->header.num_pages) {
+        res = sidecar_mark_in_use(pd->fd, &pd->header, sizeof(PageDirHeader), &pd->header.clean);
+    }
+    if (res == GRAIN_OK && num_pages < pd->header.num_pages) {
+        memset(&pd->extents[num_pages], 0, sizeof(PageExtent) * (size_t)(pd->header.num_pages - num_pages));
+        pd->header.num_pages = num_pages;
+        if (pd->dirty_hi >= num_pages) {
+            pd->dirty_hi = num_pages - 1;
+        }
+
+        int64_t end = pd->header.data_start;
+        for (int32_t i = 0; i < num_pages; i++) {
+            const PageExtent *ext = &pd->extents[i];
+            if (ext->offset != 0 && ext->offset + FRAME_HEADER_SIZE + ext->capacity > end) {
+                end = ext->offset + FRAME_HEADER_SIZE + ext->capacity;
+            }
+        }
+        pd->header.data_end = end;
+    }
+    pthread_mutex_unlock(&pd->lock);
+    return res;
+}
+
+/*
+ * walks the frame chain from data_start and keeps the newest intact frame of
+ * every page below num_pages. the chain ends at the first thing that isn't a frame.
+ */
+GrainResult pagedir_rebuild(PageDirectory *pd, int32_t num_pages) {
+    CHECK_RET_GRAIN_NULL(pd);
+    if (num_pages < 0) {
+        return GRAIN_INVALID_PAGE_ID;
+    }
+
+    pthread_mutex_lock(&pd->lock);
+    GrainResult res = sidecar_mark_in_use(pd->fd, &pd->header, sizeof(PageDirHeader), &pd->header.clean);
+    if (res == GRAIN_OK) {
+        res = reserve_pages(pd, num_pages);
+    }
+    uint64_t *seqs = (res == GRAIN_OK) ? calloc((size_t)num_pages + 1, sizeof(uint64_t)) : NULL;
+    if (res == GRAIN_OK && seqs == NULL) {
+        res = GRAIN_NULL_PTR;
+    }
+    if (res != GRAIN_OK) {
+        pthread_mutex_unlock(&pd->lock);
+        return res;
+    }
+    if (pd->capacity > 0) {
+        memset(pd->extents, 0, sizeof(PageExtent) * (size_t)pd->capacity);
+    }
+
+    uint8_t body[PAGE_SIZE];
+    uint64_t max_seq = 0;
+    int64_t offset = pd->header.data_start;
+    PageFrameHeader h;
+    while (pread_full(pd->data_fd, &h, sizeof(h), offset) && frame_valid(&h)) {
+        if (h.seq > max_seq) {
+            max_seq = h.seq;
+        }
+        if (h.page_id < num_pages && h.seq > seqs[h.page_id] &&
+            pread_full(pd->data_fd, body, (size_t)h.length, offset + FRAME_HEADER_SIZE) &&
+            h.checksum == frame_checksum(body, h.length)) {
+            seqs[h.page_id] = h.seq;
+            pd->extents[h.page_id] = (PageExtent){offset, h.capacity, h.length};
+        }
+        offset += FRAME_HEADER_SIZE + h.capacity;
+    }
+    free(seqs);
+
+    pd->header.num_pages = num_pages;
+    pd->header.data_end = offset;
+    pd->header.next_seq = max_seq + 1;
+    pd->dirty_lo = 0;
+    pd->dirty_hi = num_pages - 1;
+    pthread_mutex_unlock(&pd->lock);
+    return GRAIN_OK;
+}
+
+static PageDirectory *new_pagedir(int fd, int data_fd) {
+    PageDirectory *pd = (PageDirectory *)calloc(1, sizeof(PageDirectory));
+    CHECK_RET_NULL(pd);
+    pd->fd = fd;
+    pd->data_fd = data_fd;
+    pd->dirty_lo = INT32_MAX;
+    pd->dirty_hi = -1;
+    pthread_mutex_init(&pd->lock, NULL);
+    return pd;
+}
+
+static void free_pagedir(PageDirectory *pd) {
+    close(pd->fd);
+    pthread_mutex_destroy(&pd->lock);
+    free(pd->extents);
+    free(pd);
+}
+
+PageDirectory *pagedir_create(const char *path, int data_fd, int64_t data_start) {
+    CHECK_RET_NULL(path);
+    if (data_fd < 0 || data_start < 0) {
+        return NULL;
+    }
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return NULL;
+    }
+    PageDirectory *pd = new_pagedir(fd, data_fd);
+    if (pd == NULL) {
+        close(fd);
+        return NULL;
+    }
+
+    pd->header.magic = PAGEDIR_MAGIC;
+    pd->header.data_start = data_start;
+    pd->header.data_end = data_start;
+    pd->header.next_seq = 1;
+    pd->header.clean = 1;
+    if (write_header(pd) != GRAIN_OK) {
+        free_pagedir(pd);
+        return NULL;
+    }
+    return pd;
+}
+
+PageDirectory *pagedir_open(const char *path, int data_fd) {
+    CHECK_RET_NULL(path);
+    int fd = open(path, O_RDWR);
+    if (fd < 0) {
+        return NULL;
+    }
+    PageDirectory *pd = new_pagedir(fd, data_fd);
+    if (pd == NULL) {
+        close(fd);
+        return NULL;
+    }
+
+    PageDirHeader *h = &pd->header;
+    if (!pread_full(fd, h, sizeof(PageDirHeader), 0) || h->magic != PAGEDIR_MAGIC || h->num_pages < 0 ||
+        h->data_start < 0 || h->data_end < h->data_start ||
+        reserve_pages(pd, h->num_pages) != GRAIN_OK ||
+        !pread_full(fd, pd->extents, sizeof(PageExtent) * (size_t)h->num_pages, entry_offset(0))) {
+        free_pagedir(pd);
+        return NULL;
+    }
+    for (int32_t i = 0; i < h->num_pages; i++) {
+        const PageExtent *ext = &pd->extents[i];
+        if (ext->offset != 0 && (ext->offset < h->data_start || ext->length <= 0 ||
+                                 ext->length > ext->capacity ||
+                                 ext->offset + FRAME_HEADER_SIZE + ext->capacity > h->data_end)) {
+            free_pagedir(pd);
+            return NULL;
+        }
+    }
+    return pd;
+}
+
+/* the frames have to be on disk before a clean directory points at them */
+GrainResult pagedir_flush(PageDirectory *pd) {
+    CHECK_RET_GRAIN_NULL(pd);
+    pthread_mutex_lock(&pd->lock);
+    GrainResult res = GRAIN_OK;
+    if (!pd->header.clean) {
+        if (fdatasync(pd->data_fd) != 0) {
+            res = GRAIN_FILE_WRITE_FAILED;
+        }
+        if (res == GRAIN_OK && pd->dirty_hi >= pd->dirty_lo) {
+            size_t len = sizeof(PageExtent) * (size_t)(pd->dirty_hi - pd->dirty_lo + 1);
+            if (!pwrite_full(pd->fd, &pd->extents[pd->dirty_lo], len, entry_offset(pd->dirty_lo))) {
+                res = GRAIN_FILE_WRITE_FAILED;
+            }
+        }
+        if (res == GRAIN_OK) {
+            pd->dirty_lo = INT32_MAX;
+            pd->dirty_hi = -1;
+            pd->header.clean = 1;
+            res = write_header(pd);
+        }
+        if (res == GRAIN_OK && fsync(pd->fd) != 0) {
+            res = GRAIN_FILE_WRITE_FAILED;
+        }
+    }
+    pthread_mutex_unlock(&pd->lock);
+    return res;
+}
+
+GrainResult pagedir_close(PageDirectory *pd) {
+    CHECK_RET_GRAIN_NULL(pd);
+    GrainResult res = pagedir_flush(pd);
+    free_pagedir(pd);
+    return res;
+}
@@ -0,0 +1,253 @@
+#include "../include/wal.h"
+#include "../include/io.h"
+#include "../include/crc32c.h"
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static inline off_t log_offset(Wal *wal, uint64_t lsn) {
+    return (off_t)(sizeof(WalFileHeader) + (lsn - wal->base_lsn));
+}
+
+static GrainResult write_wal_header(Wal *wal) {
+    WalFileHeader header = {.magic = WAL_MAGIC, .reserved = 0, .base_lsn = wal->base_lsn};
+    if (!pwrite_full(wal->fd, &header, sizeof(header), 0)) {
+        return GRAIN_FILE_WRITE_FAILED;
+    }
+    return GRAIN_OK;
+}
+
+GrainResult wal_open(Wal *wal, const char *path, uint64_t min_lsn) {
+    CHECK_RET_GRAIN_NULL(wal);
+    CHECK_RET_GRAIN_NULL(path);
+
+    memset(wal, 0, sizeof(Wal));
+    wal->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (wal->fd < 0) {
+        return GRAIN_FILE_OPEN_FAILED;
+    }
+
+    wal->buf = malloc(WAL_BUFFER_SIZE);
+    wal->spare = malloc(WAL_BUFFER_SIZE);
+    if (wal->buf == NULL || wal->spare == NULL) {
+        free(wal->buf);
+        free(wal->spare);
+        close(wal->fd);
+        return GRAIN_NULL_PTR;
+    }
+    pthread_mutex_init(&wal->lock, NULL);
+    pthread_cond_init(&wal->flushed, NULL);
+
+    WalFileHeader header;
+    struct stat st;
+    bool fresh = !pread_full(wal->fd, &header, sizeof(header), 0) || header.magic != WAL_MAGIC;
+    bool empty = fstat(wal->fd, &st) == 0 && st.st_size <= (off_t)sizeof(WalFileHeader);
+    if (fresh || (empty && header.base_lsn < min_lsn)) {
+        wal->base_lsn = min_lsn;
+    } else {
+        wal->base_lsn = header.base_lsn;
+    }
+    wal->next_lsn = wal->base_lsn;
+    wal->synced_lsn = wal->base_lsn;
+    wal->buf_lsn = wal->base_lsn;
+
+    if (fresh) {
+        GrainResult res = write_wal_header(wal);
+        if (res != GRAIN_OK) {
+            wal_close(wal);
+            return res;
+        }
+    }
+    return GRAIN_OK;
+}
+
+GrainResult wal_close(Wal *wal) {
+    CHECK_RET_GRAIN_NULL(wal);
+    if (wal->buf != NULL) {
+        pthread_mutex_destroy(&wal->lock);
+        pthread_cond_destroy(&wal->flushed);
+    }
+    free(wal->buf);
+    free(wal->spare);
+    wal->buf = NULL;
+    wal->spare = NULL;
+    if (wal->fd >= 0 && close(wal->fd) != 0) {
+        wal->fd = -1;
+        return GRAIN_FILE_WRITE_FAILED;
+    }
+    wal->fd = -1;
+    return GRAIN_OK;
+}
+
+/*
+ * called with the lock held and no flush running. the filled buffer is swapped
+ * out so appenders keep going while this thread writes and syncs it.
+ */
+static GrainResult flush_locked(Wal *wal) {
+    char *buf = wal->buf;
+    size_t len = wal->buf_len;
+    off_t offset = log_offset(wal, wal->buf_lsn);
+    uint64_t end = wal->next_lsn;
+
+    wal->buf = wal->spare;
+    wal->spare = buf;
+    wal->buf_len = 0;
+    wal->buf_lsn = end;
+    wal->flushing = true;
+    pthread_mutex_unlock(&wal->lock);
+
+    bool ok = (len == 0 || pwrite_full(wal->fd, buf, len, offset)) && fdatasync(wal->fd) == 0;
+
+    pthread_mutex_lock(&wal->lock);
+    wal->flushing = false;
+    if (ok) {
+        wal->synced_lsn = end;
+        wal->syncs++;
+    } else {
+        wal->failed = true;
+    }
+    pthread_cond_broadcast(&wal->flushed);
+    return ok ? GRAIN_OK : GRAIN_FILE_WRITE_FAILED;
+}
+
+GrainResult wal_append(Wal *wal, const void *data, uint32_t len, uint64_t *lsn) {
+    CHECK_RET_GRAIN_NULL(wal);
+    CHECK_RET_GRAIN_NULL(data);
+    CHECK_RET_GRAIN_NULL(lsn);
+
+    size_t total = sizeof(WalRecordHeader) + len;
+    if (total > WAL_BUFFER_SIZE) {
+        return GRAIN_FILE_WRITE_FAILED;
+    }
+
+    pthread_mutex_lock(&wal->lock);
+    GrainResult res = GRAIN_OK;
+    while (!wal->failed && wal->buf_len + total > WAL_BUFFER_SIZE) {
+        if (wal->flushing) {
+            pthread_cond_wait(&wal->flushed, &wal->lock);
+            continue;
+        }
+        res = flush_locked(wal);
+        if (res != GRAIN_OK) break;
+    }
+    if (wal->failed) {
+        res = GRAIN_FILE_WRITE_FAILED;
+    }
+
+    if (res == GRAIN_OK) {
+        WalRecordHeader header = {.len = (uint32_t)total, .crc = 0, .lsn = wal->next_lsn + total};
+        char *dst = wal->buf + wal->buf_len;
+        memcpy(dst, &header, sizeof(header));
+        memcpy(dst + sizeof(header), data, len);
+        header.crc = crc32c(0, dst, total);
+        memcpy(dst, &header, sizeof(header));
+
+        wal->buf_len += total;
+        wal->next_lsn += total;
+        *lsn = wal->next_lsn;
+    }
+    pthread_mutex_unlock(&wal->lock);
+    return res;
+}
+
+GrainResult wal_commit(Wal *wal, uint64_t lsn) {
+    CHECK_RET_GRAIN_NULL(wal);
+
+    pthread_mutex_lock(&wal->lock);
+    if (lsn > wal->next_lsn) {
+        lsn = wal->next_lsn;
+    }
+
+    /* whoever finds no flush running becomes the leader and syncs for everyone queued so far */
+    GrainResult res = GRAIN_OK;
+    while (wal->synced_lsn < lsn) {
+        if (wal->failed) {
+            res = GRAIN_FILE_WRITE_FAILED;
+            break;
+        }
+        if (wal->flushing) {
+            pthread_cond_wait(&wal->flushed, &wal->lock);
+            continue;
+        }
+        res = flush_locked(wal);
+        if (res != GRAIN_OK) break;
+    }
+    pthread_mutex_unlock(&wal->lock);
+    return res;
+}
+
+/* replays every intact record in order and stops at the first torn or stale one */
+GrainResult wal_replay(Wal *wal, WalReplayFn fn, void *ctx) {
+    CHECK_RET_GRAIN_NULL(wal);
+    CHECK_RET_GRAIN_NULL(fn);
+
+    uint64_t lsn = wal->base_lsn;
+    char *rec = wal->spare;
+    for (;;) {
+        WalRecordHeader header;
+        off_t offset = log_offset(wal, lsn);
+        if (!pread_full(wal->fd, &header, sizeof(header), offset)) break;
+        if (header.len <= sizeof(header) || header.len > WAL_BUFFER_SIZE) break;
+        if (header.lsn != lsn + header.len) break;
+        if (!pread_full(wal->fd, rec, header.len, offset)) break;
+
+        uint32_t crc = header.crc;
+        ((WalRecordHeader *)rec)->crc = 0;
+        if (crc32c(0, rec, header.len) != crc) break;
+
+        GrainResult res = fn(ctx, header.lsn, rec + sizeof(header),
+                             header.len - (uint32_t)sizeof(header));
+        if (res != GRAIN_OK) {
+            return res;
+        }
+        lsn = header.lsn;
+    }
+
+    if (ftruncate(wal->fd, log_offset(wal, lsn)) != 0) {
+        return GRAIN_FILE_WRITE_FAILED;
+    }
+    wal->next_lsn = lsn;
+    wal->synced_lsn = lsn;
+    wal->buf_lsn = lsn;
+    wal->buf_len = 0;
+    return GRAIN_OK;
+}
+
+/* drops every record; only valid once the data they describe is durable elsewhere */
+GrainResult wal_truncate(Wal *wal) {
+    CHECK_RET_GRAIN_NULL(wal);
+
+    pthread_mutex_lock(&wal->lock);
+    GrainResult res = GRAIN_OK;
+    wal->base_lsn = wal->next_lsn;
+    wal->synced_lsn = wal->next_lsn;
+    wal->buf_lsn = wal->next_lsn;
+    wal->buf_len = 0;
+    if (ftruncate(wal->fd, sizeof(WalFileHeader)) != 0) {
+        res = GRAIN_FILE_WRITE_FAILED;
+    } else {
+        res = write_wal_header(wal);
+    }
+    if (res == GRAIN_OK && fdatasync(wal->fd) != 0) {
+        res = GRAIN_FILE_WRITE_FAILED;
+    }
+    pthread_mutex_unlock(&wal->lock);
+    return res;
+}
+
+uint64_t wal_next_lsn(Wal *wal) {
+    if (wal == NULL) return 0;
+    pthread_mutex_lock(&wal->lock);
+    uint64_t lsn = wal->next_lsn;
+    pthread_mutex_unlock(&wal->lock);
+    return lsn;
+}
+
+bool wal_is_empty(Wal *wal) {
+    if (wal == NULL) return true;
+    pthread_mutex_lock(&wal->lock);
+    bool empty = wal->next_lsn == wal->base_lsn;
+    pthread_mutex_unlock(&wal->lock);
+    return empty;
+}
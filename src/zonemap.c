@@ -0,0 +1,213 @@
+#include "../include/zonemap.h"
+#include "../include/io.h"
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define ZONEMAP_INITIAL_CAPACITY 64
+
+static const Zone EMPTY_ZONE = {INT32_MAX, INT32_MIN, INT32_MAX, INT32_MIN};
+
+static inline off_t zone_offset(int32_t page_id) {
+    return sizeof(ZoneMapHeader) + ((off_t)page_id * sizeof(Zone));
+}
+
+static GrainResult write_header(ZoneMap *zm) {
+    if (!pwrite_full(zm->fd, &zm->header, sizeof(ZoneMapHeader), 0)) {
+        return GRAIN_FILE_WRITE_FAILED;
+    }
+    return GRAIN_OK;
+}
+
+static void mark_dirty(ZoneMap *zm, int32_t lo, int32_t hi) {
+    if (lo < zm->dirty_lo) zm->dirty_lo = lo;
+    if (hi > zm->dirty_hi) zm->dirty_hi = hi;
+}
+
+static GrainResult reserve_zones(ZoneMap *zm, int32_t count) {
+    if (count <= zm->capacity) {
+        return GRAIN_OK;
+    }
+    int32_t capacity = (zm->capacity > 0) ? zm->capacity : ZONEMAP_INITIAL_CAPACITY;
+    while (capacity < count) {
+        capacity *= 2;
+    }
+    Zone *zones = realloc(zm->zones, sizeof(Zone) * capacity);
+    CHECK_RET_GRAIN_NULL(zones);
+    zm->zones = zones;
+    zm->capacity = capacity;
+    return GRAIN_OK;
+}
+
+static GrainResult begin_change(ZoneMap *zm, int32_t page_id) {
+    GrainResult res = sidecar_mark_in_use(zm->fd, &zm->header, sizeof(ZoneMapHeader), &zm->header.clean);
+    if (res != GRAIN_OK) {
+        return res;
+    }
+    if (page_id >= zm->header.num_pages) {
+        res = reserve_zones(zm, page_id + 1);
+        if (res != GRAIN_OK) {
+            return res;
+        }
+        for (int32_t i = zm->header.num_pages; i <= page_id; i++) {
+            zm->zones[i] = EMPTY_ZONE;
+        }
+        mark_dirty(zm, zm->header.num_pages, page_id);
+        zm->header.num_pages = page_id + 1;
+    }
+    mark_dirty(zm, page_id, page_id);
+    return GRAIN_OK;
+}
+
+static inline void widen(Zone *zone, const Record *rec) {
+    if (rec->id < zone->id_min) zone->id_min = rec->id;
+    if (rec->id > zone->id_max) zone->id_max = rec->id;
+    if (rec->age < zone->age_min) zone->age_min = rec->age;
+    if (rec->age > zone->age_max) zone->age_max = rec->age;
+}
+
+GrainResult zonemap_widen(ZoneMap *zm, int32_t page_id, const Record *rec) {
+    CHECK_RET_GRAIN_NULL(zm);
+    CHECK_RET_GRAIN_NULL(rec);
+    if (page_id < 0) {
+        return GRAIN_INVALID_PAGE_ID;
+    }
+
+    if (page_id < zm->header.num_pages) {
+        Zone zone = zm->zones[page_id];
+        widen(&zone, rec);
+        if (memcmp(&zone, &zm->zones[page_id], sizeof(Zone)) == 0) {
+            return GRAIN_OK;
+        }
+    }
+    GrainResult res = begin_change(zm, page_id);
+    if (res != GRAIN_OK) {
+        return res;
+    }
+    widen(&zm->zones[page_id], rec);
+    return GRAIN_OK;
+}
+
+/* recomputes a page's zone from its live records; deletes and updates can only tighten it this way */
+GrainResult zonemap_track_page(ZoneMap *zm, HeapPage *page) {
+    CHECK_RET_GRAIN_NULL(zm);
+    CHECK_RET_GRAIN_NULL(page);
+    int32_t page_id = page->header.page_id;
+    if (page_id < 0) {
+        return GRAIN_INVALID_PAGE_ID;
+    }
+
+    Zone zone = EMPTY_ZONE;
+    for (int32_t slot = next_live_slot(page, 0); slot != -1; slot = next_live_slot(page, slot + 1)) {
+        Record rec = {.id = column_value(page, COLUMN_ID, slot), .age = column_value(page, COLUMN_AGE, slot)};
+        widen(&zone, &rec);
+    }
+    if (page_id < zm->header.num_pages &&
+        memcmp(&zone, &zm->zones[page_id], sizeof(Zone)) == 0) {
+        return GRAIN_OK;
+    }
+
+    GrainResult res = begin_change(zm, page_id);
+    if (res != GRAIN_OK) {
+        return res;
+    }
+    zm->zones[page_id] = zone;
+    return GRAIN_OK;
+}
+
+/* pages the map knows nothing about are never skipped */
+bool zonemap_may_match(ZoneMap *zm, int32_t page_id, const Predicate *pred) {
+    if (zm == NULL || pred == NULL || page_id < 0 || page_id >= zm->header.num_pages) {
+        return true;
+    }
+    const Zone *zone = &zm->zones[page_id];
+    return zone->id_min <= pred->id_max && zone->id_max >= pred->id_min &&
+           zone->age_min <= pred->age_max && zone->age_max >= pred->age_min;
+}
+
+static ZoneMap *new_zonemap(int fd) {
+    ZoneMap *zm = (ZoneMap *)calloc(1, sizeof(ZoneMap));
+    CHECK_RET_NULL(zm);
+    zm->fd = fd;
+    zm->dirty_lo = INT32_MAX;
+    zm->dirty_hi = -1;
+    return zm;
+}
+
+static void free_zonemap(ZoneMap *zm) {
+    close(zm->fd);
+    free(zm->zones);
+    free(zm);
+}
+
+ZoneMap *zonemap_create(const char *path) {
+    CHECK_RET_NULL(path);
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return NULL;
+    }
+    ZoneMap *zm = new_zonemap(fd);
+    if (zm == NULL) {
+        close(fd);
+        return NULL;
+    }
+
+    zm->header.magic = ZONEMAP_MAGIC;
+    zm->header.num_pages = 0;
+    zm->header.clean = 1;
+    if (write_header(zm) != GRAIN_OK) {
+        free_zonemap(zm);
+        return NULL;
+    }
+    return zm;
+}
+
+ZoneMap *zonemap_open(const char *path) {
+    CHECK_RET_NULL(path);
+    int fd = open(path, O_RDWR);
+    if (fd < 0) {
+        return NULL;
+    }
+    ZoneMap *zm = new_zonemap(fd);
+    if (zm == NULL) {
+        close(fd);
+        return NULL;
+    }
+
+    ZoneMapHeader *h = &zm->header;
+    if (!pread_full(fd, h, sizeof(ZoneMapHeader), 0) || h->magic != ZONEMAP_MAGIC ||
+        h->num_pages < 0 || reserve_zones(zm, h->num_pages) != GRAIN_OK ||
+        !pread_full(fd, zm->zones, sizeof(Zone) * (size_t)h->num_pages, zone_offset(0))) {
+        free_zonemap(zm);
+        return NULL;
+    }
+    return zm;
+}
+
+GrainResult zonemap_flush(ZoneMap *zm) {
+    CHECK_RET_GRAIN_NULL(zm);
+    if (zm->header.clean) {
+        return GRAIN_OK;
+    }
+    if (zm->dirty_hi >= zm->dirty_lo) {
+        size_t len = sizeof(Zone) * (size_t)(zm->dirty_hi - zm->dirty_lo + 1);
+        if (!pwrite_full(zm->fd, &zm->zones[zm->dirty_lo], len, zone_offset(zm->dirty_lo))) {
+            return GRAIN_FILE_WRITE_FAILED;
+        }
+        zm->dirty_lo = INT32_MAX;
+        zm->dirty_hi = -1;
+    }
+    zm->header.clean = 1;
+    GrainResult res = write_header(zm);
+    if (res == GRAIN_OK && fsync(zm->fd) != 0) {
+        res = GRAIN_FILE_WRITE_FAILED;
+    }
+    return res;
+}
+
+GrainResult zonemap_close(ZoneMap *zm) {
+    CHECK_RET_GRAIN_NULL(zm);
+    GrainResult res = zonemap_flush(zm);
+    free_zonemap(zm);
+    return res;
+}
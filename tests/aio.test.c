@@ -0,0 +1,245 @@
+#include <check.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "../include/aio.h"
+
+#define TEST_PAGES 96
+
+static const char *test_data = "aio_test.dat";
+
+static void cleanup(void)
+{
+    remove(test_data);
+}
+
+static int open_data(void)
+{
+    int fd = open(test_data, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    ck_assert_int_ge(fd, 0);
+    return fd;
+}
+
+static void fill(char *buf, int32_t page)
+{
+    for (int32_t i = 0; i < PAGE_SIZE; i++) {
+        buf[i] = (char)(page * 31 + i);
+    }
+}
+
+/* writes every page a queue's depth at a time, then reads them back newest first */
+static void round_trip(uint32_t flags, AioBackend backend)
+{
+    cleanup();
+    int fd = open_data();
+    AioQueue *q = aio_create(0, flags);
+    ck_assert_ptr_nonnull(q);
+    ck_assert_int_eq(q->backend, backend);
+    ck_assert_int_eq(q->depth, AIO_QUEUE_DEPTH);
+
+    char *bufs = aligned_alloc(PAGE_SIZE, (size_t)TEST_PAGES * PAGE_SIZE);
+    ck_assert_ptr_nonnull(bufs);
+    for (int32_t page = 0; page < TEST_PAGES; page++) {
+        fill(bufs + (size_t)page * PAGE_SIZE, page);
+    }
+
+    AioCompletion done[AIO_QUEUE_DEPTH];
+    int32_t count;
+    for (int32_t first = 0; first < TEST_PAGES; first += AIO_QUEUE_DEPTH) {
+        for (int32_t page = first; page < first + AIO_QUEUE_DEPTH; page++) {
+            ck_assert_int_eq(aio_prep_write(q, fd, bufs + (size_t)page * PAGE_SIZE, PAGE_SIZE,
+                                            (off_t)page * PAGE_SIZE, (uint64_t)page), GRAIN_OK);
+        }
+        ck_assert_int_eq(aio_submit(q), GRAIN_OK);
+        while (aio_outstanding(q) > 0) {
+            ck_assert_int_eq(aio_wait(q, done, AIO_QUEUE_DEPTH, &count), GRAIN_OK);
+            ck_assert_int_gt(count, 0);
+            for (int32_t i = 0; i < count; i++) {
+                ck_assert_int_eq(done[i].res, PAGE_SIZE);
+            }
+        }
+    }
+
+    memset(bufs, 0, (size_t)TEST_PAGES * PAGE_SIZE);
+    char seen[TEST_PAGES] = {0};
+    int32_t next = TEST_PAGES - 1;
+    while (next >= 0 || aio_outstanding(q) > 0) {
+        /* top the queue up as completions free slots */
+        while (next >= 0 && aio_prep_read(q, fd, bufs + (size_t)next * PAGE_SIZE, PAGE_SIZE,
+                                          (off_t)next * PAGE_SIZE, (uint64_t)next) == GRAIN_OK) {
+            next--;
+        }
+        ck_assert_int_le(aio_outstanding(q), AIO_QUEUE_DEPTH);
+        ck_assert_int_eq(aio_wait(q, done, 5, &count), GRAIN_OK);
+        ck_assert_int_gt(count, 0);
+        ck_assert_int_le(count, 5);
+        for (int32_t i = 0; i < count; i++) {
+            ck_assert_int_eq(done[i].res, PAGE_SIZE);
+            ck_assert_int_eq(seen[done[i].tag]++, 0);
+        }
+    }
+
+    char expected[PAGE_SIZE];
+    for (int32_t page = 0; page < TEST_PAGES; page++) {
+        ck_assert_int_eq(seen[page], 1);
+        fill(expected, page);
+        ck_assert_int_eq(memcmp(bufs + (size_t)page * PAGE_SIZE, expected, PAGE_SIZE), 0);
+    }
+
+    aio_destroy(q);
+    free(bufs);
+    close(fd);
+    cleanup();
+}
+
+START_TEST(test_uring_round_trip)
+{
+    AioQueue *probe = aio_create(1, AIO_DEFAULT);
+    ck_assert_ptr_nonnull(probe);
+    AioBackend backend = probe->backend;
+    aio_destroy(probe);
+    if (backend != AIO_BACKEND_URING) {
+        fprintf(stderr, "io_uring unavailable, checking the fallback instead\n");
+    }
+    round_trip(AIO_DEFAULT, backend);
+}
+END_TEST
+
+START_TEST(test_thread_pool_round_trip)
+{
+    round_trip(AIO_THREAD_POOL, AIO_BACKEND_THREADS);
+}
+END_TEST
+
+START_TEST(test_queue_is_bounded_by_depth)
+{
+    cleanup();
+    int fd = open_data();
+    static char buf[4][PAGE_SIZE];
+    uint32_t flags[] = {AIO_DEFAULT, AIO_THREAD_POOL};
+    for (size_t f = 0; f < sizeof(flags) / sizeof(flags[0]); f++) {
+        AioQueue *q = aio_create(4, flags[f]);
+        ck_assert_ptr_nonnull(q);
+        for (int32_t i = 0; i < 4; i++) {
+            memset(buf[i], 'a' + i, PAGE_SIZE);
+            ck_assert_int_eq(aio_prep_write(q, fd, buf[i], PAGE_SIZE, (off_t)i * PAGE_SIZE, i), GRAIN_OK);
+        }
+        ck_assert_int_eq(aio_prep_write(q, fd, buf[0], PAGE_SIZE, 0, 9), GRAIN_NO_FREE_FRAME);
+        ck_assert_int_eq(aio_outstanding(q), 4);
+
+        /* waiting submits whatever is still only prepared */
+        AioCompletion done[4];
+        int32_t count, total = 0;
+        while (total < 4) {
+            ck_assert_int_eq(aio_wait(q, done, 4, &count), GRAIN_OK);
+            total += count;
+        }
+        ck_assert_int_eq(aio_outstanding(q), 0);
+        ck_assert_int_eq(aio_wait(q, done, 4, &count), GRAIN_OK);
+        ck_assert_int_eq(count, 0);
+
+        /* requests left in flight are waited out rather than abandoned */
+        ck_assert_int_eq(aio_prep_read(q, fd, buf[3], PAGE_SIZE, 0, 0), GRAIN_OK);
+        ck_assert_int_eq(aio_submit(q), GRAIN_OK);
+        ck_assert_int_eq(aio_prep_read(q, fd, buf[2], PAGE_SIZE, PAGE_SIZE, 1), GRAIN_OK);
+        aio_destroy(q);
+        ck_assert_int_eq(buf[3][PAGE_SIZE - 1], 'a');
+    }
+    close(fd);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_reads_past_end_come_back_short)
+{
+    cleanup();
+    int fd = open_data();
+    static char buf[2][PAGE_SIZE];
+    memset(buf[0], 'z', PAGE_SIZE);
+    ck_assert_int_eq(pwrite(fd, buf[0], PAGE_SIZE / 2, 0), PAGE_SIZE / 2);
+
+    uint32_t flags[] = {AIO_DEFAULT, AIO_THREAD_POOL};
+    for (size_t f = 0; f < sizeof(flags) / sizeof(flags[0]); f++) {
+        AioQueue *q = aio_create(2, flags[f]);
+        ck_assert_ptr_nonnull(q);
+        ck_assert_int_eq(aio_prep_read(q, fd, buf[0], PAGE_SIZE, 0, 0), GRAIN_OK);
+        ck_assert_int_eq(aio_prep_read(q, fd, buf[1], PAGE_SIZE, PAGE_SIZE, 1), GRAIN_OK);
+
+        AioCompletion done[2];
+        int32_t count, total = 0;
+        while (total < 2) {
+            ck_assert_int_eq(aio_wait(q, done + total, 2 - total, &count), GRAIN_OK);
+            total += count;
+        }
+        for (int32_t i = 0; i < 2; i++) {
+            ck_assert_int_eq(done[i].res, (done[i].tag == 0) ? PAGE_SIZE / 2 : 0);
+        }
+
+        /* a bad descriptor fails the request, not the queue */
+        ck_assert_int_eq(aio_prep_read(q, -1, buf[0], PAGE_SIZE, 0, 7), GRAIN_OK);
+        ck_assert_int_eq(aio_wait(q, done, 2, &count), GRAIN_OK);
+        ck_assert_int_eq(count, 1);
+        ck_assert_int_eq(done[0].tag, 7);
+        ck_assert_int_lt(done[0].res, 0);
+        aio_destroy(q);
+    }
+    close(fd);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_null_params)
+{
+    static char buf[PAGE_SIZE];
+    AioCompletion done[1];
+    int32_t count;
+    ck_assert_int_eq(aio_prep_read(NULL, 0, buf, PAGE_SIZE, 0, 0), GRAIN_NULL_PTR);
+    ck_assert_int_eq(aio_prep_write(NULL, 0, buf, PAGE_SIZE, 0, 0), GRAIN_NULL_PTR);
+    ck_assert_int_eq(aio_submit(NULL), GRAIN_NULL_PTR);
+    ck_assert_int_eq(aio_wait(NULL, done, 1, &count), GRAIN_NULL_PTR);
+    ck_assert_int_eq(aio_outstanding(NULL), 0);
+    aio_destroy(NULL);
+
+    AioQueue *q = aio_create(2, AIO_DEFAULT);
+    ck_assert_ptr_nonnull(q);
+    ck_assert_int_eq(aio_prep_read(q, 0, NULL, PAGE_SIZE, 0, 0), GRAIN_NULL_PTR);
+    ck_assert_int_eq(aio_wait(q, NULL, 1, &count), GRAIN_NULL_PTR);
+    ck_assert_int_eq(aio_wait(q, done, 1, NULL), GRAIN_NULL_PTR);
+    ck_assert_int_eq(aio_outstanding(q), 0);
+    aio_destroy(q);
+}
+END_TEST
+
+static Suite *aio_suite(void)
+{
+    Suite *s;
+    TCase *tc_core;
+
+    s = suite_create("Async I/O Tests");
+    tc_core = tcase_create("Core");
+
+    tcase_add_test(tc_core, test_uring_round_trip);
+    tcase_add_test(tc_core, test_thread_pool_round_trip);
+    tcase_add_test(tc_core, test_queue_is_bounded_by_depth);
+    tcase_add_test(tc_core, test_reads_past_end_come_back_short);
+    tcase_add_test(tc_core, test_null_params);
+
+    suite_add_tcase(s, tc_core);
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s = aio_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_VERBOSE);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? 0 : 1;
+}
@@ -0,0 +1,198 @@
+#include <check.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "../include/bloom.h"
+
+static const char *test_filter = "bloom_test.bloom";
+
+static void cleanup(void)
+{
+    remove(test_filter);
+}
+
+START_TEST(test_create_gives_empty_filter)
+{
+    cleanup();
+    BloomFilter *bf = bloom_create(test_filter, 0);
+    ck_assert_ptr_nonnull(bf);
+    ck_assert_int_eq(bf->header.num_blocks, BLOOM_MIN_BLOCKS);
+    ck_assert_int_eq(bf->header.num_keys, 0);
+    ck_assert_int_eq(bf->header.clean, 1);
+    ck_assert_int_eq((uintptr_t)bf->blocks % sizeof(BloomBlock), 0);
+
+    for (int32_t key = -100; key < 100; key++) {
+        ck_assert(!bloom_may_contain(bf, key));
+    }
+    ck_assert(!bloom_overloaded(bf));
+    ck_assert_int_eq(bloom_close(bf), GRAIN_OK);
+
+    bf = bloom_create(test_filter, 100000);
+    ck_assert_ptr_nonnull(bf);
+    ck_assert_int_ge((int64_t)bf->header.num_blocks * BLOOM_BLOCK_WORDS * 64, 100000 * BLOOM_BITS_PER_KEY);
+    bloom_close(bf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_added_keys_are_found)
+{
+    cleanup();
+    int32_t n = 20000;
+    BloomFilter *bf = bloom_create(test_filter, n);
+    ck_assert_ptr_nonnull(bf);
+
+    for (int32_t key = 0; key < n; key++) {
+        ck_assert_int_eq(bloom_add(bf, key * 7), GRAIN_OK);
+    }
+    ck_assert_int_eq(bf->header.clean, 0);
+    ck_assert(!bloom_overloaded(bf));
+
+    /* no false negatives, ever */
+    for (int32_t key = 0; key < n; key++) {
+        ck_assert(bloom_may_contain(bf, key * 7));
+    }
+
+    /* ten bits a key gives roughly a 1% false positive rate */
+    int32_t false_positives = 0;
+    for (int32_t key = 0; key < n; key++) {
+        if (bloom_may_contain(bf, -1 - key)) {
+            false_positives++;
+        }
+    }
+    ck_assert_int_lt(false_positives, n / 50);
+
+    bloom_close(bf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_overload_and_reset)
+{
+    cleanup();
+    BloomFilter *bf = bloom_create(test_filter, 0);
+    ck_assert_ptr_nonnull(bf);
+    int32_t capacity = BLOOM_MIN_BLOCKS * BLOOM_BLOCK_WORDS * 64 / BLOOM_BITS_PER_KEY;
+    for (int32_t key = 0; key < capacity * 2; key++) {
+        ck_assert_int_eq(bloom_add(bf, key), GRAIN_OK);
+    }
+    ck_assert(bloom_overloaded(bf));
+
+    ck_assert_int_eq(bloom_reset(bf, capacity * 4), GRAIN_OK);
+    ck_assert(!bloom_overloaded(bf));
+    ck_assert_int_eq(bf->header.num_keys, 0);
+    ck_assert_int_gt(bf->header.num_blocks, BLOOM_MIN_BLOCKS);
+    ck_assert(!bloom_may_contain(bf, 5));
+    ck_assert_int_eq(bloom_add(bf, 5), GRAIN_OK);
+    /* a key that sets no new bit isn't counted again */
+    ck_assert_int_eq(bloom_add(bf, 5), GRAIN_OK);
+    ck_assert_int_eq(bloom_close(bf), GRAIN_OK);
+
+    /* the resized filter reads back at its new size */
+    bf = bloom_open(test_filter);
+    ck_assert_ptr_nonnull(bf);
+    ck_assert_int_gt(bf->header.num_blocks, BLOOM_MIN_BLOCKS);
+    ck_assert_int_eq(bf->header.num_keys, 1);
+    ck_assert(bloom_may_contain(bf, 5));
+    ck_assert(!bloom_may_contain(bf, 6));
+    bloom_close(bf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_reopen_keeps_keys)
+{
+    cleanup();
+    BloomFilter *bf = bloom_create(test_filter, 1000);
+    ck_assert_ptr_nonnull(bf);
+    for (int32_t key = 0; key < 1000; key++) {
+        ck_assert_int_eq(bloom_add(bf, key), GRAIN_OK);
+    }
+
+    /* not flushed yet, so another reader sees it unclean */
+    BloomFilter *other = bloom_open(test_filter);
+    ck_assert_ptr_nonnull(other);
+    ck_assert_int_eq(other->header.clean, 0);
+    bloom_close(other);
+
+    ck_assert_int_eq(bloom_close(bf), GRAIN_OK);
+    bf = bloom_open(test_filter);
+    ck_assert_ptr_nonnull(bf);
+    ck_assert_int_eq(bf->header.clean, 1);
+    ck_assert_int_eq(bf->header.num_keys, 1000);
+    for (int32_t key = 0; key < 1000; key++) {
+        ck_assert(bloom_may_contain(bf, key));
+    }
+    bloom_close(bf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_open_rejects_garbage)
+{
+    cleanup();
+    FILE *f = fopen(test_filter, "wb");
+    ck_assert_ptr_nonnull(f);
+    fwrite("not a bloom filter, no", 22, 1, f);
+    fclose(f);
+    ck_assert_ptr_null(bloom_open(test_filter));
+    ck_assert_ptr_null(bloom_open("does_not_exist.bloom"));
+
+    /* a header promising more blocks than the file holds */
+    BloomHeader header = {.magic = BLOOM_MAGIC, .num_blocks = 4, .clean = 1};
+    f = fopen(test_filter, "wb");
+    ck_assert_ptr_nonnull(f);
+    fwrite(&header, sizeof(header), 1, f);
+    fclose(f);
+    ck_assert_ptr_null(bloom_open(test_filter));
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_null_params)
+{
+    ck_assert_ptr_null(bloom_create(NULL, 10));
+    ck_assert_ptr_null(bloom_open(NULL));
+    ck_assert_int_eq(bloom_add(NULL, 1), GRAIN_NULL_PTR);
+    ck_assert_int_eq(bloom_reset(NULL, 1), GRAIN_NULL_PTR);
+    ck_assert_int_eq(bloom_flush(NULL), GRAIN_NULL_PTR);
+    ck_assert_int_eq(bloom_close(NULL), GRAIN_NULL_PTR);
+    /* without a filter anything may be there */
+    ck_assert(bloom_may_contain(NULL, 1));
+    ck_assert(!bloom_overloaded(NULL));
+}
+END_TEST
+
+static Suite *bloom_suite(void)
+{
+    Suite *s;
+    TCase *tc_core;
+
+    s = suite_create("Bloom Filter Tests");
+    tc_core = tcase_create("Core");
+
+    tcase_add_test(tc_core, test_create_gives_empty_filter);
+    tcase_add_test(tc_core, test_added_keys_are_found);
+    tcase_add_test(tc_core, test_overload_and_reset);
+    tcase_add_test(tc_core, test_reopen_keeps_keys);
+    tcase_add_test(tc_core, test_open_rejects_garbage);
+    tcase_add_test(tc_core, test_null_params);
+
+    suite_add_tcase(s, tc_core);
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s = bloom_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_VERBOSE);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? 0 : 1;
+}
@@ -0,0 +1,313 @@
+#include <check.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "../include/btree.h"
+
+static const char *test_index = "btree_test.idx";
+
+static void cleanup(void)
+{
+    remove(test_index);
+}
+
+static RecordId rid_for(int32_t i)
+{
+    RecordId rid = {.page_id = i / 127, .slot_idx = i % 127};
+    return rid;
+}
+
+START_TEST(test_create_gives_empty_tree)
+{
+    cleanup();
+    BTree *bt = btree_create(test_index);
+    ck_assert_ptr_nonnull(bt);
+    ck_assert_int_eq(bt->header.height, 1);
+    ck_assert_int_eq(bt->header.num_entries, 0);
+    ck_assert_int_eq(bt->header.clean, 1);
+
+    RecordId rid;
+    ck_assert_int_eq(btree_find(bt, 1, &rid), GRAIN_RECORD_NOT_FOUND);
+
+    BTreeCursor cur;
+    int32_t key;
+    ck_assert_int_eq(btree_scan_init(bt, &cur, INT32_MIN, INT32_MAX), GRAIN_OK);
+    ck_assert_int_eq(btree_scan_next(&cur, &key, &rid), GRAIN_END);
+
+    ck_assert_int_eq(btree_close(bt), GRAIN_OK);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_insert_and_find)
+{
+    cleanup();
+    BTree *bt = btree_create(test_index);
+    ck_assert_ptr_nonnull(bt);
+
+    for (int32_t i = 0; i < 100; i++) {
+        ck_assert_int_eq(btree_insert(bt, i * 3, rid_for(i)), GRAIN_OK);
+    }
+    ck_assert_int_eq(bt->header.num_entries, 100);
+
+    RecordId rid;
+    ck_assert_int_eq(btree_find(bt, 42, &rid), GRAIN_OK);
+    ck_assert_int_eq(rid.page_id, rid_for(14).page_id);
+    ck_assert_int_eq(rid.slot_idx, rid_for(14).slot_idx);
+    ck_assert_int_eq(btree_find(bt, 43, &rid), GRAIN_RECORD_NOT_FOUND);
+
+    /* inserting the same (key, rid) twice is a no-op */
+    ck_assert_int_eq(btree_insert(bt, 42, rid_for(14)), GRAIN_OK);
+    ck_assert_int_eq(bt->header.num_entries, 100);
+
+    btree_close(bt);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_many_inserts_split_to_several_levels)
+{
+    cleanup();
+    BTree *bt = btree_create(test_index);
+    ck_assert_ptr_nonnull(bt);
+
+    /* scattered keys, enough for inner nodes to split as well */
+    int32_t n = BTREE_LEAF_CAPACITY * BTREE_INNER_CAPACITY;
+    for (int32_t i = 0; i < n; i++) {
+        int32_t key = (int32_t)(((int64_t)i * 7919) % n);
+        ck_assert_int_eq(btree_insert(bt, key, rid_for(key)), GRAIN_OK);
+    }
+    ck_assert_int_eq(bt->header.num_entries, n);
+    ck_assert_int_ge(bt->header.height, 3);
+
+    for (int32_t key = 0; key < n; key += 997) {
+        RecordId rid;
+        ck_assert_int_eq(btree_find(bt, key, &rid), GRAIN_OK);
+        ck_assert_int_eq(rid.page_id, rid_for(key).page_id);
+        ck_assert_int_eq(rid.slot_idx, rid_for(key).slot_idx);
+    }
+
+    BTreeCursor cur;
+    int32_t key, expected = 0;
+    RecordId rid;
+    ck_assert_int_eq(btree_scan_init(bt, &cur, INT32_MIN, INT32_MAX), GRAIN_OK);
+    while (btree_scan_next(&cur, &key, &rid) == GRAIN_OK) {
+        ck_assert_int_eq(key, expected);
+        expected++;
+    }
+    ck_assert_int_eq(expected, n);
+
+    btree_close(bt);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_duplicate_keys_ordered_by_rid)
+{
+    cleanup();
+    BTree *bt = btree_create(test_index);
+    ck_assert_ptr_nonnull(bt);
+
+    for (int32_t i = 2000; i >= 0; i--) {
+        ck_assert_int_eq(btree_insert(bt, i % 4, rid_for(i)), GRAIN_OK);
+    }
+
+    BTreeCursor cur;
+    int32_t key;
+    RecordId rid, prev = {.page_id = -1, .slot_idx = -1};
+    int count = 0;
+    ck_assert_int_eq(btree_scan_init(bt, &cur, 2, 2), GRAIN_OK);
+    while (btree_scan_next(&cur, &key, &rid) == GRAIN_OK) {
+        ck_assert_int_eq(key, 2);
+        ck_assert(rid.page_id > prev.page_id ||
+                  (rid.page_id == prev.page_id && rid.slot_idx > prev.slot_idx));
+        prev = rid;
+        count++;
+    }
+    ck_assert_int_eq(count, 500);
+
+    ck_assert_int_eq(btree_find(bt, 3, &rid), GRAIN_OK);
+    ck_assert_int_eq(rid.page_id, rid_for(3).page_id);
+    ck_assert_int_eq(rid.slot_idx, rid_for(3).slot_idx);
+
+    btree_close(bt);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_range_scan_bounds)
+{
+    cleanup();
+    BTree *bt = btree_create(test_index);
+    ck_assert_ptr_nonnull(bt);
+
+    for (int32_t i = 0; i < 5000; i++) {
+        ck_assert_int_eq(btree_insert(bt, i * 2, rid_for(i)), GRAIN_OK);
+    }
+
+    BTreeCursor cur;
+    int32_t key;
+    RecordId rid;
+    ck_assert_int_eq(btree_scan_init(bt, &cur, 999, 2001), GRAIN_OK);
+    int32_t expected = 1000;
+    while (btree_scan_next(&cur, &key, &rid) == GRAIN_OK) {
+        ck_assert_int_eq(key, expected);
+        expected += 2;
+    }
+    ck_assert_int_eq(expected, 2002);
+
+    ck_assert_int_eq(btree_scan_init(bt, &cur, 20000, 30000), GRAIN_OK);
+    ck_assert_int_eq(btree_scan_next(&cur, &key, &rid), GRAIN_END);
+
+    btree_close(bt);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_delete)
+{
+    cleanup();
+    BTree *bt = btree_create(test_index);
+    ck_assert_ptr_nonnull(bt);
+
+    int32_t n = BTREE_LEAF_CAPACITY * 3;
+    for (int32_t i = 0; i < n; i++) {
+        ck_assert_int_eq(btree_insert(bt, i, rid_for(i)), GRAIN_OK);
+    }
+    for (int32_t i = 0; i < n; i += 2) {
+        ck_assert_int_eq(btree_delete(bt, i, rid_for(i)), GRAIN_OK);
+    }
+    ck_assert_int_eq(bt->header.num_entries, n / 2);
+
+    RecordId rid;
+    ck_assert_int_eq(btree_delete(bt, 0, rid_for(0)), GRAIN_RECORD_NOT_FOUND);
+    ck_assert_int_eq(btree_delete(bt, 1, rid_for(2)), GRAIN_RECORD_NOT_FOUND);
+    ck_assert_int_eq(btree_find(bt, 10, &rid), GRAIN_RECORD_NOT_FOUND);
+    ck_assert_int_eq(btree_find(bt, 11, &rid), GRAIN_OK);
+
+    /* empty out a whole leaf; scans step over it */
+    for (int32_t i = 1; i < BTREE_LEAF_CAPACITY; i += 2) {
+        ck_assert_int_eq(btree_delete(bt, i, rid_for(i)), GRAIN_OK);
+    }
+    BTreeCursor cur;
+    int32_t key;
+    ck_assert_int_eq(btree_scan_init(bt, &cur, 0, INT32_MAX), GRAIN_OK);
+    ck_assert_int_eq(btree_scan_next(&cur, &key, &rid), GRAIN_OK);
+    ck_assert_int_ge(key, BTREE_LEAF_CAPACITY);
+
+    btree_close(bt);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_reopen_keeps_entries)
+{
+    cleanup();
+    BTree *bt = btree_create(test_index);
+    ck_assert_ptr_nonnull(bt);
+    for (int32_t i = 0; i < 3000; i++) {
+        ck_assert_int_eq(btree_insert(bt, i, rid_for(i)), GRAIN_OK);
+    }
+    ck_assert_int_eq(bt->header.clean, 0);
+    ck_assert_int_eq(btree_close(bt), GRAIN_OK);
+
+    bt = btree_open(test_index);
+    ck_assert_ptr_nonnull(bt);
+    ck_assert_int_eq(bt->header.clean, 1);
+    ck_assert_int_eq(bt->header.num_entries, 3000);
+    RecordId rid;
+    ck_assert_int_eq(btree_find(bt, 2999, &rid), GRAIN_OK);
+    ck_assert_int_eq(rid.slot_idx, rid_for(2999).slot_idx);
+    btree_close(bt);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_unflushed_tree_reads_back_unclean)
+{
+    cleanup();
+    BTree *bt = btree_create(test_index);
+    ck_assert_ptr_nonnull(bt);
+    ck_assert_int_eq(btree_insert(bt, 1, rid_for(1)), GRAIN_OK);
+
+    BTree *other = btree_open(test_index);
+    ck_assert_ptr_nonnull(other);
+    ck_assert_int_eq(other->header.clean, 0);
+    btree_close(other);
+
+    ck_assert_int_eq(btree_flush(bt), GRAIN_OK);
+    other = btree_open(test_index);
+    ck_assert_ptr_nonnull(other);
+    ck_assert_int_eq(other->header.clean, 1);
+    btree_close(other);
+
+    btree_close(bt);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_open_rejects_garbage)
+{
+    cleanup();
+    FILE *f = fopen(test_index, "wb");
+    ck_assert_ptr_nonnull(f);
+    fwrite("not a btree at all, not even close", 34, 1, f);
+    fclose(f);
+    ck_assert_ptr_null(btree_open(test_index));
+    ck_assert_ptr_null(btree_open("does_not_exist.idx"));
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_null_params)
+{
+    RecordId rid = {0, 0};
+    BTreeCursor cur;
+    ck_assert_ptr_null(btree_create(NULL));
+    ck_assert_ptr_null(btree_open(NULL));
+    ck_assert_int_eq(btree_insert(NULL, 1, rid), GRAIN_NULL_PTR);
+    ck_assert_int_eq(btree_delete(NULL, 1, rid), GRAIN_NULL_PTR);
+    ck_assert_int_eq(btree_find(NULL, 1, &rid), GRAIN_NULL_PTR);
+    ck_assert_int_eq(btree_scan_init(NULL, &cur, 0, 1), GRAIN_NULL_PTR);
+    ck_assert_int_eq(btree_scan_next(NULL, NULL, &rid), GRAIN_NULL_PTR);
+    ck_assert_int_eq(btree_close(NULL), GRAIN_NULL_PTR);
+}
+END_TEST
+
+static Suite *btree_suite(void)
+{
+    Suite *s;
+    TCase *tc_core;
+
+    s = suite_create("B+ Tree Tests");
+    tc_core = tcase_create("Core");
+
+    tcase_add_test(tc_core, test_create_gives_empty_tree);
+    tcase_add_test(tc_core, test_insert_and_find);
+    tcase_add_test(tc_core, test_many_inserts_split_to_several_levels);
+    tcase_add_test(tc_core, test_duplicate_keys_ordered_by_rid);
+    tcase_add_test(tc_core, test_range_scan_bounds);
+    tcase_add_test(tc_core, test_delete);
+    tcase_add_test(tc_core, test_reopen_keeps_entries);
+    tcase_add_test(tc_core, test_unflushed_tree_reads_back_unclean);
+    tcase_add_test(tc_core, test_open_rejects_garbage);
+    tcase_add_test(tc_core, test_null_params);
+
+    suite_add_tcase(s, tc_core);
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s = btree_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_VERBOSE);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? 0 : 1;
+}
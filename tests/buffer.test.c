@@ -0,0 +1,670 @@
+#include <check.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "../include/buffer.h"
+
+#define DISK_PAGES 16
+
+typedef struct {
+    char pages[DISK_PAGES][PAGE_SIZE];
+    int reads;
+    int writes;
+    int batches;
+    int largest_batch;
+    int runs;
+    int largest_run;
+    int prefetches;
+    int32_t pending_first;
+    /* a read of held_page waits until holding is cleared */
+    int32_t held_page;
+    bool holding;
+    int held_reads;
+} FakeDisk;
+
+static GrainResult fake_read(void *ctx, int32_t page_id, void *buf)
+{
+    FakeDisk *disk = ctx;
+    if (page_id >= DISK_PAGES) return GRAIN_FILE_READ_FAILED;
+    if (page_id == disk->held_page) {
+        __atomic_add_fetch(&disk->held_reads, 1, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&disk->holding, __ATOMIC_ACQUIRE)) {
+            usleep(1000);
+        }
+    }
+    memcpy(buf, disk->pages[page_id], PAGE_SIZE);
+    /* reads happen outside the pool's lock */
+    __atomic_add_fetch(&disk->reads, 1, __ATOMIC_SEQ_CST);
+    return GRAIN_OK;
+}
+
+static GrainResult fake_write(void *ctx, int32_t page_id, const void *buf)
+{
+    FakeDisk *disk = ctx;
+    if (page_id >= DISK_PAGES) return GRAIN_FILE_WRITE_FAILED;
+    memcpy(disk->pages[page_id], buf, PAGE_SIZE);
+    disk->writes++;
+    return GRAIN_OK;
+}
+
+static GrainResult fake_write_batch(void *ctx, const int32_t *page_ids, const void *const *bufs,
+                                    int32_t count)
+{
+    FakeDisk *disk = ctx;
+    for (int32_t i = 0; i < count; i++) {
+        /* always handed over in page order */
+        if (i > 0 && page_ids[i] <= page_ids[i - 1]) return GRAIN_INVALID_PAGE_ID;
+        GrainResult res = fake_write(ctx, page_ids[i], bufs[i]);
+        if (res != GRAIN_OK) return res;
+    }
+    disk->batches++;
+    if (count > disk->largest_batch) disk->largest_batch = count;
+    return GRAIN_OK;
+}
+
+static GrainResult fake_read_run(void *ctx, int32_t first_page_id, void *const *bufs, int32_t count,
+                                 int32_t *num_read)
+{
+    FakeDisk *disk = ctx;
+    *num_read = 0;
+    while (*num_read < count && first_page_id + *num_read < DISK_PAGES) {
+        memcpy(bufs[*num_read], disk->pages[first_page_id + *num_read], PAGE_SIZE);
+        (*num_read)++;
+    }
+    disk->runs++;
+    if (count > disk->largest_run) disk->largest_run = count;
+    return GRAIN_OK;
+}
+
+/* the background read only lands when it is finished */
+static GrainResult fake_read_start(void *ctx, int32_t first_page_id, void *const *bufs, int32_t count)
+{
+    FakeDisk *disk = ctx;
+    (void)bufs;
+    (void)count;
+    if (disk->pending_first != -1) return GRAIN_FILE_READ_FAILED;
+    disk->pending_first = first_page_id;
+    disk->prefetches++;
+    return GRAIN_OK;
+}
+
+static GrainResult fake_read_finish(void *ctx, void *const *bufs, int32_t count, int32_t *num_read)
+{
+    FakeDisk *disk = ctx;
+    if (disk->pending_first == -1) return GRAIN_FILE_READ_FAILED;
+    int32_t first = disk->pending_first;
+    disk->pending_first = -1;
+    *num_read = 0;
+    while (*num_read < count && first + *num_read < DISK_PAGES) {
+        memcpy(bufs[*num_read], disk->pages[first + *num_read], PAGE_SIZE);
+        (*num_read)++;
+    }
+    return GRAIN_OK;
+}
+
+static FakeDisk *new_disk(void)
+{
+    FakeDisk *disk = calloc(1, sizeof(FakeDisk));
+    ck_assert_ptr_nonnull(disk);
+    for (int i = 0; i < DISK_PAGES; i++) {
+        memset(disk->pages[i], 'a' + i, PAGE_SIZE);
+    }
+    disk->pending_first = -1;
+    disk->held_page = -1;
+    return disk;
+}
+
+START_TEST(test_pin_reads_page_once)
+{
+    FakeDisk *disk = new_disk();
+    BufferPool bp;
+    ck_assert_int_eq(bp_init(&bp, 4, fake_read, fake_write, disk), GRAIN_OK);
+
+    char *page;
+    ck_assert_int_eq(bp_pin_page(&bp, 3, (void **)&page), GRAIN_OK);
+    ck_assert_int_eq(page[0], 'd');
+    ck_assert_int_eq(bp_unpin_page(&bp, 3, false), GRAIN_OK);
+
+    ck_assert_int_eq(bp_pin_page(&bp, 3, (void **)&page), GRAIN_OK);
+    ck_assert_int_eq(bp_unpin_page(&bp, 3, false), GRAIN_OK);
+
+    ck_assert_int_eq(disk->reads, 1);
+    ck_assert(bp_is_resident(&bp, 3));
+
+    bp_destroy(&bp);
+    free(disk);
+}
+END_TEST
+
+START_TEST(test_pin_new_page_skips_read)
+{
+    FakeDisk *disk = new_disk();
+    BufferPool bp;
+    ck_assert_int_eq(bp_init(&bp, 4, fake_read, fake_write, disk), GRAIN_OK);
+
+    char *page;
+    ck_assert_int_eq(bp_pin_new_page(&bp, 2, (void **)&page), GRAIN_OK);
+    ck_assert_int_eq(page[0], 0);
+    ck_assert_int_eq(disk->reads, 0);
+    ck_assert_int_eq(bp_unpin_page(&bp, 2, false), GRAIN_OK);
+
+    bp_destroy(&bp);
+    free(disk);
+}
+END_TEST
+
+START_TEST(test_dirty_page_written_only_on_flush)
+{
+    FakeDisk *disk = new_disk();
+    BufferPool bp;
+    ck_assert_int_eq(bp_init(&bp, 4, fake_read, fake_write, disk), GRAIN_OK);
+
+    char *page;
+    for (int i = 0; i < 3; i++) {
+        ck_assert_int_eq(bp_pin_page(&bp, 1, (void **)&page), GRAIN_OK);
+        page[i] = 'X';
+        ck_assert_int_eq(bp_unpin_page(&bp, 1, true), GRAIN_OK);
+    }
+    ck_assert_int_eq(disk->writes, 0);
+
+    ck_assert_int_eq(bp_flush_all(&bp), GRAIN_OK);
+    ck_assert_int_eq(disk->writes, 1);
+    ck_assert_int_eq(disk->pages[1][2], 'X');
+
+    ck_assert_int_eq(bp_flush_all(&bp), GRAIN_OK);
+    ck_assert_int_eq(disk->writes, 1);
+
+    bp_destroy(&bp);
+    free(disk);
+}
+END_TEST
+
+START_TEST(test_discard_drops_page_unwritten)
+{
+    FakeDisk *disk = new_disk();
+    BufferPool bp;
+    ck_assert_int_eq(bp_init(&bp, 4, fake_read, fake_write, disk), GRAIN_OK);
+
+    char *page;
+    ck_assert_int_eq(bp_pin_page(&bp, 5, (void **)&page), GRAIN_OK);
+    page[0] = 'X';
+    ck_assert_int_eq(bp_discard_page(&bp, 5), GRAIN_NO_FREE_FRAME);
+    ck_assert_int_eq(bp_unpin_page(&bp, 5, true), GRAIN_OK);
+
+    ck_assert_int_eq(bp_discard_page(&bp, 5), GRAIN_OK);
+    ck_assert(!bp_is_resident(&bp, 5));
+    ck_assert_int_eq(bp_flush_all(&bp), GRAIN_OK);
+    ck_assert_int_eq(disk->writes, 0);
+    ck_assert_int_eq(disk->pages[5][0], 'f');
+
+    /* pages that were never loaded are fine too */
+    ck_assert_int_eq(bp_discard_page(&bp, 7), GRAIN_OK);
+
+    bp_destroy(&bp);
+    free(disk);
+}
+END_TEST
+
+START_TEST(test_eviction_writes_back_dirty_page)
+{
+    FakeDisk *disk = new_disk();
+    BufferPool bp;
+    ck_assert_int_eq(bp_init(&bp, 2, fake_read, fake_write, disk), GRAIN_OK);
+
+    char *page;
+    ck_assert_int_eq(bp_pin_page(&bp, 0, (void **)&page), GRAIN_OK);
+    page[0] = 'Z';
+    ck_assert_int_eq(bp_unpin_page(&bp, 0, true), GRAIN_OK);
+
+    for (int i = 1; i < 6; i++) {
+        ck_assert_int_eq(bp_pin_page(&bp, i, (void **)&page), GRAIN_OK);
+        ck_assert_int_eq(bp_unpin_page(&bp, i, false), GRAIN_OK);
+    }
+
+    ck_assert(!bp_is_resident(&bp, 0));
+    ck_assert_int_eq(disk->writes, 1);
+    ck_assert_int_eq(disk->pages[0][0], 'Z');
+
+    ck_assert_int_eq(bp_pin_page(&bp, 0, (void **)&page), GRAIN_OK);
+    ck_assert_int_eq(page[0], 'Z');
+    ck_assert_int_eq(bp_unpin_page(&bp, 0, false), GRAIN_OK);
+
+    bp_destroy(&bp);
+    free(disk);
+}
+END_TEST
+
+START_TEST(test_pinned_pages_are_not_evicted)
+{
+    FakeDisk *disk = new_disk();
+    BufferPool bp;
+    ck_assert_int_eq(bp_init(&bp, 2, fake_read, fake_write, disk), GRAIN_OK);
+
+    char *p0, *p1, *p2;
+    ck_assert_int_eq(bp_pin_page(&bp, 0, (void **)&p0), GRAIN_OK);
+    ck_assert_int_eq(bp_pin_page(&bp, 1, (void **)&p1), GRAIN_OK);
+    ck_assert_int_eq(bp_pin_page(&bp, 2, (void **)&p2), GRAIN_NO_FREE_FRAME);
+
+    ck_assert_int_eq(bp_unpin_page(&bp, 1, false), GRAIN_OK);
+    ck_assert_int_eq(bp_pin_page(&bp, 2, (void **)&p2), GRAIN_OK);
+    ck_assert(bp_is_resident(&bp, 0));
+    ck_assert(!bp_is_resident(&bp, 1));
+    ck_assert_int_eq(p0[0], 'a');
+    ck_assert_int_eq(p2[0], 'c');
+
+    bp_destroy(&bp);
+    free(disk);
+}
+END_TEST
+
+START_TEST(test_clock_gives_second_chance)
+{
+    FakeDisk *disk = new_disk();
+    BufferPool bp;
+    ck_assert_int_eq(bp_init(&bp, 3, fake_read, fake_write, disk), GRAIN_OK);
+
+    char *page;
+    for (int i = 0; i < 3; i++) {
+        ck_assert_int_eq(bp_pin_page(&bp, i, (void **)&page), GRAIN_OK);
+        ck_assert_int_eq(bp_unpin_page(&bp, i, false), GRAIN_OK);
+    }
+
+    /* first miss clears every reference bit and evicts page 0 */
+    ck_assert_int_eq(bp_pin_page(&bp, 3, (void **)&page), GRAIN_OK);
+    ck_assert_int_eq(bp_unpin_page(&bp, 3, false), GRAIN_OK);
+    ck_assert(!bp_is_resident(&bp, 0));
+
+    /* touching page 1 protects it from the next sweep */
+    ck_assert_int_eq(bp_pin_page(&bp, 1, (void **)&page), GRAIN_OK);
+    ck_assert_int_eq(bp_unpin_page(&bp, 1, false), GRAIN_OK);
+    ck_assert_int_eq(bp_pin_page(&bp, 4, (void **)&page), GRAIN_OK);
+    ck_assert_int_eq(bp_unpin_page(&bp, 4, false), GRAIN_OK);
+
+    ck_assert(bp_is_resident(&bp, 1));
+    ck_assert(!bp_is_resident(&bp, 2));
+
+    bp_destroy(&bp);
+    free(disk);
+}
+END_TEST
+
+START_TEST(test_unpin_errors)
+{
+    FakeDisk *disk = new_disk();
+    BufferPool bp;
+    ck_assert_int_eq(bp_init(&bp, 2, fake_read, fake_write, disk), GRAIN_OK);
+
+    ck_assert_int_eq(bp_unpin_page(&bp, 0, false), GRAIN_INVALID_PAGE_ID);
+    ck_assert_int_eq(bp_unpin_page(NULL, 0, false), GRAIN_NULL_PTR);
+
+    char *page;
+    ck_assert_int_eq(bp_pin_page(&bp, 0, (void **)&page), GRAIN_OK);
+    ck_assert_int_eq(bp_unpin_page(&bp, 0, false), GRAIN_OK);
+    ck_assert_int_eq(bp_unpin_page(&bp, 0, false), GRAIN_INVALID_PAGE_ID);
+
+    ck_assert_int_eq(bp_pin_page(&bp, -1, (void **)&page), GRAIN_INVALID_PAGE_ID);
+    ck_assert_int_eq(bp_pin_page(&bp, DISK_PAGES, (void **)&page), GRAIN_FILE_READ_FAILED);
+    ck_assert(!bp_is_resident(&bp, DISK_PAGES));
+
+    bp_destroy(&bp);
+    free(disk);
+}
+END_TEST
+
+START_TEST(test_many_pages_through_small_pool)
+{
+    FakeDisk *disk = new_disk();
+    BufferPool bp;
+    ck_assert_int_eq(bp_init(&bp, 3, fake_read, fake_write, disk), GRAIN_OK);
+
+    char *page;
+    for (int round = 0; round < 4; round++) {
+        for (int i = 0; i < DISK_PAGES; i++) {
+            ck_assert_int_eq(bp_pin_page(&bp, i, (void **)&page), GRAIN_OK);
+            page[round + 1] = (char)('A' + i);
+            ck_assert_int_eq(bp_unpin_page(&bp, i, true), GRAIN_OK);
+        }
+    }
+    ck_assert_int_eq(bp_flush_all(&bp), GRAIN_OK);
+
+    for (int i = 0; i < DISK_PAGES; i++) {
+        ck_assert_int_eq(disk->pages[i][0], 'a' + i);
+        for (int round = 0; round < 4; round++) {
+            ck_assert_int_eq(disk->pages[i][round + 1], 'A' + i);
+        }
+    }
+
+    bp_destroy(&bp);
+    free(disk);
+}
+END_TEST
+
+typedef struct {
+    BufferPool *bp;
+    unsigned seed;
+    int failures;
+} PinWorker;
+
+static void *pin_worker(void *arg)
+{
+    PinWorker *w = arg;
+    for (int i = 0; i < 5000; i++) {
+        int32_t page_id = (int32_t)(rand_r(&w->seed) % DISK_PAGES);
+        char *page;
+        if (bp_pin_page(w->bp, page_id, (void **)&page) != GRAIN_OK) {
+            w->failures++;
+            continue;
+        }
+        if (page[0] != 'a' + page_id) {
+            w->failures++;
+        }
+        if (bp_unpin_page(w->bp, page_id, i % 3 == 0) != GRAIN_OK) {
+            w->failures++;
+        }
+    }
+    return NULL;
+}
+
+START_TEST(test_concurrent_pins)
+{
+    FakeDisk *disk = new_disk();
+    BufferPool bp;
+    ck_assert_int_eq(bp_init(&bp, 8, fake_read, fake_write, disk), GRAIN_OK);
+
+    /* threads fight over half as many frames as there are pages; each must always see its own page */
+    pthread_t threads[4];
+    PinWorker workers[4];
+    for (int i = 0; i < 4; i++) {
+        workers[i] = (PinWorker){.bp = &bp, .seed = (unsigned)i + 1, .failures = 0};
+        ck_assert_int_eq(pthread_create(&threads[i], NULL, pin_worker, &workers[i]), 0);
+    }
+    for (int i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+        ck_assert_int_eq(workers[i].failures, 0);
+    }
+
+    ck_assert_int_eq(bp_flush_all(&bp), GRAIN_OK);
+    for (int i = 0; i < DISK_PAGES; i++) {
+        ck_assert_int_eq(disk->pages[i][0], 'a' + i);
+    }
+    bp_destroy(&bp);
+    free(disk);
+}
+END_TEST
+
+static void *held_pin_worker(void *arg)
+{
+    PinWorker *w = arg;
+    char *page;
+    if (bp_pin_page(w->bp, 5, (void **)&page) != GRAIN_OK) {
+        w->failures++;
+        return NULL;
+    }
+    if (page[0] != 'f' || bp_unpin_page(w->bp, 5, false) != GRAIN_OK) {
+        w->failures++;
+    }
+    return NULL;
+}
+
+START_TEST(test_slow_read_blocks_only_its_page)
+{
+    FakeDisk *disk = new_disk();
+    BufferPool bp;
+    ck_assert_int_eq(bp_init(&bp, 4, fake_read, fake_write, disk), GRAIN_OK);
+    disk->held_page = 5;
+    disk->holding = true;
+
+    pthread_t threads[2];
+    PinWorker workers[2];
+    for (int i = 0; i < 2; i++) {
+        workers[i] = (PinWorker){.bp = &bp};
+        ck_assert_int_eq(pthread_create(&threads[i], NULL, held_pin_worker, &workers[i]), 0);
+        while (__atomic_load_n(&disk->held_reads, __ATOMIC_SEQ_CST) == 0) {
+            usleep(1000);
+        }
+    }
+
+    /* page 5 is still being read, but other pages come and go meanwhile */
+    char *page;
+    ck_assert_int_eq(bp_pin_page(&bp, 2, (void **)&page), GRAIN_OK);
+    ck_assert_int_eq(page[0], 'c');
+    ck_assert_int_eq(bp_unpin_page(&bp, 2, false), GRAIN_OK);
+
+    usleep(10000);
+    __atomic_store_n(&disk->holding, false, __ATOMIC_RELEASE);
+    for (int i = 0; i < 2; i++) {
+        pthread_join(threads[i], NULL);
+        ck_assert_int_eq(workers[i].failures, 0);
+    }
+
+    /* the second pinner waited for the first read rather than doing its own */
+    ck_assert_int_eq(disk->held_reads, 1);
+    ck_assert_int_eq(disk->reads, 2);
+    bp_destroy(&bp);
+    free(disk);
+}
+END_TEST
+
+START_TEST(test_batch_writer_takes_flushes_and_evictions)
+{
+    FakeDisk *disk = new_disk();
+    BufferPool bp;
+    ck_assert_int_eq(bp_init(&bp, 8, fake_read, fake_write, disk), GRAIN_OK);
+    bp_set_batch_writer(&bp, fake_write_batch);
+
+    char *page;
+    for (int i = 7; i >= 0; i--) {
+        ck_assert_int_eq(bp_pin_page(&bp, i, (void **)&page), GRAIN_OK);
+        page[1] = 'X';
+        ck_assert_int_eq(bp_unpin_page(&bp, i, true), GRAIN_OK);
+    }
+    ck_assert_int_eq(bp_flush_all(&bp), GRAIN_OK);
+    ck_assert_int_eq(disk->batches, 1);
+    ck_assert_int_eq(disk->largest_batch, 8);
+    ck_assert_int_eq(disk->writes, 8);
+
+    /* the first dirty victim takes every other dirty, unpinned frame with it; the pinned one stays */
+    for (int i = 0; i < 8; i++) {
+        ck_assert_int_eq(bp_pin_page(&bp, i, (void **)&page), GRAIN_OK);
+        page[2] = 'Y';
+        ck_assert_int_eq(bp_unpin_page(&bp, i, true), GRAIN_OK);
+    }
+    ck_assert_int_eq(bp_pin_page(&bp, 5, (void **)&page), GRAIN_OK);
+    ck_assert_int_eq(bp_pin_page(&bp, 8, (void **)&page), GRAIN_OK);
+    ck_assert_int_eq(bp_unpin_page(&bp, 8, false), GRAIN_OK);
+    ck_assert_int_eq(disk->batches, 2);
+    ck_assert_int_eq(disk->largest_batch, 8);
+    ck_assert_int_eq(disk->writes, 15);
+    ck_assert_int_ne(disk->pages[5][2], 'Y');
+    for (int i = 0; i < 8; i++) {
+        if (i != 5) ck_assert_int_eq(disk->pages[i][2], 'Y');
+    }
+
+    /* pages the batch wrote stay cached and clean; no second write when they go */
+    for (int i = 9; i < DISK_PAGES; i++) {
+        ck_assert_int_eq(bp_pin_page(&bp, i, (void **)&page), GRAIN_OK);
+        ck_assert_int_eq(bp_unpin_page(&bp, i, false), GRAIN_OK);
+    }
+    ck_assert_int_eq(disk->writes, 15);
+    ck_assert_int_eq(bp_unpin_page(&bp, 5, false), GRAIN_OK);
+    ck_assert_int_eq(bp_flush_all(&bp), GRAIN_OK);
+    ck_assert_int_eq(disk->writes, 16);
+    ck_assert_int_eq(disk->pages[5][2], 'Y');
+
+    bp_destroy(&bp);
+    free(disk);
+}
+END_TEST
+
+START_TEST(test_sequential_misses_read_extents)
+{
+    FakeDisk *disk = new_disk();
+    BufferPool bp;
+    ck_assert_int_eq(bp_init(&bp, 16, fake_read, fake_write, disk), GRAIN_OK);
+    bp_set_run_reader(&bp, fake_read_run);
+    ck_assert_int_eq(bp.ra_pages, 4);
+
+    char *page;
+    for (int32_t i = 0; i < DISK_PAGES; i++) {
+        ck_assert_int_eq(bp_pin_page(&bp, i, (void **)&page), GRAIN_OK);
+        ck_assert_int_eq(page[0], 'a' + i);
+        ck_assert_int_eq(bp_unpin_page(&bp, i, false), GRAIN_OK);
+    }
+    ck_assert_int_eq(disk->reads, 0);
+    ck_assert_int_eq(disk->runs, DISK_PAGES / 4);
+    ck_assert_int_eq(disk->largest_run, 4);
+
+    /* a jump is read on its own; the miss after it looks sequential again */
+    bp_destroy(&bp);
+    ck_assert_int_eq(bp_init(&bp, 16, fake_read, fake_write, disk), GRAIN_OK);
+    bp_set_run_reader(&bp, fake_read_run);
+    disk->runs = 0;
+    ck_assert_int_eq(bp_pin_page(&bp, 9, (void **)&page), GRAIN_OK);
+    ck_assert_int_eq(bp_unpin_page(&bp, 9, false), GRAIN_OK);
+    ck_assert_int_eq(disk->reads, 1);
+    ck_assert_int_eq(disk->runs, 0);
+    ck_assert_int_eq(bp_pin_page(&bp, 10, (void **)&page), GRAIN_OK);
+    ck_assert_int_eq(bp_unpin_page(&bp, 10, false), GRAIN_OK);
+    ck_assert_int_eq(disk->runs, 1);
+    ck_assert(bp_is_resident(&bp, 13));
+
+    /* a run stops short of a page that is already here, and of the end of the disk */
+    ck_assert_int_eq(bp_pin_page(&bp, 14, (void **)&page), GRAIN_OK);
+    ck_assert_int_eq(page[0], 'a' + 14);
+    ck_assert_int_eq(bp_unpin_page(&bp, 14, false), GRAIN_OK);
+    ck_assert_int_eq(disk->runs, 2);
+    ck_assert(bp_is_resident(&bp, 15));
+    ck_assert(!bp_is_resident(&bp, 16));
+    ck_assert_int_eq(disk->reads, 1);
+
+    bp_destroy(&bp);
+    free(disk);
+}
+END_TEST
+
+START_TEST(test_scan_ring_spares_hot_pages)
+{
+    FakeDisk *disk = new_disk();
+    BufferPool bp;
+    ck_assert_int_eq(bp_init(&bp, 8, fake_read, fake_write, disk), GRAIN_OK);
+    bp_set_run_reader(&bp, fake_read_run);
+    ck_assert_int_eq(bp.ring_cap, 4);
+
+    char *page;
+    int32_t hot[] = {15, 13};
+    for (int round = 0; round < 2; round++) {
+        for (size_t h = 0; h < sizeof(hot) / sizeof(hot[0]); h++) {
+            ck_assert_int_eq(bp_pin_page(&bp, hot[h], (void **)&page), GRAIN_OK);
+            ck_assert_int_eq(bp_unpin_page(&bp, hot[h], false), GRAIN_OK);
+        }
+    }
+
+    /* twelve pages through an eight frame pool; read-ahead only ever takes four of them */
+    for (int32_t i = 0; i < 12; i++) {
+        ck_assert_int_eq(bp_pin_page(&bp, i, (void **)&page), GRAIN_OK);
+        ck_assert_int_eq(page[0], 'a' + i);
+        page[1] = 'S';
+        ck_assert_int_eq(bp_unpin_page(&bp, i, true), GRAIN_OK);
+    }
+    ck_assert(bp_is_resident(&bp, 15));
+    ck_assert(bp_is_resident(&bp, 13));
+    ck_assert_int_gt(disk->runs, 0);
+
+    /* recycled ring frames were written back on the way out */
+    ck_assert_int_eq(bp_flush_all(&bp), GRAIN_OK);
+    for (int32_t i = 0; i < 12; i++) {
+        ck_assert_int_eq(disk->pages[i][1], 'S');
+    }
+    bp_destroy(&bp);
+    free(disk);
+}
+END_TEST
+
+START_TEST(test_prefetch_loads_next_extent)
+{
+    FakeDisk *disk = new_disk();
+    BufferPool bp;
+    ck_assert_int_eq(bp_init(&bp, 16, fake_read, fake_write, disk), GRAIN_OK);
+    bp_set_run_reader(&bp, fake_read_run);
+    bp_set_prefetcher(&bp, fake_read_start, fake_read_finish);
+
+    /* the first extent is read in the foreground and the one after it starts loading */
+    char *page;
+    ck_assert_int_eq(bp_pin_page(&bp, 0, (void **)&page), GRAIN_OK);
+    ck_assert_int_eq(bp_unpin_page(&bp, 0, false), GRAIN_OK);
+    ck_assert_int_eq(disk->runs, 1);
+    ck_assert_int_eq(disk->prefetches, 1);
+    ck_assert_int_eq(disk->pending_first, 4);
+    ck_assert(bp_is_resident(&bp, 7));
+
+    /* dropping a page that is still loading waits for it first */
+    ck_assert_int_eq(bp_discard_page(&bp, 6), GRAIN_OK);
+    ck_assert_int_eq(disk->pending_first, -1);
+    ck_assert(!bp_is_resident(&bp, 6));
+    ck_assert(bp_is_resident(&bp, 5));
+
+    for (int32_t i = 1; i < DISK_PAGES; i++) {
+        ck_assert_int_eq(bp_pin_page(&bp, i, (void **)&page), GRAIN_OK);
+        ck_assert_int_eq(page[0], 'a' + i);
+        ck_assert_int_eq(bp_unpin_page(&bp, i, false), GRAIN_OK);
+    }
+    ck_assert_int_eq(disk->reads, 1);
+    ck_assert_int_gt(disk->prefetches, 2);
+
+    /* the last one ran past the end of the disk; those pages come back as misses */
+    ck_assert_int_eq(bp_pin_page(&bp, DISK_PAGES, (void **)&page), GRAIN_FILE_READ_FAILED);
+    ck_assert(!bp_is_resident(&bp, DISK_PAGES));
+    ck_assert_int_eq(bp_pin_new_page(&bp, DISK_PAGES + 1, (void **)&page), GRAIN_OK);
+    ck_assert_int_eq(page[0], 0);
+    ck_assert_int_eq(bp_unpin_page(&bp, DISK_PAGES + 1, false), GRAIN_OK);
+    ck_assert_int_eq(disk->pending_first, -1);
+
+    bp_destroy(&bp);
+    free(disk);
+}
+END_TEST
+
+static Suite *buffer_suite(void)
+{
+    Suite *s;
+    TCase *tc_core;
+
+    s = suite_create("Buffer Pool Tests");
+    tc_core = tcase_create("Core");
+
+    tcase_add_test(tc_core, test_pin_reads_page_once);
+    tcase_add_test(tc_core, test_pin_new_page_skips_read);
+    tcase_add_test(tc_core, test_dirty_page_written_only_on_flush);
+    tcase_add_test(tc_core, test_discard_drops_page_unwritten);
+    tcase_add_test(tc_core, test_eviction_writes_back_dirty_page);
+    tcase_add_test(tc_core, test_pinned_pages_are_not_evicted);
+    tcase_add_test(tc_core, test_clock_gives_second_chance);
+    tcase_add_test(tc_core, test_unpin_errors);
+    tcase_add_test(tc_core, test_many_pages_through_small_pool);
+    tcase_add_test(tc_core, test_concurrent_pins);
+    tcase_add_test(tc_core, test_slow_read_blocks_only_its_page);
+    tcase_add_test(tc_core, test_batch_writer_takes_flushes_and_evictions);
+    tcase_add_test(tc_core, test_sequential_misses_read_extents);
+    tcase_add_test(tc_core, test_scan_ring_spares_hot_pages);
+    tcase_add_test(tc_core, test_prefetch_loads_next_extent);
+
+    suite_add_tcase(s, tc_core);
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s = buffer_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_VERBOSE);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? 0 : 1;
+}
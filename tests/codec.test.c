@@ -0,0 +1,128 @@
+#include <check.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "../include/codec.h"
+#include "../include/heap.h"
+
+static void fill_page(HeapPage *page, int32_t count)
+{
+    init_page(page, 3);
+    for (int32_t i = 0; i < count; i++) {
+        Record rec = {.id = i, .age = 20 + (i % 50)};
+        snprintf(rec.name, sizeof(rec.name), "user %d", i);
+        snprintf(rec.email, sizeof(rec.email), "u%d@example.com", i);
+        ck_assert_int_ge(insert_record(page, &rec), 0);
+    }
+}
+
+START_TEST(test_page_round_trip)
+{
+    static HeapPage page;
+    static HeapPage out;
+    static uint8_t buf[PAGE_SIZE * 2];
+    ck_assert_uint_ge(codec_bound(PAGE_SIZE), PAGE_SIZE);
+
+    int32_t counts[] = {0, 1, 40, MAX_SLOTS};
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+        fill_page(&page, counts[c]);
+        size_t len = codec_compress(&page, PAGE_SIZE, buf, sizeof(buf));
+        ck_assert_uint_gt(len, 0);
+        /* zero-padded strings and a mostly empty page shrink a long way */
+        ck_assert_uint_lt(len, PAGE_SIZE / 2);
+
+        memset(&out, 0xAB, sizeof(out));
+        ck_assert(codec_decompress(buf, len, &out, PAGE_SIZE));
+        ck_assert_int_eq(memcmp(&page, &out, PAGE_SIZE), 0);
+    }
+}
+END_TEST
+
+START_TEST(test_incompressible_input)
+{
+    static uint8_t src[PAGE_SIZE];
+    static uint8_t buf[PAGE_SIZE * 2];
+    static uint8_t out[PAGE_SIZE];
+    uint32_t x = 12345;
+    for (size_t i = 0; i < sizeof(src); i++) {
+        x = x * 1103515245u + 12345u;
+        src[i] = (uint8_t)(x >> 24);
+    }
+
+    /* a cap below the input size turns random bytes away */
+    ck_assert_uint_eq(codec_compress(src, sizeof(src), buf, sizeof(src) - 1), 0);
+
+    /* with room to spare it still round trips, just a little bigger */
+    size_t len = codec_compress(src, sizeof(src), buf, codec_bound(sizeof(src)));
+    ck_assert_uint_gt(len, 0);
+    ck_assert_uint_le(len, codec_bound(sizeof(src)));
+    ck_assert(codec_decompress(buf, len, out, sizeof(out)));
+    ck_assert_int_eq(memcmp(src, out, sizeof(src)), 0);
+
+    /* tiny inputs are all literals */
+    ck_assert_uint_gt(codec_compress("abc", 3, buf, sizeof(buf)), 0);
+    ck_assert_uint_eq(codec_compress("abc", 3, buf, 2), 0);
+}
+END_TEST
+
+START_TEST(test_corrupt_input_rejected)
+{
+    static HeapPage page;
+    static HeapPage out;
+    static uint8_t buf[PAGE_SIZE * 2];
+    fill_page(&page, 60);
+    size_t len = codec_compress(&page, PAGE_SIZE, buf, sizeof(buf));
+    ck_assert_uint_gt(len, 0);
+
+    /* cut short, or asked for the wrong size */
+    ck_assert(!codec_decompress(buf, len - 1, &out, PAGE_SIZE));
+    ck_assert(!codec_decompress(buf, len, &out, PAGE_SIZE - 1));
+    ck_assert(!codec_decompress(buf, 0, &out, PAGE_SIZE));
+
+    /* garbage never writes past the output, it just fails or yields the wrong bytes */
+    for (size_t i = 0; i < len; i += 7) {
+        uint8_t saved = buf[i];
+        buf[i] ^= 0xFF;
+        codec_decompress(buf, len, &out, PAGE_SIZE);
+        buf[i] = saved;
+    }
+    ck_assert(codec_decompress(buf, len, &out, PAGE_SIZE));
+    ck_assert_int_eq(memcmp(&page, &out, PAGE_SIZE), 0);
+
+    ck_assert(!codec_decompress(NULL, len, &out, PAGE_SIZE));
+    ck_assert(!codec_decompress(buf, len, NULL, PAGE_SIZE));
+    ck_assert_uint_eq(codec_compress(NULL, PAGE_SIZE, buf, sizeof(buf)), 0);
+    ck_assert_uint_eq(codec_compress(&page, PAGE_SIZE, NULL, sizeof(buf)), 0);
+}
+END_TEST
+
+static Suite *codec_suite(void)
+{
+    Suite *s;
+    TCase *tc_core;
+
+    s = suite_create("Codec Tests");
+    tc_core = tcase_create("Core");
+
+    tcase_add_test(tc_core, test_page_round_trip);
+    tcase_add_test(tc_core, test_incompressible_input);
+    tcase_add_test(tc_core, test_corrupt_input_rejected);
+
+    suite_add_tcase(s, tc_core);
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s = codec_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_VERBOSE);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? 0 : 1;
+}
@@ -0,0 +1,100 @@
+#include <check.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "../include/crc32c.h"
+#include "../include/heap.h"
+
+START_TEST(test_known_values)
+{
+    /* the standard check value, and the all-zeros / all-ones vectors from rfc 3720 */
+    ck_assert_uint_eq(crc32c(0, "123456789", 9), 0xe3069283u);
+    ck_assert_uint_eq(crc32c_sw(0, "123456789", 9), 0xe3069283u);
+
+    uint8_t buf[32];
+    memset(buf, 0, sizeof(buf));
+    ck_assert_uint_eq(crc32c(0, buf, sizeof(buf)), 0x8a9136aau);
+    memset(buf, 0xff, sizeof(buf));
+    ck_assert_uint_eq(crc32c(0, buf, sizeof(buf)), 0x62a8ab43u);
+    for (int i = 0; i < 32; i++) buf[i] = (uint8_t)i;
+    ck_assert_uint_eq(crc32c(0, buf, sizeof(buf)), 0x46dd794eu);
+
+    ck_assert_uint_eq(crc32c(0, buf, 0), 0);
+}
+END_TEST
+
+START_TEST(test_hardware_matches_table)
+{
+    static uint8_t data[PAGE_SIZE + 64];
+    uint32_t x = 99;
+    for (size_t i = 0; i < sizeof(data); i++) {
+        x = x * 1103515245u + 12345u;
+        data[i] = (uint8_t)(x >> 24);
+    }
+    /* every alignment and every tail length */
+    for (size_t start = 0; start < 16; start++) {
+        for (size_t len = 0; len < 80; len++) {
+            ck_assert_uint_eq(crc32c(0, data + start, len), crc32c_sw(0, data + start, len));
+        }
+        ck_assert_uint_eq(crc32c(0, data + start, PAGE_SIZE), crc32c_sw(0, data + start, PAGE_SIZE));
+    }
+
+    /* a crc can be carried across chunks */
+    uint32_t whole = crc32c(0, data, PAGE_SIZE);
+    uint32_t part = crc32c(0, data, 1000);
+    ck_assert_uint_eq(crc32c(part, data + 1000, PAGE_SIZE - 1000), whole);
+    ck_assert_uint_eq(crc32c_sw(crc32c_sw(0, data, 13), data + 13, PAGE_SIZE - 13), whole);
+}
+END_TEST
+
+START_TEST(test_page_rate)
+{
+    static HeapPage pages[256];
+    memset(pages, 0x5a, sizeof(pages));
+    struct timespec t0, t1;
+    uint32_t sink = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int round = 0; round < 20; round++) {
+        for (int i = 0; i < 256; i++) {
+            sink ^= page_checksum(&pages[i]);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    double gbps = 20.0 * sizeof(pages) / secs / 1e9;
+    printf("page checksums: %.2f GB/s (%08x)\n", gbps, sink);
+    /* loose on purpose: the table fallback and sanitizer builds have to pass too */
+    ck_assert(gbps > 0.1);
+}
+END_TEST
+
+static Suite *crc32c_suite(void)
+{
+    Suite *s;
+    TCase *tc_core;
+
+    s = suite_create("CRC32C Tests");
+    tc_core = tcase_create("Core");
+
+    tcase_add_test(tc_core, test_known_values);
+    tcase_add_test(tc_core, test_hardware_matches_table);
+    tcase_add_test(tc_core, test_page_rate);
+
+    suite_add_tcase(s, tc_core);
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s = crc32c_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_VERBOSE);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? 0 : 1;
+}
@@ -1,14 +1,35 @@
 #include <check.h>
 #include <stdio.h>
 #include <string.h>
+#include <stddef.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <pthread.h>
 #include "../include/file.h"
 
 static const char *test_file = "hf_test.bin";
+static const char *test_wal = "hf_test.bin.wal";
+static const char *test_id_index = "hf_test.bin.id.idx";
+static const char *test_hash_index = "hf_test.bin.id.hash";
+static const char *test_age_index = "hf_test.bin.age.idx";
+static const char *test_id_filter = "hf_test.bin.id.bloom";
+static const char *test_zone_map = "hf_test.bin.zm";
+static const char *test_fsm = "hf_test.bin.fsm";
+static const char *test_page_dir = "hf_test.bin.pdir";
 
 static void cleanup(void)
 {
     remove(test_file);
+    remove(test_wal);
+    remove(test_id_index);
+    remove(test_hash_index);
+    remove(test_age_index);
+    remove(test_id_filter);
+    remove(test_zone_map);
+    remove(test_fsm);
+    remove(test_page_dir);
 }
 
 static void create_corrupted_file(const char *filename)
@@ -102,7 +123,7 @@ START_TEST(test_create_file_returns_valid_heapfile)
 
     HeapFile *hf = create_file(test_file);
     ck_assert_ptr_nonnull(hf);
-    ck_assert_ptr_nonnull(hf->file_ptr);
+    ck_assert_int_ge(hf->fd, 0);
 
     close_file(hf);
     cleanup();
@@ -969,11 +990,3680 @@ START_TEST(test_hf_delete_record_page_rejoins_free_list)
 }
 END_TEST
 
+// ============== buffer pool tests ==============
+
+static long file_size_on_disk(const char *filename)
+{
+    FILE *f = fopen(filename, "rb");
+    ck_assert_ptr_nonnull(f);
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fclose(f);
+    return size;
+}
+
+START_TEST(test_hf_pin_page_shares_frame)
+{
+    cleanup();
+
+    HeapFile *hf = create_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+
+    int32_t page_id;
+    ck_assert_int_eq(hf_alloc_page(hf, &page_id), GRAIN_OK);
+
+    HeapPage *first, *second;
+    ck_assert_int_eq(hf_pin_page(hf, page_id, &first), GRAIN_OK);
+    ck_assert_int_eq(hf_pin_page(hf, page_id, &second), GRAIN_OK);
+    ck_assert_ptr_eq(first, second);
+    ck_assert_int_eq(first->header.page_id, page_id);
+
+    ck_assert_int_eq(hf_unpin_page(hf, page_id, false), GRAIN_OK);
+    ck_assert_int_eq(hf_unpin_page(hf, page_id, false), GRAIN_OK);
+    ck_assert_int_eq(hf_unpin_page(hf, page_id, false), GRAIN_INVALID_PAGE_ID);
+
+    HeapPage *page;
+    ck_assert_int_eq(hf_pin_page(hf, 5, &page), GRAIN_INVALID_PAGE_ID);
+    ck_assert_int_eq(hf_pin_page(NULL, 0, &page), GRAIN_NULL_PTR);
+
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_hf_insert_defers_page_writes)
+{
+    cleanup();
+
+    HeapFile *hf = create_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+
+    for (int i = 0; i < 10; i++) {
+        Record rec = {.id = i, .age = 20 + i};
+        snprintf(rec.name, sizeof(rec.name), "User%d", i);
+        ck_assert_int_eq(hf_insert_record(hf, &rec), GRAIN_OK);
+    }
+    ck_assert_int_eq(file_size_on_disk(test_file), (long)sizeof(FileHeader));
+
+    ck_assert_int_eq(hf_flush(hf), GRAIN_OK);
+    ck_assert_int_eq(file_size_on_disk(test_file), (long)FILE_DATA_OFFSET + PAGE_SIZE);
+
+    close_file(hf);
+
+    HeapFile *hf2 = open_file(test_file);
+    ck_assert_ptr_nonnull(hf2);
+    ck_assert_int_eq(hf2->header.num_pages, 1);
+
+    RecordId rid = {.page_id = 0, .slot_idx = -1};
+    Record found;
+    int count = 0;
+    while (hf_scan_next(hf2, &rid, &found) == GRAIN_OK) {
+        ck_assert_int_eq(found.id, count);
+        count++;
+    }
+    ck_assert_int_eq(count, 10);
+
+    close_file(hf2);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_hf_pages_survive_eviction)
+{
+    cleanup();
+
+    HeapFile *hf = create_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+
+    int total_records = MAX_SLOTS * (BUFFER_POOL_FRAMES + 8);
+    for (int i = 0; i < total_records; i++) {
+        Record rec = {.id = i, .age = i % 90};
+        ck_assert_int_eq(hf_insert_record(hf, &rec), GRAIN_OK);
+    }
+    ck_assert_int_eq(hf->header.num_pages, BUFFER_POOL_FRAMES + 8);
+
+    RecordId rid = {.page_id = 0, .slot_idx = -1};
+    Record found;
+    int count = 0;
+    while (hf_scan_next(hf, &rid, &found) == GRAIN_OK) {
+        ck_assert_int_eq(found.id, count);
+        count++;
+    }
+    ck_assert_int_eq(count, total_records);
+
+    close_file(hf);
+
+    HeapFile *hf2 = open_file(test_file);
+    ck_assert_ptr_nonnull(hf2);
+    rid = (RecordId){.page_id = 0, .slot_idx = -1};
+    count = 0;
+    while (hf_scan_next(hf2, &rid, &found) == GRAIN_OK) {
+        ck_assert_int_eq(found.id, count);
+        count++;
+    }
+    ck_assert_int_eq(count, total_records);
+
+    close_file(hf2);
+    cleanup();
+}
+END_TEST
+
+// ============== format version tests ==============
+
+static void create_legacy_file(const char *filename)
+{
+    FILE *f = fopen(filename, "wb");
+    ck_assert_ptr_nonnull(f);
+
+    int32_t header[3] = {1, 1, 0};
+    fwrite(header, sizeof(header), 1, f);
+
+    char page[PAGE_SIZE];
+    memset(page, 0, sizeof(page));
+    int32_t page_header[5] = {0, 3, 5, 3, -1};
+    memcpy(page, page_header, sizeof(page_header));
+
+    char *storage = page + sizeof(page_header);
+    for (int i = 0; i < 5; i++) {
+        Record rec = {.id = 100 + i, .age = 30 + i};
+        snprintf(rec.name, sizeof(rec.name), "Legacy%d", i);
+        memcpy(storage + i * RECORD_SIZE, &rec, RECORD_SIZE);
+    }
+    /* free list: slot 3 -> slot 1 -> end */
+    int32_t next = 1;
+    memcpy(storage + 3 * RECORD_SIZE, &next, sizeof(next));
+    next = FREE_SLOT_END;
+    memcpy(storage + 1 * RECORD_SIZE, &next, sizeof(next));
+
+    fwrite(page, sizeof(page), 1, f);
+    fclose(f);
+}
+
+START_TEST(test_create_file_writes_format_version)
+{
+    cleanup();
+
+    HeapFile *hf = create_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_int_eq(hf->header.version, GRAIN_FORMAT_VERSION);
+    close_file(hf);
+
+    FILE *f = fopen(test_file, "rb");
+    ck_assert_ptr_nonnull(f);
+    FileHeader raw_header;
+    ck_assert_int_eq(fread(&raw_header, sizeof(FileHeader), 1, f), 1);
+    fclose(f);
+    ck_assert_int_eq(raw_header.version, GRAIN_FORMAT_VERSION);
+
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_open_file_upgrades_legacy_file)
+{
+    cleanup();
+    create_legacy_file(test_file);
+
+    HeapFile *hf = open_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_int_eq(hf->header.version, GRAIN_FORMAT_VERSION);
+    ck_assert_int_eq(hf->header.num_pages, 1);
+    ck_assert_int_eq(hf->header.first_free_page, 0);
+
+    int expected_ids[] = {100, 102, 104};
+    RecordId rid = {.page_id = 0, .slot_idx = -1};
+    Record rec;
+    int count = 0;
+    while (hf_scan_next(hf, &rid, &rec) == GRAIN_OK) {
+        ck_assert_int_lt(count, 3);
+        ck_assert_int_eq(rec.id, expected_ids[count]);
+        ck_assert_int_eq(rec.age, expected_ids[count] - 70);
+        count++;
+    }
+    ck_assert_int_eq(count, 3);
+
+    Record fresh = {.id = 200, .age = 50};
+    ck_assert_int_eq(hf_insert_record(hf, &fresh), GRAIN_OK);
+    HeapPage page;
+    ck_assert_int_eq(read_page(hf, &page, 0), GRAIN_OK);
+    ck_assert_int_eq(get_record(&page, 3)->id, 200);
+    ck_assert_int_eq(page.header.first_free_slot, 1);
+    close_file(hf);
+
+    HeapFile *hf2 = open_file(test_file);
+    ck_assert_ptr_nonnull(hf2);
+    ck_assert_int_eq(hf2->header.version, GRAIN_FORMAT_VERSION);
+    ck_assert_int_eq(read_page(hf2, &page, 0), GRAIN_OK);
+    ck_assert_int_eq(page.header.num_slots, 4);
+    ck_assert(is_in_free_list(&page, 1) == true);
+    close_file(hf2);
+
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_open_file_upgrades_empty_legacy_file)
+{
+    cleanup();
+
+    FILE *f = fopen(test_file, "wb");
+    ck_assert_ptr_nonnull(f);
+    int32_t header[3] = {0, 0, -1};
+    fwrite(header, sizeof(header), 1, f);
+    fclose(f);
+
+    HeapFile *hf = open_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_int_eq(hf->header.version, GRAIN_FORMAT_VERSION);
+    ck_assert_int_eq(hf->header.num_pages, 0);
+    close_file(hf);
+
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_open_file_upgrades_v2_file)
+{
+    cleanup();
+
+    FILE *f = fopen(test_file, "wb");
+    ck_assert_ptr_nonnull(f);
+    int32_t header[4] = {1, 1, 0, 2};
+    fwrite(header, sizeof(header), 1, f);
+
+    /* version 2 pages: 20 bytes of fields plus the slot bitmap, no lsn */
+    char page[PAGE_SIZE];
+    memset(page, 0, sizeof(page));
+    int32_t page_header[9] = {0, 3, 3, FREE_SLOT_END, -1, 0x7, 0, 0, 0};
+    memcpy(page, page_header, sizeof(page_header));
+    for (int i = 0; i < 3; i++) {
+        Record rec = {.id = 200 + i, .age = 40 + i};
+        memcpy(page + sizeof(page_header) + i * RECORD_SIZE, &rec, RECORD_SIZE);
+    }
+    fwrite(page, sizeof(page), 1, f);
+    fclose(f);
+
+    HeapFile *hf = open_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_int_eq(hf->header.version, GRAIN_FORMAT_VERSION);
+    ck_assert_uint_eq(hf->header.checkpoint_lsn, 0);
+
+    RecordId rid = {.page_id = 0, .slot_idx = -1};
+    Record found;
+    for (int i = 0; i < 3; i++) {
+        ck_assert_int_eq(hf_scan_next(hf, &rid, &found), GRAIN_OK);
+        ck_assert_int_eq(found.id, 200 + i);
+        ck_assert_int_eq(found.age, 40 + i);
+    }
+    ck_assert_int_eq(hf_scan_next(hf, &rid, &found), GRAIN_END);
+
+    HeapPage *upgraded;
+    ck_assert_int_eq(hf_pin_page(hf, 0, &upgraded), GRAIN_OK);
+    ck_assert_uint_eq(upgraded->header.lsn, 0);
+    ck_assert_int_eq(hf_unpin_page(hf, 0, false), GRAIN_OK);
+    close_file(hf);
+
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_open_file_rejects_newer_version)
+{
+    cleanup();
+
+    FileHeader header = {
+        .num_pages = 0,
+        .next_page_idx = 0,
+        .first_free_page = -1,
+        .version = GRAIN_FORMAT_VERSION + 1
+    };
+    create_invalid_header_file(test_file, &header);
+
+    HeapFile *hf = open_file(test_file);
+    ck_assert_ptr_null(hf);
+
+    cleanup();
+}
+END_TEST
+
+// ============== mmap mode tests ==============
+
+START_TEST(test_mmap_insert_scan_and_reopen)
+{
+    cleanup();
+
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_MMAP);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_ptr_nonnull(hf->map);
+
+    int total_records = MAX_SLOTS * (MMAP_GROW_PAGES + 4);
+    for (int i = 0; i < total_records; i++) {
+        Record rec = {.id = i, .age = i % 70};
+        ck_assert_int_eq(hf_insert_record(hf, &rec), GRAIN_OK);
+    }
+    ck_assert_int_eq(hf->header.num_pages, MMAP_GROW_PAGES + 4);
+
+    RecordId rid = {.page_id = 0, .slot_idx = -1};
+    Record found;
+    int count = 0;
+    while (hf_scan_next(hf, &rid, &found) == GRAIN_OK) {
+        ck_assert_int_eq(found.id, count);
+        count++;
+    }
+    ck_assert_int_eq(count, total_records);
+    ck_assert_int_eq(close_file(hf), GRAIN_OK);
+
+    FILE *f = fopen(test_file, "rb");
+    ck_assert_ptr_nonnull(f);
+    fseek(f, 0, SEEK_END);
+    ck_assert_int_eq(ftell(f), (long)FILE_DATA_OFFSET + (long)(MMAP_GROW_PAGES + 4) * PAGE_SIZE);
+    fclose(f);
+
+    HeapFile *hf2 = open_file(test_file);
+    ck_assert_ptr_nonnull(hf2);
+    rid = (RecordId){.page_id = 0, .slot_idx = -1};
+    count = 0;
+    while (hf_scan_next(hf2, &rid, &found) == GRAIN_OK) {
+        ck_assert_int_eq(found.id, count);
+        count++;
+    }
+    ck_assert_int_eq(count, total_records);
+    close_file(hf2);
+
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_mmap_pin_points_into_mapping)
+{
+    cleanup();
+
+    HeapFile *hf = create_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    Record rec = {.id = 7, .age = 21};
+    strcpy(rec.name, "Mapped");
+    ck_assert_int_eq(hf_insert_record(hf, &rec), GRAIN_OK);
+    close_file(hf);
+
+    HeapFile *hf2 = open_file_ex(test_file, HF_OPEN_MMAP);
+    ck_assert_ptr_nonnull(hf2);
+
+    HeapPage *page;
+    ck_assert_int_eq(hf_pin_page(hf2, 0, &page), GRAIN_OK);
+    ck_assert_ptr_eq(page, hf2->map + FILE_DATA_OFFSET);
+    ck_assert_str_eq(get_record(page, 0)->name, "Mapped");
+
+    /* growing the file must not move a page that is still pinned */
+    for (int i = 0; i < MMAP_GROW_PAGES + 1; i++) {
+        int32_t page_id;
+        ck_assert_int_eq(hf_alloc_page(hf2, &page_id), GRAIN_OK);
+    }
+    ck_assert_str_eq(get_record(page, 0)->name, "Mapped");
+    get_record(page, 0)->age = 22;
+    ck_assert_int_eq(hf_unpin_page(hf2, 0, true), GRAIN_OK);
+    ck_assert_int_eq(hf_unpin_page(hf2, 0, false), GRAIN_INVALID_PAGE_ID);
+
+    ck_assert_int_eq(close_file(hf2), GRAIN_OK);
+
+    HeapFile *hf3 = open_file(test_file);
+    ck_assert_ptr_nonnull(hf3);
+    ck_assert_int_eq(hf3->header.num_pages, MMAP_GROW_PAGES + 2);
+    RecordId rid = {.page_id = 0, .slot_idx = -1};
+    Record found;
+    ck_assert_int_eq(hf_scan_next(hf3, &rid, &found), GRAIN_OK);
+    ck_assert_int_eq(found.age, 22);
+    close_file(hf3);
+
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_mmap_flush_persists_without_close)
+{
+    cleanup();
+
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_MMAP);
+    ck_assert_ptr_nonnull(hf);
+    for (int i = 0; i < 5; i++) {
+        Record rec = {.id = i, .age = 40};
+        ck_assert_int_eq(hf_insert_record(hf, &rec), GRAIN_OK);
+    }
+    RecordId rid = {.page_id = 0, .slot_idx = 2};
+    ck_assert_int_eq(hf_delete_record(hf, rid), GRAIN_OK);
+    ck_assert_int_eq(hf_flush(hf), GRAIN_OK);
+
+    HeapFile *reader = open_file(test_file);
+    ck_assert_ptr_nonnull(reader);
+    HeapPage page;
+    ck_assert_int_eq(read_page(reader, &page, 0), GRAIN_OK);
+    ck_assert_int_eq(page.header.num_slots, 4);
+    ck_assert_ptr_null(get_record(&page, 2));
+    close_file(reader);
+
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_mmap_open_rejects_short_file)
+{
+    cleanup();
+
+    FileHeader header = {
+        .num_pages = 3,
+        .next_page_idx = 3,
+        .first_free_page = -1,
+        .version = GRAIN_FORMAT_VERSION
+    };
+    create_invalid_header_file(test_file, &header);
+
+    HeapFile *hf = open_file_ex(test_file, HF_OPEN_MMAP);
+    ck_assert_ptr_null(hf);
+
+    cleanup();
+}
+END_TEST
+
+// ============== write-ahead log tests ==============
+
+/* runs body in a child that exits without flushing or closing anything */
+#define CRASH_AFTER(...)                   \
+    do {                                   \
+        pid_t pid = fork();                \
+        ck_assert_int_ge(pid, 0);          \
+        if (pid == 0) {                    \
+            __VA_ARGS__;                   \
+            _exit(0);                      \
+        }                                  \
+        int status;                        \
+        waitpid(pid, &status, 0);          \
+        ck_assert(WIFEXITED(status));      \
+        ck_assert_int_eq(WEXITSTATUS(status), 0); \
+    } while (0)
+
+static void insert_and_commit_ex(int n, uint32_t flags)
+{
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_WAL | flags);
+    if (hf == NULL) _exit(1);
+    for (int i = 0; i < n; i++) {
+        Record rec = {.id = i, .age = i % 60};
+        if (hf_insert_record(hf, &rec) != GRAIN_OK) _exit(1);
+    }
+    RecordId updated = {.page_id = 1, .slot_idx = 3};
+    Record rec = {.id = MAX_SLOTS + 3, .age = 99};
+    if (hf_update_record(hf, updated, &rec) != GRAIN_OK) _exit(1);
+    RecordId deleted = {.page_id = 0, .slot_idx = 5};
+    if (hf_delete_record(hf, deleted) != GRAIN_OK) _exit(1);
+    if (hf_commit(hf) != GRAIN_OK) _exit(1);
+}
+
+static void insert_and_commit(int n)
+{
+    insert_and_commit_ex(n, HF_OPEN_DEFAULT);
+}
+
+static void assert_recovered(HeapFile *hf, int n)
+{
+    ck_assert_int_eq(hf->header.num_pages, (n + MAX_SLOTS - 1) / MAX_SLOTS);
+    ck_assert_int_eq(hf->header.first_free_page, 0);
+
+    RecordId rid = {.page_id = 0, .slot_idx = -1};
+    Record found;
+    int count = 0;
+    bool saw_update = false;
+    while (hf_scan_next(hf, &rid, &found) == GRAIN_OK) {
+        ck_assert_int_ne(found.id, 5);
+        if (found.id == MAX_SLOTS + 3) {
+            ck_assert_int_eq(found.age, 99);
+            saw_update = true;
+        }
+        count++;
+    }
+    ck_assert_int_eq(count, n - 1);
+    ck_assert(saw_update);
+}
+
+START_TEST(test_wal_recovers_committed_changes_after_crash)
+{
+    cleanup();
+    int n = MAX_SLOTS * 2 + 40;
+    CRASH_AFTER(insert_and_commit(n));
+    ck_assert_int_eq(access(test_wal, F_OK), 0);
+
+    HeapFile *hf = open_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    assert_recovered(hf, n);
+    close_file(hf);
+
+    /* without HF_OPEN_WAL the log is removed once it has been applied */
+    ck_assert_int_eq(access(test_wal, F_OK), -1);
+
+    hf = open_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    assert_recovered(hf, n);
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_wal_repairs_torn_page)
+{
+    cleanup();
+    int n = MAX_SLOTS * 2 + 40;
+    CRASH_AFTER(insert_and_commit(n));
+
+    /* simulate a page write that stopped halfway */
+    int fd = open(test_file, O_RDWR);
+    ck_assert_int_ge(fd, 0);
+    char garbage[PAGE_SIZE / 2];
+    memset(garbage, 0xab, sizeof(garbage));
+    ck_assert_int_eq(pwrite(fd, garbage, sizeof(garbage), FILE_DATA_OFFSET + PAGE_SIZE), sizeof(garbage));
+    close(fd);
+
+    HeapFile *hf = open_file_ex(test_file, HF_OPEN_WAL);
+    ck_assert_ptr_nonnull(hf);
+    assert_recovered(hf, n);
+    ck_assert_ptr_nonnull(hf->wal);
+    ck_assert(wal_is_empty(hf->wal));
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_wal_uncommitted_tail_is_dropped)
+{
+    cleanup();
+    CRASH_AFTER({
+        HeapFile *hf = create_file_ex(test_file, HF_OPEN_WAL);
+        if (hf == NULL) _exit(1);
+        Record rec = {.id = 1, .age = 1};
+        if (hf_insert_record(hf, &rec) != GRAIN_OK) _exit(1);
+        if (hf_commit(hf) != GRAIN_OK) _exit(1);
+        rec.id = 2;
+        if (hf_insert_record(hf, &rec) != GRAIN_OK) _exit(1);
+    });
+
+    HeapFile *hf = open_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    RecordId rid = {.page_id = 0, .slot_idx = -1};
+    Record found;
+    ck_assert_int_eq(hf_scan_next(hf, &rid, &found), GRAIN_OK);
+    ck_assert_int_eq(found.id, 1);
+    ck_assert_int_eq(hf_scan_next(hf, &rid, &found), GRAIN_END);
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_wal_flush_checkpoints_and_truncates_log)
+{
+    cleanup();
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_WAL);
+    ck_assert_ptr_nonnull(hf);
+
+    for (int i = 0; i < 20; i++) {
+        Record rec = {.id = i, .age = 20};
+        ck_assert_int_eq(hf_insert_record(hf, &rec), GRAIN_OK);
+    }
+    ck_assert(!wal_is_empty(hf->wal));
+    uint64_t lsn = wal_next_lsn(hf->wal);
+
+    ck_assert_int_eq(hf_flush(hf), GRAIN_OK);
+    ck_assert(wal_is_empty(hf->wal));
+    ck_assert_uint_eq(hf->header.checkpoint_lsn, lsn);
+    ck_assert_int_eq(file_size_on_disk(test_wal), (long)sizeof(WalFileHeader));
+    close_file(hf);
+
+    hf = open_file_ex(test_file, HF_OPEN_WAL);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_uint_eq(wal_next_lsn(hf->wal), lsn);
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_wal_stamps_page_lsn)
+{
+    cleanup();
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_WAL);
+    ck_assert_ptr_nonnull(hf);
+
+    Record rec = {.id = 1, .age = 20};
+    ck_assert_int_eq(hf_insert_record(hf, &rec), GRAIN_OK);
+    HeapPage *page;
+    ck_assert_int_eq(hf_pin_page(hf, 0, &page), GRAIN_OK);
+    uint64_t first = page->header.lsn;
+    ck_assert_uint_eq(first, wal_next_lsn(hf->wal));
+    ck_assert_int_eq(hf_unpin_page(hf, 0, false), GRAIN_OK);
+
+    RecordId rid = {.page_id = 0, .slot_idx = 0};
+    rec.age = 21;
+    ck_assert_int_eq(hf_update_record(hf, rid, &rec), GRAIN_OK);
+    ck_assert_int_eq(hf_pin_page(hf, 0, &page), GRAIN_OK);
+    ck_assert_uint_gt(page->header.lsn, first);
+
+    /* after the first full image, single-slot changes log much less than a page */
+    ck_assert_uint_lt(page->header.lsn - first, PAGE_SIZE / 4);
+    ck_assert_int_eq(hf_unpin_page(hf, 0, false), GRAIN_OK);
+
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_wal_eviction_forces_log_first)
+{
+    cleanup();
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_WAL);
+    ck_assert_ptr_nonnull(hf);
+
+    int total_records = MAX_SLOTS * (BUFFER_POOL_FRAMES + 8);
+    for (int i = 0; i < total_records; i++) {
+        Record rec = {.id = i, .age = 20};
+        ck_assert_int_eq(hf_insert_record(hf, &rec), GRAIN_OK);
+    }
+    ck_assert(!bp_is_resident(&hf->pool, 0));
+
+    HeapPage on_disk;
+    int fd = open(test_file, O_RDONLY);
+    ck_assert_int_ge(fd, 0);
+    ck_assert_int_eq(pread(fd, &on_disk, PAGE_SIZE, FILE_DATA_OFFSET), PAGE_SIZE);
+    close(fd);
+    ck_assert_uint_gt(on_disk.header.lsn, 0);
+    ck_assert_uint_ge(hf->wal->synced_lsn, on_disk.header.lsn);
+
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_wal_rejects_mmap)
+{
+    cleanup();
+    ck_assert_ptr_null(create_file_ex(test_file, HF_OPEN_MMAP | HF_OPEN_WAL));
+
+    HeapFile *hf = create_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    close_file(hf);
+    ck_assert_ptr_null(open_file_ex(test_file, HF_OPEN_MMAP | HF_OPEN_WAL));
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_commit_without_wal_flushes)
+{
+    cleanup();
+    HeapFile *hf = create_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_ptr_null(hf->wal);
+
+    Record rec = {.id = 1, .age = 20};
+    ck_assert_int_eq(hf_insert_record(hf, &rec), GRAIN_OK);
+    ck_assert_int_eq(hf_commit(hf), GRAIN_OK);
+    ck_assert_int_eq(file_size_on_disk(test_file), (long)FILE_DATA_OFFSET + PAGE_SIZE);
+    ck_assert_int_eq(hf_commit(NULL), GRAIN_NULL_PTR);
+
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+static void assert_record_at(HeapFile *hf, RecordId rid, int32_t id)
+{
+    HeapPage page;
+    ck_assert_int_eq(read_page(hf, &page, rid.page_id), GRAIN_OK);
+    Record *found = get_record(&page, rid.slot_idx);
+    ck_assert_ptr_nonnull(found);
+    ck_assert_int_eq(found->id, id);
+}
+
+START_TEST(test_hf_insert_records_fills_new_pages)
+{
+    cleanup();
+    HeapFile *hf = create_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+
+    int n = 1000;
+    Record *recs = malloc(sizeof(Record) * n);
+    RecordId *rids = malloc(sizeof(RecordId) * n);
+    for (int i = 0; i < n; i++) {
+        recs[i] = (Record){.id = i, .age = i % 90};
+    }
+    ck_assert_int_eq(hf_insert_records(hf, recs, n, rids), GRAIN_OK);
+
+    int expected_pages = (n + MAX_SLOTS - 1) / MAX_SLOTS;
+    ck_assert_int_eq(hf->header.num_pages, expected_pages);
+    ck_assert_int_eq(hf->header.first_free_page, expected_pages - 1);
+    for (int i = 0; i < n; i++) {
+        ck_assert_int_eq(rids[i].page_id, i / MAX_SLOTS);
+        ck_assert_int_eq(rids[i].slot_idx, i % MAX_SLOTS);
+    }
+    ck_assert_int_eq(close_file(hf), GRAIN_OK);
+
+    hf = open_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    for (int i = 0; i < n; i += 37) {
+        assert_record_at(hf, rids[i], i);
+    }
+    close_file(hf);
+
+    free(recs);
+    free(rids);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_hf_insert_records_tops_up_free_pages_first)
+{
+    cleanup();
+    HeapFile *hf = create_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+
+    for (int i = 0; i < 10; i++) {
+        Record rec = {.id = i, .age = 30};
+        ck_assert_int_eq(hf_insert_record(hf, &rec), GRAIN_OK);
+    }
+    RecordId hole = {.page_id = 0, .slot_idx = 4};
+    ck_assert_int_eq(hf_delete_record(hf, hole), GRAIN_OK);
+
+    Record recs[MAX_SLOTS];
+    RecordId rids[MAX_SLOTS];
+    for (int i = 0; i < MAX_SLOTS; i++) {
+        recs[i] = (Record){.id = 100 + i, .age = 40};
+    }
+    ck_assert_int_eq(hf_insert_records(hf, recs, MAX_SLOTS, rids), GRAIN_OK);
+
+    /* the deleted slot is reused, page 0 is topped up, the rest spills to page 1 */
+    ck_assert_int_eq(rids[0].page_id, 0);
+    ck_assert_int_eq(rids[0].slot_idx, 4);
+    ck_assert_int_eq(rids[1].page_id, 0);
+    ck_assert_int_eq(rids[1].slot_idx, 10);
+    int on_page_zero = MAX_SLOTS - 9;
+    ck_assert_int_eq(rids[on_page_zero - 1].page_id, 0);
+    ck_assert_int_eq(rids[on_page_zero].page_id, 1);
+    ck_assert_int_eq(rids[on_page_zero].slot_idx, 0);
+
+    ck_assert_int_eq(hf->header.num_pages, 2);
+    ck_assert_int_eq(hf->header.first_free_page, 1);
+
+    for (int i = 0; i < MAX_SLOTS; i++) {
+        assert_record_at(hf, rids[i], 100 + i);
+    }
+
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_hf_insert_records_null_and_empty)
+{
+    cleanup();
+    HeapFile *hf = create_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+
+    Record rec = {.id = 1, .age = 20};
+    ck_assert_int_eq(hf_insert_records(NULL, &rec, 1, NULL), GRAIN_NULL_PTR);
+    ck_assert_int_eq(hf_insert_records(hf, NULL, 1, NULL), GRAIN_NULL_PTR);
+
+    ck_assert_int_eq(hf_insert_records(hf, &rec, 0, NULL), GRAIN_OK);
+    ck_assert_int_eq(hf->header.num_pages, 0);
+
+    /* rids are optional */
+    ck_assert_int_eq(hf_insert_records(hf, &rec, 1, NULL), GRAIN_OK);
+    ck_assert_int_eq(hf->header.num_pages, 1);
+
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_hf_insert_records_mmap)
+{
+    cleanup();
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_MMAP);
+    ck_assert_ptr_nonnull(hf);
+
+    int n = MAX_SLOTS * (MMAP_GROW_PAGES + 2) + 5;
+    Record *recs = malloc(sizeof(Record) * n);
+    for (int i = 0; i < n; i++) {
+        recs[i] = (Record){.id = i, .age = i % 50};
+    }
+    ck_assert_int_eq(hf_insert_records(hf, recs, n, NULL), GRAIN_OK);
+    ck_assert_int_eq(hf->header.num_pages, MMAP_GROW_PAGES + 3);
+    ck_assert_int_eq(close_file(hf), GRAIN_OK);
+
+    hf = open_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    RecordId rid = {.page_id = 0, .slot_idx = -1};
+    Record found;
+    int count = 0;
+    while (hf_scan_next(hf, &rid, &found) == GRAIN_OK) {
+        ck_assert_int_eq(found.id, count);
+        count++;
+    }
+    ck_assert_int_eq(count, n);
+    close_file(hf);
+
+    free(recs);
+    cleanup();
+}
+END_TEST
+
+// ============== id index tests ==============
+
+static void insert_ids(HeapFile *hf, int from, int to)
+{
+    for (int i = from; i < to; i++) {
+        Record rec = {.id = i, .age = i % 80};
+        snprintf(rec.name, sizeof(rec.name), "User%d", i);
+        ck_assert_int_eq(hf_insert_record(hf, &rec), GRAIN_OK);
+    }
+}
+
+START_TEST(test_id_index_point_lookup)
+{
+    cleanup();
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_ID_INDEX);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_ptr_nonnull(hf->id_index);
+    ck_assert_int_eq(access(test_id_index, F_OK), 0);
+
+    insert_ids(hf, 0, 2000);
+    ck_assert_int_eq(hf->id_index->header.num_entries, 2000);
+
+    RecordId rid;
+    Record found;
+    ck_assert_int_eq(hf_find_by_id(hf, 1234, &rid, &found), GRAIN_OK);
+    ck_assert_int_eq(found.id, 1234);
+    ck_assert_str_eq(found.name, "User1234");
+    ck_assert_int_eq(rid.page_id, 1234 / MAX_SLOTS);
+    ck_assert_int_eq(rid.slot_idx, 1234 % MAX_SLOTS);
+
+    ck_assert_int_eq(hf_find_by_id(hf, 5000, &rid, &found), GRAIN_RECORD_NOT_FOUND);
+
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_id_index_follows_delete_and_update)
+{
+    cleanup();
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_ID_INDEX);
+    ck_assert_ptr_nonnull(hf);
+    insert_ids(hf, 0, 300);
+
+    RecordId rid;
+    Record found;
+    ck_assert_int_eq(hf_find_by_id(hf, 150, &rid, &found), GRAIN_OK);
+    ck_assert_int_eq(hf_delete_record(hf, rid), GRAIN_OK);
+    ck_assert_int_eq(hf_find_by_id(hf, 150, &rid, &found), GRAIN_RECORD_NOT_FOUND);
+    ck_assert_int_eq(hf->id_index->header.num_entries, 299);
+
+    /* the freed slot is reused by the next insert and indexed under the new id */
+    insert_ids(hf, 7000, 7001);
+    ck_assert_int_eq(hf_find_by_id(hf, 7000, &rid, &found), GRAIN_OK);
+    ck_assert_int_eq(rid.page_id, 150 / MAX_SLOTS);
+    ck_assert_int_eq(rid.slot_idx, 150 % MAX_SLOTS);
+
+    Record changed = {.id = 151, .age = 99};
+    ck_assert_int_eq(hf_find_by_id(hf, 151, &rid, &found), GRAIN_OK);
+    ck_assert_int_eq(hf_update_record(hf, rid, &changed), GRAIN_OK);
+    ck_assert_int_eq(hf_find_by_id(hf, 151, &rid, &found), GRAIN_OK);
+    ck_assert_int_eq(found.age, 99);
+
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_id_index_range_scan)
+{
+    cleanup();
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_ID_INDEX);
+    ck_assert_ptr_nonnull(hf);
+
+    /* ids arrive out of order; the range comes back sorted */
+    for (int i = 0; i < 1000; i++) {
+        Record rec = {.id = (i * 37) % 1000, .age = 20};
+        ck_assert_int_eq(hf_insert_record(hf, &rec), GRAIN_OK);
+    }
+
+    BTreeCursor cur;
+    RecordId rid;
+    Record found;
+    ck_assert_int_eq(hf_id_range_init(hf, &cur, 100, 199), GRAIN_OK);
+    int expected = 100;
+    while (hf_id_range_next(hf, &cur, &rid, &found) == GRAIN_OK) {
+        ck_assert_int_eq(found.id, expected);
+        expected++;
+    }
+    ck_assert_int_eq(expected, 200);
+
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_id_index_bulk_insert)
+{
+    cleanup();
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_ID_INDEX);
+    ck_assert_ptr_nonnull(hf);
+    insert_ids(hf, 0, 10);
+
+    int n = MAX_SLOTS * 3;
+    Record *recs = malloc(sizeof(Record) * n);
+    for (int i = 0; i < n; i++) {
+        recs[i] = (Record){.id = 1000 + i, .age = 30};
+    }
+    ck_assert_int_eq(hf_insert_records(hf, recs, n, NULL), GRAIN_OK);
+    ck_assert_int_eq(hf->id_index->header.num_entries, n + 10);
+
+    RecordId rid;
+    Record found;
+    for (int i = 0; i < n; i += 50) {
+        ck_assert_int_eq(hf_find_by_id(hf, 1000 + i, &rid, &found), GRAIN_OK);
+        ck_assert_int_eq(found.id, 1000 + i);
+    }
+
+    free(recs);
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_id_index_persists_and_is_rebuilt)
+{
+    cleanup();
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_ID_INDEX);
+    ck_assert_ptr_nonnull(hf);
+    insert_ids(hf, 0, 500);
+    close_file(hf);
+
+    /* an existing index is attached and maintained even without the flag */
+    hf = open_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_ptr_nonnull(hf->id_index);
+    insert_ids(hf, 500, 600);
+    close_file(hf);
+
+    remove(test_id_index);
+    hf = open_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_ptr_null(hf->id_index);
+    close_file(hf);
+
+    hf = open_file_ex(test_file, HF_OPEN_ID_INDEX);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_int_eq(hf->id_index->header.num_entries, 600);
+    RecordId rid;
+    Record found;
+    ck_assert_int_eq(hf_find_by_id(hf, 599, &rid, &found), GRAIN_OK);
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_id_index_rebuilt_after_crash)
+{
+    cleanup();
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_ID_INDEX);
+    ck_assert_ptr_nonnull(hf);
+    insert_ids(hf, 0, 100);
+    close_file(hf);
+
+    /* the heap change is committed through the log, the index change never reaches disk */
+    CRASH_AFTER({
+        HeapFile *child = open_file_ex(test_file, HF_OPEN_WAL);
+        if (child == NULL) _exit(1);
+        Record rec = {.id = 4242, .age = 1};
+        if (hf_insert_record(child, &rec) != GRAIN_OK) _exit(1);
+        RecordId victim = {.page_id = 0, .slot_idx = 7};
+        if (hf_delete_record(child, victim) != GRAIN_OK) _exit(1);
+        if (hf_commit(child) != GRAIN_OK) _exit(1);
+    });
+
+    hf = open_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_ptr_nonnull(hf->id_index);
+    ck_assert_int_eq(hf->id_index->header.num_entries, 100);
+    RecordId rid;
+    Record found;
+    ck_assert_int_eq(hf_find_by_id(hf, 4242, &rid, &found), GRAIN_OK);
+    ck_assert_int_eq(rid.page_id, 0);
+    ck_assert_int_eq(rid.slot_idx, 100);
+    ck_assert_int_eq(hf_find_by_id(hf, 7, &rid, &found), GRAIN_RECORD_NOT_FOUND);
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_hash_index_point_lookup)
+{
+    cleanup();
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_HASH_INDEX);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_ptr_nonnull(hf->hash_index);
+    ck_assert_ptr_null(hf->id_index);
+    ck_assert_int_eq(access(test_hash_index, F_OK), 0);
+
+    insert_ids(hf, 0, 5000);
+    ck_assert_int_eq(hf->hash_index->header.num_entries, 5000);
+
+    RecordId rid;
+    Record found;
+    ck_assert_int_eq(hf_find_by_id(hf, 4321, &rid, &found), GRAIN_OK);
+    ck_assert_int_eq(found.id, 4321);
+    ck_assert_str_eq(found.name, "User4321");
+    ck_assert_int_eq(rid.page_id, 4321 / MAX_SLOTS);
+    ck_assert_int_eq(rid.slot_idx, 4321 % MAX_SLOTS);
+    ck_assert_int_eq(hf_find_by_id(hf, 9000, &rid, &found), GRAIN_RECORD_NOT_FOUND);
+
+    /* ranges still need the b+ tree */
+    BTreeCursor cur;
+    ck_assert_int_eq(hf_id_range_init(hf, &cur, 0, 10), GRAIN_NO_INDEX);
+
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_hash_index_follows_delete_and_vacuum)
+{
+    cleanup();
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_HASH_INDEX | HF_OPEN_ID_INDEX);
+    ck_assert_ptr_nonnull(hf);
+    insert_ids(hf, 0, MAX_SLOTS * 6);
+
+    /* leave the last page sparse so vacuum moves its records */
+    RecordId rid;
+    Record found;
+    for (int i = MAX_SLOTS * 5; i < MAX_SLOTS * 6 - 3; i++) {
+        ck_assert_int_eq(hf_find_by_id(hf, i, &rid, &found), GRAIN_OK);
+        ck_assert_int_eq(hf_delete_record(hf, rid), GRAIN_OK);
+    }
+    for (int i = 0; i < 3; i++) {
+        ck_assert_int_eq(hf_find_by_id(hf, i, &rid, &found), GRAIN_OK);
+        ck_assert_int_eq(hf_delete_record(hf, rid), GRAIN_OK);
+    }
+    ck_assert_int_eq(hf_vacuum(hf, MAX_SLOTS / 2, NULL, NULL), GRAIN_OK);
+    ck_assert_int_eq(hf->header.num_pages, 5);
+    ck_assert_int_eq(hf->hash_index->header.num_entries, MAX_SLOTS * 5);
+
+    for (int i = MAX_SLOTS * 6 - 3; i < MAX_SLOTS * 6; i++) {
+        ck_assert_int_eq(hf_find_by_id(hf, i, &rid, &found), GRAIN_OK);
+        ck_assert_int_eq(found.id, i);
+        ck_assert_int_eq(rid.page_id, 0);
+    }
+    ck_assert_int_eq(hf_find_by_id(hf, 1, &rid, &found), GRAIN_RECORD_NOT_FOUND);
+
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_hash_index_rebuilt_when_stale)
+{
+    cleanup();
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_HASH_INDEX);
+    ck_assert_ptr_nonnull(hf);
+    insert_ids(hf, 0, 100);
+    close_file(hf);
+
+    CRASH_AFTER({
+        HeapFile *child = open_file_ex(test_file, HF_OPEN_WAL);
+        if (child == NULL) _exit(1);
+        Record rec = {.id = 4242, .age = 1};
+        if (hf_insert_record(child, &rec) != GRAIN_OK) _exit(1);
+        RecordId victim = {.page_id = 0, .slot_idx = 7};
+        if (hf_delete_record(child, victim) != GRAIN_OK) _exit(1);
+        if (hf_commit(child) != GRAIN_OK) _exit(1);
+    });
+
+    hf = open_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_ptr_nonnull(hf->hash_index);
+    ck_assert_int_eq(hf->hash_index->header.num_entries, 100);
+    RecordId rid;
+    Record found;
+    ck_assert_int_eq(hf_find_by_id(hf, 4242, &rid, &found), GRAIN_OK);
+    ck_assert_int_eq(rid.slot_idx, 100);
+    ck_assert_int_eq(hf_find_by_id(hf, 7, &rid, &found), GRAIN_RECORD_NOT_FOUND);
+    close_file(hf);
+
+    remove(test_hash_index);
+    hf = open_file_ex(test_file, HF_OPEN_HASH_INDEX);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_int_eq(hf->hash_index->header.num_entries, 100);
+    ck_assert_int_eq(hf_find_by_id(hf, 99, &rid, &found), GRAIN_OK);
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+static int count_age_range(HeapFile *hf, int32_t lo, int32_t hi)
+{
+    BTreeCursor cur;
+    RecordId rids[64];
+    Record recs[64];
+    int32_t count;
+    int total = 0;
+    ck_assert_int_eq(hf_age_range_init(hf, &cur, lo, hi), GRAIN_OK);
+    while (hf_age_range_fetch(hf, &cur, rids, recs, 64, &count) == GRAIN_OK) {
+        for (int32_t i = 0; i < count; i++) {
+            ck_assert_int_ge(recs[i].age, lo);
+            ck_assert_int_le(recs[i].age, hi);
+            if (i > 0) {
+                ck_assert_int_le(rids[i - 1].page_id, rids[i].page_id);
+            }
+        }
+        total += count;
+    }
+    return total;
+}
+
+START_TEST(test_age_index_range_fetch)
+{
+    cleanup();
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_AGE_INDEX);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_ptr_nonnull(hf->age_index);
+    ck_assert_ptr_null(hf->id_index);
+    ck_assert_int_eq(access(test_age_index, F_OK), 0);
+
+    insert_ids(hf, 0, 4000);
+    ck_assert_int_eq(hf->age_index->header.num_entries, 4000);
+
+    /* ages are i % 80, so each age has 50 records spread over the whole file */
+    ck_assert_int_eq(count_age_range(hf, 20, 29), 500);
+    ck_assert_int_eq(count_age_range(hf, 79, 200), 50);
+    ck_assert_int_eq(count_age_range(hf, 100, 200), 0);
+
+    /* next walks the same entries in age order without touching the heap */
+    BTreeCursor cur;
+    RecordId rid;
+    Record rec;
+    int seen = 0;
+    int32_t last_age = 0;
+    ck_assert_int_eq(hf_age_range_init(hf, &cur, 5, 6), GRAIN_OK);
+    while (hf_age_range_next(hf, &cur, &rid) == GRAIN_OK) {
+        ck_assert_int_eq(hf_get_record(hf, rid, &rec), GRAIN_OK);
+        ck_assert_int_ge(rec.age, last_age);
+        last_age = rec.age;
+        seen++;
+    }
+    ck_assert_int_eq(seen, 100);
+
+    int32_t count;
+    Record recs[4];
+    RecordId rids[4];
+    ck_assert_int_eq(hf_age_range_fetch(hf, &cur, rids, recs, 0, &count), GRAIN_INVALID_SLOT);
+    ck_assert_int_eq(hf_age_range_fetch(hf, &cur, rids, recs, 4, &count), GRAIN_END);
+
+    close_file(hf);
+    hf = open_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_int_eq(hf_id_range_init(hf, &cur, 0, 10), GRAIN_NO_INDEX);
+    ck_assert_int_eq(count_age_range(hf, 0, 79), 4000);
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_age_index_follows_update_and_delete)
+{
+    cleanup();
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_AGE_INDEX | HF_OPEN_ID_INDEX);
+    ck_assert_ptr_nonnull(hf);
+    insert_ids(hf, 0, MAX_SLOTS * 4);
+    int in_range = count_age_range(hf, 30, 39);
+
+    /* moving a record's age into the range, out of it and within it */
+    RecordId rid;
+    Record found;
+    ck_assert_int_eq(hf_find_by_id(hf, 1, &rid, &found), GRAIN_OK);
+    Record changed = {.id = 1, .age = 35};
+    ck_assert_int_eq(hf_update_record(hf, rid, &changed), GRAIN_OK);
+    ck_assert_int_eq(count_age_range(hf, 30, 39), in_range + 1);
+    ck_assert_int_eq(count_age_range(hf, 1, 1), MAX_SLOTS * 4 / 80);
+
+    ck_assert_int_eq(hf_find_by_id(hf, 31, &rid, &found), GRAIN_OK);
+    changed = (Record){.id = 31, .age = 90};
+    ck_assert_int_eq(hf_update_record(hf, rid, &changed), GRAIN_OK);
+    ck_assert_int_eq(count_age_range(hf, 30, 39), in_range);
+    ck_assert_int_eq(count_age_range(hf, 90, 90), 1);
+
+    ck_assert_int_eq(hf_find_by_id(hf, 32, &rid, &found), GRAIN_OK);
+    changed = (Record){.id = 32, .age = 33};
+    ck_assert_int_eq(hf_update_record(hf, rid, &changed), GRAIN_OK);
+    ck_assert_int_eq(count_age_range(hf, 30, 39), in_range);
+    ck_assert_int_eq(hf->age_index->header.num_entries, MAX_SLOTS * 4);
+
+    ck_assert_int_eq(hf_find_by_id(hf, 33, &rid, &found), GRAIN_OK);
+    ck_assert_int_eq(hf_delete_record(hf, rid), GRAIN_OK);
+    ck_assert_int_eq(count_age_range(hf, 30, 39), in_range - 1);
+
+    /* vacuum moves the last page's records down and the index follows them */
+    for (int i = MAX_SLOTS * 3; i < MAX_SLOTS * 4 - 1; i++) {
+        ck_assert_int_eq(hf_find_by_id(hf, i, &rid, &found), GRAIN_OK);
+        ck_assert_int_eq(hf_delete_record(hf, rid), GRAIN_OK);
+    }
+    ck_assert_int_eq(hf_vacuum(hf, MAX_SLOTS / 2, NULL, NULL), GRAIN_OK);
+    ck_assert_int_eq(hf->header.num_pages, 3);
+    ck_assert_int_eq(count_age_range(hf, 0, 100), MAX_SLOTS * 3);
+
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_age_index_rebuilt_after_crash)
+{
+    cleanup();
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_AGE_INDEX);
+    ck_assert_ptr_nonnull(hf);
+    insert_ids(hf, 0, 100);
+    close_file(hf);
+
+    /* the age change is committed through the log, the index change never reaches disk */
+    CRASH_AFTER({
+        HeapFile *child = open_file_ex(test_file, HF_OPEN_WAL);
+        if (child == NULL) _exit(1);
+        RecordId target = {.page_id = 0, .slot_idx = 10};
+        Record changed = {.id = 10, .age = 95};
+        if (hf_update_record(child, target, &changed) != GRAIN_OK) _exit(1);
+        if (hf_commit(child) != GRAIN_OK) _exit(1);
+    });
+
+    hf = open_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_ptr_nonnull(hf->age_index);
+    ck_assert_int_eq(count_age_range(hf, 95, 95), 1);
+    ck_assert_int_eq(count_age_range(hf, 10, 10), 1);
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_id_filter_skips_missing_ids)
+{
+    cleanup();
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_ID_FILTER);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_ptr_nonnull(hf->id_filter);
+    ck_assert_int_eq(access(test_id_filter, F_OK), 0);
+    insert_ids(hf, 0, 3000);
+    close_file(hf);
+
+    /* reopened without the flag, the filter is attached and no heap page is cached yet */
+    hf = open_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_ptr_nonnull(hf->id_filter);
+    for (int32_t page_id = 0; page_id < hf->header.num_pages; page_id++) {
+        ck_assert(!bp_is_resident(&hf->pool, page_id));
+    }
+
+    RecordId rid;
+    Record found;
+    int negatives = 0;
+    for (int i = 0; i < 1000; i++) {
+        int32_t id = 3000 + i * 13;
+        if (!hf_id_may_exist(hf, id)) {
+            ck_assert_int_eq(hf_find_by_id(hf, id, &rid, &found), GRAIN_RECORD_NOT_FOUND);
+            negatives++;
+        }
+    }
+    ck_assert_int_gt(negatives, 950);
+    for (int32_t page_id = 0; page_id < hf->header.num_pages; page_id++) {
+        ck_assert(!bp_is_resident(&hf->pool, page_id));
+    }
+
+    for (int i = 0; i < 3000; i += 7) {
+        ck_assert(hf_id_may_exist(hf, i));
+        ck_assert_int_eq(hf_find_by_id(hf, i, &rid, &found), GRAIN_OK);
+        ck_assert_int_eq(found.id, i);
+    }
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_id_filter_rebuilt_by_vacuum)
+{
+    cleanup();
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_ID_FILTER);
+    ck_assert_ptr_nonnull(hf);
+    insert_ids(hf, 0, MAX_SLOTS * 8);
+
+    /* deleted ids stay in the filter until a vacuum rebuilds it */
+    for (int i = MAX_SLOTS; i < MAX_SLOTS * 8; i++) {
+        RecordId rid = {.page_id = i / MAX_SLOTS, .slot_idx = i % MAX_SLOTS};
+        ck_assert_int_eq(hf_delete_record(hf, rid), GRAIN_OK);
+    }
+    ck_assert(hf_id_may_exist(hf, MAX_SLOTS * 4));
+
+    ck_assert_int_eq(hf_vacuum(hf, MAX_SLOTS / 2, NULL, NULL), GRAIN_OK);
+    ck_assert_int_eq(hf->header.num_pages, 1);
+    int lingering = 0;
+    for (int i = MAX_SLOTS; i < MAX_SLOTS * 8; i++) {
+        if (hf_id_may_exist(hf, i)) {
+            lingering++;
+        }
+    }
+    ck_assert_int_lt(lingering, MAX_SLOTS * 7 / 20);
+    for (int i = 0; i < MAX_SLOTS; i++) {
+        ck_assert(hf_id_may_exist(hf, i));
+    }
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_id_filter_rebuilt_when_overloaded_or_stale)
+{
+    cleanup();
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_ID_FILTER);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_int_eq(hf->id_filter->header.num_blocks, BLOOM_MIN_BLOCKS);
+
+    /* an empty file gets the smallest filter; filling it well past that overloads it */
+    int n = BLOOM_MIN_BLOCKS * BLOOM_BLOCK_WORDS * 64 / BLOOM_BITS_PER_KEY * 3;
+    insert_ids(hf, 0, n);
+    ck_assert(bloom_overloaded(hf->id_filter));
+    close_file(hf);
+
+    hf = open_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert(!bloom_overloaded(hf->id_filter));
+    ck_assert_int_gt(hf->id_filter->header.num_blocks, BLOOM_MIN_BLOCKS);
+    ck_assert(hf_id_may_exist(hf, n - 1));
+    close_file(hf);
+
+    /* an insert committed through the log whose filter bits never reached disk */
+    CRASH_AFTER({
+        HeapFile *child = open_file_ex(test_file, HF_OPEN_WAL);
+        if (child == NULL) _exit(1);
+        Record rec = {.id = -4242, .age = 1};
+        if (hf_insert_record(child, &rec) != GRAIN_OK) _exit(1);
+        if (hf_commit(child) != GRAIN_OK) _exit(1);
+    });
+
+    hf = open_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_int_eq(hf->id_filter->header.clean, 1);
+    ck_assert(hf_id_may_exist(hf, -4242));
+    RecordId rid;
+    Record found;
+    ck_assert_int_eq(hf_find_by_id(hf, -4242, &rid, &found), GRAIN_OK);
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_find_by_id_without_index_scans)
+{
+    cleanup();
+    HeapFile *hf = create_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_ptr_null(hf->id_index);
+    insert_ids(hf, 0, 300);
+
+    RecordId rid;
+    Record found;
+    ck_assert_int_eq(hf_find_by_id(hf, 299, &rid, &found), GRAIN_OK);
+    ck_assert_int_eq(found.id, 299);
+    ck_assert_int_eq(hf_find_by_id(hf, 300, &rid, &found), GRAIN_RECORD_NOT_FOUND);
+
+    BTreeCursor cur;
+    ck_assert_int_eq(hf_id_range_init(hf, &cur, 0, 10), GRAIN_NO_INDEX);
+    ck_assert_int_eq(hf_find_by_id(NULL, 1, &rid, &found), GRAIN_NULL_PTR);
+
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_hf_get_record)
+{
+    cleanup();
+    HeapFile *hf = create_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    insert_ids(hf, 0, 5);
+
+    RecordId rid = {.page_id = 0, .slot_idx = 3};
+    Record found;
+    ck_assert_int_eq(hf_get_record(hf, rid, &found), GRAIN_OK);
+    ck_assert_int_eq(found.id, 3);
+
+    ck_assert_int_eq(hf_delete_record(hf, rid), GRAIN_OK);
+    ck_assert_int_eq(hf_get_record(hf, rid, &found), GRAIN_RECORD_NOT_FOUND);
+
+    rid.page_id = 9;
+    ck_assert_int_eq(hf_get_record(hf, rid, &found), GRAIN_INVALID_PAGE_ID);
+    ck_assert_int_eq(hf_get_record(hf, rid, NULL), GRAIN_NULL_PTR);
+
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+// ============== batch scan tests ==============
+
+START_TEST(test_batch_scan_returns_records_in_order)
+{
+    cleanup();
+    HeapFile *hf = create_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    int32_t n = MAX_SLOTS * 5 + 17;
+    insert_ids(hf, 0, n);
+    for (int32_t i = 0; i < n; i += 3) {
+        RecordId rid = {.page_id = i / MAX_SLOTS, .slot_idx = i % MAX_SLOTS};
+        ck_assert_int_eq(hf_delete_record(hf, rid), GRAIN_OK);
+    }
+
+    /* batch sizes below, at and above a page's worth */
+    int32_t sizes[] = {1, 50, MAX_SLOTS, MAX_SLOTS * 3};
+    RecordId rids[MAX_SLOTS * 3];
+    Record recs[MAX_SLOTS * 3];
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        HfScanCursor cur;
+        ck_assert_int_eq(hf_batch_scan_init(hf, &cur), GRAIN_OK);
+        int32_t expected = 1, count;
+        GrainResult res;
+        while ((res = hf_batch_scan_next(hf, &cur, rids, recs, sizes[s], &count)) == GRAIN_OK) {
+            ck_assert_int_le(count, sizes[s]);
+            for (int32_t i = 0; i < count; i++) {
+                ck_assert_int_eq(recs[i].id, expected);
+                ck_assert_int_eq(rids[i].page_id, expected / MAX_SLOTS);
+                ck_assert_int_eq(rids[i].slot_idx, expected % MAX_SLOTS);
+                expected += (expected % 3 == 2) ? 2 : 1;
+            }
+        }
+        ck_assert_int_eq(res, GRAIN_END);
+        ck_assert_int_eq(count, 0);
+        ck_assert_int_ge(expected, n);
+        ck_assert_int_eq(hf_batch_scan_close(hf, &cur), GRAIN_OK);
+    }
+
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_batch_scan_keeps_page_pinned)
+{
+    cleanup();
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_MMAP);
+    ck_assert_ptr_nonnull(hf);
+    insert_ids(hf, 0, MAX_SLOTS * 2);
+
+    HfScanCursor cur;
+    RecordId rids[10];
+    Record recs[10];
+    int32_t count;
+    ck_assert_int_eq(hf_batch_scan_init(hf, &cur), GRAIN_OK);
+    ck_assert_int_eq(hf_batch_scan_next(hf, &cur, rids, recs, 10, &count), GRAIN_OK);
+    ck_assert_int_eq(count, 10);
+    ck_assert_int_eq(hf->map_pins, 1);
+
+    /* records deleted behind the cursor's back are skipped */
+    RecordId victim = {.page_id = 0, .slot_idx = 10};
+    ck_assert_int_eq(hf_delete_record(hf, victim), GRAIN_OK);
+    ck_assert_int_eq(hf_batch_scan_next(hf, &cur, rids, recs, 10, &count), GRAIN_OK);
+    ck_assert_int_eq(recs[0].id, 11);
+
+    ck_assert_int_eq(hf_batch_scan_close(hf, &cur), GRAIN_OK);
+    ck_assert_int_eq(hf->map_pins, 0);
+    ck_assert_int_eq(hf_batch_scan_close(hf, &cur), GRAIN_OK);
+
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_batch_scan_filtered)
+{
+    cleanup();
+    HeapFile *hf = create_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    int32_t n = MAX_SLOTS * 6;
+    insert_ids(hf, 0, n);
+    RecordId victim = {.page_id = 2, .slot_idx = 5};
+    ck_assert_int_eq(hf_delete_record(hf, victim), GRAIN_OK);
+
+    Predicate pred = {.id_min = 100, .id_max = 600, .age_min = 20, .age_max = 29};
+    HfScanCursor cur;
+    RecordId rids[7];
+    Record recs[7];
+    int32_t count, found = 0;
+    ck_assert_int_eq(hf_batch_scan_init_filtered(hf, &cur, &pred), GRAIN_OK);
+    while (hf_batch_scan_next(hf, &cur, rids, recs, 7, &count) == GRAIN_OK) {
+        for (int32_t i = 0; i < count; i++) {
+            ck_assert_int_ge(recs[i].id, 100);
+            ck_assert_int_le(recs[i].id, 600);
+            ck_assert_int_ge(recs[i].age, 20);
+            ck_assert_int_le(recs[i].age, 29);
+            ck_assert_int_eq(rids[i].page_id * MAX_SLOTS + rids[i].slot_idx, recs[i].id);
+            found++;
+        }
+    }
+    ck_assert_int_eq(hf_batch_scan_close(hf, &cur), GRAIN_OK);
+
+    int32_t expected = 0;
+    for (int32_t i = 100; i <= 600; i++) {
+        if (i % 80 >= 20 && i % 80 <= 29 && i != 2 * MAX_SLOTS + 5) expected++;
+    }
+    ck_assert_int_eq(found, expected);
+    ck_assert_int_eq(hf_batch_scan_init_filtered(hf, &cur, NULL), GRAIN_NULL_PTR);
+
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_batch_scan_null_params)
+{
+    cleanup();
+    HeapFile *hf = create_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+
+    HfScanCursor cur;
+    RecordId rid;
+    Record rec;
+    int32_t count;
+    ck_assert_int_eq(hf_batch_scan_init(hf, &cur), GRAIN_OK);
+    ck_assert_int_eq(hf_batch_scan_next(hf, &cur, &rid, &rec, 1, &count), GRAIN_END);
+    ck_assert_int_eq(hf_batch_scan_next(hf, &cur, &rid, &rec, 0, &count), GRAIN_INVALID_SLOT);
+    ck_assert_int_eq(hf_batch_scan_next(hf, &cur, NULL, &rec, 1, &count), GRAIN_NULL_PTR);
+    ck_assert_int_eq(hf_batch_scan_next(NULL, &cur, &rid, &rec, 1, &count), GRAIN_NULL_PTR);
+    ck_assert_int_eq(hf_batch_scan_init(NULL, &cur), GRAIN_NULL_PTR);
+    ck_assert_int_eq(hf_batch_scan_close(hf, NULL), GRAIN_NULL_PTR);
+
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+// ============== zone map tests ==============
+
+static int32_t count_filtered(HeapFile *hf, Predicate pred)
+{
+    HfScanCursor cur;
+    RecordId rids[MAX_SLOTS];
+    Record recs[MAX_SLOTS];
+    int32_t count, total = 0;
+    ck_assert_int_eq(hf_batch_scan_init_filtered(hf, &cur, &pred), GRAIN_OK);
+    while (hf_batch_scan_next(hf, &cur, rids, recs, MAX_SLOTS, &count) == GRAIN_OK) {
+        total += count;
+    }
+    ck_assert_int_eq(hf_batch_scan_close(hf, &cur), GRAIN_OK);
+    return total;
+}
+
+START_TEST(test_zone_map_skips_pages)
+{
+    cleanup();
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_ZONE_MAP);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_ptr_nonnull(hf->zone_map);
+    int32_t n = MAX_SLOTS * 50;
+    insert_ids(hf, 0, n);
+    close_file(hf);
+
+    /* a cold pool shows which pages the filtered scan actually read */
+    hf = open_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_ptr_nonnull(hf->zone_map);
+    Predicate pred = PREDICATE_ALL;
+    pred.id_min = n - 10;
+    ck_assert_int_eq(count_filtered(hf, pred), 10);
+    for (int32_t page_id = 0; page_id < 49; page_id++) {
+        ck_assert(!bp_is_resident(&hf->pool, page_id));
+    }
+    ck_assert(bp_is_resident(&hf->pool, 49));
+
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_zone_map_follows_changes)
+{
+    cleanup();
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_ZONE_MAP);
+    ck_assert_ptr_nonnull(hf);
+    insert_ids(hf, 0, MAX_SLOTS * 2);
+
+    Predicate old = {.id_min = INT32_MIN, .id_max = INT32_MAX, .age_min = 90, .age_max = 90};
+    ck_assert_int_eq(count_filtered(hf, old), 0);
+
+    /* an update widens the zone by the new age */
+    RecordId rid = {.page_id = 1, .slot_idx = 4};
+    Record changed = {.id = -1, .age = 90};
+    ck_assert_int_eq(hf_update_record(hf, rid, &changed), GRAIN_OK);
+    ck_assert_int_eq(hf->zone_map->zones[1].age_max, 90);
+    ck_assert_int_eq(hf->zone_map->zones[1].id_min, MAX_SLOTS);
+    ck_assert_int_eq(count_filtered(hf, old), 1);
+
+    /* deleting it shrinks the zone back */
+    ck_assert_int_eq(hf_delete_record(hf, rid), GRAIN_OK);
+    ck_assert_int_eq(hf->zone_map->zones[1].age_max, 79);
+    ck_assert(!zonemap_may_match(hf->zone_map, 1, &old));
+
+    Record *recs = malloc(sizeof(Record) * MAX_SLOTS * 2);
+    for (int32_t i = 0; i < MAX_SLOTS * 2; i++) {
+        recs[i] = (Record){.id = 5000 + i, .age = 95};
+    }
+    ck_assert_int_eq(hf_insert_records(hf, recs, MAX_SLOTS * 2, NULL), GRAIN_OK);
+    Predicate bulk = {.id_min = 5000, .id_max = INT32_MAX, .age_min = 95, .age_max = 95};
+    ck_assert_int_eq(count_filtered(hf, bulk), MAX_SLOTS * 2);
+    free(recs);
+
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_zone_map_rebuilt_when_stale)
+{
+    cleanup();
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_ZONE_MAP);
+    ck_assert_ptr_nonnull(hf);
+    insert_ids(hf, 0, MAX_SLOTS * 3);
+    close_file(hf);
+
+    /* the zone change is committed to the heap through the log but never flushed */
+    CRASH_AFTER({
+        HeapFile *child = open_file_ex(test_file, HF_OPEN_WAL);
+        if (child == NULL) _exit(1);
+        RecordId rid = {.page_id = 0, .slot_idx = 1};
+        Record changed = {.age = 200};
+        if (hf_update_record(child, rid, &changed) != GRAIN_OK) _exit(1);
+        if (hf_commit(child) != GRAIN_OK) _exit(1);
+    });
+
+    hf = open_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_int_eq(hf->zone_map->header.clean, 1);
+    ck_assert_int_eq(hf->zone_map->zones[0].age_max, 200);
+    Predicate pred = {.id_min = INT32_MIN, .id_max = INT32_MAX, .age_min = 200, .age_max = 200};
+    ck_assert_int_eq(count_filtered(hf, pred), 1);
+    close_file(hf);
+
+    remove(test_zone_map);
+    hf = open_file_ex(test_file, HF_OPEN_ZONE_MAP);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_int_eq(hf->zone_map->header.num_pages, 3);
+    ck_assert_int_eq(hf->zone_map->zones[2].id_min, MAX_SLOTS * 2);
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+// ============== pax layout tests ==============
+
+static void assert_pax_pages(HeapFile *hf)
+{
+    for (int32_t page_id = 0; page_id < hf->header.num_pages; page_id++) {
+        HeapPage *page;
+        ck_assert_int_eq(hf_pin_page(hf, page_id, &page), GRAIN_OK);
+        ck_assert_int_eq(page->header.layout, PAGE_LAYOUT_PAX);
+        ck_assert_ptr_nonnull(page_column(page, COLUMN_AGE));
+        ck_assert_int_eq(hf_unpin_page(hf, page_id, false), GRAIN_OK);
+    }
+}
+
+START_TEST(test_pax_file_round_trip)
+{
+    cleanup();
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_PAX | HF_OPEN_ID_INDEX | HF_OPEN_ZONE_MAP);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_int_eq(hf->header.layout, PAGE_LAYOUT_PAX);
+
+    int32_t n = MAX_SLOTS * 3 + 10;
+    insert_ids(hf, 0, MAX_SLOTS);
+    Record bulk[MAX_SLOTS * 2 + 10];
+    for (int32_t i = 0; i < MAX_SLOTS * 2 + 10; i++) {
+        Record rec = {.id = MAX_SLOTS + i, .age = (MAX_SLOTS + i) % 80};
+        snprintf(rec.name, sizeof(rec.name), "User%d", MAX_SLOTS + i);
+        bulk[i] = rec;
+    }
+    ck_assert_int_eq(hf_insert_records(hf, bulk, MAX_SLOTS * 2 + 10, NULL), GRAIN_OK);
+    assert_pax_pages(hf);
+
+    RecordId rid = {.page_id = 1, .slot_idx = 4};
+    Record rec = {.id = -1, .age = 77};
+    strcpy(rec.name, "Updated");
+    strcpy(rec.email, "updated@test.com");
+    ck_assert_int_eq(hf_update_record(hf, rid, &rec), GRAIN_OK);
+    RecordId victim = {.page_id = 2, .slot_idx = 0};
+    ck_assert_int_eq(hf_delete_record(hf, victim), GRAIN_OK);
+    ck_assert_int_eq(close_file(hf), GRAIN_OK);
+
+    /* the layout comes from the file header, whatever flags the opener passes */
+    hf = open_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_int_eq(hf->header.layout, PAGE_LAYOUT_PAX);
+    assert_pax_pages(hf);
+
+    Record found;
+    ck_assert_int_eq(hf_get_record(hf, rid, &found), GRAIN_OK);
+    ck_assert_int_eq(found.id, MAX_SLOTS + 4);
+    ck_assert_int_eq(found.age, 77);
+    ck_assert_str_eq(found.name, "Updated");
+    ck_assert_str_eq(found.email, "updated@test.com");
+    ck_assert_int_eq(hf_get_record(hf, victim, &found), GRAIN_RECORD_NOT_FOUND);
+
+    RecordId scan_rid = {.page_id = 0, .slot_idx = -1};
+    int32_t count = 0;
+    while (hf_scan_next(hf, &scan_rid, &found) == GRAIN_OK) {
+        int32_t id = scan_rid.page_id * MAX_SLOTS + scan_rid.slot_idx;
+        char name[32];
+        snprintf(name, sizeof(name), "User%d", id);
+        ck_assert_int_eq(found.id, id);
+        if (id != MAX_SLOTS + 4) {
+            ck_assert_str_eq(found.name, name);
+        }
+        count++;
+    }
+    ck_assert_int_eq(count, n - 1);
+
+    /* the freed slot is the next one filled */
+    Record fresh = {.id = 5000, .age = 1};
+    ck_assert_int_eq(hf_insert_record(hf, &fresh), GRAIN_OK);
+    ck_assert_int_eq(hf_get_record(hf, victim, &found), GRAIN_OK);
+    ck_assert_int_eq(found.id, 5000);
+    ck_assert_int_eq(hf_find_by_id(hf, 5000, &rid, &found), GRAIN_OK);
+    ck_assert_int_eq(rid.page_id, victim.page_id);
+
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+static void check_column_scan(HeapFile *hf, RecordColumn col, const Predicate *pred)
+{
+    HfScanCursor rows, cols;
+    RecordId row_rids[50], col_rids[50];
+    Record recs[50];
+    int32_t values[50];
+    int32_t row_count, col_count, total = 0;
+
+    if (pred != NULL) {
+        ck_assert_int_eq(hf_batch_scan_init_filtered(hf, &rows, pred), GRAIN_OK);
+        ck_assert_int_eq(hf_batch_scan_init_filtered(hf, &cols, pred), GRAIN_OK);
+    } else {
+        ck_assert_int_eq(hf_batch_scan_init(hf, &rows), GRAIN_OK);
+        ck_assert_int_eq(hf_batch_scan_init(hf, &cols), GRAIN_OK);
+    }
+    /* the column scan returns the same rids, in the same batches, as the record scan */
+    while (hf_batch_scan_next(hf, &rows, row_rids, recs, 50, &row_count) == GRAIN_OK) {
+        ck_assert_int_eq(hf_column_scan_next(hf, &cols, col, col_rids, values, 50, &col_count), GRAIN_OK);
+        ck_assert_int_eq(col_count, row_count);
+        for (int32_t i = 0; i < row_count; i++) {
+            ck_assert_int_eq(col_rids[i].page_id, row_rids[i].page_id);
+            ck_assert_int_eq(col_rids[i].slot_idx, row_rids[i].slot_idx);
+            ck_assert_int_eq(values[i], (col == COLUMN_ID) ? recs[i].id : recs[i].age);
+        }
+        total += row_count;
+    }
+    ck_assert_int_eq(hf_column_scan_next(hf, &cols, col, col_rids, values, 50, &col_count), GRAIN_END);
+    ck_assert_int_gt(total, 0);
+    ck_assert_int_eq(hf_batch_scan_close(hf, &rows), GRAIN_OK);
+    ck_assert_int_eq(hf_batch_scan_close(hf, &cols), GRAIN_OK);
+}
+
+START_TEST(test_pax_column_scan)
+{
+    uint32_t layouts[] = {HF_OPEN_PAX, HF_OPEN_DEFAULT};
+    for (int l = 0; l < 2; l++) {
+        cleanup();
+        HeapFile *hf = create_file_ex(test_file, layouts[l] | HF_OPEN_ZONE_MAP);
+        ck_assert_ptr_nonnull(hf);
+        insert_ids(hf, 0, MAX_SLOTS * 5);
+        for (int32_t i = 0; i < MAX_SLOTS * 5; i += 9) {
+            RecordId rid = {.page_id = i / MAX_SLOTS, .slot_idx = i % MAX_SLOTS};
+            ck_assert_int_eq(hf_delete_record(hf, rid), GRAIN_OK);
+        }
+
+        Predicate pred = {.id_min = 100, .id_max = 400, .age_min = 10, .age_max = 49};
+        check_column_scan(hf, COLUMN_ID, NULL);
+        check_column_scan(hf, COLUMN_AGE, NULL);
+        check_column_scan(hf, COLUMN_AGE, &pred);
+
+        int64_t sum = 0;
+        HfScanCursor cur;
+        RecordId rids[MAX_SLOTS];
+        int32_t ages[MAX_SLOTS];
+        int32_t count;
+        ck_assert_int_eq(hf_batch_scan_init_filtered(hf, &cur, &pred), GRAIN_OK);
+        while (hf_column_scan_next(hf, &cur, COLUMN_AGE, rids, ages, MAX_SLOTS, &count) == GRAIN_OK) {
+            for (int32_t i = 0; i < count; i++) {
+                sum += ages[i];
+            }
+        }
+        int64_t expected = 0;
+        for (int32_t i = 100; i <= 400; i++) {
+            if (i % 9 != 0 && i % 80 >= 10 && i % 80 <= 49) expected += i % 80;
+        }
+        ck_assert_int_eq(sum, expected);
+
+        ck_assert_int_eq(hf_batch_scan_init(hf, &cur), GRAIN_OK);
+        ck_assert_int_eq(hf_column_scan_next(hf, &cur, COLUMN_ID, rids, NULL, 1, &count), GRAIN_NULL_PTR);
+        ck_assert_int_eq(hf_column_scan_next(hf, &cur, COLUMN_ID, rids, ages, 0, &count), GRAIN_INVALID_SLOT);
+        ck_assert_int_eq(hf_column_scan_next(NULL, &cur, COLUMN_ID, rids, ages, 1, &count), GRAIN_NULL_PTR);
+        close_file(hf);
+    }
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_pax_wal_recovers_after_crash)
+{
+    cleanup();
+    int n = MAX_SLOTS * 2 + 40;
+    CRASH_AFTER(insert_and_commit_ex(n, HF_OPEN_PAX));
+    ck_assert_int_eq(access(test_wal, F_OK), 0);
+
+    HeapFile *hf = open_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_int_eq(hf->header.layout, PAGE_LAYOUT_PAX);
+    assert_recovered(hf, n);
+    assert_pax_pages(hf);
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+/* rewrites the current file as version 3 wrote it: a 24 byte header and no layout */
+static void downgrade_to_v3(void)
+{
+    FILE *f = fopen(test_file, "rb");
+    ck_assert_ptr_nonnull(f);
+    FileHeader header;
+    ck_assert_int_eq(fread(&header, sizeof(header), 1, f), 1);
+    int32_t num_pages = header.num_pages;
+    char *pages = malloc((size_t)num_pages * PAGE_SIZE);
+    ck_assert_ptr_nonnull(pages);
+    ck_assert_int_eq(fseek(f, FILE_DATA_OFFSET, SEEK_SET), 0);
+    ck_assert_int_eq(fread(pages, PAGE_SIZE, num_pages, f), num_pages);
+    fclose(f);
+
+    header.version = 3;
+    f = fopen(test_file, "wb");
+    ck_assert_ptr_nonnull(f);
+    fwrite(&header, 24, 1, f);
+    fwrite(pages, PAGE_SIZE, num_pages, f);
+    fclose(f);
+    free(pages);
+}
+
+START_TEST(test_open_file_upgrades_v3_file_with_log)
+{
+    cleanup();
+    int n = MAX_SLOTS * 2 + 40;
+    CRASH_AFTER(insert_and_commit(n));
+    ck_assert_int_eq(access(test_wal, F_OK), 0);
+    downgrade_to_v3();
+
+    /* the log written against the version 3 file replays into the upgraded one */
+    HeapFile *hf = open_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_int_eq(hf->header.version, GRAIN_FORMAT_VERSION);
+    ck_assert_int_eq(hf->header.layout, PAGE_LAYOUT_ROW);
+    assert_recovered(hf, n);
+    close_file(hf);
+    ck_assert_int_eq(access(test_wal, F_OK), -1);
+
+    FILE *f = fopen(test_file, "rb");
+    ck_assert_ptr_nonnull(f);
+    FileHeader raw_header;
+    ck_assert_int_eq(fread(&raw_header, sizeof(FileHeader), 1, f), 1);
+    fclose(f);
+    ck_assert_int_eq(raw_header.version, GRAIN_FORMAT_VERSION);
+    ck_assert_int_eq(raw_header.layout, PAGE_LAYOUT_ROW);
+    cleanup();
+}
+END_TEST
+
+// ============== parallel scan tests ==============
+
+#define SCAN_TEST_WORKERS 4
+
+typedef struct {
+    int64_t id_sum[SCAN_TEST_WORKERS];
+    int32_t count[SCAN_TEST_WORKERS];
+    int32_t pages[SCAN_TEST_WORKERS];
+    char *seen;
+    int32_t fail_on_page;
+} ScanTotals;
+
+static GrainResult sum_page(void *ctx, int32_t worker, const RecordId *rids,
+                            const Record *recs, int32_t count)
+{
+    ScanTotals *totals = ctx;
+    if (rids[0].page_id == totals->fail_on_page) {
+        return GRAIN_FILE_READ_FAILED;
+    }
+    for (int32_t i = 0; i < count; i++) {
+        if (rids[i].page_id != rids[0].page_id) return GRAIN_INVALID_PAGE_ID;
+        totals->id_sum[worker] += recs[i].id;
+        totals->seen[recs[i].id]++;
+    }
+    totals->count[worker] += count;
+    totals->pages[worker]++;
+    return GRAIN_OK;
+}
+
+static ScanTotals *new_totals(int32_t max_id)
+{
+    ScanTotals *totals = calloc(1, sizeof(ScanTotals));
+    totals->seen = calloc(max_id, 1);
+    totals->fail_on_page = -1;
+    return totals;
+}
+
+static void free_totals(ScanTotals *totals)
+{
+    free(totals->seen);
+    free(totals);
+}
+
+static int64_t total_sum(ScanTotals *totals)
+{
+    int64_t sum = 0;
+    for (int i = 0; i < SCAN_TEST_WORKERS; i++) sum += totals->id_sum[i];
+    return sum;
+}
+
+static int32_t total_count(ScanTotals *totals)
+{
+    int32_t count = 0;
+    for (int i = 0; i < SCAN_TEST_WORKERS; i++) count += totals->count[i];
+    return count;
+}
+
+START_TEST(test_parallel_scan_sees_every_record_once)
+{
+    cleanup();
+    HeapFile *hf = create_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    int32_t n = 20000;
+    insert_ids(hf, 0, n);
+
+    /* some deletes stay in the buffer pool only */
+    for (int32_t i = 0; i < n; i += 10) {
+        RecordId rid = {.page_id = i / MAX_SLOTS, .slot_idx = i % MAX_SLOTS};
+        ck_assert_int_eq(hf_delete_record(hf, rid), GRAIN_OK);
+    }
+
+    ScanTotals *totals = new_totals(n);
+    ck_assert_int_eq(hf_parallel_scan(hf, SCAN_TEST_WORKERS, sum_page, totals), GRAIN_OK);
+
+    int64_t expected = 0;
+    for (int32_t i = 0; i < n; i++) {
+        ck_assert_int_eq(totals->seen[i], (i % 10 == 0) ? 0 : 1);
+        if (i % 10 != 0) expected += i;
+    }
+    ck_assert_int_eq(total_count(totals), n - n / 10);
+    ck_assert(total_sum(totals) == expected);
+
+    int32_t pages = 0;
+    for (int i = 0; i < SCAN_TEST_WORKERS; i++) pages += totals->pages[i];
+    ck_assert_int_eq(pages, hf->header.num_pages);
+
+    free_totals(totals);
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_parallel_scan_mmap)
+{
+    cleanup();
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_MMAP);
+    ck_assert_ptr_nonnull(hf);
+    int32_t n = 5000;
+    insert_ids(hf, 0, n);
+
+    ScanTotals *totals = new_totals(n);
+    ck_assert_int_eq(hf_parallel_scan(hf, SCAN_TEST_WORKERS, sum_page, totals), GRAIN_OK);
+    ck_assert_int_eq(total_count(totals), n);
+    ck_assert(total_sum(totals) == (int64_t)n * (n - 1) / 2);
+
+    free_totals(totals);
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_parallel_scan_callback_error_stops_scan)
+{
+    cleanup();
+    HeapFile *hf = create_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    int32_t n = MAX_SLOTS * 40;
+    insert_ids(hf, 0, n);
+
+    ScanTotals *totals = new_totals(n);
+    totals->fail_on_page = 3;
+    ck_assert_int_eq(hf_parallel_scan(hf, 1, sum_page, totals), GRAIN_FILE_READ_FAILED);
+    ck_assert_int_eq(total_count(totals), MAX_SLOTS * 3);
+
+    free_totals(totals);
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_parallel_scan_empty_and_null)
+{
+    cleanup();
+    HeapFile *hf = create_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+
+    ScanTotals *totals = new_totals(1);
+    ck_assert_int_eq(hf_parallel_scan(hf, 0, sum_page, totals), GRAIN_OK);
+    ck_assert_int_eq(total_count(totals), 0);
+
+    ck_assert_int_eq(hf_parallel_scan(NULL, 2, sum_page, totals), GRAIN_NULL_PTR);
+    ck_assert_int_eq(hf_parallel_scan(hf, 2, NULL, totals), GRAIN_NULL_PTR);
+
+    free_totals(totals);
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+// ============== free space map tests ==============
+
+static void delete_page(HeapFile *hf, int32_t page_id)
+{
+    for (int32_t slot = 0; slot < MAX_SLOTS; slot++) {
+        RecordId rid = {.page_id = page_id, .slot_idx = slot};
+        ck_assert_int_eq(hf_delete_record(hf, rid), GRAIN_OK);
+    }
+}
+
+START_TEST(test_fsm_follows_inserts_and_deletes)
+{
+    cleanup();
+    HeapFile *hf = create_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_ptr_nonnull(hf->fsm);
+    insert_ids(hf, 0, MAX_SLOTS * 3 - 5);
+    ck_assert_int_eq(fsm_free_slots(hf->fsm, 0), 0);
+    ck_assert_int_eq(fsm_free_slots(hf->fsm, 2), 5);
+    ck_assert_int_eq(hf->header.first_free_page, 2);
+
+    /* the lowest page with room takes the next insert */
+    RecordId rid = {.page_id = 1, .slot_idx = 9};
+    ck_assert_int_eq(hf_delete_record(hf, rid), GRAIN_OK);
+    ck_assert_int_eq(fsm_free_slots(hf->fsm, 1), 1);
+    ck_assert_int_eq(hf->header.first_free_page, 1);
+
+    Record rec = {.id = 9999, .age = 1};
+    ck_assert_int_eq(hf_insert_record(hf, &rec), GRAIN_OK);
+    Record out;
+    ck_assert_int_eq(hf_get_record(hf, rid, &out), GRAIN_OK);
+    ck_assert_int_eq(out.id, 9999);
+    ck_assert_int_eq(fsm_free_slots(hf->fsm, 1), 0);
+    ck_assert_int_eq(hf->header.first_free_page, 2);
+
+    ck_assert_int_eq(close_file(hf), GRAIN_OK);
+    hf = open_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_int_eq(hf->fsm->header.clean, 1);
+    ck_assert_int_eq(hf->fsm->header.num_pages, 3);
+    ck_assert_int_eq(fsm_free_slots(hf->fsm, 2), 5);
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_bulk_insert_fills_empty_pages)
+{
+    cleanup();
+    HeapFile *hf = create_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    insert_ids(hf, 0, MAX_SLOTS * 4);
+    delete_page(hf, 1);
+    delete_page(hf, 2);
+    ck_assert_int_eq(fsm_free_slots(hf->fsm, 1), MAX_SLOTS);
+
+    /* whole pages of records go back into the emptied run instead of growing the file */
+    int32_t n = MAX_SLOTS * 2;
+    Record *recs = malloc(sizeof(Record) * n);
+    RecordId *rids = malloc(sizeof(RecordId) * n);
+    for (int32_t i = 0; i < n; i++) {
+        recs[i] = (Record){.id = 10000 + i, .age = 1};
+    }
+    ck_assert_int_eq(hf_insert_records(hf, recs, n, rids), GRAIN_OK);
+    ck_assert_int_eq(hf->header.num_pages, 4);
+    ck_assert_int_eq(rids[0].page_id, 1);
+    ck_assert_int_eq(rids[n - 1].page_id, 2);
+    ck_assert_int_eq(hf->header.first_free_page, -1);
+
+    free(recs);
+    free(rids);
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_fsm_rebuilt_when_missing_or_stale)
+{
+    cleanup();
+    HeapFile *hf = create_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    insert_ids(hf, 0, MAX_SLOTS * 3);
+    close_file(hf);
+
+    /* the delete reaches the heap through the log, but the map is never flushed */
+    CRASH_AFTER({
+        HeapFile *child = open_file_ex(test_file, HF_OPEN_WAL);
+        if (child == NULL) _exit(1);
+        RecordId rid = {.page_id = 1, .slot_idx = 3};
+        if (hf_delete_record(child, rid) != GRAIN_OK) _exit(1);
+        if (hf_commit(child) != GRAIN_OK) _exit(1);
+    });
+
+    hf = open_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_int_eq(hf->fsm->header.clean, 1);
+    ck_assert_int_eq(fsm_free_slots(hf->fsm, 1), 1);
+    ck_assert_int_eq(hf->header.first_free_page, 1);
+    close_file(hf);
+
+    remove(test_fsm);
+    hf = open_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_int_eq(hf->fsm->header.num_pages, 3);
+    ck_assert_int_eq(fsm_free_slots(hf->fsm, 0), 0);
+    ck_assert_int_eq(fsm_free_slots(hf->fsm, 1), 1);
+    ck_assert_int_eq(hf->header.first_free_page, 1);
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+// ============== vacuum tests ==============
+
+typedef struct {
+    HeapFile *hf;
+    int32_t count;
+    int32_t mismatches;
+} Forwarding;
+
+static GrainResult check_forward(void *ctx, RecordId from, RecordId to, const Record *rec)
+{
+    Forwarding *fwd = ctx;
+    Record out;
+    if (hf_get_record(fwd->hf, to, &out) != GRAIN_OK || out.id != rec->id ||
+        to.page_id >= from.page_id) {
+        fwd->mismatches++;
+    }
+    fwd->count++;
+    return GRAIN_OK;
+}
+
+/* leaves `keep` records on each page in [from, to) */
+static void thin_pages(HeapFile *hf, int32_t from, int32_t to, int32_t keep)
+{
+    for (int32_t page_id = from; page_id < to; page_id++) {
+        for (int32_t slot = keep; slot < MAX_SLOTS; slot++) {
+            RecordId rid = {.page_id = page_id, .slot_idx = slot};
+            ck_assert_int_eq(hf_delete_record(hf, rid), GRAIN_OK);
+        }
+    }
+}
+
+static int32_t count_records(HeapFile *hf)
+{
+    RecordId rid = {0, -1};
+    Record rec;
+    int32_t count = 0;
+    while (hf_scan_next(hf, &rid, &rec) == GRAIN_OK) {
+        count++;
+    }
+    return count;
+}
+
+static off_t file_size(const char *filename)
+{
+    FILE *f = fopen(filename, "rb");
+    ck_assert_ptr_nonnull(f);
+    fseek(f, 0, SEEK_END);
+    off_t size = ftell(f);
+    fclose(f);
+    return size;
+}
+
+static long space_on_disk(const char *filename)
+{
+    struct stat st;
+    ck_assert_int_eq(stat(filename, &st), 0);
+    return (long)st.st_blocks * 512;
+}
+
+START_TEST(test_hf_alloc_reserves_space_in_extents)
+{
+    cleanup();
+    HeapFile *hf = create_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+
+    /* the first page takes space for a whole extent, but the file doesn't get any longer */
+    int32_t page_id;
+    ck_assert_int_eq(hf_alloc_page(hf, &page_id), GRAIN_OK);
+    ck_assert_int_eq(hf->alloc_pages, FILE_GROW_PAGES);
+    ck_assert_int_eq(file_size_on_disk(test_file), (long)sizeof(FileHeader));
+    ck_assert_int_ge(space_on_disk(test_file), (long)FILE_GROW_PAGES * PAGE_SIZE);
+
+    /* a burst that runs past it reserves the next one in one go, and a flush keeps it */
+    insert_ids(hf, 0, MAX_SLOTS * FILE_GROW_PAGES + 1);
+    ck_assert_int_eq(hf->header.num_pages, FILE_GROW_PAGES + 1);
+    ck_assert_int_eq(hf->alloc_pages, 2 * FILE_GROW_PAGES);
+    ck_assert_int_eq(hf_flush(hf), GRAIN_OK);
+    ck_assert_int_eq(file_size_on_disk(test_file), (long)FILE_DATA_OFFSET + (FILE_GROW_PAGES + 1) * PAGE_SIZE);
+    ck_assert_int_ge(space_on_disk(test_file), (long)2 * FILE_GROW_PAGES * PAGE_SIZE);
+
+    /* closing gives back what no page uses */
+    ck_assert_int_eq(close_file(hf), GRAIN_OK);
+    ck_assert_int_lt(space_on_disk(test_file), (long)FILE_DATA_OFFSET + (FILE_GROW_PAGES + 2) * PAGE_SIZE);
+
+    hf = open_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_int_eq(hf->alloc_pages, FILE_GROW_PAGES + 1);
+    ck_assert_int_eq(count_records(hf), MAX_SLOTS * FILE_GROW_PAGES + 1);
+
+    /* a vacuum that shrinks the file gives back the extent reserved past the end as well */
+    insert_ids(hf, 0, MAX_SLOTS);
+    ck_assert_int_eq(hf->header.num_pages, FILE_GROW_PAGES + 2);
+    ck_assert_int_eq(hf->alloc_pages, 2 * FILE_GROW_PAGES);
+    thin_pages(hf, 1, FILE_GROW_PAGES + 1, 0);
+    RecordId last = {.page_id = FILE_GROW_PAGES + 1, .slot_idx = 0};
+    ck_assert_int_eq(hf_delete_record(hf, last), GRAIN_OK);
+    ck_assert_int_eq(hf_vacuum(hf, 0, NULL, NULL), GRAIN_OK);
+    ck_assert_int_eq(hf_flush(hf), GRAIN_OK);
+    ck_assert_int_eq(hf->header.num_pages, 1);
+    ck_assert_int_eq(hf->alloc_pages, 1);
+    ck_assert_int_lt(space_on_disk(test_file), (long)FILE_DATA_OFFSET + 2 * PAGE_SIZE);
+    close_file(hf);
+
+    /* a mapped file grows to the end of its chunk, and the chunk is allocated rather than sparse */
+    hf = create_file_ex(test_file, HF_OPEN_MMAP);
+    ck_assert_ptr_nonnull(hf);
+    insert_ids(hf, 0, 10);
+    ck_assert_int_ge(space_on_disk(test_file), file_size_on_disk(test_file));
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_vacuum_moves_records_and_shrinks_file)
+{
+    cleanup();
+    HeapFile *hf = create_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    insert_ids(hf, 0, MAX_SLOTS * 10);
+    thin_pages(hf, 0, 2, MAX_SLOTS - 20);
+    thin_pages(hf, 5, 10, 3);
+    ck_assert_int_eq(hf_flush(hf), GRAIN_OK);
+
+    Forwarding fwd = {.hf = hf};
+    HfVacuum vac;
+    ck_assert_int_eq(hf_vacuum_init(hf, &vac, 10, check_forward, &fwd), GRAIN_OK);
+    ck_assert_int_eq(hf_vacuum_step(hf, &vac, VACUUM_STEP_PAGES), GRAIN_END);
+    ck_assert_int_eq(vac.records_moved, 15);
+    ck_assert_int_eq(fwd.count, 15);
+    ck_assert_int_eq(fwd.mismatches, 0);
+    ck_assert_int_eq(vac.pages_released, 5);
+    ck_assert_int_eq(hf->header.num_pages, 5);
+    ck_assert_int_eq(hf->header.next_page_idx, 5);
+    ck_assert_int_eq(hf->fsm->header.num_pages, 5);
+    ck_assert_int_eq(count_records(hf), MAX_SLOTS * 5 - 40 + 15);
+
+    /* the file itself shrinks once the smaller header is written */
+    ck_assert_int_eq(hf_flush(hf), GRAIN_OK);
+    ck_assert_int_eq(file_size(test_file), FILE_DATA_OFFSET + 5 * PAGE_SIZE);
+    close_file(hf);
+
+    hf = open_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_int_eq(hf->header.num_pages, 5);
+    ck_assert_int_eq(count_records(hf), MAX_SLOTS * 5 - 40 + 15);
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_vacuum_runs_in_bounded_steps)
+{
+    cleanup();
+    HeapFile *hf = create_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    insert_ids(hf, 0, MAX_SLOTS * 8);
+    thin_pages(hf, 0, 1, 0);
+    thin_pages(hf, 4, 8, 1);
+
+    HfVacuum vac;
+    ck_assert_int_eq(hf_vacuum_init(hf, &vac, 1, NULL, NULL), GRAIN_OK);
+    ck_assert_int_eq(hf_vacuum_step(hf, &vac, 1), GRAIN_OK);
+    ck_assert_int_eq(vac.records_moved, 1);
+    ck_assert_int_eq(vac.pages_released, 1);
+    ck_assert_int_eq(hf->header.num_pages, 7);
+
+    /* the table stays usable between steps */
+    Record rec = {.id = 5000, .age = 1};
+    ck_assert_int_eq(hf_insert_record(hf, &rec), GRAIN_OK);
+
+    GrainResult res;
+    int32_t steps = 1;
+    while ((res = hf_vacuum_step(hf, &vac, 1)) == GRAIN_OK) {
+        steps++;
+    }
+    ck_assert_int_eq(res, GRAIN_END);
+    ck_assert_int_ge(steps, 3);
+    ck_assert_int_eq(vac.records_moved, 4);
+    ck_assert_int_eq(hf->header.num_pages, 4);
+    ck_assert_int_eq(count_records(hf), MAX_SLOTS * 3 + 5);
+
+    /* dense pages are left alone */
+    ck_assert_int_eq(hf_vacuum(hf, 0, NULL, NULL), GRAIN_OK);
+    ck_assert_int_eq(hf->header.num_pages, 4);
+
+    ck_assert_int_eq(hf_vacuum_init(hf, &vac, MAX_SLOTS + 1, NULL, NULL), GRAIN_INVALID_SLOT);
+    ck_assert_int_eq(hf_vacuum_init(NULL, &vac, 1, NULL, NULL), GRAIN_NULL_PTR);
+    ck_assert_int_eq(hf_vacuum_step(hf, NULL, 1), GRAIN_NULL_PTR);
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_vacuum_keeps_index_and_log_consistent)
+{
+    cleanup();
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_WAL | HF_OPEN_ID_INDEX);
+    ck_assert_ptr_nonnull(hf);
+    insert_ids(hf, 0, MAX_SLOTS * 4);
+    thin_pages(hf, 0, 1, MAX_SLOTS - 5);
+    thin_pages(hf, 3, 4, 2);
+    ck_assert_int_eq(hf_commit(hf), GRAIN_OK);
+
+    ck_assert_int_eq(hf_vacuum(hf, 10, NULL, NULL), GRAIN_OK);
+    ck_assert_int_eq(hf->header.num_pages, 3);
+    RecordId rid;
+    Record rec;
+    ck_assert_int_eq(hf_find_by_id(hf, MAX_SLOTS * 3 + 1, &rid, &rec), GRAIN_OK);
+    ck_assert_int_eq(rid.page_id, 0);
+    ck_assert_int_eq(rec.id, MAX_SLOTS * 3 + 1);
+    ck_assert_int_eq(hf_commit(hf), GRAIN_OK);
+    close_file(hf);
+
+    hf = open_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_int_eq(hf->header.num_pages, 3);
+    ck_assert_int_eq(file_size(test_file), FILE_DATA_OFFSET + 3 * PAGE_SIZE);
+    ck_assert_int_eq(hf_find_by_id(hf, MAX_SLOTS * 3, &rid, &rec), GRAIN_OK);
+    ck_assert_int_eq(rid.page_id, 0);
+    ck_assert_int_eq(count_records(hf), MAX_SLOTS * 3 - 5 + 2);
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_vacuum_leaves_pinned_tail)
+{
+    cleanup();
+    HeapFile *hf = create_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    insert_ids(hf, 0, MAX_SLOTS * 3);
+    thin_pages(hf, 2, 3, 0);
+
+    /* someone still has the empty last page pinned */
+    HeapPage *page;
+    ck_assert_int_eq(hf_pin_page(hf, 2, &page), GRAIN_OK);
+    ck_assert_int_eq(hf_vacuum(hf, 0, NULL, NULL), GRAIN_OK);
+    ck_assert_int_eq(hf->header.num_pages, 3);
+    ck_assert_int_eq(hf_unpin_page(hf, 2, false), GRAIN_OK);
+
+    ck_assert_int_eq(hf_vacuum(hf, 0, NULL, NULL), GRAIN_OK);
+    ck_assert_int_eq(hf->header.num_pages, 2);
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+#define CONCURRENT_THREADS 8
+
+/* worker threads can't use ck_assert, so they count what went wrong instead */
+typedef struct {
+    HeapFile *hf;
+    int32_t first_id;
+    int32_t count;
+    int32_t failures;
+    bool *stop;
+} Worker;
+
+static void *insert_worker(void *arg)
+{
+    Worker *w = arg;
+    for (int32_t id = w->first_id; id < w->first_id + w->count; id++) {
+        Record rec = {.id = id, .age = id % 60};
+        if (hf_insert_record(w->hf, &rec) != GRAIN_OK) {
+            w->failures++;
+        }
+    }
+    return NULL;
+}
+
+START_TEST(test_concurrent_inserts)
+{
+    cleanup();
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_ID_INDEX | HF_OPEN_ZONE_MAP);
+    ck_assert_ptr_nonnull(hf);
+
+    pthread_t threads[CONCURRENT_THREADS];
+    Worker workers[CONCURRENT_THREADS];
+    for (int i = 0; i < CONCURRENT_THREADS; i++) {
+        workers[i] = (Worker){.hf = hf, .first_id = i * 2000, .count = 2000};
+        ck_assert_int_eq(pthread_create(&threads[i], NULL, insert_worker, &workers[i]), 0);
+    }
+    for (int i = 0; i < CONCURRENT_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        ck_assert_int_eq(workers[i].failures, 0);
+    }
+
+    /* nothing lost, nothing doubled, and pages are as full as a single thread would leave them */
+    int32_t total = CONCURRENT_THREADS * 2000;
+    ck_assert_int_eq(count_records(hf), total);
+    ck_assert_int_eq(hf->header.num_pages, (total + MAX_SLOTS - 1) / MAX_SLOTS);
+    for (int32_t id = 0; id < total; id += 7) {
+        RecordId rid;
+        Record rec;
+        ck_assert_int_eq(hf_find_by_id(hf, id, &rid, &rec), GRAIN_OK);
+        ck_assert_int_eq(rec.id, id);
+    }
+    Predicate pred = {.id_min = 100, .id_max = 199, .age_min = INT32_MIN, .age_max = INT32_MAX};
+    ck_assert_int_eq(count_filtered(hf, pred), 100);
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+static void *churn_worker(void *arg)
+{
+    Worker *w = arg;
+    RecordId *rids = malloc(sizeof(RecordId) * w->count);
+    if (rids == NULL) {
+        w->failures++;
+        return NULL;
+    }
+    for (int32_t i = 0; i < w->count; i++) {
+        Record rec = {.id = w->first_id + i, .age = (w->first_id + i) % 60};
+        if (hf_insert_records(w->hf, &rec, 1, &rids[i]) != GRAIN_OK) {
+            w->failures++;
+        }
+    }
+    for (int32_t i = 0; i < w->count; i++) {
+        Record rec = {.id = w->first_id + i, .age = 1000 + (w->first_id + i) % 60};
+        GrainResult res = (i % 2 == 0) ? hf_delete_record(w->hf, rids[i])
+                                       : hf_update_record(w->hf, rids[i], &rec);
+        if (res != GRAIN_OK) {
+            w->failures++;
+        }
+    }
+    free(rids);
+    return NULL;
+}
+
+/* a reader must never see a record half written */
+static void *scan_checker(void *arg)
+{
+    Worker *w = arg;
+    while (!__atomic_load_n(w->stop, __ATOMIC_ACQUIRE)) {
+        RecordId rid = {0, -1};
+        Record rec;
+        while (hf_scan_next(w->hf, &rid, &rec) == GRAIN_OK) {
+            if (rec.age != rec.id % 60 && rec.age != 1000 + rec.id % 60) {
+                w->failures++;
+            }
+        }
+    }
+    return NULL;
+}
+
+START_TEST(test_concurrent_changes_and_scans)
+{
+    cleanup();
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_ID_INDEX);
+    ck_assert_ptr_nonnull(hf);
+
+    bool stop = false;
+    pthread_t threads[CONCURRENT_THREADS + 1];
+    Worker workers[CONCURRENT_THREADS + 1];
+    for (int i = 0; i < CONCURRENT_THREADS; i++) {
+        workers[i] = (Worker){.hf = hf, .first_id = i * 1000, .count = 1000};
+        ck_assert_int_eq(pthread_create(&threads[i], NULL, churn_worker, &workers[i]), 0);
+    }
+    workers[CONCURRENT_THREADS] = (Worker){.hf = hf, .stop = &stop};
+    ck_assert_int_eq(pthread_create(&threads[CONCURRENT_THREADS], NULL, scan_checker,
+                                    &workers[CONCURRENT_THREADS]), 0);
+    for (int i = 0; i < CONCURRENT_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        ck_assert_int_eq(workers[i].failures, 0);
+    }
+    __atomic_store_n(&stop, true, __ATOMIC_RELEASE);
+    pthread_join(threads[CONCURRENT_THREADS], NULL);
+    ck_assert_int_eq(workers[CONCURRENT_THREADS].failures, 0);
+
+    ck_assert_int_eq(count_records(hf), CONCURRENT_THREADS * 500);
+    for (int32_t id = 0; id < CONCURRENT_THREADS * 1000; id++) {
+        RecordId rid;
+        Record rec;
+        GrainResult res = hf_find_by_id(hf, id, &rid, &rec);
+        if (id % 2 == 0) {
+            ck_assert_int_eq(res, GRAIN_RECORD_NOT_FOUND);
+        } else {
+            ck_assert_int_eq(res, GRAIN_OK);
+            ck_assert_int_eq(rec.age, 1000 + id % 60);
+        }
+    }
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+/* inserts one at a time, in batches or through a session, by worker */
+static void *mixed_insert_worker(void *arg)
+{
+    Worker *w = arg;
+    HfSession session;
+    int mode = (w->first_id / 1000) % 3;
+    if (mode == 2 && hf_session_init(w->hf, &session) != GRAIN_OK) {
+        w->failures++;
+        return NULL;
+    }
+    for (int32_t id = w->first_id; id < w->first_id + w->count; id += 8) {
+        Record recs[8];
+        for (int32_t k = 0; k < 8; k++) {
+            recs[k] = (Record){.id = id + k, .age = (id + k) % 60};
+        }
+        for (int32_t k = 0; k < 8; k++) {
+            GrainResult res = GRAIN_OK;
+            if (mode == 0) {
+                res = hf_insert_record(w->hf, &recs[k]);
+            } else if (mode == 2) {
+                res = hf_session_insert(w->hf, &session, &recs[k], NULL);
+            } else if (k == 0) {
+                res = hf_insert_records(w->hf, recs, 8, NULL);
+            }
+            if (res != GRAIN_OK) {
+                w->failures++;
+            }
+        }
+    }
+    if (mode == 2 && hf_session_close(w->hf, &session) != GRAIN_OK) {
+        w->failures++;
+    }
+    return NULL;
+}
+
+/* deletes every record of its parity the moment a scan finds it */
+static void *scan_deleter(void *arg)
+{
+    Worker *w = arg;
+    bool last = false;
+    while (!last) {
+        last = __atomic_load_n(w->stop, __ATOMIC_ACQUIRE);
+        RecordId rid = {0, -1};
+        Record rec;
+        while (hf_scan_next(w->hf, &rid, &rec) == GRAIN_OK) {
+            if (rec.id % 2 == w->first_id && hf_delete_record(w->hf, rid) != GRAIN_OK) {
+                w->failures++;
+            }
+        }
+    }
+    return NULL;
+}
+
+START_TEST(test_concurrent_inserts_and_deletes)
+{
+    cleanup();
+    HeapFile *hf = create_file_ex(test_file,
+                                  HF_OPEN_ID_INDEX | HF_OPEN_HASH_INDEX | HF_OPEN_AGE_INDEX);
+    ck_assert_ptr_nonnull(hf);
+
+    /* a record can be deleted as soon as it is on the page, so its index entries must be there too */
+    bool stop = false;
+    pthread_t threads[CONCURRENT_THREADS + 2];
+    Worker workers[CONCURRENT_THREADS + 2];
+    for (int i = 0; i < CONCURRENT_THREADS; i++) {
+        workers[i] = (Worker){.hf = hf, .first_id = i * 1000, .count = 1000};
+        ck_assert_int_eq(pthread_create(&threads[i], NULL, mixed_insert_worker, &workers[i]), 0);
+    }
+    for (int i = CONCURRENT_THREADS; i < CONCURRENT_THREADS + 2; i++) {
+        workers[i] = (Worker){.hf = hf, .first_id = i - CONCURRENT_THREADS, .stop = &stop};
+        ck_assert_int_eq(pthread_create(&threads[i], NULL, scan_deleter, &workers[i]), 0);
+    }
+    for (int i = 0; i < CONCURRENT_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        ck_assert_int_eq(workers[i].failures, 0);
+    }
+    __atomic_store_n(&stop, true, __ATOMIC_RELEASE);
+    for (int i = CONCURRENT_THREADS; i < CONCURRENT_THREADS + 2; i++) {
+        pthread_join(threads[i], NULL);
+        ck_assert_int_eq(workers[i].failures, 0);
+    }
+
+    /* the last passes deleted everything, and no index kept an entry behind */
+    ck_assert_int_eq(count_records(hf), 0);
+    ck_assert_int_eq(hf->id_index->header.num_entries, 0);
+    ck_assert_int_eq(hf->age_index->header.num_entries, 0);
+    ck_assert_int_eq(hf->hash_index->header.num_entries, 0);
+    for (int32_t id = 0; id < CONCURRENT_THREADS * 1000; id += 7) {
+        RecordId rid;
+        Record rec;
+        ck_assert_int_eq(hf_find_by_id(hf, id, &rid, &rec), GRAIN_RECORD_NOT_FOUND);
+    }
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+#define VACUUM_PAGES 24
+#define VACUUM_KEEP 4
+
+/* ids that thin_pages left behind are the first VACUUM_KEEP of every page */
+static void *lookup_checker(void *arg)
+{
+    Worker *w = arg;
+    int32_t total = VACUUM_PAGES * (int32_t)MAX_SLOTS;
+    while (!__atomic_load_n(w->stop, __ATOMIC_ACQUIRE)) {
+        for (int32_t id = 0; id < total; id += MAX_SLOTS) {
+            for (int32_t k = 0; k < VACUUM_KEEP; k++) {
+                RecordId rid;
+                Record rec;
+                if (hf_find_by_id(w->hf, id + k, &rid, &rec) != GRAIN_OK || rec.id != id + k) {
+                    w->failures++;
+                }
+            }
+        }
+        BTreeCursor cur;
+        int32_t lo = total / 4, hi = total / 2;
+        if (hf_id_range_init(w->hf, &cur, lo, hi) != GRAIN_OK) {
+            w->failures++;
+            continue;
+        }
+        RecordId rid;
+        Record rec;
+        GrainResult res;
+        while ((res = hf_id_range_next(w->hf, &cur, &rid, &rec)) == GRAIN_OK) {
+            if (rec.id < lo || rec.id > hi || (int32_t)(rec.id % MAX_SLOTS) >= VACUUM_KEEP) {
+                w->failures++;
+            }
+        }
+        if (res != GRAIN_END) {
+            w->failures++;
+        }
+    }
+    return NULL;
+}
+
+START_TEST(test_concurrent_vacuum_and_lookups)
+{
+    cleanup();
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_ID_INDEX);
+    ck_assert_ptr_nonnull(hf);
+    insert_ids(hf, 0, VACUUM_PAGES * MAX_SLOTS);
+    thin_pages(hf, 0, VACUUM_PAGES, VACUUM_KEEP);
+
+    /* records move under the lookups and the emptied tail goes away */
+    bool stop = false;
+    pthread_t threads[CONCURRENT_THREADS];
+    Worker workers[CONCURRENT_THREADS];
+    for (int i = 0; i < CONCURRENT_THREADS; i++) {
+        workers[i] = (Worker){.hf = hf, .stop = &stop};
+        ck_assert_int_eq(pthread_create(&threads[i], NULL, lookup_checker, &workers[i]), 0);
+    }
+    ck_assert_int_eq(hf_vacuum(hf, MAX_SLOTS, NULL, NULL), GRAIN_OK);
+    __atomic_store_n(&stop, true, __ATOMIC_RELEASE);
+    for (int i = 0; i < CONCURRENT_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        ck_assert_int_eq(workers[i].failures, 0);
+    }
+
+    /* a tail page a lookup had pinned stays until the next vacuum */
+    ck_assert_int_eq(hf_vacuum(hf, MAX_SLOTS, NULL, NULL), GRAIN_OK);
+    ck_assert_int_eq(hf->header.num_pages, 1);
+    ck_assert_int_eq(count_records(hf), VACUUM_PAGES * VACUUM_KEEP);
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+static void *vacuum_worker(void *arg)
+{
+    Worker *w = arg;
+    if (hf_vacuum(w->hf, MAX_SLOTS, NULL, NULL) != GRAIN_OK) {
+        w->failures++;
+    }
+    __atomic_store_n(w->stop, true, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static GrainResult count_seen(void *ctx, int32_t worker, const RecordId *rids,
+                              const Record *recs, int32_t count)
+{
+    int32_t *seen = ctx;
+    (void)worker;
+    (void)rids;
+    for (int32_t i = 0; i < count; i++) {
+        __atomic_add_fetch(&seen[recs[i].id], 1, __ATOMIC_RELAXED);
+    }
+    return GRAIN_OK;
+}
+
+START_TEST(test_parallel_scan_shuts_out_changes)
+{
+    cleanup();
+    HeapFile *hf = create_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    int32_t total = VACUUM_PAGES * (int32_t)MAX_SLOTS;
+    insert_ids(hf, 0, total);
+    thin_pages(hf, 0, VACUUM_PAGES, VACUUM_KEEP);
+
+    /* records move to the front while the scans run; each scan sees them all where they were */
+    bool stop = false;
+    pthread_t thread;
+    Worker worker = {.hf = hf, .stop = &stop};
+    ck_assert_int_eq(pthread_create(&thread, NULL, vacuum_worker, &worker), 0);
+    int32_t *seen = malloc(sizeof(int32_t) * total);
+    ck_assert_ptr_nonnull(seen);
+    do {
+        memset(seen, 0, sizeof(int32_t) * total);
+        ck_assert_int_eq(hf_parallel_scan(hf, 4, count_seen, seen), GRAIN_OK);
+        for (int32_t id = 0; id < total; id++) {
+            ck_assert_int_eq(seen[id], (id % MAX_SLOTS < VACUUM_KEEP) ? 1 : 0);
+        }
+    } while (!__atomic_load_n(&stop, __ATOMIC_ACQUIRE));
+    pthread_join(thread, NULL);
+    ck_assert_int_eq(worker.failures, 0);
+
+    free(seen);
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+static void *commit_worker(void *arg)
+{
+    Worker *w = arg;
+    for (int32_t id = w->first_id; id < w->first_id + w->count; id++) {
+        Record rec = {.id = id, .age = id % 60};
+        if (hf_insert_record(w->hf, &rec) != GRAIN_OK) {
+            w->failures++;
+        }
+        if (id % 100 == 99 && hf_commit(w->hf) != GRAIN_OK) {
+            w->failures++;
+        }
+    }
+    return NULL;
+}
+
+START_TEST(test_concurrent_commits_and_checkpoints)
+{
+    cleanup();
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_WAL);
+    ck_assert_ptr_nonnull(hf);
+
+    pthread_t threads[4];
+    Worker workers[4];
+    for (int i = 0; i < 4; i++) {
+        workers[i] = (Worker){.hf = hf, .first_id = i * 1000, .count = 1000};
+        ck_assert_int_eq(pthread_create(&threads[i], NULL, commit_worker, &workers[i]), 0);
+    }
+    /* checkpoints keep cutting the log while the writers run */
+    for (int i = 0; i < 20; i++) {
+        ck_assert_int_eq(hf_flush(hf), GRAIN_OK);
+        usleep(1000);
+    }
+    for (int i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+        ck_assert_int_eq(workers[i].failures, 0);
+    }
+    close_file(hf);
+
+    hf = open_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_int_eq(count_records(hf), 4000);
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_sessions_fill_their_own_pages)
+{
+    cleanup();
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_ID_INDEX);
+    ck_assert_ptr_nonnull(hf);
+
+    /* two interleaved sessions never share a page */
+    HfSession a, b;
+    ck_assert_int_eq(hf_session_init(hf, &a), GRAIN_OK);
+    ck_assert_int_eq(hf_session_init(hf, &b), GRAIN_OK);
+    for (int32_t i = 0; i < MAX_SLOTS; i++) {
+        Record rec = {.id = i, .age = 1};
+        RecordId rid_a, rid_b;
+        ck_assert_int_eq(hf_session_insert(hf, &a, &rec, &rid_a), GRAIN_OK);
+        rec.id += 1000;
+        ck_assert_int_eq(hf_session_insert(hf, &b, &rec, &rid_b), GRAIN_OK);
+        ck_assert_int_eq(rid_a.page_id, 0);
+        ck_assert_int_eq(rid_b.page_id, 1);
+        ck_assert_int_eq(rid_a.slot_idx, i);
+    }
+
+    /* a full page is let go, and the session moves on to a new one */
+    ck_assert_int_eq(a.page_id, -1);
+    Record rec = {.id = 5000, .age = 1};
+    RecordId rid;
+    ck_assert_int_eq(hf_session_insert(hf, &a, &rec, &rid), GRAIN_OK);
+    ck_assert_int_eq(rid.page_id, 2);
+
+    /* plain inserts stay off claimed pages too */
+    ck_assert_int_eq(hf_session_insert(hf, &b, &rec, NULL), GRAIN_OK);
+    ck_assert_int_eq(b.page_id, 3);
+    rec.id = 6000;
+    ck_assert_int_eq(hf_insert_record(hf, &rec), GRAIN_OK);
+    ck_assert_int_eq(hf_find_by_id(hf, 6000, &rid, &rec), GRAIN_OK);
+    ck_assert_int_eq(rid.page_id, 4);
+    Record batch[3] = {{.id = 6001, .age = 1}, {.id = 6002, .age = 1}, {.id = 6003, .age = 1}};
+    RecordId rids[3];
+    ck_assert_int_eq(hf_insert_records(hf, batch, 3, rids), GRAIN_OK);
+    for (int i = 0; i < 3; i++) {
+        ck_assert_int_eq(rids[i].page_id, 4);
+    }
+
+    /* once closed, the page is open to everyone again */
+    ck_assert_int_eq(hf_session_close(hf, &a), GRAIN_OK);
+    ck_assert_int_eq(hf_session_close(hf, &b), GRAIN_OK);
+    ck_assert_int_eq(a.page_id, -1);
+    rec.id = 7000;
+    ck_assert_int_eq(hf_insert_record(hf, &rec), GRAIN_OK);
+    ck_assert_int_eq(hf_find_by_id(hf, 7000, &rid, &rec), GRAIN_OK);
+    ck_assert_int_eq(rid.page_id, 2);
+    ck_assert_int_eq(count_records(hf), MAX_SLOTS * 2 + 7);
+
+    ck_assert_int_eq(hf_session_init(NULL, &a), GRAIN_NULL_PTR);
+    ck_assert_int_eq(hf_session_insert(hf, NULL, &rec, NULL), GRAIN_NULL_PTR);
+    ck_assert_int_eq(hf_session_insert(hf, &a, NULL, NULL), GRAIN_NULL_PTR);
+    ck_assert_int_eq(hf_session_close(hf, NULL), GRAIN_NULL_PTR);
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_vacuum_keeps_claimed_page)
+{
+    cleanup();
+    HeapFile *hf = create_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    insert_ids(hf, 0, MAX_SLOTS * 2);
+
+    HfSession session;
+    ck_assert_int_eq(hf_session_init(hf, &session), GRAIN_OK);
+    Record rec = {.id = 9000, .age = 1};
+    RecordId rid;
+    ck_assert_int_eq(hf_session_insert(hf, &session, &rec, &rid), GRAIN_OK);
+    ck_assert_int_eq(rid.page_id, 2);
+    ck_assert_int_eq(hf_delete_record(hf, rid), GRAIN_OK);
+
+    /* the session's empty page is at the end, but it is still in use */
+    ck_assert_int_eq(hf_vacuum(hf, 0, NULL, NULL), GRAIN_OK);
+    ck_assert_int_eq(hf->header.num_pages, 3);
+    ck_assert_int_eq(hf_session_insert(hf, &session, &rec, &rid), GRAIN_OK);
+    ck_assert_int_eq(rid.page_id, 2);
+    ck_assert_int_eq(hf_delete_record(hf, rid), GRAIN_OK);
+
+    ck_assert_int_eq(hf_session_close(hf, &session), GRAIN_OK);
+    ck_assert_int_eq(hf_vacuum(hf, 0, NULL, NULL), GRAIN_OK);
+    ck_assert_int_eq(hf->header.num_pages, 2);
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+static void *session_worker(void *arg)
+{
+    Worker *w = arg;
+    HfSession session;
+    if (hf_session_init(w->hf, &session) != GRAIN_OK) {
+        w->failures++;
+        return NULL;
+    }
+    RecordId last = {.page_id = -1, .slot_idx = -1};
+    for (int32_t id = w->first_id; id < w->first_id + w->count; id++) {
+        Record rec = {.id = id, .age = id % 60};
+        RecordId rid;
+        if (hf_session_insert(w->hf, &session, &rec, &rid) != GRAIN_OK) {
+            w->failures++;
+            continue;
+        }
+        /* nobody else writes to the session's page, so its slots come in order */
+        if (rid.page_id == last.page_id && rid.slot_idx != last.slot_idx + 1) {
+            w->failures++;
+        }
+        last = rid;
+    }
+    if (hf_session_close(w->hf, &session) != GRAIN_OK) {
+        w->failures++;
+    }
+    return NULL;
+}
+
+START_TEST(test_concurrent_sessions)
+{
+    cleanup();
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_ID_INDEX);
+    ck_assert_ptr_nonnull(hf);
+
+    pthread_t threads[CONCURRENT_THREADS];
+    Worker workers[CONCURRENT_THREADS];
+    for (int i = 0; i < CONCURRENT_THREADS; i++) {
+        workers[i] = (Worker){.hf = hf, .first_id = i * 2000, .count = 2000};
+        ck_assert_int_eq(pthread_create(&threads[i], NULL, session_worker, &workers[i]), 0);
+    }
+    for (int i = 0; i < CONCURRENT_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        ck_assert_int_eq(workers[i].failures, 0);
+    }
+
+    int32_t total = CONCURRENT_THREADS * 2000;
+    ck_assert_int_eq(count_records(hf), total);
+    /* at most one part-filled page per session */
+    ck_assert_int_le(hf->header.num_pages, total / MAX_SLOTS + CONCURRENT_THREADS);
+    for (int32_t id = 0; id < total; id += 7) {
+        RecordId rid;
+        Record rec;
+        ck_assert_int_eq(hf_find_by_id(hf, id, &rid, &rec), GRAIN_OK);
+        ck_assert_int_eq(rec.id, id);
+    }
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+// ============== compressed file tests ==============
+
+START_TEST(test_compressed_file_round_trip)
+{
+    cleanup();
+    ck_assert_ptr_null(create_file_ex(test_file, HF_OPEN_COMPRESS | HF_OPEN_MMAP));
+
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_COMPRESS | HF_OPEN_ID_INDEX);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_int_eq(hf->header.compressed, 1);
+    ck_assert_ptr_nonnull(hf->page_dir);
+    int32_t n = MAX_SLOTS * 20;
+    insert_ids(hf, 0, n);
+    for (int32_t i = 0; i < n; i += 7) {
+        RecordId rid = {.page_id = i / MAX_SLOTS, .slot_idx = i % MAX_SLOTS};
+        ck_assert_int_eq(hf_delete_record(hf, rid), GRAIN_OK);
+    }
+    ck_assert_int_eq(close_file(hf), GRAIN_OK);
+
+    /* zero-padded names and emails leave most of every page to squeeze out */
+    ck_assert_int_lt(file_size(test_file), (off_t)20 * PAGE_SIZE / 3);
+    ck_assert_int_eq(access(test_page_dir, F_OK), 0);
+
+    /* compressed pages can't be mapped, and the header says so whatever the opener asks for */
+    ck_assert_ptr_null(open_file_ex(test_file, HF_OPEN_MMAP));
+    hf = open_file_ex(test_file, HF_OPEN_ID_INDEX);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_int_eq(hf->header.compressed, 1);
+    ck_assert_int_eq(hf->header.num_pages, 20);
+    ck_assert_int_eq(count_records(hf), n - (n + 6) / 7);
+
+    RecordId rid;
+    Record rec;
+    ck_assert_int_eq(hf_find_by_id(hf, 1234, &rid, &rec), GRAIN_OK);
+    ck_assert_str_eq(rec.name, "User1234");
+    ck_assert_int_eq(hf_find_by_id(hf, 1232, &rid, &rec), GRAIN_RECORD_NOT_FOUND);
+
+    ScanTotals *totals = new_totals(n);
+    ck_assert_int_eq(hf_parallel_scan(hf, SCAN_TEST_WORKERS, sum_page, totals), GRAIN_OK);
+    ck_assert_int_eq(total_count(totals), n - (n + 6) / 7);
+    free_totals(totals);
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_compressed_file_rebuilds_directory)
+{
+    cleanup();
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_COMPRESS);
+    ck_assert_ptr_nonnull(hf);
+    insert_ids(hf, 0, MAX_SLOTS * 6);
+    ck_assert_int_eq(close_file(hf), GRAIN_OK);
+
+    /* longer records outgrow their frames and move to the end of the file */
+    hf = open_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    for (int32_t i = 0; i < MAX_SLOTS; i++) {
+        RecordId rid = {.page_id = 2, .slot_idx = i};
+        Record rec = {.id = 2 * MAX_SLOTS + i, .age = i};
+        uint32_t x = (uint32_t)i + 1;
+        for (size_t c = 0; c + 1 < sizeof(rec.name); c++) {
+            x = x * 1103515245u + 12345u;
+            rec.name[c] = (char)('a' + (x >> 16) % 26);
+        }
+        strcpy(rec.email, "x@test.com");
+        ck_assert_int_eq(hf_update_record(hf, rid, &rec), GRAIN_OK);
+    }
+    ck_assert_int_eq(hf_flush(hf), GRAIN_OK);
+    PageExtent moved;
+    ck_assert(pagedir_extent(hf->page_dir, 2, &moved));
+    PageExtent last;
+    ck_assert(pagedir_extent(hf->page_dir, 5, &last));
+    ck_assert_int_gt(moved.offset, last.offset);
+    ck_assert_int_eq(close_file(hf), GRAIN_OK);
+
+    /* the directory is only a cache of where the frames are */
+    remove(test_page_dir);
+    hf = open_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    PageExtent found;
+    ck_assert(pagedir_extent(hf->page_dir, 2, &found));
+    ck_assert_int_eq(found.offset, moved.offset);
+    ck_assert_int_eq(count_records(hf), MAX_SLOTS * 6);
+    RecordId rid = {.page_id = 2, .slot_idx = 9};
+    Record rec;
+    ck_assert_int_eq(hf_get_record(hf, rid, &rec), GRAIN_OK);
+    ck_assert_int_eq(rec.id, 2 * MAX_SLOTS + 9);
+    ck_assert_int_eq(strlen(rec.name), sizeof(rec.name) - 1);
+    ck_assert_str_eq(rec.email, "x@test.com");
+    rid.page_id = 4;
+    ck_assert_int_eq(hf_get_record(hf, rid, &rec), GRAIN_OK);
+    ck_assert_str_eq(rec.name, "User517");
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_compressed_wal_recovers_after_crash)
+{
+    cleanup();
+    int n = MAX_SLOTS * 2 + 40;
+    CRASH_AFTER(insert_and_commit_ex(n, HF_OPEN_COMPRESS));
+    ck_assert_int_eq(access(test_wal, F_OK), 0);
+
+    HeapFile *hf = open_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_int_eq(hf->header.compressed, 1);
+    assert_recovered(hf, n);
+    close_file(hf);
+
+    hf = open_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    assert_recovered(hf, n);
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_compressed_vacuum_trims_file)
+{
+    cleanup();
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_COMPRESS);
+    ck_assert_ptr_nonnull(hf);
+    insert_ids(hf, 0, MAX_SLOTS * 10);
+    ck_assert_int_eq(hf_flush(hf), GRAIN_OK);
+    off_t full = file_size(test_file);
+    thin_pages(hf, 0, 2, MAX_SLOTS - 20);
+    thin_pages(hf, 5, 10, 2);
+
+    ck_assert_int_eq(hf_vacuum(hf, 10, NULL, NULL), GRAIN_OK);
+    ck_assert_int_eq(hf->header.num_pages, 5);
+    ck_assert_int_eq(hf_flush(hf), GRAIN_OK);
+    ck_assert_int_eq(file_size(test_file), hf->page_dir->header.data_end);
+    ck_assert_int_lt(file_size(test_file), full);
+    ck_assert_int_eq(count_records(hf), MAX_SLOTS * 5 - 40 + 10);
+    close_file(hf);
+
+    hf = open_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_int_eq(hf->header.num_pages, 5);
+    ck_assert_int_eq(count_records(hf), MAX_SLOTS * 5 - 40 + 10);
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+// ============== page checksum tests ==============
+
+static void flip_byte(off_t offset)
+{
+    int fd = open(test_file, O_RDWR);
+    ck_assert_int_ge(fd, 0);
+    uint8_t byte;
+    ck_assert_int_eq(pread(fd, &byte, 1, offset), 1);
+    byte ^= 0x01;
+    ck_assert_int_eq(pwrite(fd, &byte, 1, offset), 1);
+    close(fd);
+}
+
+static void read_raw_page(int32_t page_id, HeapPage *page)
+{
+    int fd = open(test_file, O_RDONLY);
+    ck_assert_int_ge(fd, 0);
+    ck_assert_int_eq(pread(fd, page, PAGE_SIZE, FILE_DATA_OFFSET + (off_t)page_id * PAGE_SIZE), PAGE_SIZE);
+    close(fd);
+}
+
+START_TEST(test_corrupt_page_detected_on_read)
+{
+    cleanup();
+    HeapFile *hf = create_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    insert_ids(hf, 0, MAX_SLOTS * 4);
+    ck_assert_int_eq(close_file(hf), GRAIN_OK);
+
+    HeapPage raw;
+    for (int32_t page_id = 0; page_id < 4; page_id++) {
+        read_raw_page(page_id, &raw);
+        ck_assert(verify_page(&raw));
+    }
+
+    /* one bit of rot in a record on page 2 */
+    flip_byte(FILE_DATA_OFFSET + 2 * PAGE_SIZE + sizeof(PageHeader) + 5 * RECORD_SIZE + 10);
+
+    hf = open_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    RecordId rid = {.page_id = 1, .slot_idx = 5};
+    Record rec;
+    ck_assert_int_eq(hf_get_record(hf, rid, &rec), GRAIN_OK);
+    rid.page_id = 2;
+    ck_assert_int_eq(hf_get_record(hf, rid, &rec), GRAIN_CORRUPT_PAGE);
+    HeapPage *page;
+    ck_assert_int_eq(hf_pin_page(hf, 2, &page), GRAIN_CORRUPT_PAGE);
+
+    /* scans stop at the page instead of handing back what's on it */
+    RecordId scan = {.page_id = 0, .slot_idx = -1};
+    int32_t count = 0;
+    GrainResult res;
+    while ((res = hf_scan_next(hf, &scan, &rec)) == GRAIN_OK) {
+        count++;
+    }
+    ck_assert_int_eq(res, GRAIN_CORRUPT_PAGE);
+    ck_assert_int_eq(count, MAX_SLOTS * 2);
+
+    ScanTotals *totals = new_totals(MAX_SLOTS * 4);
+    ck_assert_int_eq(hf_parallel_scan(hf, SCAN_TEST_WORKERS, sum_page, totals), GRAIN_CORRUPT_PAGE);
+    free_totals(totals);
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_corrupt_compressed_page_detected)
+{
+    cleanup();
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_COMPRESS);
+    ck_assert_ptr_nonnull(hf);
+    insert_ids(hf, 0, MAX_SLOTS * 3);
+    ck_assert_int_eq(hf_flush(hf), GRAIN_OK);
+    PageExtent ext;
+    ck_assert(pagedir_extent(hf->page_dir, 1, &ext));
+    ck_assert_int_eq(close_file(hf), GRAIN_OK);
+
+    flip_byte(ext.offset + sizeof(PageFrameHeader) + ext.length / 2);
+
+    hf = open_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    RecordId rid = {.page_id = 1, .slot_idx = 0};
+    Record rec;
+    ck_assert_int_eq(hf_get_record(hf, rid, &rec), GRAIN_CORRUPT_PAGE);
+    rid.page_id = 2;
+    ck_assert_int_eq(hf_get_record(hf, rid, &rec), GRAIN_OK);
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_mmap_pages_stamped_on_flush)
+{
+    cleanup();
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_MMAP);
+    ck_assert_ptr_nonnull(hf);
+    insert_ids(hf, 0, MAX_SLOTS * 3);
+    ck_assert_int_eq(hf_flush(hf), GRAIN_OK);
+
+    HeapPage raw;
+    read_raw_page(1, &raw);
+    ck_assert(verify_page(&raw));
+
+    RecordId rid = {.page_id = 1, .slot_idx = 7};
+    Record rec = {.id = MAX_SLOTS + 7, .age = 99};
+    strcpy(rec.name, "Mapped");
+    ck_assert_int_eq(hf_update_record(hf, rid, &rec), GRAIN_OK);
+    ck_assert_int_eq(close_file(hf), GRAIN_OK);
+
+    /* a buffered open checks what the mapping wrote */
+    hf = open_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_int_eq(hf_get_record(hf, rid, &rec), GRAIN_OK);
+    ck_assert_int_eq(rec.age, 99);
+    ck_assert_str_eq(rec.name, "Mapped");
+    ck_assert_int_eq(count_records(hf), MAX_SLOTS * 3);
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+/* rewrites the current file as version 4 or 5 wrote it: pages right behind the header, stamped from 5 on */
+static void downgrade_to(int32_t version)
+{
+    int fd = open(test_file, O_RDWR);
+    ck_assert_int_ge(fd, 0);
+    FileHeader header;
+    ck_assert_int_eq(pread(fd, &header, sizeof(header), 0), sizeof(header));
+    HeapPage page;
+    for (int32_t i = 0; i < header.num_pages; i++) {
+        ck_assert_int_eq(pread(fd, &page, PAGE_SIZE, FILE_DATA_OFFSET + (off_t)i * PAGE_SIZE), PAGE_SIZE);
+        if (version == 4) page.checksum = 0;
+        ck_assert_int_eq(pwrite(fd, &page, PAGE_SIZE, sizeof(FileHeader) + (off_t)i * PAGE_SIZE), PAGE_SIZE);
+    }
+    ck_assert_int_eq(ftruncate(fd, sizeof(FileHeader) + (off_t)header.num_pages * PAGE_SIZE), 0);
+    header.version = version;
+    ck_assert_int_eq(pwrite(fd, &header, sizeof(header), 0), sizeof(header));
+    close(fd);
+}
+
+START_TEST(test_open_file_stamps_v4_file)
+{
+    cleanup();
+    int n = MAX_SLOTS * 2 + 40;
+    CRASH_AFTER(insert_and_commit(n));
+    downgrade_to(4);
+
+    /* stamped on the way to their new offsets, and the log left behind still replays on top */
+    HeapFile *hf = open_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_int_eq(hf->header.version, GRAIN_FORMAT_VERSION);
+    assert_recovered(hf, n);
+    ck_assert_int_eq(close_file(hf), GRAIN_OK);
+    ck_assert_int_eq(access(test_wal, F_OK), -1);
+
+    FILE *f = fopen(test_file, "rb");
+    ck_assert_ptr_nonnull(f);
+    FileHeader raw_header;
+    ck_assert_int_eq(fread(&raw_header, sizeof(FileHeader), 1, f), 1);
+    fclose(f);
+    ck_assert_int_eq(raw_header.version, GRAIN_FORMAT_VERSION);
+    HeapPage raw;
+    for (int32_t page_id = 0; page_id < raw_header.num_pages; page_id++) {
+        read_raw_page(page_id, &raw);
+        ck_assert(verify_page(&raw));
+    }
+    cleanup();
+}
+END_TEST
+
+// ============== async i/o tests ==============
+
+START_TEST(test_async_flush_and_eviction_write_batches)
+{
+    cleanup();
+    ck_assert_ptr_null(create_file_ex(test_file, HF_OPEN_MMAP | HF_OPEN_ASYNC_IO));
+
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_ASYNC_IO | HF_OPEN_WAL);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_ptr_nonnull(hf->aio);
+
+    /* more pages than the pool holds, so dirty pages leave through eviction as well as the flush */
+    int32_t pages = BUFFER_POOL_FRAMES + 40;
+    insert_ids(hf, 0, MAX_SLOTS * pages);
+    ck_assert_int_eq(hf_flush(hf), GRAIN_OK);
+    ck_assert_int_eq(close_file(hf), GRAIN_OK);
+
+    HeapPage raw;
+    for (int32_t page_id = 0; page_id < pages; page_id++) {
+        read_raw_page(page_id, &raw);
+        ck_assert(verify_page(&raw));
+        ck_assert_int_eq(raw.header.page_id, page_id);
+    }
+
+    hf = open_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_int_eq(hf->header.num_pages, pages);
+    ck_assert_int_eq(count_records(hf), MAX_SLOTS * pages);
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_async_wal_recovers_after_crash)
+{
+    cleanup();
+    int n = MAX_SLOTS * (BUFFER_POOL_FRAMES + 20);
+    CRASH_AFTER(insert_and_commit_ex(n, HF_OPEN_ASYNC_IO));
+    ck_assert_int_eq(access(test_wal, F_OK), 0);
+
+    HeapFile *hf = open_file_ex(test_file, HF_OPEN_ASYNC_IO);
+    ck_assert_ptr_nonnull(hf);
+    assert_recovered(hf, n);
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_async_parallel_scan_sees_every_record_once)
+{
+    cleanup();
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_ASYNC_IO);
+    ck_assert_ptr_nonnull(hf);
+    int32_t n = 20000;
+    insert_ids(hf, 0, n);
+    for (int32_t i = 0; i < n; i += 10) {
+        RecordId rid = {.page_id = i / MAX_SLOTS, .slot_idx = i % MAX_SLOTS};
+        ck_assert_int_eq(hf_delete_record(hf, rid), GRAIN_OK);
+    }
+
+    int32_t workers[] = {1, SCAN_TEST_WORKERS};
+    for (size_t w = 0; w < sizeof(workers) / sizeof(workers[0]); w++) {
+        ScanTotals *totals = new_totals(n);
+        ck_assert_int_eq(hf_parallel_scan(hf, workers[w], sum_page, totals), GRAIN_OK);
+        int64_t expected = 0;
+        for (int32_t i = 0; i < n; i++) {
+            ck_assert_int_eq(totals->seen[i], (i % 10 == 0) ? 0 : 1);
+            if (i % 10 != 0) expected += i;
+        }
+        ck_assert_int_eq(total_count(totals), n - n / 10);
+        ck_assert(total_sum(totals) == expected);
+        free_totals(totals);
+    }
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_async_scan_stops_at_corrupt_page)
+{
+    cleanup();
+    HeapFile *hf = create_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    insert_ids(hf, 0, MAX_SLOTS * 60);
+    ck_assert_int_eq(close_file(hf), GRAIN_OK);
+    flip_byte(FILE_DATA_OFFSET + 37 * PAGE_SIZE + sizeof(PageHeader) + 3 * RECORD_SIZE);
+
+    hf = open_file_ex(test_file, HF_OPEN_ASYNC_IO);
+    ck_assert_ptr_nonnull(hf);
+    ScanTotals *totals = new_totals(MAX_SLOTS * 60);
+    ck_assert_int_eq(hf_parallel_scan(hf, 2, sum_page, totals), GRAIN_CORRUPT_PAGE);
+    ck_assert_int_lt(total_count(totals), MAX_SLOTS * 60);
+
+    /* a callback failing partway is passed on the same way */
+    free_totals(totals);
+    totals = new_totals(MAX_SLOTS * 60);
+    totals->fail_on_page = 3;
+    ck_assert_int_eq(hf_parallel_scan(hf, 1, sum_page, totals), GRAIN_FILE_READ_FAILED);
+    ck_assert_int_eq(totals->seen[3 * MAX_SLOTS], 0);
+    free_totals(totals);
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_async_write_fails_when_a_page_cant_be_queued)
+{
+    cleanup();
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_ASYNC_IO);
+    ck_assert_ptr_nonnull(hf);
+    insert_ids(hf, 0, MAX_SLOTS * 4);
+
+    /* every slot of the write queue is taken, so the flush can't queue a single page */
+    char *scratch = malloc((size_t)AIO_QUEUE_DEPTH * PAGE_SIZE);
+    ck_assert_ptr_nonnull(scratch);
+    for (int32_t i = 0; i < AIO_QUEUE_DEPTH; i++) {
+        ck_assert_int_eq(aio_prep_read(hf->aio, hf->page_fd, scratch + (size_t)i * PAGE_SIZE, PAGE_SIZE,
+                                       0, (uint64_t)i), GRAIN_OK);
+    }
+    ck_assert_int_eq(hf_flush(hf), GRAIN_NO_FREE_FRAME);
+    ck_assert_int_eq(aio_outstanding(hf->aio), 0);
+    free(scratch);
+
+    /* the pages stayed dirty and go out with the next flush */
+    ck_assert_int_eq(hf_flush(hf), GRAIN_OK);
+    ck_assert_int_eq(close_file(hf), GRAIN_OK);
+    hf = open_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_int_eq(count_records(hf), MAX_SLOTS * 4);
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+// ============== direct i/o tests ==============
+
+START_TEST(test_direct_io_round_trip)
+{
+    cleanup();
+    ck_assert_int_eq(FILE_DATA_OFFSET % DIRECT_IO_ALIGN, 0);
+    ck_assert_int_eq(PAGE_SIZE % DIRECT_IO_ALIGN, 0);
+
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_DIRECT | HF_OPEN_WAL);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_int_ne(hf->page_fd, hf->fd);
+
+    /* enough pages to go through eviction, then a flush, then a trim */
+    int32_t pages = BUFFER_POOL_FRAMES + 30;
+    insert_ids(hf, 0, MAX_SLOTS * pages);
+    ck_assert_int_eq(hf_flush(hf), GRAIN_OK);
+    ck_assert_int_eq(file_size(test_file), FILE_DATA_OFFSET + (off_t)pages * PAGE_SIZE);
+    thin_pages(hf, pages - 10, pages, 0);
+    ck_assert_int_eq(hf_vacuum(hf, 1, NULL, NULL), GRAIN_OK);
+    ck_assert_int_eq(hf_flush(hf), GRAIN_OK);
+    ck_assert_int_eq(file_size(test_file), FILE_DATA_OFFSET + (off_t)(pages - 10) * PAGE_SIZE);
+    ck_assert_int_eq(close_file(hf), GRAIN_OK);
+
+    HeapPage raw;
+    read_raw_page(pages - 11, &raw);
+    ck_assert(verify_page(&raw));
+    ck_assert_int_eq(raw.header.page_id, pages - 11);
+
+    /* the same file reads back buffered, direct, and direct with queued reads */
+    uint32_t flags[] = {HF_OPEN_DEFAULT, HF_OPEN_DIRECT, HF_OPEN_DIRECT | HF_OPEN_ASYNC_IO};
+    for (size_t f = 0; f < sizeof(flags) / sizeof(flags[0]); f++) {
+        hf = open_file_ex(test_file, flags[f]);
+        ck_assert_ptr_nonnull(hf);
+        ck_assert_int_eq(count_records(hf), MAX_SLOTS * (pages - 10));
+        ScanTotals *totals = new_totals(MAX_SLOTS * pages);
+        ck_assert_int_eq(hf_parallel_scan(hf, SCAN_TEST_WORKERS, sum_page, totals), GRAIN_OK);
+        ck_assert_int_eq(total_count(totals), MAX_SLOTS * (pages - 10));
+        free_totals(totals);
+        ck_assert_int_eq(close_file(hf), GRAIN_OK);
+    }
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_direct_io_wal_recovers_after_crash)
+{
+    cleanup();
+    int n = MAX_SLOTS * (BUFFER_POOL_FRAMES + 20);
+    CRASH_AFTER(insert_and_commit_ex(n, HF_OPEN_DIRECT));
+    ck_assert_int_eq(access(test_wal, F_OK), 0);
+
+    HeapFile *hf = open_file_ex(test_file, HF_OPEN_DIRECT);
+    ck_assert_ptr_nonnull(hf);
+    assert_recovered(hf, n);
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_direct_io_rejects_mmap_and_compress)
+{
+    cleanup();
+    ck_assert_ptr_null(create_file_ex(test_file, HF_OPEN_DIRECT | HF_OPEN_MMAP));
+    ck_assert_ptr_null(create_file_ex(test_file, HF_OPEN_DIRECT | HF_OPEN_COMPRESS));
+
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_COMPRESS);
+    ck_assert_ptr_nonnull(hf);
+    insert_ids(hf, 0, 10);
+    close_file(hf);
+    ck_assert_ptr_null(open_file_ex(test_file, HF_OPEN_DIRECT));
+    ck_assert_ptr_null(open_file_ex(test_file, HF_OPEN_DIRECT | HF_OPEN_MMAP));
+
+    hf = open_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_int_eq(hf->page_fd, hf->fd);
+    ck_assert_int_eq(count_records(hf), 10);
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_open_file_moves_v5_pages)
+{
+    cleanup();
+    int n = MAX_SLOTS * 2 + 40;
+    CRASH_AFTER(insert_and_commit_ex(n, HF_OPEN_PAX));
+    downgrade_to(5);
+
+    /* moved up to the aligned offset with their layout kept, and the log still replays on top */
+    HeapFile *hf = open_file_ex(test_file, HF_OPEN_DIRECT);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_int_eq(hf->header.version, GRAIN_FORMAT_VERSION);
+    ck_assert_int_eq(hf->header.layout, PAGE_LAYOUT_PAX);
+    assert_recovered(hf, n);
+    assert_pax_pages(hf);
+    ck_assert_int_eq(close_file(hf), GRAIN_OK);
+
+    HeapPage raw;
+    for (int32_t page_id = 0; page_id < 3; page_id++) {
+        read_raw_page(page_id, &raw);
+        ck_assert(verify_page(&raw));
+        ck_assert_int_eq(raw.header.page_id, page_id);
+    }
+    ck_assert_int_eq(file_size(test_file), FILE_DATA_OFFSET + 3 * PAGE_SIZE);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_open_file_keeps_v5_compressed_frames)
+{
+    cleanup();
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_COMPRESS);
+    ck_assert_ptr_nonnull(hf);
+    insert_ids(hf, 0, MAX_SLOTS * 3);
+    ck_assert_int_eq(close_file(hf), GRAIN_OK);
+    off_t size = file_size(test_file);
+
+    /* frames are found through the directory, so only the version changes */
+    int fd = open(test_file, O_RDWR);
+    ck_assert_int_ge(fd, 0);
+    int32_t version = 5;
+    ck_assert_int_eq(pwrite(fd, &version, sizeof(version), offsetof(FileHeader, version)), sizeof(version));
+    close(fd);
+
+    hf = open_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_int_eq(hf->header.version, GRAIN_FORMAT_VERSION);
+    ck_assert_int_eq(hf->page_dir->header.data_start, (int64_t)sizeof(FileHeader));
+    ck_assert_int_eq(count_records(hf), MAX_SLOTS * 3);
+    ck_assert_int_eq(close_file(hf), GRAIN_OK);
+    ck_assert_int_eq(file_size(test_file), size);
+    cleanup();
+}
+END_TEST
+
+// ============== read-ahead tests ==============
+
+START_TEST(test_scan_reads_ahead_and_spares_hot_pages)
+{
+    cleanup();
+    HeapFile *hf = create_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    int32_t pages = BUFFER_POOL_FRAMES * 2;
+    insert_ids(hf, 0, MAX_SLOTS * pages);
+    ck_assert_int_eq(close_file(hf), GRAIN_OK);
+
+    /* a hot set read backwards, so none of it looks sequential */
+    hf = open_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    int32_t hot = 40;
+    HeapPage *page;
+    for (int32_t page_id = hot - 1; page_id >= 0; page_id--) {
+        ck_assert_int_eq(hf_pin_page(hf, page_id, &page), GRAIN_OK);
+        ck_assert_int_eq(hf_unpin_page(hf, page_id, false), GRAIN_OK);
+    }
+
+    /* the scan is twice the pool, but it only ever recycles the ring's frames */
+    ck_assert_int_eq(count_records(hf), MAX_SLOTS * pages);
+    int32_t scanned = 0;
+    for (int32_t page_id = 0; page_id < pages; page_id++) {
+        if (page_id < hot) {
+            ck_assert(bp_is_resident(&hf->pool, page_id));
+        } else if (bp_is_resident(&hf->pool, page_id)) {
+            scanned++;
+        }
+    }
+    ck_assert_int_le(scanned, BP_SCAN_RING_FRAMES + 1);
+    ck_assert_int_eq(count_records(hf), MAX_SLOTS * pages);
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_read_ahead_stops_at_corrupt_page)
+{
+    cleanup();
+    HeapFile *hf = create_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    insert_ids(hf, 0, MAX_SLOTS * 100);
+    ck_assert_int_eq(close_file(hf), GRAIN_OK);
+    flip_byte(FILE_DATA_OFFSET + 50 * PAGE_SIZE + sizeof(PageHeader) + 7 * RECORD_SIZE);
+
+    /* the bad page is in the middle of an extent, read in the foreground or in the background */
+    uint32_t flags[] = {HF_OPEN_DEFAULT, HF_OPEN_ASYNC_IO};
+    for (size_t f = 0; f < sizeof(flags) / sizeof(flags[0]); f++) {
+        hf = open_file_ex(test_file, flags[f]);
+        ck_assert_ptr_nonnull(hf);
+        RecordId rid = {.page_id = 0, .slot_idx = -1};
+        Record rec;
+        int32_t count = 0;
+        GrainResult res;
+        while ((res = hf_scan_next(hf, &rid, &rec)) == GRAIN_OK) {
+            ck_assert_int_eq(rec.id, count);
+            count++;
+        }
+        ck_assert_int_eq(res, GRAIN_CORRUPT_PAGE);
+        ck_assert_int_eq(count, MAX_SLOTS * 50);
+        ck_assert(!bp_is_resident(&hf->pool, 50));
+
+        rid = (RecordId){.page_id = 51, .slot_idx = 0};
+        ck_assert_int_eq(hf_get_record(hf, rid, &rec), GRAIN_OK);
+        ck_assert_int_eq(rec.id, MAX_SLOTS * 51);
+        close_file(hf);
+    }
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_prefetch_keeps_up_with_changes)
+{
+    cleanup();
+    HeapFile *hf = create_file_ex(test_file, HF_OPEN_COMPRESS | HF_OPEN_ASYNC_IO);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_ptr_null(hf->prefetch);
+    close_file(hf);
+
+    hf = create_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    int32_t pages = BUFFER_POOL_FRAMES + 50;
+    insert_ids(hf, 0, MAX_SLOTS * pages);
+    ck_assert_int_eq(close_file(hf), GRAIN_OK);
+
+    hf = open_file_ex(test_file, HF_OPEN_ASYNC_IO | HF_OPEN_DIRECT);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_ptr_nonnull(hf->prefetch);
+    ck_assert_int_eq(count_records(hf), MAX_SLOTS * pages);
+
+    /* the last extent asked for pages past the end; new pages must not come from it */
+    insert_ids(hf, MAX_SLOTS * pages, MAX_SLOTS * (pages + 3));
+    ck_assert_int_eq(count_records(hf), MAX_SLOTS * (pages + 3));
+
+    /* and a vacuum drops pages that may still be landing */
+    RecordId rid = {.page_id = 0, .slot_idx = -1};
+    Record rec;
+    for (int32_t i = 0; i < 40; i++) {
+        ck_assert_int_eq(hf_scan_next(hf, &rid, &rec), GRAIN_OK);
+    }
+    thin_pages(hf, pages - 20, pages + 3, 0);
+    ck_assert_int_eq(hf_vacuum(hf, 1, NULL, NULL), GRAIN_OK);
+    ck_assert_int_eq(hf->header.num_pages, pages - 20);
+    ck_assert_int_eq(count_records(hf), MAX_SLOTS * (pages - 20));
+    ck_assert_int_eq(close_file(hf), GRAIN_OK);
+
+    hf = open_file(test_file);
+    ck_assert_ptr_nonnull(hf);
+    ck_assert_int_eq(count_records(hf), MAX_SLOTS * (pages - 20));
+    close_file(hf);
+    cleanup();
+}
+END_TEST
+
 static Suite *file_suite(void)
 {
     Suite *s;
     TCase *tc_create, *tc_open, *tc_close, *tc_readwrite;
     TCase *tc_insert, *tc_scan, *tc_update, *tc_delete;
+    TCase *tc_buffer, *tc_format, *tc_mmap, *tc_bulk, *tc_wal, *tc_index, *tc_batch, *tc_zone, *tc_parallel;
+    TCase *tc_fsm, *tc_vacuum, *tc_concurrency, *tc_session, *tc_pax, *tc_compress, *tc_checksum;
+    TCase *tc_async, *tc_direct, *tc_read_ahead;
 
     s = suite_create("File Tests");
 
@@ -1045,6 +4735,157 @@ static Suite *file_suite(void)
     tcase_add_test(tc_delete, test_hf_delete_record_page_rejoins_free_list);
     suite_add_tcase(s, tc_delete);
 
+    tc_buffer = tcase_create("BufferPool");
+    tcase_add_test(tc_buffer, test_hf_pin_page_shares_frame);
+    tcase_add_test(tc_buffer, test_hf_insert_defers_page_writes);
+    tcase_add_test(tc_buffer, test_hf_pages_survive_eviction);
+    tcase_add_test(tc_buffer, test_hf_alloc_reserves_space_in_extents);
+    suite_add_tcase(s, tc_buffer);
+
+    tc_format = tcase_create("Format");
+    tcase_add_test(tc_format, test_create_file_writes_format_version);
+    tcase_add_test(tc_format, test_open_file_upgrades_legacy_file);
+    tcase_add_test(tc_format, test_open_file_upgrades_empty_legacy_file);
+    tcase_add_test(tc_format, test_open_file_upgrades_v2_file);
+    tcase_add_test(tc_format, test_open_file_upgrades_v3_file_with_log);
+    tcase_add_test(tc_format, test_open_file_rejects_newer_version);
+    suite_add_tcase(s, tc_format);
+
+    tc_mmap = tcase_create("Mmap");
+    tcase_add_test(tc_mmap, test_mmap_insert_scan_and_reopen);
+    tcase_add_test(tc_mmap, test_mmap_pin_points_into_mapping);
+    tcase_add_test(tc_mmap, test_mmap_flush_persists_without_close);
+    tcase_add_test(tc_mmap, test_mmap_open_rejects_short_file);
+    suite_add_tcase(s, tc_mmap);
+
+    tc_bulk = tcase_create("BulkInsert");
+    tcase_add_test(tc_bulk, test_hf_insert_records_fills_new_pages);
+    tcase_add_test(tc_bulk, test_hf_insert_records_tops_up_free_pages_first);
+    tcase_add_test(tc_bulk, test_hf_insert_records_null_and_empty);
+    tcase_add_test(tc_bulk, test_hf_insert_records_mmap);
+    suite_add_tcase(s, tc_bulk);
+
+    tc_wal = tcase_create("Wal");
+    tcase_add_test(tc_wal, test_wal_recovers_committed_changes_after_crash);
+    tcase_add_test(tc_wal, test_wal_repairs_torn_page);
+    tcase_add_test(tc_wal, test_wal_uncommitted_tail_is_dropped);
+    tcase_add_test(tc_wal, test_wal_flush_checkpoints_and_truncates_log);
+    tcase_add_test(tc_wal, test_wal_stamps_page_lsn);
+    tcase_add_test(tc_wal, test_wal_eviction_forces_log_first);
+    tcase_add_test(tc_wal, test_wal_rejects_mmap);
+    tcase_add_test(tc_wal, test_commit_without_wal_flushes);
+    suite_add_tcase(s, tc_wal);
+
+    tc_index = tcase_create("IdIndex");
+    tcase_add_test(tc_index, test_id_index_point_lookup);
+    tcase_add_test(tc_index, test_id_index_follows_delete_and_update);
+    tcase_add_test(tc_index, test_id_index_range_scan);
+    tcase_add_test(tc_index, test_id_index_bulk_insert);
+    tcase_add_test(tc_index, test_id_index_persists_and_is_rebuilt);
+    tcase_add_test(tc_index, test_id_index_rebuilt_after_crash);
+    tcase_add_test(tc_index, test_hash_index_point_lookup);
+    tcase_add_test(tc_index, test_hash_index_follows_delete_and_vacuum);
+    tcase_add_test(tc_index, test_hash_index_rebuilt_when_stale);
+    tcase_add_test(tc_index, test_age_index_range_fetch);
+    tcase_add_test(tc_index, test_age_index_follows_update_and_delete);
+    tcase_add_test(tc_index, test_age_index_rebuilt_after_crash);
+    tcase_add_test(tc_index, test_id_filter_skips_missing_ids);
+    tcase_add_test(tc_index, test_id_filter_rebuilt_by_vacuum);
+    tcase_add_test(tc_index, test_id_filter_rebuilt_when_overloaded_or_stale);
+    tcase_add_test(tc_index, test_find_by_id_without_index_scans);
+    tcase_add_test(tc_index, test_hf_get_record);
+    suite_add_tcase(s, tc_index);
+
+    tc_batch = tcase_create("BatchScan");
+    tcase_add_test(tc_batch, test_batch_scan_returns_records_in_order);
+    tcase_add_test(tc_batch, test_batch_scan_keeps_page_pinned);
+    tcase_add_test(tc_batch, test_batch_scan_filtered);
+    tcase_add_test(tc_batch, test_batch_scan_null_params);
+    suite_add_tcase(s, tc_batch);
+
+    tc_zone = tcase_create("ZoneMap");
+    tcase_add_test(tc_zone, test_zone_map_skips_pages);
+    tcase_add_test(tc_zone, test_zone_map_follows_changes);
+    tcase_add_test(tc_zone, test_zone_map_rebuilt_when_stale);
+    suite_add_tcase(s, tc_zone);
+
+    tc_pax = tcase_create("Pax");
+    tcase_add_test(tc_pax, test_pax_file_round_trip);
+    tcase_add_test(tc_pax, test_pax_column_scan);
+    tcase_add_test(tc_pax, test_pax_wal_recovers_after_crash);
+    suite_add_tcase(s, tc_pax);
+
+    tc_parallel = tcase_create("ParallelScan");
+    tcase_add_test(tc_parallel, test_parallel_scan_sees_every_record_once);
+    tcase_add_test(tc_parallel, test_parallel_scan_mmap);
+    tcase_add_test(tc_parallel, test_parallel_scan_callback_error_stops_scan);
+    tcase_add_test(tc_parallel, test_parallel_scan_empty_and_null);
+    suite_add_tcase(s, tc_parallel);
+
+    tc_fsm = tcase_create("FreeSpace");
+    tcase_add_test(tc_fsm, test_fsm_follows_inserts_and_deletes);
+    tcase_add_test(tc_fsm, test_bulk_insert_fills_empty_pages);
+    tcase_add_test(tc_fsm, test_fsm_rebuilt_when_missing_or_stale);
+    suite_add_tcase(s, tc_fsm);
+
+    tc_vacuum = tcase_create("Vacuum");
+    tcase_add_test(tc_vacuum, test_vacuum_moves_records_and_shrinks_file);
+    tcase_add_test(tc_vacuum, test_vacuum_runs_in_bounded_steps);
+    tcase_add_test(tc_vacuum, test_vacuum_keeps_index_and_log_consistent);
+    tcase_add_test(tc_vacuum, test_vacuum_leaves_pinned_tail);
+    suite_add_tcase(s, tc_vacuum);
+
+    tc_concurrency = tcase_create("Concurrency");
+    tcase_add_test(tc_concurrency, test_concurrent_inserts);
+    tcase_add_test(tc_concurrency, test_concurrent_changes_and_scans);
+    tcase_add_test(tc_concurrency, test_concurrent_inserts_and_deletes);
+    tcase_add_test(tc_concurrency, test_concurrent_vacuum_and_lookups);
+    tcase_add_test(tc_concurrency, test_parallel_scan_shuts_out_changes);
+    tcase_add_test(tc_concurrency, test_concurrent_commits_and_checkpoints);
+    suite_add_tcase(s, tc_concurrency);
+
+    tc_session = tcase_create("Session");
+    tcase_add_test(tc_session, test_sessions_fill_their_own_pages);
+    tcase_add_test(tc_session, test_vacuum_keeps_claimed_page);
+    tcase_add_test(tc_session, test_concurrent_sessions);
+    suite_add_tcase(s, tc_session);
+
+    tc_compress = tcase_create("Compress");
+    tcase_add_test(tc_compress, test_compressed_file_round_trip);
+    tcase_add_test(tc_compress, test_compressed_file_rebuilds_directory);
+    tcase_add_test(tc_compress, test_compressed_wal_recovers_after_crash);
+    tcase_add_test(tc_compress, test_compressed_vacuum_trims_file);
+    suite_add_tcase(s, tc_compress);
+
+    tc_checksum = tcase_create("Checksum");
+    tcase_add_test(tc_checksum, test_corrupt_page_detected_on_read);
+    tcase_add_test(tc_checksum, test_corrupt_compressed_page_detected);
+    tcase_add_test(tc_checksum, test_mmap_pages_stamped_on_flush);
+    tcase_add_test(tc_checksum, test_open_file_stamps_v4_file);
+    suite_add_tcase(s, tc_checksum);
+
+    tc_async = tcase_create("AsyncIo");
+    tcase_add_test(tc_async, test_async_flush_and_eviction_write_batches);
+    tcase_add_test(tc_async, test_async_wal_recovers_after_crash);
+    tcase_add_test(tc_async, test_async_parallel_scan_sees_every_record_once);
+    tcase_add_test(tc_async, test_async_scan_stops_at_corrupt_page);
+    tcase_add_test(tc_async, test_async_write_fails_when_a_page_cant_be_queued);
+    suite_add_tcase(s, tc_async);
+
+    tc_direct = tcase_create("DirectIo");
+    tcase_add_test(tc_direct, test_direct_io_round_trip);
+    tcase_add_test(tc_direct, test_direct_io_wal_recovers_after_crash);
+    tcase_add_test(tc_direct, test_direct_io_rejects_mmap_and_compress);
+    tcase_add_test(tc_direct, test_open_file_moves_v5_pages);
+    tcase_add_test(tc_direct, test_open_file_keeps_v5_compressed_frames);
+    suite_add_tcase(s, tc_direct);
+
+    tc_read_ahead = tcase_create("ReadAhead");
+    tcase_add_test(tc_read_ahead, test_scan_reads_ahead_and_spares_hot_pages);
+    tcase_add_test(tc_read_ahead, test_read_ahead_stops_at_corrupt_page);
+    tcase_add_test(tc_read_ahead, test_prefetch_keeps_up_with_changes);
+    suite_add_tcase(s, tc_read_ahead);
+
     return s;
 }
 
@@ -0,0 +1,270 @@
+#include <check.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "../include/fsm.h"
+
+static const char *test_map = "fsm_test.fsm";
+
+static void cleanup(void)
+{
+    remove(test_map);
+}
+
+START_TEST(test_set_and_find)
+{
+    cleanup();
+    FreeSpaceMap *fsm = fsm_create(test_map);
+    ck_assert_ptr_nonnull(fsm);
+    ck_assert_int_eq(fsm->header.num_pages, 0);
+    ck_assert_int_eq(fsm->header.clean, 1);
+    ck_assert_int_eq(fsm_find(fsm), -1);
+
+    /* pages skipped over count as full */
+    ck_assert_int_eq(fsm_set(fsm, 5, 3), GRAIN_OK);
+    ck_assert_int_eq(fsm->header.num_pages, 6);
+    ck_assert_int_eq(fsm->header.clean, 0);
+    ck_assert_int_eq(fsm_free_slots(fsm, 2), 0);
+    ck_assert_int_eq(fsm_free_slots(fsm, 5), 3);
+    ck_assert_int_eq(fsm_find(fsm), 5);
+
+    ck_assert_int_eq(fsm_set(fsm, 1, 1), GRAIN_OK);
+    ck_assert_int_eq(fsm_find(fsm), 1);
+    ck_assert_int_eq(fsm_set(fsm, 1, 0), GRAIN_OK);
+    ck_assert_int_eq(fsm_find(fsm), 5);
+    ck_assert_int_eq(fsm_set(fsm, 5, 0), GRAIN_OK);
+    ck_assert_int_eq(fsm_find(fsm), -1);
+
+    ck_assert_int_eq(fsm_free_slots(fsm, 6), 0);
+    ck_assert_int_eq(fsm_free_slots(fsm, -1), 0);
+
+    fsm_close(fsm);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_find_across_words)
+{
+    cleanup();
+    FreeSpaceMap *fsm = fsm_create(test_map);
+    ck_assert_ptr_nonnull(fsm);
+
+    /* several thousand pages, all full but one near the end */
+    for (int32_t page_id = 0; page_id < 5000; page_id++) {
+        ck_assert_int_eq(fsm_set(fsm, page_id, 0), GRAIN_OK);
+    }
+    ck_assert_int_ge(fsm->capacity, 5000);
+    ck_assert_int_eq(fsm_set(fsm, 4321, 7), GRAIN_OK);
+    ck_assert_int_eq(fsm_find(fsm), 4321);
+
+    /* freeing room lower down moves the search back */
+    ck_assert_int_eq(fsm_set(fsm, 65, 1), GRAIN_OK);
+    ck_assert_int_eq(fsm_find(fsm), 65);
+
+    fsm_close(fsm);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_find_empty_run)
+{
+    cleanup();
+    FreeSpaceMap *fsm = fsm_create(test_map);
+    ck_assert_ptr_nonnull(fsm);
+
+    int32_t first = -1;
+    ck_assert_int_eq(fsm_find_empty_run(fsm, 4, &first), 0);
+
+    for (int32_t page_id = 0; page_id < 200; page_id++) {
+        ck_assert_int_eq(fsm_set(fsm, page_id, 0), GRAIN_OK);
+    }
+    /* a partly used page is not part of a run */
+    ck_assert_int_eq(fsm_set(fsm, 10, 50), GRAIN_OK);
+    ck_assert_int_eq(fsm_set(fsm, 70, MAX_SLOTS), GRAIN_OK);
+    for (int32_t page_id = 130; page_id < 140; page_id++) {
+        ck_assert_int_eq(fsm_set(fsm, page_id, MAX_SLOTS), GRAIN_OK);
+    }
+
+    ck_assert_int_eq(fsm_find_empty_run(fsm, 4, &first), 1);
+    ck_assert_int_eq(first, 70);
+    ck_assert_int_eq(fsm_set(fsm, 70, 0), GRAIN_OK);
+
+    ck_assert_int_eq(fsm_find_empty_run(fsm, 4, &first), 4);
+    ck_assert_int_eq(first, 130);
+    ck_assert_int_eq(fsm_find_empty_run(fsm, 50, &first), 10);
+    ck_assert_int_eq(first, 130);
+
+    /* a page a session has claimed ends a run, and can't start one */
+    ck_assert_int_eq(fsm_claim(fsm, 130), GRAIN_OK);
+    ck_assert_int_eq(fsm_claim(fsm, 134), GRAIN_OK);
+    ck_assert_int_eq(fsm_find_empty_run(fsm, 50, &first), 3);
+    ck_assert_int_eq(first, 131);
+
+    fsm_close(fsm);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_claimed_pages_are_skipped)
+{
+    cleanup();
+    FreeSpaceMap *fsm = fsm_create(test_map);
+    ck_assert_ptr_nonnull(fsm);
+    ck_assert_int_eq(fsm_find_unclaimed(fsm), -1);
+
+    for (int32_t page_id = 0; page_id < 130; page_id++) {
+        ck_assert_int_eq(fsm_set(fsm, page_id, 0), GRAIN_OK);
+    }
+    ck_assert_int_eq(fsm_set(fsm, 3, 10), GRAIN_OK);
+    ck_assert_int_eq(fsm_set(fsm, 129, 10), GRAIN_OK);
+
+    /* a claim hides a page from other inserters but not from fsm_find */
+    ck_assert_int_eq(fsm_claim(fsm, 3), GRAIN_OK);
+    ck_assert(fsm_is_claimed(fsm, 3));
+    ck_assert_int_eq(fsm_find(fsm), 3);
+    ck_assert_int_eq(fsm_find_unclaimed(fsm), 129);
+    ck_assert_int_eq(fsm_claim(fsm, 129), GRAIN_OK);
+    ck_assert_int_eq(fsm_find_unclaimed(fsm), -1);
+
+    ck_assert_int_eq(fsm_unclaim(fsm, 3), GRAIN_OK);
+    ck_assert(!fsm_is_claimed(fsm, 3));
+    ck_assert_int_eq(fsm_find_unclaimed(fsm), 3);
+
+    /* claims are never written out, and truncating drops them */
+    ck_assert_int_eq(fsm_truncate(fsm, 100), GRAIN_OK);
+    ck_assert(!fsm_is_claimed(fsm, 129));
+    ck_assert_int_eq(fsm_claim(fsm, 100), GRAIN_INVALID_PAGE_ID);
+    ck_assert_int_eq(fsm_claim(fsm, 3), GRAIN_OK);
+    ck_assert_int_eq(fsm_close(fsm), GRAIN_OK);
+
+    fsm = fsm_open(test_map);
+    ck_assert_ptr_nonnull(fsm);
+    ck_assert(!fsm_is_claimed(fsm, 3));
+    ck_assert_int_eq(fsm_find_unclaimed(fsm), 3);
+    fsm_close(fsm);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_flush_and_reopen)
+{
+    cleanup();
+    FreeSpaceMap *fsm = fsm_create(test_map);
+    ck_assert_ptr_nonnull(fsm);
+    for (int32_t page_id = 0; page_id < 1000; page_id++) {
+        ck_assert_int_eq(fsm_set(fsm, page_id, page_id % 3), GRAIN_OK);
+    }
+
+    /* another handle sees the map as in use until it is flushed */
+    FreeSpaceMap *other = fsm_open(test_map);
+    ck_assert_ptr_nonnull(other);
+    ck_assert_int_eq(other->header.clean, 0);
+    fsm_close(other);
+
+    ck_assert_int_eq(fsm_close(fsm), GRAIN_OK);
+    fsm = fsm_open(test_map);
+    ck_assert_ptr_nonnull(fsm);
+    ck_assert_int_eq(fsm->header.clean, 1);
+    ck_assert_int_eq(fsm->header.num_pages, 1000);
+    ck_assert_int_eq(fsm_free_slots(fsm, 778), 778 % 3);
+    ck_assert_int_eq(fsm_find(fsm), 1);
+
+    /* setting an unchanged value leaves the map clean; a change writes only its byte */
+    ck_assert_int_eq(fsm_set(fsm, 500, 500 % 3), GRAIN_OK);
+    ck_assert_int_eq(fsm->header.clean, 1);
+    ck_assert_int_eq(fsm_set(fsm, 500, 100), GRAIN_OK);
+    ck_assert_int_eq(fsm->dirty_lo, 500);
+    ck_assert_int_eq(fsm->dirty_hi, 500);
+    ck_assert_int_eq(fsm_close(fsm), GRAIN_OK);
+
+    fsm = fsm_open(test_map);
+    ck_assert_ptr_nonnull(fsm);
+    ck_assert_int_eq(fsm_free_slots(fsm, 500), 100);
+    fsm_close(fsm);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_open_rejects_garbage)
+{
+    cleanup();
+    FILE *f = fopen(test_map, "wb");
+    ck_assert_ptr_nonnull(f);
+    fwrite("nothing like a free space map", 29, 1, f);
+    fclose(f);
+    ck_assert_ptr_null(fsm_open(test_map));
+    ck_assert_ptr_null(fsm_open("does_not_exist.fsm"));
+
+    /* an entry larger than a page can hold */
+    FsmHeader header = {.magic = FSM_MAGIC, .num_pages = 1, .clean = 1};
+    uint8_t entry = MAX_SLOTS + 1;
+    f = fopen(test_map, "wb");
+    ck_assert_ptr_nonnull(f);
+    fwrite(&header, sizeof(header), 1, f);
+    fwrite(&entry, 1, 1, f);
+    fclose(f);
+    ck_assert_ptr_null(fsm_open(test_map));
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_null_params)
+{
+    int32_t first;
+    ck_assert_ptr_null(fsm_create(NULL));
+    ck_assert_ptr_null(fsm_open(NULL));
+    ck_assert_int_eq(fsm_set(NULL, 0, 1), GRAIN_NULL_PTR);
+    ck_assert_int_eq(fsm_find(NULL), -1);
+    ck_assert_int_eq(fsm_find_empty_run(NULL, 1, &first), 0);
+    ck_assert_int_eq(fsm_free_slots(NULL, 0), 0);
+    ck_assert_int_eq(fsm_find_unclaimed(NULL), -1);
+    ck_assert_int_eq(fsm_claim(NULL, 0), GRAIN_NULL_PTR);
+    ck_assert_int_eq(fsm_unclaim(NULL, 0), GRAIN_NULL_PTR);
+    ck_assert_int_eq(fsm_flush(NULL), GRAIN_NULL_PTR);
+    ck_assert_int_eq(fsm_close(NULL), GRAIN_NULL_PTR);
+
+    cleanup();
+    FreeSpaceMap *fsm = fsm_create(test_map);
+    ck_assert_ptr_nonnull(fsm);
+    ck_assert_int_eq(fsm_set(fsm, -1, 1), GRAIN_INVALID_PAGE_ID);
+    ck_assert_int_eq(fsm_set(fsm, 0, MAX_SLOTS + 1), GRAIN_INVALID_SLOT);
+    ck_assert_int_eq(fsm_set(fsm, 0, -1), GRAIN_INVALID_SLOT);
+    fsm_close(fsm);
+    cleanup();
+}
+END_TEST
+
+static Suite *fsm_suite(void)
+{
+    Suite *s;
+    TCase *tc_core;
+
+    s = suite_create("Free Space Map Tests");
+    tc_core = tcase_create("Core");
+
+    tcase_add_test(tc_core, test_set_and_find);
+    tcase_add_test(tc_core, test_find_across_words);
+    tcase_add_test(tc_core, test_find_empty_run);
+    tcase_add_test(tc_core, test_claimed_pages_are_skipped);
+    tcase_add_test(tc_core, test_flush_and_reopen);
+    tcase_add_test(tc_core, test_open_rejects_garbage);
+    tcase_add_test(tc_core, test_null_params);
+
+    suite_add_tcase(s, tc_core);
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s = fsm_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_VERBOSE);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? 0 : 1;
+}
@@ -0,0 +1,290 @@
+#include <check.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "../include/hash.h"
+
+static const char *test_index = "hash_test.hash";
+
+static void cleanup(void)
+{
+    remove(test_index);
+}
+
+static RecordId rid_for(int32_t i)
+{
+    RecordId rid = {.page_id = i / 127, .slot_idx = i % 127};
+    return rid;
+}
+
+START_TEST(test_create_gives_empty_index)
+{
+    cleanup();
+    HashIndex *hi = hash_create(test_index);
+    ck_assert_ptr_nonnull(hi);
+    ck_assert_int_eq(hi->header.global_depth, 0);
+    ck_assert_int_eq(hi->header.num_pages, 1);
+    ck_assert_int_eq(hi->header.num_entries, 0);
+    ck_assert_int_eq(hi->header.clean, 1);
+
+    RecordId rid;
+    ck_assert_int_eq(hash_find(hi, 1, &rid), GRAIN_RECORD_NOT_FOUND);
+    ck_assert_int_eq(hash_close(hi), GRAIN_OK);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_insert_and_find)
+{
+    cleanup();
+    HashIndex *hi = hash_create(test_index);
+    ck_assert_ptr_nonnull(hi);
+
+    for (int32_t i = 0; i < 100; i++) {
+        ck_assert_int_eq(hash_insert(hi, i * 3, rid_for(i)), GRAIN_OK);
+    }
+    ck_assert_int_eq(hi->header.num_entries, 100);
+
+    RecordId rid;
+    ck_assert_int_eq(hash_find(hi, 42, &rid), GRAIN_OK);
+    ck_assert_int_eq(rid.page_id, rid_for(14).page_id);
+    ck_assert_int_eq(rid.slot_idx, rid_for(14).slot_idx);
+    ck_assert_int_eq(hash_find(hi, 43, &rid), GRAIN_RECORD_NOT_FOUND);
+
+    /* inserting the same (key, rid) twice is a no-op */
+    ck_assert_int_eq(hash_insert(hi, 42, rid_for(14)), GRAIN_OK);
+    ck_assert_int_eq(hi->header.num_entries, 100);
+
+    hash_close(hi);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_many_inserts_split_buckets)
+{
+    cleanup();
+    HashIndex *hi = hash_create(test_index);
+    ck_assert_ptr_nonnull(hi);
+
+    int32_t n = HASH_BUCKET_CAPACITY * 300;
+    for (int32_t i = 0; i < n; i++) {
+        ck_assert_int_eq(hash_insert(hi, i, rid_for(i)), GRAIN_OK);
+    }
+    ck_assert_int_eq(hi->header.num_entries, n);
+    ck_assert_int_ge(hi->header.global_depth, 9);
+
+    /* a well mixed hash needs no overflow pages: every lookup is a single bucket */
+    int32_t buckets = hi->header.num_pages;
+    ck_assert_int_le(buckets, 2 * n / HASH_BUCKET_CAPACITY + 1);
+    for (int32_t i = 0; i < n; i++) {
+        RecordId rid;
+        ck_assert_int_eq(hash_find(hi, i, &rid), GRAIN_OK);
+        ck_assert_int_eq(rid.page_id, rid_for(i).page_id);
+        ck_assert_int_eq(rid.slot_idx, rid_for(i).slot_idx);
+    }
+    RecordId rid;
+    ck_assert_int_eq(hash_find(hi, -1, &rid), GRAIN_RECORD_NOT_FOUND);
+    ck_assert_int_eq(hash_find(hi, n, &rid), GRAIN_RECORD_NOT_FOUND);
+
+    hash_close(hi);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_duplicate_keys_overflow)
+{
+    cleanup();
+    HashIndex *hi = hash_create(test_index);
+    ck_assert_ptr_nonnull(hi);
+
+    /* far more copies of one id than a bucket holds can't be split apart */
+    int32_t copies = HASH_BUCKET_CAPACITY * 3;
+    for (int32_t i = 0; i < copies; i++) {
+        ck_assert_int_eq(hash_insert(hi, 7, rid_for(i)), GRAIN_OK);
+    }
+    for (int32_t i = 0; i < 1000; i++) {
+        ck_assert_int_eq(hash_insert(hi, 1000 + i, rid_for(i)), GRAIN_OK);
+    }
+    ck_assert_int_eq(hi->header.num_entries, copies + 1000);
+    ck_assert_int_lt(hi->header.global_depth, HASH_MAX_DEPTH);
+
+    RecordId rid;
+    ck_assert_int_eq(hash_find(hi, 1999, &rid), GRAIN_OK);
+    ck_assert_int_eq(rid.slot_idx, rid_for(999).slot_idx);
+
+    /* delete removes exactly the pair it was given */
+    for (int32_t i = 0; i < copies - 1; i++) {
+        ck_assert_int_eq(hash_delete(hi, 7, rid_for(i)), GRAIN_OK);
+    }
+    ck_assert_int_eq(hash_delete(hi, 7, rid_for(0)), GRAIN_RECORD_NOT_FOUND);
+    ck_assert_int_eq(hash_find(hi, 7, &rid), GRAIN_OK);
+    ck_assert_int_eq(rid.page_id, rid_for(copies - 1).page_id);
+    ck_assert_int_eq(rid.slot_idx, rid_for(copies - 1).slot_idx);
+    ck_assert_int_eq(hash_delete(hi, 7, rid_for(copies - 1)), GRAIN_OK);
+    ck_assert_int_eq(hash_find(hi, 7, &rid), GRAIN_RECORD_NOT_FOUND);
+    ck_assert_int_eq(hi->header.num_entries, 1000);
+
+    hash_close(hi);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_delete)
+{
+    cleanup();
+    HashIndex *hi = hash_create(test_index);
+    ck_assert_ptr_nonnull(hi);
+    for (int32_t i = 0; i < 5000; i++) {
+        ck_assert_int_eq(hash_insert(hi, i, rid_for(i)), GRAIN_OK);
+    }
+
+    for (int32_t i = 0; i < 5000; i += 2) {
+        ck_assert_int_eq(hash_delete(hi, i, rid_for(i)), GRAIN_OK);
+    }
+    ck_assert_int_eq(hash_delete(hi, 2, rid_for(2)), GRAIN_RECORD_NOT_FOUND);
+    ck_assert_int_eq(hash_delete(hi, 3, rid_for(4)), GRAIN_RECORD_NOT_FOUND);
+    ck_assert_int_eq(hi->header.num_entries, 2500);
+
+    RecordId rid;
+    for (int32_t i = 0; i < 5000; i++) {
+        ck_assert_int_eq(hash_find(hi, i, &rid), (i % 2 == 0) ? GRAIN_RECORD_NOT_FOUND : GRAIN_OK);
+    }
+    hash_close(hi);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_reopen_keeps_entries)
+{
+    cleanup();
+    HashIndex *hi = hash_create(test_index);
+    ck_assert_ptr_nonnull(hi);
+    for (int32_t i = 0; i < 3000; i++) {
+        ck_assert_int_eq(hash_insert(hi, i, rid_for(i)), GRAIN_OK);
+    }
+    ck_assert_int_eq(hi->header.clean, 0);
+    int32_t depth = hi->header.global_depth;
+    ck_assert_int_eq(hash_close(hi), GRAIN_OK);
+
+    hi = hash_open(test_index);
+    ck_assert_ptr_nonnull(hi);
+    ck_assert_int_eq(hi->header.clean, 1);
+    ck_assert_int_eq(hi->header.global_depth, depth);
+    ck_assert_int_eq(hi->header.num_entries, 3000);
+    RecordId rid;
+    for (int32_t i = 0; i < 3000; i += 11) {
+        ck_assert_int_eq(hash_find(hi, i, &rid), GRAIN_OK);
+        ck_assert_int_eq(rid.slot_idx, rid_for(i).slot_idx);
+    }
+
+    /* growing after a reopen writes the directory behind the new last bucket */
+    for (int32_t i = 3000; i < 6000; i++) {
+        ck_assert_int_eq(hash_insert(hi, i, rid_for(i)), GRAIN_OK);
+    }
+    ck_assert_int_eq(hash_close(hi), GRAIN_OK);
+    hi = hash_open(test_index);
+    ck_assert_ptr_nonnull(hi);
+    ck_assert_int_eq(hash_find(hi, 5999, &rid), GRAIN_OK);
+    ck_assert_int_eq(hash_find(hi, 17, &rid), GRAIN_OK);
+    hash_close(hi);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_unflushed_index_reads_back_unclean)
+{
+    cleanup();
+    HashIndex *hi = hash_create(test_index);
+    ck_assert_ptr_nonnull(hi);
+    ck_assert_int_eq(hash_insert(hi, 1, rid_for(1)), GRAIN_OK);
+
+    HashIndex *other = hash_open(test_index);
+    ck_assert_ptr_nonnull(other);
+    ck_assert_int_eq(other->header.clean, 0);
+    hash_close(other);
+
+    ck_assert_int_eq(hash_flush(hi), GRAIN_OK);
+    other = hash_open(test_index);
+    ck_assert_ptr_nonnull(other);
+    ck_assert_int_eq(other->header.clean, 1);
+    hash_close(other);
+
+    hash_close(hi);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_open_rejects_garbage)
+{
+    cleanup();
+    FILE *f = fopen(test_index, "wb");
+    ck_assert_ptr_nonnull(f);
+    fwrite("not a hash index at all, not close", 34, 1, f);
+    fclose(f);
+    ck_assert_ptr_null(hash_open(test_index));
+    ck_assert_ptr_null(hash_open("does_not_exist.hash"));
+
+    /* a directory pointing past the last bucket */
+    HashHeader header = {.magic = HASH_MAGIC, .global_depth = 0, .num_pages = 1, .free_page = -1, .clean = 1};
+    char bucket[PAGE_SIZE] = {0};
+    int32_t dir = 5;
+    f = fopen(test_index, "wb");
+    ck_assert_ptr_nonnull(f);
+    fwrite(&header, sizeof(header), 1, f);
+    fwrite(bucket, sizeof(bucket), 1, f);
+    fwrite(&dir, sizeof(dir), 1, f);
+    fclose(f);
+    ck_assert_ptr_null(hash_open(test_index));
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_null_params)
+{
+    RecordId rid = {0, 0};
+    ck_assert_ptr_null(hash_create(NULL));
+    ck_assert_ptr_null(hash_open(NULL));
+    ck_assert_int_eq(hash_insert(NULL, 1, rid), GRAIN_NULL_PTR);
+    ck_assert_int_eq(hash_delete(NULL, 1, rid), GRAIN_NULL_PTR);
+    ck_assert_int_eq(hash_find(NULL, 1, &rid), GRAIN_NULL_PTR);
+    ck_assert_int_eq(hash_flush(NULL), GRAIN_NULL_PTR);
+    ck_assert_int_eq(hash_close(NULL), GRAIN_NULL_PTR);
+}
+END_TEST
+
+static Suite *hash_suite(void)
+{
+    Suite *s;
+    TCase *tc_core;
+
+    s = suite_create("Hash Index Tests");
+    tc_core = tcase_create("Core");
+
+    tcase_add_test(tc_core, test_create_gives_empty_index);
+    tcase_add_test(tc_core, test_insert_and_find);
+    tcase_add_test(tc_core, test_many_inserts_split_buckets);
+    tcase_add_test(tc_core, test_duplicate_keys_overflow);
+    tcase_add_test(tc_core, test_delete);
+    tcase_add_test(tc_core, test_reopen_keeps_entries);
+    tcase_add_test(tc_core, test_unflushed_index_reads_back_unclean);
+    tcase_add_test(tc_core, test_open_rejects_garbage);
+    tcase_add_test(tc_core, test_null_params);
+
+    suite_add_tcase(s, tc_core);
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s = hash_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_VERBOSE);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? 0 : 1;
+}
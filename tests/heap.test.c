@@ -2,6 +2,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include "../include/heap.h"
 
 START_TEST(test_insert_records)
@@ -297,6 +298,306 @@ START_TEST(test_page_initialization)
 }
 END_TEST
 
+START_TEST(test_slot_bitmap_tracks_live_slots)
+{
+    HeapPage page;
+    init_page(&page, 0);
+
+    for (int i = 0; i < 40; i++) {
+        Record rec = {.id = i, .age = 20};
+        insert_record(&page, &rec);
+        ck_assert(is_slot_live(&page, i) == true);
+    }
+    ck_assert_uint_eq(page.header.slot_bitmap[0], 0xffffffffu);
+    ck_assert_uint_eq(page.header.slot_bitmap[1], 0xffu);
+
+    delete_record(&page, 33);
+    ck_assert(is_slot_live(&page, 33) == false);
+    ck_assert(is_in_free_list(&page, 33) == true);
+    ck_assert_uint_eq(page.header.slot_bitmap[1], 0xfdu);
+
+    insert_record(&page, &(Record){.id = 99, .age = 1});
+    ck_assert(is_slot_live(&page, 33) == true);
+
+    ck_assert(is_slot_live(&page, 40) == false);
+    ck_assert(is_in_free_list(&page, 40) == false);
+    ck_assert(is_slot_live(&page, -1) == false);
+    ck_assert(is_slot_live(NULL, 0) == false);
+}
+END_TEST
+
+START_TEST(test_next_live_slot)
+{
+    HeapPage page;
+    init_page(&page, 0);
+    ck_assert_int_eq(next_live_slot(&page, 0), -1);
+
+    for (int i = 0; i < MAX_SLOTS; i++) {
+        Record rec = {.id = i, .age = 20};
+        insert_record(&page, &rec);
+    }
+    for (int i = 1; i < 100; i++) {
+        delete_record(&page, i);
+    }
+
+    ck_assert_int_eq(next_live_slot(&page, 0), 0);
+    ck_assert_int_eq(next_live_slot(&page, 1), 100);
+    ck_assert_int_eq(next_live_slot(&page, 100), 100);
+    ck_assert_int_eq(next_live_slot(&page, MAX_SLOTS - 1), MAX_SLOTS - 1);
+    ck_assert_int_eq(next_live_slot(&page, MAX_SLOTS), -1);
+
+    delete_record(&page, MAX_SLOTS - 1);
+    ck_assert_int_eq(next_live_slot(&page, MAX_SLOTS - 1), -1);
+    ck_assert_int_eq(next_live_slot(NULL, 0), -1);
+}
+END_TEST
+
+START_TEST(test_rebuild_slot_bitmap)
+{
+    HeapPage page;
+    init_page(&page, 0);
+
+    for (int i = 0; i < 6; i++) {
+        Record rec = {.id = i, .age = 20};
+        insert_record(&page, &rec);
+    }
+    delete_record(&page, 1);
+    delete_record(&page, 4);
+
+    uint32_t expected = page.header.slot_bitmap[0];
+    memset(page.header.slot_bitmap, 0xff, sizeof(page.header.slot_bitmap));
+    rebuild_slot_bitmap(&page);
+
+    ck_assert_uint_eq(page.header.slot_bitmap[0], expected);
+    ck_assert_uint_eq(page.header.slot_bitmap[1], 0);
+    ck_assert(is_in_free_list(&page, 1) == true);
+    ck_assert(is_in_free_list(&page, 4) == true);
+    ck_assert(is_slot_live(&page, 5) == true);
+}
+END_TEST
+
+START_TEST(test_insert_records_batch)
+{
+    HeapPage page;
+    init_page(&page, 0);
+
+    for (int i = 0; i < 4; i++) {
+        Record rec = {.id = i, .age = 20};
+        insert_record(&page, &rec);
+    }
+    delete_record(&page, 2);
+
+    Record recs[MAX_SLOTS];
+    int32_t slots[MAX_SLOTS];
+    for (int i = 0; i < MAX_SLOTS; i++) {
+        recs[i] = (Record){.id = 100 + i, .age = 30};
+    }
+
+    int32_t inserted = insert_records(&page, recs, MAX_SLOTS, slots);
+    ck_assert_int_eq(inserted, MAX_SLOTS - 3);
+    ck_assert_int_eq(slots[0], 2);
+    ck_assert_int_eq(slots[1], 4);
+    ck_assert_int_eq(slots[inserted - 1], MAX_SLOTS - 1);
+    ck_assert_int_eq(page.header.num_slots, MAX_SLOTS);
+    ck_assert(has_free_space(&page) == false);
+
+    for (int i = 0; i < inserted; i++) {
+        ck_assert(is_slot_live(&page, slots[i]) == true);
+        Record *found = get_record(&page, slots[i]);
+        ck_assert_ptr_nonnull(found);
+        ck_assert_int_eq(found->id, 100 + i);
+    }
+
+    ck_assert_int_eq(insert_records(&page, recs, 1, NULL), 0);
+    ck_assert_int_eq(insert_records(NULL, recs, 1, NULL), -1);
+}
+END_TEST
+
+START_TEST(test_match_records)
+{
+    HeapPage page;
+    init_page(&page, 0);
+
+    for (int i = 0; i < MAX_SLOTS; i++) {
+        Record rec = {.id = (i * 7919) % 1000 - 500, .age = i % 90};
+        insert_record(&page, &rec);
+    }
+    for (int i = 0; i < MAX_SLOTS; i += 5) {
+        delete_record(&page, i);
+    }
+
+    Predicate preds[] = {
+        PREDICATE_ALL,
+        {.id_min = -100, .id_max = 100, .age_min = INT32_MIN, .age_max = INT32_MAX},
+        {.id_min = INT32_MIN, .id_max = INT32_MAX, .age_min = 30, .age_max = 39},
+        {.id_min = 0, .id_max = 499, .age_min = 10, .age_max = 80},
+        {.id_min = 10, .id_max = 9, .age_min = 0, .age_max = 100},
+    };
+    for (size_t p = 0; p < sizeof(preds) / sizeof(preds[0]); p++) {
+        uint32_t matches[SLOT_BITMAP_WORDS];
+        match_records(&page, &preds[p], matches);
+        for (int i = 0; i < MAX_SLOTS; i++) {
+            Record *rec = get_record(&page, i);
+            bool expected = rec != NULL &&
+                            rec->id >= preds[p].id_min && rec->id <= preds[p].id_max &&
+                            rec->age >= preds[p].age_min && rec->age <= preds[p].age_max;
+            bool matched = (matches[i >> 5] >> (i & 31)) & 1u;
+            ck_assert_int_eq(matched, expected);
+        }
+        ck_assert_int_eq(matches[SLOT_BITMAP_WORDS - 1] >> 31, 0);
+    }
+
+    /* a partly filled page only looks at slots that were ever used */
+    init_page(&page, 1);
+    Record rec = {.id = 5, .age = 5};
+    insert_record(&page, &rec);
+    uint32_t matches[SLOT_BITMAP_WORDS];
+    Predicate all = PREDICATE_ALL;
+    match_records(&page, &all, matches);
+    ck_assert_uint_eq(matches[0], 1);
+    ck_assert_uint_eq(matches[1] | matches[2] | matches[3], 0);
+    ck_assert_int_eq(next_set_slot(matches, 0, page.header.next_slot_idx), 0);
+    ck_assert_int_eq(next_set_slot(matches, 1, page.header.next_slot_idx), -1);
+}
+END_TEST
+
+START_TEST(test_pax_page)
+{
+    HeapPage page;
+    memset(&page, 0, sizeof(page));
+    init_page_layout(&page, 0, PAGE_LAYOUT_PAX);
+    ck_assert_int_eq(page.header.layout, PAGE_LAYOUT_PAX);
+
+    Record recs[MAX_SLOTS];
+    for (int i = 0; i < MAX_SLOTS; i++) {
+        Record r = {.id = 1000 + i, .age = i % 90};
+        snprintf(r.name, sizeof(r.name), "Pax%d", i);
+        snprintf(r.email, sizeof(r.email), "pax%d@test.com", i);
+        recs[i] = r;
+    }
+    ck_assert_int_eq(insert_record(&page, &recs[0]), 0);
+    ck_assert_int_eq(insert_records(&page, &recs[1], MAX_SLOTS - 1, NULL), MAX_SLOTS - 1);
+    ck_assert(has_free_space(&page) == false);
+
+    /* no row to point into; reads go through the copying accessors */
+    ck_assert_ptr_null(get_record(&page, 3));
+    ck_assert_ptr_null(get_slot(&page, 3));
+    Record found;
+    ck_assert(read_record(&page, 3, &found));
+    ck_assert_int_eq(found.id, 1003);
+    ck_assert_int_eq(found.age, 3);
+    ck_assert_str_eq(found.name, "Pax3");
+    ck_assert_str_eq(found.email, "pax3@test.com");
+
+    const int32_t *ids = page_column(&page, COLUMN_ID);
+    const int32_t *ages = page_column(&page, COLUMN_AGE);
+    ck_assert_ptr_nonnull(ids);
+    for (int i = 0; i < MAX_SLOTS; i++) {
+        ck_assert_int_eq(ids[i], 1000 + i);
+        ck_assert_int_eq(ages[i], i % 90);
+        ck_assert_int_eq(column_value(&page, COLUMN_AGE, i), i % 90);
+    }
+
+    /* freed slots chain through the id column and are reused newest first */
+    ck_assert_int_eq(delete_record(&page, 10), GRAIN_OK);
+    ck_assert_int_eq(delete_record(&page, 20), GRAIN_OK);
+    ck_assert(read_record(&page, 10, &found) == false);
+    Record fresh = {.id = 7, .age = 70};
+    strcpy(fresh.name, "Fresh");
+    ck_assert_int_eq(insert_record(&page, &fresh), 20);
+    ck_assert_int_eq(insert_record(&page, &fresh), 10);
+    ck_assert_int_eq(insert_record(&page, &fresh), -1);
+
+    Record changed = {.id = 1, .age = 55};
+    strcpy(changed.name, "Changed");
+    strcpy(changed.email, "changed@test.com");
+    ck_assert_int_eq(update_record(&page, 5, &changed), GRAIN_OK);
+    ck_assert(read_record(&page, 5, &found));
+    ck_assert_int_eq(found.id, 1005);
+    ck_assert_int_eq(found.age, 55);
+    ck_assert_str_eq(found.name, "Changed");
+    ck_assert_str_eq(found.email, "changed@test.com");
+    ck_assert(read_record(&page, 4, &found));
+    ck_assert_str_eq(found.name, "Pax4");
+
+    /* a row page hands out no columns but still answers per slot */
+    HeapPage row;
+    init_page(&row, 1);
+    insert_record(&row, &recs[2]);
+    ck_assert_ptr_null(page_column(&row, COLUMN_ID));
+    ck_assert_int_eq(column_value(&row, COLUMN_ID, 0), 1002);
+    ck_assert_int_eq(column_value(&row, COLUMN_AGE, 0), 2);
+}
+END_TEST
+
+START_TEST(test_match_records_pax)
+{
+    HeapPage row, pax;
+    init_page(&row, 0);
+    init_page_layout(&pax, 0, PAGE_LAYOUT_PAX);
+
+    for (int i = 0; i < MAX_SLOTS - 3; i++) {
+        Record rec = {.id = (i * 7919) % 1000 - 500, .age = i % 90};
+        insert_record(&row, &rec);
+        insert_record(&pax, &rec);
+    }
+    for (int i = 0; i < MAX_SLOTS; i += 3) {
+        delete_record(&row, i);
+        delete_record(&pax, i);
+    }
+
+    /* both layouts pick exactly the same slots */
+    Predicate preds[] = {
+        PREDICATE_ALL,
+        {.id_min = -100, .id_max = 100, .age_min = INT32_MIN, .age_max = INT32_MAX},
+        {.id_min = 0, .id_max = 499, .age_min = 10, .age_max = 80},
+    };
+    for (size_t p = 0; p < sizeof(preds) / sizeof(preds[0]); p++) {
+        uint32_t row_matches[SLOT_BITMAP_WORDS], pax_matches[SLOT_BITMAP_WORDS];
+        match_records(&row, &preds[p], row_matches);
+        match_records(&pax, &preds[p], pax_matches);
+        ck_assert_int_eq(memcmp(row_matches, pax_matches, sizeof(row_matches)), 0);
+    }
+}
+END_TEST
+
+START_TEST(test_page_checksum)
+{
+    HeapPage page;
+    memset(&page, 0, sizeof(page));
+    init_page(&page, 7);
+    Record rec = {.id = 42, .age = 30};
+    strcpy(rec.name, "Checked");
+    ck_assert_int_ge(insert_record(&page, &rec), 0);
+
+    /* the checksum sits in the last word and leaves room for every slot */
+    ck_assert_uint_eq(sizeof(HeapPage), PAGE_SIZE);
+    ck_assert_uint_ge(sizeof(page.storage), MAX_SLOTS * RECORD_SIZE);
+    ck_assert_uint_eq((char *)&page.checksum - (char *)&page, PAGE_SIZE - sizeof(uint32_t));
+
+    ck_assert(!verify_page(&page));
+    stamp_page(&page);
+    ck_assert(verify_page(&page));
+    uint32_t sum = page.checksum;
+    ck_assert_uint_eq(page_checksum(&page), sum);
+
+    /* any flipped bit, header or storage, shows */
+    page.storage[100] ^= 0x10;
+    ck_assert(!verify_page(&page));
+    page.storage[100] ^= 0x10;
+    page.header.lsn++;
+    ck_assert(!verify_page(&page));
+    page.header.lsn--;
+    ck_assert(verify_page(&page));
+    page.checksum ^= 1;
+    ck_assert(!verify_page(&page));
+
+    ck_assert(!verify_page(NULL));
+    ck_assert_uint_eq(page_checksum(NULL), 0);
+    stamp_page(NULL);
+}
+END_TEST
+
 static Suite *heap_suite(void)
 {
     Suite *s;
@@ -324,6 +625,15 @@ static Suite *heap_suite(void)
 
     tcase_add_test(tc_core, test_page_initialization);
 
+    tcase_add_test(tc_core, test_slot_bitmap_tracks_live_slots);
+    tcase_add_test(tc_core, test_next_live_slot);
+    tcase_add_test(tc_core, test_rebuild_slot_bitmap);
+    tcase_add_test(tc_core, test_insert_records_batch);
+    tcase_add_test(tc_core, test_match_records);
+    tcase_add_test(tc_core, test_pax_page);
+    tcase_add_test(tc_core, test_match_records_pax);
+    tcase_add_test(tc_core, test_page_checksum);
+
     suite_add_tcase(s, tc_core);
     return s;
 }
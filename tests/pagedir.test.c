@@ -0,0 +1,327 @@
+#include <check.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "../include/pagedir.h"
+
+static const char *test_data = "pagedir_test.bin";
+static const char *test_dir = "pagedir_test.bin.pdir";
+
+#define DATA_START 32
+
+static void cleanup(void)
+{
+    remove(test_data);
+    remove(test_dir);
+}
+
+static int open_data(void)
+{
+    int fd = open(test_data, O_RDWR | O_CREAT, 0644);
+    ck_assert_int_ge(fd, 0);
+    return fd;
+}
+
+static void fill_page(HeapPage *page, int32_t page_id, int32_t count)
+{
+    init_page(page, page_id);
+    for (int32_t i = 0; i < count; i++) {
+        Record rec = {.id = page_id * 1000 + i, .age = i % 90};
+        snprintf(rec.name, sizeof(rec.name), "name %d", i);
+        ck_assert_int_ge(insert_record(page, &rec), 0);
+    }
+}
+
+static void fill_random(HeapPage *page, uint32_t seed)
+{
+    uint8_t *bytes = (uint8_t *)page;
+    for (size_t i = 0; i < PAGE_SIZE; i++) {
+        seed = seed * 1103515245u + 12345u;
+        bytes[i] = (uint8_t)(seed >> 24);
+    }
+}
+
+static void assert_reads(PageDirectory *pd, int32_t page_id, const HeapPage *expected)
+{
+    static HeapPage out;
+    memset(&out, 0, sizeof(out));
+    ck_assert_int_eq(pagedir_read(pd, page_id, &out), GRAIN_OK);
+    ck_assert_int_eq(memcmp(&out, expected, PAGE_SIZE), 0);
+}
+
+START_TEST(test_write_and_read)
+{
+    cleanup();
+    static HeapPage pages[4];
+    int data_fd = open_data();
+    PageDirectory *pd = pagedir_create(test_dir, data_fd, DATA_START);
+    ck_assert_ptr_nonnull(pd);
+    ck_assert_int_eq(pd->header.clean, 1);
+    ck_assert_int_eq(pd->header.data_end, DATA_START);
+
+    for (int32_t i = 0; i < 4; i++) {
+        fill_page(&pages[i], i, i * 30);
+        ck_assert_int_eq(pagedir_write(pd, i, &pages[i]), GRAIN_OK);
+    }
+    ck_assert_int_eq(pd->header.num_pages, 4);
+    ck_assert_int_eq(pd->header.clean, 0);
+
+    /* each frame sits right behind the one before and is much smaller than a page */
+    int64_t offset = DATA_START;
+    for (int32_t i = 0; i < 4; i++) {
+        PageExtent ext;
+        ck_assert(pagedir_extent(pd, i, &ext));
+        ck_assert_int_eq(ext.offset, offset);
+        ck_assert_int_lt(ext.length, PAGE_SIZE / 2);
+        ck_assert_int_eq((sizeof(PageFrameHeader) + ext.capacity) % PAGE_FRAME_ALIGN, 0);
+        offset += sizeof(PageFrameHeader) + ext.capacity;
+        assert_reads(pd, i, &pages[i]);
+    }
+    ck_assert_int_eq(pd->header.data_end, offset);
+
+    /* no frame yet */
+    HeapPage out;
+    PageExtent ext;
+    ck_assert(!pagedir_extent(pd, 4, &ext));
+    ck_assert_int_eq(pagedir_read(pd, 4, &out), GRAIN_FILE_READ_FAILED);
+    ck_assert_int_eq(pagedir_read(pd, -1, &out), GRAIN_INVALID_PAGE_ID);
+    ck_assert_int_eq(pagedir_write(pd, -1, &out), GRAIN_INVALID_PAGE_ID);
+
+    ck_assert_int_eq(pagedir_close(pd), GRAIN_OK);
+    pd = pagedir_open(test_dir, data_fd);
+    ck_assert_ptr_nonnull(pd);
+    ck_assert_int_eq(pd->header.clean, 1);
+    ck_assert_int_eq(pd->header.num_pages, 4);
+    for (int32_t i = 0; i < 4; i++) {
+        assert_reads(pd, i, &pages[i]);
+    }
+    pagedir_close(pd);
+    close(data_fd);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_rewrite_in_place_and_relocate)
+{
+    cleanup();
+    static HeapPage small;
+    static HeapPage big;
+    static HeapPage other;
+    int data_fd = open_data();
+    PageDirectory *pd = pagedir_create(test_dir, data_fd, DATA_START);
+    ck_assert_ptr_nonnull(pd);
+
+    fill_page(&small, 0, 10);
+    fill_page(&other, 1, 10);
+    ck_assert_int_eq(pagedir_write(pd, 0, &small), GRAIN_OK);
+    ck_assert_int_eq(pagedir_write(pd, 1, &other), GRAIN_OK);
+    PageExtent first;
+    ck_assert(pagedir_extent(pd, 0, &first));
+
+    /* a page that still fits its frame keeps it */
+    fill_page(&small, 0, 11);
+    ck_assert_int_eq(pagedir_write(pd, 0, &small), GRAIN_OK);
+    PageExtent ext;
+    ck_assert(pagedir_extent(pd, 0, &ext));
+    ck_assert_int_eq(ext.offset, first.offset);
+    assert_reads(pd, 0, &small);
+
+    /* one that outgrows it moves to the end and is stored raw */
+    int64_t end = pd->header.data_end;
+    fill_random(&big, 7);
+    ck_assert_int_eq(pagedir_write(pd, 0, &big), GRAIN_OK);
+    ck_assert(pagedir_extent(pd, 0, &ext));
+    ck_assert_int_eq(ext.offset, end);
+    ck_assert_int_eq(ext.length, PAGE_SIZE);
+    assert_reads(pd, 0, &big);
+    assert_reads(pd, 1, &other);
+
+    pagedir_close(pd);
+    close(data_fd);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_rebuild_from_frames)
+{
+    cleanup();
+    static HeapPage pages[6];
+    int data_fd = open_data();
+    PageDirectory *pd = pagedir_create(test_dir, data_fd, DATA_START);
+    ck_assert_ptr_nonnull(pd);
+    for (int32_t i = 0; i < 6; i++) {
+        fill_page(&pages[i], i, 20);
+        ck_assert_int_eq(pagedir_write(pd, i, &pages[i]), GRAIN_OK);
+    }
+    /* page 2 moves, so the chain holds a stale frame for it */
+    fill_random(&pages[2], 3);
+    ck_assert_int_eq(pagedir_write(pd, 2, &pages[2]), GRAIN_OK);
+    PageExtent moved;
+    ck_assert(pagedir_extent(pd, 2, &moved));
+    int64_t end = pd->header.data_end;
+    uint64_t next_seq = pd->header.next_seq;
+
+    /* the directory never got flushed, so the copy on disk is marked unclean */
+    PageDirectory *other = pagedir_open(test_dir, data_fd);
+    ck_assert_ptr_nonnull(other);
+    ck_assert_int_eq(other->header.clean, 0);
+    pagedir_close(other);
+    pagedir_close(pd);
+
+    pd = pagedir_create(test_dir, data_fd, DATA_START);
+    ck_assert_ptr_nonnull(pd);
+    ck_assert_int_eq(pagedir_rebuild(pd, 6), GRAIN_OK);
+    ck_assert_int_eq(pd->header.num_pages, 6);
+    ck_assert_int_eq(pd->header.data_end, end);
+    ck_assert_int_eq(pd->header.next_seq, next_seq);
+    PageExtent ext;
+    ck_assert(pagedir_extent(pd, 2, &ext));
+    ck_assert_int_eq(ext.offset, moved.offset);
+    for (int32_t i = 0; i < 6; i++) {
+        assert_reads(pd, i, &pages[i]);
+    }
+
+    /* pages past the count the heap file knows about are left out */
+    ck_assert_int_eq(pagedir_rebuild(pd, 4), GRAIN_OK);
+    ck_assert_int_eq(pd->header.num_pages, 4);
+    ck_assert(!pagedir_extent(pd, 5, &ext));
+
+    pagedir_close(pd);
+    close(data_fd);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_truncate)
+{
+    cleanup();
+    static HeapPage pages[4];
+    int data_fd = open_data();
+    PageDirectory *pd = pagedir_create(test_dir, data_fd, DATA_START);
+    ck_assert_ptr_nonnull(pd);
+    for (int32_t i = 0; i < 4; i++) {
+        fill_page(&pages[i], i, 5);
+        ck_assert_int_eq(pagedir_write(pd, i, &pages[i]), GRAIN_OK);
+    }
+    PageExtent ext;
+    ck_assert(pagedir_extent(pd, 2, &ext));
+
+    ck_assert_int_eq(pagedir_truncate(pd, 2), GRAIN_OK);
+    ck_assert_int_eq(pd->header.num_pages, 2);
+    ck_assert_int_eq(pd->header.data_end, ext.offset);
+    ck_assert(!pagedir_extent(pd, 2, &ext));
+    assert_reads(pd, 1, &pages[1]);
+
+    /* growing again appends where the dropped frames were */
+    ck_assert_int_eq(pagedir_write(pd, 2, &pages[3]), GRAIN_OK);
+    PageExtent again;
+    ck_assert(pagedir_extent(pd, 2, &again));
+    ck_assert_int_eq(again.offset, ext.offset);
+    assert_reads(pd, 2, &pages[3]);
+
+    ck_assert_int_eq(pagedir_truncate(pd, 0), GRAIN_OK);
+    ck_assert_int_eq(pd->header.data_end, DATA_START);
+    ck_assert_int_eq(pagedir_truncate(pd, -1), GRAIN_INVALID_PAGE_ID);
+
+    pagedir_close(pd);
+    close(data_fd);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_damaged_frame_rejected)
+{
+    cleanup();
+    static HeapPage page;
+    static HeapPage out;
+    int data_fd = open_data();
+    PageDirectory *pd = pagedir_create(test_dir, data_fd, DATA_START);
+    ck_assert_ptr_nonnull(pd);
+    fill_page(&page, 0, 40);
+    ck_assert_int_eq(pagedir_write(pd, 0, &page), GRAIN_OK);
+
+    PageExtent ext;
+    ck_assert(pagedir_extent(pd, 0, &ext));
+    uint8_t byte;
+    off_t at = ext.offset + sizeof(PageFrameHeader) + ext.length / 2;
+    ck_assert_int_eq(pread(data_fd, &byte, 1, at), 1);
+    byte ^= 0x5A;
+    ck_assert_int_eq(pwrite(data_fd, &byte, 1, at), 1);
+    ck_assert_int_eq(pagedir_read(pd, 0, &out), GRAIN_CORRUPT_PAGE);
+
+    /* a rebuild won't pick up a frame whose checksum is off either */
+    ck_assert_int_eq(pagedir_rebuild(pd, 1), GRAIN_OK);
+    ck_assert(!pagedir_extent(pd, 0, &ext));
+
+    /* a directory pointing past the end of the data is refused */
+    pagedir_close(pd);
+    pd = pagedir_create(test_dir, data_fd, DATA_START);
+    ck_assert_ptr_nonnull(pd);
+    ck_assert_int_eq(pagedir_write(pd, 0, &page), GRAIN_OK);
+    pd->header.data_end = DATA_START;
+    pagedir_close(pd);
+    ck_assert_ptr_null(pagedir_open(test_dir, data_fd));
+
+    FILE *f = fopen(test_dir, "wb");
+    ck_assert_ptr_nonnull(f);
+    fwrite("not a page directory", 20, 1, f);
+    fclose(f);
+    ck_assert_ptr_null(pagedir_open(test_dir, data_fd));
+    ck_assert_ptr_null(pagedir_open("does_not_exist.pdir", data_fd));
+
+    close(data_fd);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_null_params)
+{
+    HeapPage page;
+    PageExtent ext;
+    ck_assert_ptr_null(pagedir_create(NULL, 0, DATA_START));
+    ck_assert_ptr_null(pagedir_create(test_dir, -1, DATA_START));
+    ck_assert_ptr_null(pagedir_open(NULL, 0));
+    ck_assert_int_eq(pagedir_close(NULL), GRAIN_NULL_PTR);
+    ck_assert_int_eq(pagedir_flush(NULL), GRAIN_NULL_PTR);
+    ck_assert_int_eq(pagedir_rebuild(NULL, 1), GRAIN_NULL_PTR);
+    ck_assert_int_eq(pagedir_read(NULL, 0, &page), GRAIN_NULL_PTR);
+    ck_assert_int_eq(pagedir_write(NULL, 0, &page), GRAIN_NULL_PTR);
+    ck_assert_int_eq(pagedir_truncate(NULL, 0), GRAIN_NULL_PTR);
+    ck_assert(!pagedir_extent(NULL, 0, &ext));
+}
+END_TEST
+
+static Suite *pagedir_suite(void)
+{
+    Suite *s;
+    TCase *tc_core;
+
+    s = suite_create("Page Directory Tests");
+    tc_core = tcase_create("Core");
+
+    tcase_add_test(tc_core, test_write_and_read);
+    tcase_add_test(tc_core, test_rewrite_in_place_and_relocate);
+    tcase_add_test(tc_core, test_rebuild_from_frames);
+    tcase_add_test(tc_core, test_truncate);
+    tcase_add_test(tc_core, test_damaged_frame_rejected);
+    tcase_add_test(tc_core, test_null_params);
+
+    suite_add_tcase(s, tc_core);
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s = pagedir_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_VERBOSE);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? 0 : 1;
+}
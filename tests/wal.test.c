@@ -0,0 +1,285 @@
+#include <check.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "../include/wal.h"
+
+static const char *test_wal = "wal_test.wal";
+
+static void cleanup(void)
+{
+    remove(test_wal);
+}
+
+typedef struct {
+    int count;
+    uint64_t lsns[512];
+    int32_t values[512];
+} Replayed;
+
+static GrainResult collect(void *ctx, uint64_t lsn, const void *data, uint32_t len)
+{
+    Replayed *out = ctx;
+    ck_assert_uint_eq(len, sizeof(int32_t));
+    out->lsns[out->count] = lsn;
+    memcpy(&out->values[out->count], data, sizeof(int32_t));
+    out->count++;
+    return GRAIN_OK;
+}
+
+static Replayed *replay_file(uint64_t min_lsn)
+{
+    static Replayed out;
+    memset(&out, 0, sizeof(out));
+    Wal wal;
+    ck_assert_int_eq(wal_open(&wal, test_wal, min_lsn), GRAIN_OK);
+    ck_assert_int_eq(wal_replay(&wal, collect, &out), GRAIN_OK);
+    wal_close(&wal);
+    return &out;
+}
+
+START_TEST(test_committed_records_replay_in_order)
+{
+    cleanup();
+    Wal wal;
+    ck_assert_int_eq(wal_open(&wal, test_wal, 0), GRAIN_OK);
+
+    uint64_t lsns[3];
+    for (int32_t i = 0; i < 3; i++) {
+        ck_assert_int_eq(wal_append(&wal, &i, sizeof(i), &lsns[i]), GRAIN_OK);
+    }
+    ck_assert(lsns[0] < lsns[1] && lsns[1] < lsns[2]);
+    ck_assert_uint_eq(wal_next_lsn(&wal), lsns[2]);
+    ck_assert_int_eq(wal_commit(&wal, lsns[2]), GRAIN_OK);
+    wal_close(&wal);
+
+    Replayed *out = replay_file(0);
+    ck_assert_int_eq(out->count, 3);
+    for (int i = 0; i < 3; i++) {
+        ck_assert_int_eq(out->values[i], i);
+        ck_assert_uint_eq(out->lsns[i], lsns[i]);
+    }
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_uncommitted_records_are_not_durable)
+{
+    cleanup();
+    Wal wal;
+    ck_assert_int_eq(wal_open(&wal, test_wal, 0), GRAIN_OK);
+
+    int32_t value = 7;
+    uint64_t lsn;
+    ck_assert_int_eq(wal_append(&wal, &value, sizeof(value), &lsn), GRAIN_OK);
+    ck_assert_int_eq(wal_commit(&wal, lsn), GRAIN_OK);
+    ck_assert_int_eq(wal_append(&wal, &value, sizeof(value), &lsn), GRAIN_OK);
+    wal_close(&wal);
+
+    ck_assert_int_eq(replay_file(0)->count, 1);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_replay_stops_at_torn_record)
+{
+    cleanup();
+    Wal wal;
+    ck_assert_int_eq(wal_open(&wal, test_wal, 0), GRAIN_OK);
+
+    uint64_t lsn;
+    for (int32_t i = 0; i < 3; i++) {
+        ck_assert_int_eq(wal_append(&wal, &i, sizeof(i), &lsn), GRAIN_OK);
+    }
+    ck_assert_int_eq(wal_commit(&wal, lsn), GRAIN_OK);
+    wal_close(&wal);
+
+    /* flip a payload byte in the last record */
+    int fd = open(test_wal, O_RDWR);
+    ck_assert_int_ge(fd, 0);
+    off_t end = lseek(fd, 0, SEEK_END);
+    char byte = 0x5a;
+    ck_assert_int_eq(pwrite(fd, &byte, 1, end - 1), 1);
+    close(fd);
+
+    Replayed *out = replay_file(0);
+    ck_assert_int_eq(out->count, 2);
+    ck_assert_int_eq(out->values[1], 1);
+
+    /* the torn tail is cut off, so a new append lands right after record 1 */
+    ck_assert_int_eq(wal_open(&wal, test_wal, 0), GRAIN_OK);
+    Replayed scratch = {0};
+    ck_assert_int_eq(wal_replay(&wal, collect, &scratch), GRAIN_OK);
+    int32_t value = 42;
+    ck_assert_int_eq(wal_append(&wal, &value, sizeof(value), &lsn), GRAIN_OK);
+    ck_assert_int_eq(wal_commit(&wal, lsn), GRAIN_OK);
+    wal_close(&wal);
+
+    out = replay_file(0);
+    ck_assert_int_eq(out->count, 3);
+    ck_assert_int_eq(out->values[2], 42);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_truncate_keeps_lsns_increasing)
+{
+    cleanup();
+    Wal wal;
+    ck_assert_int_eq(wal_open(&wal, test_wal, 1000), GRAIN_OK);
+    ck_assert_uint_eq(wal_next_lsn(&wal), 1000);
+    ck_assert(wal_is_empty(&wal));
+
+    int32_t value = 1;
+    uint64_t lsn;
+    ck_assert_int_eq(wal_append(&wal, &value, sizeof(value), &lsn), GRAIN_OK);
+    ck_assert_int_eq(wal_commit(&wal, lsn), GRAIN_OK);
+    ck_assert(!wal_is_empty(&wal));
+
+    ck_assert_int_eq(wal_truncate(&wal), GRAIN_OK);
+    ck_assert(wal_is_empty(&wal));
+    ck_assert_uint_eq(wal_next_lsn(&wal), lsn);
+    wal_close(&wal);
+
+    ck_assert_int_eq(replay_file(0)->count, 0);
+    ck_assert_int_eq(wal_open(&wal, test_wal, 0), GRAIN_OK);
+    ck_assert_uint_eq(wal_next_lsn(&wal), lsn);
+
+    uint64_t next;
+    ck_assert_int_eq(wal_append(&wal, &value, sizeof(value), &next), GRAIN_OK);
+    ck_assert(next > lsn);
+    wal_close(&wal);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_one_sync_covers_many_appends)
+{
+    cleanup();
+    Wal wal;
+    ck_assert_int_eq(wal_open(&wal, test_wal, 0), GRAIN_OK);
+
+    uint64_t lsn = 0;
+    for (int32_t i = 0; i < 50; i++) {
+        ck_assert_int_eq(wal_append(&wal, &i, sizeof(i), &lsn), GRAIN_OK);
+    }
+    ck_assert_uint_eq(wal.syncs, 0);
+    ck_assert_int_eq(wal_commit(&wal, lsn), GRAIN_OK);
+    ck_assert_uint_eq(wal.syncs, 1);
+
+    /* already durable: no second sync */
+    ck_assert_int_eq(wal_commit(&wal, lsn), GRAIN_OK);
+    ck_assert_uint_eq(wal.syncs, 1);
+    wal_close(&wal);
+
+    ck_assert_int_eq(replay_file(0)->count, 50);
+    cleanup();
+}
+END_TEST
+
+#define COMMIT_THREADS 8
+#define COMMITS_PER_THREAD 40
+
+typedef struct {
+    Wal *wal;
+    int32_t base;
+} CommitArgs;
+
+static void *commit_worker(void *arg)
+{
+    CommitArgs *args = arg;
+    for (int32_t i = 0; i < COMMITS_PER_THREAD; i++) {
+        int32_t value = args->base + i;
+        uint64_t lsn;
+        if (wal_append(args->wal, &value, sizeof(value), &lsn) != GRAIN_OK) return (void *)1;
+        if (wal_commit(args->wal, lsn) != GRAIN_OK) return (void *)1;
+        if (args->wal->synced_lsn < lsn) return (void *)1;
+    }
+    return NULL;
+}
+
+START_TEST(test_concurrent_commits_share_syncs)
+{
+    cleanup();
+    Wal wal;
+    ck_assert_int_eq(wal_open(&wal, test_wal, 0), GRAIN_OK);
+
+    pthread_t threads[COMMIT_THREADS];
+    CommitArgs args[COMMIT_THREADS];
+    for (int i = 0; i < COMMIT_THREADS; i++) {
+        args[i].wal = &wal;
+        args[i].base = i * 1000;
+        ck_assert_int_eq(pthread_create(&threads[i], NULL, commit_worker, &args[i]), 0);
+    }
+    for (int i = 0; i < COMMIT_THREADS; i++) {
+        void *ret;
+        pthread_join(threads[i], &ret);
+        ck_assert_ptr_null(ret);
+    }
+    ck_assert_uint_le(wal.syncs, COMMIT_THREADS * COMMITS_PER_THREAD);
+    wal_close(&wal);
+
+    Replayed *out = replay_file(0);
+    ck_assert_int_eq(out->count, COMMIT_THREADS * COMMITS_PER_THREAD);
+
+    /* each thread's records come back in the order it wrote them */
+    int32_t last[COMMIT_THREADS];
+    for (int i = 0; i < COMMIT_THREADS; i++) last[i] = -1;
+    for (int i = 0; i < out->count; i++) {
+        int t = out->values[i] / 1000;
+        ck_assert_int_gt(out->values[i], last[t]);
+        last[t] = out->values[i];
+    }
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_null_params)
+{
+    Wal wal;
+    int32_t value = 0;
+    uint64_t lsn;
+    ck_assert_int_eq(wal_open(NULL, test_wal, 0), GRAIN_NULL_PTR);
+    ck_assert_int_eq(wal_open(&wal, NULL, 0), GRAIN_NULL_PTR);
+    ck_assert_int_eq(wal_append(NULL, &value, sizeof(value), &lsn), GRAIN_NULL_PTR);
+    ck_assert_int_eq(wal_commit(NULL, 0), GRAIN_NULL_PTR);
+    ck_assert_int_eq(wal_replay(NULL, collect, NULL), GRAIN_NULL_PTR);
+    ck_assert_int_eq(wal_truncate(NULL), GRAIN_NULL_PTR);
+}
+END_TEST
+
+static Suite *wal_suite(void)
+{
+    Suite *s;
+    TCase *tc_core;
+
+    s = suite_create("Write-Ahead Log Tests");
+    tc_core = tcase_create("Core");
+
+    tcase_add_test(tc_core, test_committed_records_replay_in_order);
+    tcase_add_test(tc_core, test_uncommitted_records_are_not_durable);
+    tcase_add_test(tc_core, test_replay_stops_at_torn_record);
+    tcase_add_test(tc_core, test_truncate_keeps_lsns_increasing);
+    tcase_add_test(tc_core, test_one_sync_covers_many_appends);
+    tcase_add_test(tc_core, test_concurrent_commits_share_syncs);
+    tcase_add_test(tc_core, test_null_params);
+
+    suite_add_tcase(s, tc_core);
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s = wal_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_VERBOSE);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? 0 : 1;
+}
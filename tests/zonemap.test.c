@@ -0,0 +1,199 @@
+#include <check.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "../include/zonemap.h"
+
+static const char *test_map = "zonemap_test.zm";
+
+static void cleanup(void)
+{
+    remove(test_map);
+}
+
+static Predicate ids_between(int32_t lo, int32_t hi)
+{
+    Predicate pred = PREDICATE_ALL;
+    pred.id_min = lo;
+    pred.id_max = hi;
+    return pred;
+}
+
+START_TEST(test_widen_grows_zones)
+{
+    cleanup();
+    ZoneMap *zm = zonemap_create(test_map);
+    ck_assert_ptr_nonnull(zm);
+    ck_assert_int_eq(zm->header.num_pages, 0);
+    ck_assert_int_eq(zm->header.clean, 1);
+
+    Record a = {.id = 10, .age = 30};
+    Record b = {.id = 20, .age = 25};
+    ck_assert_int_eq(zonemap_widen(zm, 3, &a), GRAIN_OK);
+    ck_assert_int_eq(zonemap_widen(zm, 3, &b), GRAIN_OK);
+    ck_assert_int_eq(zm->header.num_pages, 4);
+    ck_assert_int_eq(zm->header.clean, 0);
+    ck_assert_int_eq(zm->zones[3].id_min, 10);
+    ck_assert_int_eq(zm->zones[3].id_max, 20);
+    ck_assert_int_eq(zm->zones[3].age_min, 25);
+    ck_assert_int_eq(zm->zones[3].age_max, 30);
+
+    Predicate pred = ids_between(15, 15);
+    ck_assert(zonemap_may_match(zm, 3, &pred));
+    pred = ids_between(21, 100);
+    ck_assert(!zonemap_may_match(zm, 3, &pred));
+    pred.id_min = INT32_MIN;
+    pred.age_min = 31;
+    ck_assert(!zonemap_may_match(zm, 3, &pred));
+
+    /* pages 0-2 were never filled; pages past the end are unknown */
+    pred = ids_between(0, 100);
+    ck_assert(!zonemap_may_match(zm, 0, &pred));
+    ck_assert(zonemap_may_match(zm, 4, &pred));
+    ck_assert(zonemap_may_match(NULL, 0, &pred));
+
+    zonemap_close(zm);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_track_page_tightens_zone)
+{
+    cleanup();
+    ZoneMap *zm = zonemap_create(test_map);
+    ck_assert_ptr_nonnull(zm);
+
+    HeapPage page;
+    init_page(&page, 1);
+    for (int32_t i = 0; i < 10; i++) {
+        Record rec = {.id = 100 + i, .age = 20 + i};
+        insert_record(&page, &rec);
+        ck_assert_int_eq(zonemap_widen(zm, 1, &rec), GRAIN_OK);
+    }
+    delete_record(&page, 0);
+    delete_record(&page, 9);
+    ck_assert_int_eq(zonemap_track_page(zm, &page), GRAIN_OK);
+    ck_assert_int_eq(zm->zones[1].id_min, 101);
+    ck_assert_int_eq(zm->zones[1].id_max, 108);
+    ck_assert_int_eq(zm->zones[1].age_min, 21);
+    ck_assert_int_eq(zm->zones[1].age_max, 28);
+
+    for (int32_t i = 1; i < 9; i++) {
+        delete_record(&page, i);
+    }
+    ck_assert_int_eq(zonemap_track_page(zm, &page), GRAIN_OK);
+    Predicate pred = ids_between(0, 1000);
+    ck_assert(!zonemap_may_match(zm, 1, &pred));
+
+    zonemap_close(zm);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_flush_and_reopen)
+{
+    cleanup();
+    ZoneMap *zm = zonemap_create(test_map);
+    ck_assert_ptr_nonnull(zm);
+    for (int32_t page_id = 0; page_id < 1000; page_id++) {
+        Record rec = {.id = page_id * 10, .age = page_id % 50};
+        ck_assert_int_eq(zonemap_widen(zm, page_id, &rec), GRAIN_OK);
+    }
+
+    /* another handle sees the map as in use until it is flushed */
+    ZoneMap *other = zonemap_open(test_map);
+    ck_assert_ptr_nonnull(other);
+    ck_assert_int_eq(other->header.clean, 0);
+    zonemap_close(other);
+
+    ck_assert_int_eq(zonemap_close(zm), GRAIN_OK);
+    zm = zonemap_open(test_map);
+    ck_assert_ptr_nonnull(zm);
+    ck_assert_int_eq(zm->header.clean, 1);
+    ck_assert_int_eq(zm->header.num_pages, 1000);
+    ck_assert_int_eq(zm->zones[777].id_min, 7770);
+    ck_assert_int_eq(zm->zones[777].age_max, 777 % 50);
+
+    /* only the changed zone is written on the next flush */
+    Record rec = {.id = -5, .age = 0};
+    ck_assert_int_eq(zonemap_widen(zm, 500, &rec), GRAIN_OK);
+    ck_assert_int_eq(zm->dirty_lo, 500);
+    ck_assert_int_eq(zm->dirty_hi, 500);
+    ck_assert_int_eq(zonemap_close(zm), GRAIN_OK);
+
+    zm = zonemap_open(test_map);
+    ck_assert_ptr_nonnull(zm);
+    ck_assert_int_eq(zm->zones[500].id_min, -5);
+    ck_assert_int_eq(zm->zones[500].id_max, 5000);
+    zonemap_close(zm);
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_open_rejects_garbage)
+{
+    cleanup();
+    FILE *f = fopen(test_map, "wb");
+    ck_assert_ptr_nonnull(f);
+    fwrite("definitely not a zone map", 25, 1, f);
+    fclose(f);
+    ck_assert_ptr_null(zonemap_open(test_map));
+    ck_assert_ptr_null(zonemap_open("does_not_exist.zm"));
+    cleanup();
+}
+END_TEST
+
+START_TEST(test_null_params)
+{
+    Record rec = {.id = 1, .age = 1};
+    HeapPage page;
+    init_page(&page, 0);
+    ck_assert_ptr_null(zonemap_create(NULL));
+    ck_assert_ptr_null(zonemap_open(NULL));
+    ck_assert_int_eq(zonemap_widen(NULL, 0, &rec), GRAIN_NULL_PTR);
+    ck_assert_int_eq(zonemap_track_page(NULL, &page), GRAIN_NULL_PTR);
+    ck_assert_int_eq(zonemap_flush(NULL), GRAIN_NULL_PTR);
+    ck_assert_int_eq(zonemap_close(NULL), GRAIN_NULL_PTR);
+
+    cleanup();
+    ZoneMap *zm = zonemap_create(test_map);
+    ck_assert_ptr_nonnull(zm);
+    ck_assert_int_eq(zonemap_widen(zm, -1, &rec), GRAIN_INVALID_PAGE_ID);
+    ck_assert_int_eq(zonemap_widen(zm, 0, NULL), GRAIN_NULL_PTR);
+    zonemap_close(zm);
+    cleanup();
+}
+END_TEST
+
+static Suite *zonemap_suite(void)
+{
+    Suite *s;
+    TCase *tc_core;
+
+    s = suite_create("Zone Map Tests");
+    tc_core = tcase_create("Core");
+
+    tcase_add_test(tc_core, test_widen_grows_zones);
+    tcase_add_test(tc_core, test_track_page_tightens_zone);
+    tcase_add_test(tc_core, test_flush_and_reopen);
+    tcase_add_test(tc_core, test_open_rejects_garbage);
+    tcase_add_test(tc_core, test_null_params);
+
+    suite_add_tcase(s, tc_core);
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s = zonemap_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_VERBOSE);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? 0 : 1;
+}